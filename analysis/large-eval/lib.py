@@ -9,6 +9,7 @@ import numpy as np
 class Measurement(Enum):
     ALL = 0
     BUCKETS = 2
+    HDR = 6
 
 
 @dataclass
@@ -32,39 +33,257 @@ class BucketsHeader:
     max_packet: np.array
 
 
+# Binary format written by PERSISTENCE_F_BINARY, see common/persistence.h
+BIN_MAGIC = 0x53545050
+BIN_HEADER_DTYPE = np.dtype([
+    ("magic", "<u4"),
+    ("version", "<u2"),
+    ("header_size", "<u2"),
+    ("record_size", "<u4"),
+    ("packet_size", "<u4"),
+    ("iters", "<u8"),
+    ("interval", "<u8"),
+    ("clock_id", "<i4"),
+    ("datapath", "S28"),
+])
+# Fields appended in version 2
+BIN_HEADER_V2_DTYPE = np.dtype(BIN_HEADER_DTYPE.descr + [
+    ("timesource", "<u4"),
+    ("tsc_hz", "<u8"),
+])
+
+
+def parse_bin_header(filename: str) -> dict | None:
+    """
+    Read the header of a binary timestamps file.
+    Return None if the file is not in the binary format.
+    """
+    with open(filename, "rb") as file:
+        raw = file.read(BIN_HEADER_DTYPE.itemsize)
+    if len(raw) < BIN_HEADER_DTYPE.itemsize:
+        return None
+    header = np.frombuffer(raw, dtype=BIN_HEADER_DTYPE)[0]
+    if header["magic"] != BIN_MAGIC:
+        return None
+    if header["version"] >= 2:
+        with open(filename, "rb") as file:
+            header = np.frombuffer(file.read(BIN_HEADER_V2_DTYPE.itemsize), dtype=BIN_HEADER_V2_DTYPE)[0]
+    return {name: header[name] for name in header.dtype.names}
+
+
+def parse_metadata(filename: str) -> dict[str, str]:
+    """
+    Read the `<filename>.meta` file written next to each output file: the experiment information and the source
+    of the timestamps, as `key value` lines.
+    """
+    metadata = {}
+    with open(f"{filename}.meta", "r") as file:
+        for line in file:
+            key, _, value = line.strip().partition(" ")
+            metadata[key] = value
+    return metadata
+
+
 def parse_timestamps(filename: str, warmup=100) -> np.ndarray:
     """
     Read the content of filename and parse the timestamps it contains.
     The content should follow the format:
-    <packet id> <timestamp 1> <timestamp 2> <timestamp 3> <timestamp 4>
+    <packet id> <timestamp 1> <timestamp 2> <timestamp 3> <timestamp 4> [<intended send time>]
+    The intended send time is only present in the files of the recent versions.
+    Files written in the binary format are detected and memory-mapped.
     """
+    header = parse_bin_header(filename)
+    if header is not None:
+        records = np.memmap(filename, dtype="<u8", mode="r", offset=int(header["header_size"]))
+        return records.reshape((-1, int(header["record_size"]) // 8)).astype(int)
+
+    with open(filename) as file:
+        columns = len(file.readline().split()) or 5
     data = np.fromfile(filename, sep=" ", dtype=int)
-    arr = np.reshape(data, (len(data) // 5, 5))
+    arr = np.reshape(data, (len(data) // columns, columns))
     return arr
 
 
 def parse_buckets(filename: str) -> tuple[BucketsHeader, np.ndarray, np.ndarray]:
+    """
+    Read the output of the buckets measurement.
+    The file only holds the non-empty buckets, as rows of <bucket index> <4 relative latencies> <absolute latency>;
+    the returned arrays are dense, with bucket 0 and the last bucket holding the values out of range.
+    """
     with open(filename, "r") as file:
         tot = int(file.readline().split(" ")[1])
         rel_info = BucketsInfo.from_list([int(x) for x in file.readline().split(" ")[1:]])
         abs_info = BucketsInfo.from_list([int(x) for x in file.readline().split(" ")[1:]])
+        num_buckets = int(file.readline().split(" ")[1])
         min_packet = [int(x) for x in file.readline().split(" ")[1:]]
         max_packet = [int(x) for x in file.readline().split(" ")[1:]]
 
         header = BucketsHeader(tot, rel_info, abs_info, np.array(min_packet), np.array(max_packet))
 
-        # get all_buckets from the rest of the file
-        all_buckets = np.fromfile(file, sep=" ", dtype=int)
-        all_buckets = all_buckets.reshape((all_buckets.size//5, 5))
-        
-        rel_buckets = all_buckets[:, :4]
-        rel_info.num_buckets = rel_buckets.shape[0]-2
-        rel_info.bucket_size = (rel_info.max_val-rel_info.min_val)/rel_info.num_buckets
-        abs_buckets = all_buckets[:, 4]
-        abs_info.num_buckets = abs_buckets.shape[0]-2
-        abs_info.bucket_size = (abs_info.max_val-rel_info.min_val)/abs_info.num_buckets
+        rows = np.fromfile(file, sep=" ", dtype=int)
+        rows = rows.reshape((rows.size // 6, 6))
+
+    all_buckets = np.zeros((num_buckets + 2, 5), dtype=int)
+    all_buckets[rows[:, 0]] = rows[:, 1:]
+
+    rel_buckets = all_buckets[:, :4]
+    rel_info.num_buckets = num_buckets
+    rel_info.bucket_size = (rel_info.max_val - rel_info.min_val) / num_buckets
+    abs_buckets = all_buckets[:, 4]
+    abs_info.num_buckets = num_buckets
+    abs_info.bucket_size = (abs_info.max_val - abs_info.min_val) / num_buckets
 
-        return header, rel_buckets, abs_buckets
+    return header, rel_buckets, abs_buckets
+
+
+def parse_hdr(filename: str) -> tuple[int, dict[str, dict[str, float]], dict[str, np.ndarray]]:
+    """
+    Read the output of the HDR histogram measurement.
+    Return the total number of packets, the summary (count, min, mean, max and percentiles) of each histogram
+    and the non-empty counters of each histogram, as rows of <lowest value> <highest value> <count>.
+    """
+    summaries = {}
+    rows = {}
+    with open(filename, "r") as file:
+        tot = int(file.readline().split(" ")[1])
+        file.readline()  # DIGITS
+        for line in file:
+            fields = line.split()
+            if fields[1] == "COUNT":
+                summaries[fields[0]] = {fields[i]: float(fields[i + 1]) for i in range(1, len(fields), 2)}
+            else:
+                rows.setdefault(fields[0], []).append([int(x) for x in fields[1:]])
+
+    counts = {name: np.array(values, dtype=int) for name, values in rows.items()}
+    return tot, summaries, counts
+
+
+def parse_owd(filename: str) -> tuple[dict[str, float], dict[str, dict[str, float]], dict[str, np.ndarray]]:
+    """
+    Read the output of the one-way delay measurement.
+    Return the clock estimate (TOT, DIGITS, OFFSET in ns, SKEW in ns/s, MIN_RTT, POINTS, NEGATIVE), then the summary
+    and the non-empty counters of the FWD and REV histograms, as in `parse_hdr`.
+    """
+    estimate = {}
+    summaries = {}
+    rows = {}
+    with open(filename, "r") as file:
+        for line in file:
+            fields = line.split()
+            if len(fields) == 2:
+                estimate[fields[0]] = float(fields[1])
+            elif fields[1] == "COUNT":
+                summaries[fields[0]] = {fields[i]: float(fields[i + 1]) for i in range(1, len(fields), 2)}
+            else:
+                rows.setdefault(fields[0], []).append([int(x) for x in fields[1:]])
+
+    counts = {name: np.array(values, dtype=int) for name, values in rows.items()}
+    return estimate, summaries, counts
+
+
+def parse_quantiles(filename: str) -> tuple[int, dict[str, dict[str, float]]]:
+    """
+    Read the output of the streaming quantiles measurement.
+    Return the total number of packets and the summary (count, min, max and estimated percentiles) of each digest.
+    """
+    summaries = {}
+    with open(filename, "r") as file:
+        tot = int(file.readline().split(" ")[1])
+        file.readline()  # COMPRESSION
+        for line in file:
+            fields = line.split()
+            summaries[fields[0]] = {fields[i]: float(fields[i + 1]) for i in range(1, len(fields), 2)}
+
+    return tot, summaries
+
+
+def parse_topk(filename: str) -> tuple[int, list[dict]]:
+    """
+    Read the output of the top-K measurement.
+    Return the total number of rounds and, from the highest latency, each captured round as a dict with its id,
+    latency and context: rows of <offset> <id> <4 timestamps> <latency> <4 differences from the previous round>.
+    """
+    rounds = []
+    with open(filename, "r") as file:
+        tot = int(file.readline().split(" ")[1])
+        file.readline()  # TOPK <k> CONTEXT <n>
+        for line in file:
+            fields = line.split()
+            if fields[0] == "ROUND":
+                rounds.append({"id": int(fields[3]), "latency": int(fields[5]), "context": []})
+            else:
+                rounds[-1]["context"].append([int(x) for x in fields])
+
+    for r in rounds:
+        r["context"] = np.array(r["context"], dtype=int)
+    return tot, rounds
+
+
+def parse_loss(filename: str) -> tuple[dict[str, int], np.ndarray]:
+    """
+    Read the output of the loss tracker.
+    Return the counters (INTERVAL, RECEIVED, HIGHEST, LOST, LATE, REORDERED, DUPLICATED, LONGEST_BURST, SERIES)
+    and the loss series as rows of <window start in ns> <lost rounds>, each window spanning SERIES ns of intended send
+    times from the first round received.
+    """
+    counters = {}
+    series = []
+    with open(filename, "r") as file:
+        for line in file:
+            fields = line.split()
+            if fields[0].isdigit():
+                series.append([int(fields[0]), int(fields[1])])
+            else:
+                counters[fields[0]] = int(fields[1])
+
+    series = np.array(series, dtype=int).reshape(-1, 2)
+    series[:, 0] *= counters["SERIES"]
+    return counters, series
+
+
+def parse_schedule(filename: str) -> tuple[dict[str, int], dict[str, float], np.ndarray]:
+    """
+    Read the schedule statistics of the sender, written to <output file>.schedule.
+    Return the counters (SENDS, INTERVAL, GUARD, LATE, WINDOW, EXPIRED), the summary of the lateness of the sends in ns
+    and its non-empty counters, as in `parse_hdr`.
+    """
+    counters = {}
+    summary = {}
+    rows = []
+    with open(filename, "r") as file:
+        for line in file:
+            fields = line.split()
+            if len(fields) == 2:
+                counters[fields[0]] = int(fields[1])
+            elif fields[1] == "COUNT":
+                summary = {fields[i]: float(fields[i + 1]) for i in range(1, len(fields), 2)}
+            else:
+                rows.append([int(x) for x in fields[1:]])
+
+    return counters, summary, np.array(rows, dtype=int).reshape(-1, 3)
+
+
+def parse_sweep(filename: str) -> tuple[dict[str, int], list[dict[str, int]], dict[int, np.ndarray]]:
+    """
+    Read the summary of a rate sweep, written to <output file>.sweep.
+    Return the counters (STEPS, DWELL, BOUND_P99, BOUND_P999, MAX_RATE), one dictionary per step
+    (STEP, RATE, INTERVAL, PACKETS, RECEIVED, LOST, P50, P99, P999, MAX, SUSTAINABLE) and the non-empty
+    counters of the latency histogram of each step, as in `parse_hdr`.
+    """
+    counters = {}
+    steps = []
+    histograms = {}
+    with open(filename, "r") as file:
+        for line in file:
+            fields = line.split()
+            if len(fields) == 2:
+                counters[fields[0]] = int(fields[1])
+            elif fields[0] == "STEP":
+                steps.append({fields[i]: int(fields[i + 1]) for i in range(0, len(fields), 2)})
+            else:
+                histograms.setdefault(int(fields[0][4:]), []).append([int(x) for x in fields[1:]])
+
+    return counters, steps, {step: np.array(rows, dtype=int) for step, rows in histograms.items()}
 
 
 def compute_latency(ts) -> int:
@@ -81,8 +300,22 @@ def compute_latencies(timestamps: np.ndarray) -> np.ndarray:
     return np.array([lat(round) for round in timestamps])
 
 
+def compute_corrected_latencies(timestamps: np.ndarray) -> np.ndarray:
+    """
+    Compute the latency of each packet corrected for coordinated omission: the time the packet waited in the client
+    after its intended send time is added to its latency. Rounds without intended send time are not corrected.
+    """
+    latencies = compute_latencies(timestamps)
+    if timestamps.shape[1] < 6:
+        return latencies
+    intended = timestamps[:, 5]
+    wait = np.where((intended > 0) & (intended < timestamps[:, 1]), timestamps[:, 1] - intended, 0)
+    latencies[:, 1] += wait
+    return latencies
+
+
 def compute_diffs(timestamps: np.ndarray) -> np.ndarray:
-    return np.array([np.array([timestamps[i][0], *((timestamps[i] - timestamps[i - 1])[1:])]) for i in
+    return np.array([np.array([timestamps[i][0], *((timestamps[i] - timestamps[i - 1])[1:5])]) for i in
                      range(1, len(timestamps))])  # if timestamps[i][0] == timestamps[i-1][0]+1])
 
 
@@ -36,10 +36,13 @@ def parse_timestamps(filename: str, warmup=100) -> np.ndarray:
     """
     Read the content of filename and parse the timestamps it contains.
     The content should follow the format:
-    <packet id> <timestamp 1> <timestamp 2> <timestamp 3> <timestamp 4>
+    <packet id> <timestamp 1> <timestamp 2> <timestamp 3> <timestamp 4> [<intended send time>]
+    The intended send time is only present in the files of the recent versions.
     """
+    with open(filename) as file:
+        columns = len(file.readline().split()) or 5
     data = np.fromfile(filename, sep=" ", dtype=int)
-    arr = np.reshape(data, (len(data) // 5, 5))
+    arr = np.reshape(data, (len(data) // columns, columns))
     return arr
 
 
@@ -0,0 +1,292 @@
+#include "arrival.h"
+#include "persistence.h"
+#include "utils.h"
+
+#include <endian.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *arrival_names[] = {
+    [ARRIVAL_FIXED] = "fixed",
+    [ARRIVAL_POISSON] = "poisson",
+    [ARRIVAL_ONOFF] = "onoff",
+    [ARRIVAL_STEP] = "step",
+    [ARRIVAL_RAMP] = "ramp",
+    [ARRIVAL_TRACE] = "trace",
+};
+
+const char *arrival_name (enum arrival_kind kind)
+{
+    return arrival_names[kind];
+}
+
+/**
+ * Parse the `count` numeric parameters following the kind, of which the first `required` must be present.
+ */
+static int arrival_parse_params (const char *params, uint64_t **values, int count, int required)
+{
+    int parsed = 0;
+    while (params != NULL && *params != '\0' && parsed < count)
+    {
+        char *end;
+        *values[parsed++] = strtoull (params, &end, 10);
+        if (end == params || (*end != ':' && *end != '\0'))
+            return -1;
+        params = *end == ':' ? end + 1 : NULL;
+    }
+
+    if (params != NULL && *params != '\0')
+        return -1;
+    return parsed >= required ? 0 : -1;
+}
+
+int arrival_parse (const char *spec, struct arrival *arrival)
+{
+    memset (arrival, 0, sizeof (struct arrival));
+    arrival->kind = ARRIVAL_FIXED;
+    arrival->seed = ARRIVAL_DEFAULT_SEED;
+    if (spec == NULL)
+        return 0;
+
+    const char *params = strchr (spec, ':');
+    const size_t name_len = params ? (size_t) (params - spec) : strlen (spec);
+    if (params)
+        ++params;
+
+    int kind = -1;
+    for (size_t i = 0; i < sizeof (arrival_names) / sizeof (arrival_names[0]); ++i)
+    {
+        if (strlen (arrival_names[i]) == name_len && strncmp (spec, arrival_names[i], name_len) == 0)
+            kind = i;
+    }
+
+    int ret = -1;
+    switch (kind)
+    {
+    case ARRIVAL_FIXED:
+        ret = params ? -1 : 0;
+        break;
+    case ARRIVAL_POISSON:
+        ret = arrival_parse_params (params, (uint64_t *[]) {&arrival->mean, &arrival->seed}, 2, 0);
+        break;
+    case ARRIVAL_ONOFF:
+        ret = arrival_parse_params (params, (uint64_t *[]) {&arrival->burst, &arrival->gap}, 2, 2);
+        if (arrival->burst == 0)
+            ret = -1;
+        break;
+    case ARRIVAL_STEP:
+        ret = arrival_parse_params (params, (uint64_t *[]) {&arrival->step, &arrival->next_interval}, 2, 2);
+        break;
+    case ARRIVAL_RAMP:
+        ret = arrival_parse_params (params, (uint64_t *[]) {&arrival->next_interval}, 1, 1);
+        break;
+    case ARRIVAL_TRACE:
+        if (params == NULL || *params == '\0' || strlen (params) >= sizeof (arrival->trace))
+            break;
+        strcpy (arrival->trace, params);
+        ret = 0;
+        break;
+    }
+
+    if (ret != 0)
+    {
+        LOG (stderr, "ERROR: Invalid arrival process %s\n", spec);
+        return -1;
+    }
+
+    arrival->kind = kind;
+    return 0;
+}
+
+/**
+ * splitmix64, enough for a reproducible schedule.
+ */
+static inline uint64_t arrival_random (uint64_t *state)
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * Read the inter-departure times of a recorded All Timestamps file, i.e. the differences between the send
+ * timestamps of consecutive rounds. When rounds are missing (lost or sampled out), the difference is spread
+ * evenly over them.
+ *
+ * @return the number of inter-departure times read, -1 on error
+ */
+static int64_t arrival_read_trace (const char *filename, uint64_t **gaps)
+{
+    FILE *file = fopen (filename, "r");
+    if (file == NULL)
+    {
+        LOG (stderr, "ERROR: Could not open %s\n", filename);
+        return -1;
+    }
+
+    struct pers_bin_header header;
+    uint32_t record_size = 0;
+    const bool binary = fread (&header, sizeof (uint32_t), 1, file) == 1 && le32toh (header.magic) == PERSISTENCE_BIN_MAGIC;
+    if (binary)
+    {
+        // Only the id and the send timestamp are needed, which all the versions of the record start with
+        if (fread ((char *) &header + sizeof (uint32_t), offsetof (struct pers_bin_header, packet_size) - sizeof (uint32_t), 1, file) != 1 ||
+            (record_size = le32toh (header.record_size)) < offsetof (struct pers_bin_record, ts[1]) ||
+            fseek (file, le16toh (header.header_size), SEEK_SET) != 0)
+        {
+            LOG (stderr, "ERROR: Invalid header in %s\n", filename);
+            fclose (file);
+            return -1;
+        }
+    }
+    else
+    {
+        rewind (file);
+    }
+
+    uint64_t capacity = 1024, count = 0;
+    uint64_t prev_id = 0, prev_ts = 0;
+    *gaps = malloc (capacity * sizeof (uint64_t));
+    if (*gaps == NULL)
+    {
+        fclose (file);
+        return -1;
+    }
+
+    while (true)
+    {
+        uint64_t id, ts;
+        if (binary)
+        {
+            struct pers_bin_record record;
+            if (fread (&record, min (record_size, (uint32_t) sizeof (record)), 1, file) != 1 ||
+                (record_size > sizeof (record) && fseek (file, record_size - sizeof (record), SEEK_CUR) != 0))
+                break;
+            id = le64toh (record.id);
+            ts = le64toh (record.ts[0]);
+        }
+        else
+        {
+            // The intended send time, if any, ends the line
+            unsigned long long fields[5];
+            const int ret = fscanf (file, "%llu %llu %llu %llu %llu%*[^\n]", &fields[0], &fields[1], &fields[2], &fields[3], &fields[4]);
+            if (ret == EOF)
+                break;
+            if (ret != 5)
+            {
+                LOG (stderr, "ERROR: Invalid round in %s\n", filename);
+                free (*gaps);
+                fclose (file);
+                return -1;
+            }
+            id = fields[0];
+            ts = fields[1];
+        }
+
+        if (prev_id != 0 && id > prev_id && ts > prev_ts)
+        {
+            const uint64_t rounds = id - prev_id;
+            for (uint64_t i = 0; i < rounds; ++i)
+            {
+                if (count == capacity)
+                {
+                    capacity *= 2;
+                    uint64_t *grown = realloc (*gaps, capacity * sizeof (uint64_t));
+                    if (grown == NULL)
+                    {
+                        free (*gaps);
+                        fclose (file);
+                        return -1;
+                    }
+                    *gaps = grown;
+                }
+                (*gaps)[count++] = (ts - prev_ts) / rounds;
+            }
+        }
+        // Rounds received out of order are skipped, the schedule follows the send times
+        if (id > prev_id)
+        {
+            prev_id = id;
+            prev_ts = ts;
+        }
+    }
+
+    fclose (file);
+    if (count == 0)
+    {
+        LOG (stderr, "ERROR: No inter-departure time in %s\n", filename);
+        free (*gaps);
+        return -1;
+    }
+
+    return count;
+}
+
+int arrival_schedule (const struct arrival *arrival, uint64_t iters, uint64_t interval, uint64_t **offsets)
+{
+    *offsets = NULL;
+    if (arrival->kind == ARRIVAL_FIXED || iters == 0)
+        return 0;
+
+    uint64_t *gaps = NULL;
+    int64_t num_gaps = 0;
+    if (arrival->kind == ARRIVAL_TRACE)
+    {
+        num_gaps = arrival_read_trace (arrival->trace, &gaps);
+        if (num_gaps < 0)
+            return -1;
+    }
+
+    uint64_t *schedule = malloc (iters * sizeof (uint64_t));
+    if (schedule == NULL)
+    {
+        PERROR ("malloc");
+        free (gaps);
+        return -1;
+    }
+
+    const double mean = arrival->mean ? arrival->mean : interval;
+    uint64_t state = arrival->seed;
+    uint64_t offset = 0;
+    schedule[0] = 0;
+    for (uint64_t i = 1; i < iters; ++i)
+    {
+        // Time between packet i and packet i + 1
+        uint64_t gap = interval;
+        switch (arrival->kind)
+        {
+        case ARRIVAL_POISSON: {
+            // Inverse transform of a uniform in (0, 1]
+            const double uniform = (double) ((arrival_random (&state) >> 11) + 1) / (double) (1ULL << 53);
+            gap = (uint64_t) (-log (uniform) * mean + 0.5);
+            break;
+        }
+        case ARRIVAL_ONOFF:
+            if (i % arrival->burst == 0)
+                gap += arrival->gap;
+            break;
+        case ARRIVAL_STEP:
+            if (i > arrival->step)
+                gap = arrival->next_interval;
+            break;
+        case ARRIVAL_RAMP:
+            gap = interval + (int64_t) (arrival->next_interval - interval) * (double) (i - 1) / (double) max (iters - 2, 1UL);
+            break;
+        case ARRIVAL_TRACE:
+            gap = gaps[(i - 1) % num_gaps];
+            break;
+        default:
+            break;
+        }
+
+        offset += gap;
+        schedule[i] = offset;
+    }
+
+    free (gaps);
+    *offsets = schedule;
+    return 0;
+}
@@ -0,0 +1,71 @@
+/**
+ * Arrival processes of the sender, i.e. when each ping leaves the client.
+ *
+ * A process is given as a string `<kind>[:<parameter>...]`, all the durations in nanoseconds:
+ * - fixed: one packet every interval, the default.
+ * - poisson[:<mean>[:<seed>]]: exponential inter-departure times of the given mean (default: the interval).
+ * - onoff:<burst>:<gap>: bursts of <burst> packets, one every interval, separated by <gap> of silence.
+ * - step:<packets>:<interval>: one packet every interval for the first <packets> packets, then one every <interval>.
+ * - ramp:<interval>: the inter-departure time goes linearly from the interval to <interval> over the run.
+ * - trace:<file>: replay the inter-departure times of a recorded All Timestamps file, text or binary, looping over
+ *   them if the run is longer than the recording.
+ *
+ * Except for `fixed`, the departure times of all the packets are computed before the run starts, so that the send
+ * loop only reads them from an array.
+ */
+#pragma once
+
+#include "common.h"
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+
+enum arrival_kind {
+    ARRIVAL_FIXED = 0,
+    ARRIVAL_POISSON,
+    ARRIVAL_ONOFF,
+    ARRIVAL_STEP,
+    ARRIVAL_RAMP,
+    ARRIVAL_TRACE,
+};
+
+/* Seed of the poisson process when none is given, so that two runs send the same schedule */
+#define ARRIVAL_DEFAULT_SEED 0x5eed
+
+struct arrival {
+    enum arrival_kind kind;
+    // poisson: mean inter-departure time, 0 for the interval
+    uint64_t mean;
+    uint64_t seed;
+    // onoff: packets per burst and silence between two bursts
+    uint64_t burst;
+    uint64_t gap;
+    // step: packets sent before switching to `next_interval`; ramp: last inter-departure time
+    uint64_t step;
+    uint64_t next_interval;
+    // trace: recorded file
+    char trace[PATH_MAX];
+};
+
+/**
+ * Parse an arrival process, see above.
+ *
+ * @param spec the process to parse, NULL for `fixed`
+ * @param arrival the process to fill
+ * @return 0 on success, -1 if the process is not valid
+ */
+int arrival_parse (const char *spec, struct arrival *arrival);
+
+/**
+ * Compute the departure time of each packet, relative to the first one.
+ *
+ * @param arrival the process
+ * @param iters number of packets
+ * @param interval interval between two packets in nanoseconds
+ * @param offsets filled with an array of `iters` offsets in nanoseconds, the one of packet `id` at index `id - 1`,
+ *        to be freed by the caller; NULL for `fixed`, where packet `id` leaves at (id - 1) * interval
+ * @return 0 on success, -1 on error
+ */
+int arrival_schedule (const struct arrival *arrival, uint64_t iters, uint64_t interval, uint64_t **offsets);
+
+const char *arrival_name (enum arrival_kind kind);
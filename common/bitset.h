@@ -30,6 +30,12 @@
  */
 #define BITSET_CLEAR(a, b) ((a)[BITSLOT (b)] &= ~BITMASK (b))
 
+/**
+ * Atomic versions of BITSET_SET and BITSET_CLEAR, for bitsets whose bits are modified by several threads.
+ */
+#define BITSET_SET_ATOMIC(a, b) __atomic_fetch_or (&(a)[BITSLOT (b)], BITMASK (b), __ATOMIC_RELEASE)
+#define BITSET_CLEAR_ATOMIC(a, b) __atomic_fetch_and (&(a)[BITSLOT (b)], ~BITMASK (b), __ATOMIC_RELEASE)
+
 /**
  * Test if the bit at position b is set in the bitset a.
  * @param a the bitset
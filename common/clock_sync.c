@@ -0,0 +1,46 @@
+#include "clock_sync.h"
+
+#include <string.h>
+
+void clock_sync_init (struct clock_sync *cs, uint64_t filter_ns, uint32_t half_life)
+{
+    memset (cs, 0, sizeof (struct clock_sync));
+    cs->filter_ns = filter_ns;
+    cs->decay = half_life ? pow (0.5, 1.0 / half_life) : 1.0;
+    cs->best_rtt = UINT64_MAX;
+    cs->min_rtt = UINT64_MAX;
+}
+
+void clock_sync_commit (struct clock_sync *cs)
+{
+    if (cs->best_rtt == UINT64_MAX)
+        return;
+
+    if (cs->points == 0)
+    {
+        cs->ref_time = cs->best_time;
+        cs->ref_offset = cs->best_offset;
+    }
+    cs->min_rtt = cs->best_rtt < cs->min_rtt ? cs->best_rtt : cs->min_rtt;
+
+    const double x = (double) (int64_t) (cs->best_time - cs->ref_time) * 1e-9;
+    const double y = (double) (cs->best_offset - cs->ref_offset);
+    cs->sw = cs->sw * cs->decay + 1;
+    cs->sx = cs->sx * cs->decay + x;
+    cs->sy = cs->sy * cs->decay + y;
+    cs->sxx = cs->sxx * cs->decay + x * x;
+    cs->sxy = cs->sxy * cs->decay + x * y;
+    cs->points++;
+
+    // With a single point, or points too close in time, the skew cannot be estimated: keep the last one
+    const double det = cs->sw * cs->sxx - cs->sx * cs->sx;
+    if (cs->points >= 2 && det > 1e-12 * cs->sw * cs->sw)
+    {
+        cs->skew = (cs->sw * cs->sxy - cs->sx * cs->sy) / det;
+        cs->intercept = (cs->sy - cs->skew * cs->sx) / cs->sw;
+    }
+    else
+    {
+        cs->intercept = cs->sy / cs->sw - cs->skew * cs->sx / cs->sw;
+    }
+}
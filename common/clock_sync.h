@@ -0,0 +1,117 @@
+/**
+ * Online estimator of the offset and skew of the server clock with respect to the client clock, from the four
+ * timestamps of each round, to split the round trip in its forward and reverse one-way delays.
+ *
+ * Each round gives, NTP-style, an estimate of the offset ((ts1 - ts0) + (ts2 - ts3)) / 2, which is exact if the
+ * forward and reverse delays are equal. Queueing makes them differ, so only the round with the lowest RTT of each
+ * filter window is kept: its delays are the closest to the propagation delays, assumed symmetric.
+ * A weighted least-squares line is fit through the kept points, with the weight of the older points decaying
+ * exponentially, so that the estimate follows the drift of the clocks during the run.
+ *
+ * The estimate is only as good as the symmetry of the fastest rounds: a constant asymmetry shifts the forward and
+ * reverse delays by opposite constants, but does not change their jitter.
+ */
+#pragma once
+
+#include "common.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+struct clock_sync {
+    // Duration of each filter window, in client nanoseconds
+    uint64_t filter_ns;
+    // Weight kept by the previous points when a point is added
+    double decay;
+
+    // Round with the lowest RTT in the current filter window
+    bool window_open;
+    uint64_t window_start;
+    uint64_t best_rtt;
+    uint64_t best_time;
+    int64_t best_offset;
+
+    // The points are relative to the first one, to keep the sums well conditioned
+    uint64_t ref_time;
+    int64_t ref_offset;
+
+    // Decayed sums of the weights, times in seconds, offsets in nanoseconds and their products
+    double sw;
+    double sx;
+    double sy;
+    double sxx;
+    double sxy;
+    uint64_t points;
+
+    // Current estimate: offset (t) = ref_offset + intercept + skew * (t - ref_time) in seconds
+    double intercept;
+    // In nanoseconds per second
+    double skew;
+
+    uint64_t min_rtt;
+};
+
+/**
+ * Initialize the estimator.
+ *
+ * @param cs the estimator to initialize
+ * @param filter_ns duration of each filter window, in nanoseconds
+ * @param half_life number of points after which the weight of a point is halved
+ */
+void clock_sync_init (struct clock_sync *cs, uint64_t filter_ns, uint32_t half_life);
+
+/**
+ * Add the lowest-RTT round of the current filter window to the fit and update the estimate.
+ */
+void clock_sync_commit (struct clock_sync *cs);
+
+/**
+ * Feed a round to the estimator.
+ *
+ * @param cs the estimator
+ * @param ts0 time the ping was sent, on the client clock
+ * @param ts1 time the ping was received, on the server clock
+ * @param ts2 time the pong was sent, on the server clock
+ * @param ts3 time the pong was received, on the client clock
+ */
+static inline void clock_sync_add (struct clock_sync *cs, uint64_t ts0, uint64_t ts1, uint64_t ts2, uint64_t ts3)
+{
+    const uint64_t elapsed = ts3 - ts0;
+    const uint64_t residence = ts2 - ts1;
+    if (UNLIKELY (ts3 < ts0 || ts2 < ts1 || elapsed < residence))
+        return;
+
+    if (UNLIKELY (!cs->window_open))
+    {
+        cs->window_open = true;
+        cs->window_start = ts0;
+        cs->best_rtt = UINT64_MAX;
+    }
+    else if (UNLIKELY (ts0 - cs->window_start >= cs->filter_ns))
+    {
+        clock_sync_commit (cs);
+        cs->window_start = ts0;
+        cs->best_rtt = UINT64_MAX;
+    }
+
+    const uint64_t rtt = elapsed - residence;
+    if (rtt < cs->best_rtt)
+    {
+        cs->best_rtt = rtt;
+        cs->best_time = ts0;
+        cs->best_offset = ((int64_t) (ts1 - ts0) + (int64_t) (ts2 - ts3)) / 2;
+    }
+}
+
+/**
+ * Estimated offset of the server clock at client time `t`, i.e. server time - client time.
+ * Before the first point is committed, the best round of the current window is used.
+ */
+static inline int64_t clock_sync_offset (const struct clock_sync *cs, uint64_t t)
+{
+    if (UNLIKELY (cs->points == 0))
+        return cs->window_open && cs->best_rtt != UINT64_MAX ? cs->best_offset : 0;
+
+    const double x = (double) (int64_t) (t - cs->ref_time) * 1e-9;
+    return cs->ref_offset + (int64_t) llround (cs->intercept + cs->skew * x);
+}
@@ -6,6 +6,8 @@
 #define LIKELY(x) (__builtin_expect (!!(x), 1))
 #define UNLIKELY(x) (__builtin_expect (!!(x), 0))
 
+#define CACHE_LINE_SIZE 64
+
 #define BARRIER() __asm__ __volatile__ ("" ::: "memory")
 
 #define BUSY_WAIT(cond) \
@@ -18,13 +20,6 @@
 #define DEBUG 0
 #endif
 
-/**
- * SERVER is specified at compilation time by CMake.
- */
-#ifndef SERVER
-#define SERVER 0
-#endif
-
 #if DEBUG
 #define LOG(stream, fmt, ...)                 \
     do                                        \
@@ -91,13 +86,20 @@
 // Random magic number for pingpong packets
 #define PINGPONG_MAGIC 0x8badbeef
 
+// Highest number of concurrent flows of a client, each with its own sender thread and id space
+#define PINGPONG_MAX_FLOWS 16
+
 
 #pragma pack (push, 1)
 struct pingpong_payload {
     __u64 id;
     __u64 ts[4];
+    // Time at which the client meant to send the ping, in the domain of ts[0]; 0 if unknown
+    __u64 intended;
 
     __u32 phase;
+    // Flow of the packet, in [0, PINGPONG_MAX_FLOWS); the ids of each flow start from 1
+    __u32 flow;
     /**
      * In an unsynchronized XDP-userspace polling communication, there is the possibility of a corruption of packets in the case of XDP writing the same space in memory that userspace is reading.
      * To address this issue, a "magic number" was added at the end of the pingpong payload, which helps recognize the integrity of the packet without need of any checksum: before reading a packets from the map,
@@ -114,24 +116,28 @@ inline struct pingpong_payload empty_pingpong_payload ()
     struct pingpong_payload payload;
     payload.id = 0;
     payload.phase = 0;
+    payload.flow = 0;
     payload.ts[0] = 0;
     payload.ts[1] = 0;
     payload.ts[2] = 0;
     payload.ts[3] = 0;
+    payload.intended = 0;
     payload.magic = PINGPONG_MAGIC;
 
     return payload;
 }
 
-inline struct pingpong_payload new_pingpong_payload (__u64 id)
+inline struct pingpong_payload new_pingpong_payload (__u64 id, __u32 flow, __u64 intended)
 {
     struct pingpong_payload payload;
     payload.id = id;
     payload.phase = 0;
+    payload.flow = flow;
     payload.ts[0] = 0;
     payload.ts[1] = 0;
     payload.ts[2] = 0;
     payload.ts[3] = 0;
+    payload.intended = intended;
     payload.magic = PINGPONG_MAGIC;
 
     return payload;
@@ -152,4 +158,15 @@ inline __u32 valid_pingpong_payload (const volatile struct pingpong_payload *vol
 inline __u64 compute_latency (const struct pingpong_payload *payload)
 {
     return ((payload->ts[3] - payload->ts[0]) - (payload->ts[2] - payload->ts[1])) / 2;
+}
+
+/**
+ * Latency corrected for coordinated omission: the time the ping waited in the client before leaving, from its intended
+ * send time to ts[0], is added to the latency. A sender that stalls then shows in the latency of the pings it delayed,
+ * instead of silently sending them late.
+ */
+inline __u64 compute_corrected_latency (const struct pingpong_payload *payload)
+{
+    const __u64 wait = payload->intended && payload->intended < payload->ts[0] ? payload->ts[0] - payload->intended : 0;
+    return compute_latency (payload) + wait;
 }
\ No newline at end of file
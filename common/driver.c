@@ -0,0 +1,525 @@
+#include "driver.h"
+
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+volatile bool pp_driver_exit = false;
+
+static persistence_agent_t *persistence_agents[PINGPONG_MAX_FLOWS];
+
+// Rate sweep of the run, referenced by the configuration of the persistence
+static struct sweep sweep;
+
+/**
+ * Datapath and context of the run, passed to the sender threads.
+ */
+struct driver_run {
+    const struct pp_datapath *datapath;
+    void *ctx;
+};
+
+static void driver_print_usage (const char *prog, const struct pp_datapath *datapath)
+{
+    printf ("Usage: %s [--role client|server]%s%s%s -p <packets> -i <interval> -s <server_ip> [-m <measurement>] [-a] [-L] [-H <digits>] [-q <quantiles>] [-b <buckets>] [-w <width>] [-R <range>] [-S <n>] [-k <rounds>] [-C <rounds>] [-W <window>] [-T <source>] [-A <arrival>] [-F <flows>] [-x <sweep>] [-B <bounds>] [-O <pings>] [-G <align>] [-P <placement>]\n",
+            prog,
+            datapath->flags & PP_DATAPATH_F_DEVICE ? " -d <device>" : "",
+            datapath->flags & PP_DATAPATH_F_GID ? " -g <gidx>" : "",
+            datapath->remove ? " [-r]" : "");
+    printf ("\t--role <role>\tRole of the program: client (default) or server.\n");
+    if (datapath->flags & PP_DATAPATH_F_DEVICE)
+        printf ("\t-d, --dev <device>\tDevice used by the %s datapath, e.g. the network interface or the IB device.\n", datapath->name);
+    if (datapath->flags & PP_DATAPATH_F_GID)
+        printf ("\t-g, --gidx <gidx>\tGID index of the IB port.\n");
+    if (datapath->remove)
+        printf ("\t-r, --remove\tRemove what the datapath left on the device, e.g. its XDP program. Only -d is required.\n");
+    printf ("\t-p, --packets <packets>\tNumber of packets to process in the experiment.\n");
+    printf ("\t-i, --interval <interval>\tInterval between each packet in nanoseconds. A comma-separated list gives the interval of each flow, the last one applying to the following flows.\n");
+    printf ("\t-s, --server <server_ip>\tServer IP address.\n");
+    printf ("\t-m, --measurement <measurement>\tMeasurement to perform. 0: All Timestamps, 1: Min/Max latency, 2: Buckets, 3: All Timestamps (binary), 4: In-memory capture, 5: In-memory capture (binary), 6: HDR histogram, 7: Streaming quantiles, 8: Top-K worst rounds, 9: Loss tracker, 10: One-way delays. A comma-separated list, e.g. 2,1,0, records all of them in one run.\n");
+    printf ("\t-a, --async\tPersist the measurements from a writer thread on a non-isolated core.\n");
+    printf ("\t-L, --live\tPublish live statistics in /dev/shm/det-bypass-<pid>, see the live_stats tool. With several flows, only the first one is published.\n");
+    printf ("\t-H, --hdr-digits <digits>\tSignificant digits of the HDR histogram (1-5, default %d).\n", PERSISTENCE_HDR_DEFAULT_DIGITS);
+    printf ("\t-q, --quantiles <quantiles>\tComma-separated quantiles reported by the streaming quantiles, e.g. 0.5,0.99,0.9999.\n");
+    printf ("\t-b, --buckets <buckets>\tNumber of buckets (default %d).\n", NUM_BUCKETS);
+    printf ("\t-w, --bucket-width <width>\tWidth of each bucket in nanoseconds (default: range / buckets).\n");
+    printf ("\t-R, --bucket-range <range>\tHalf-width in nanoseconds of the bucket range around the interval (default %d).\n", OFFSET);
+    printf ("\t-S, --trace-sample <n>\tKeep one round out of n in the All Timestamps measurement.\n");
+    printf ("\t-k, --topk <rounds>\tNumber of worst rounds kept by the Top-K measurement (default %d).\n", PERSISTENCE_TOPK_DEFAULT);
+    printf ("\t-C, --topk-context <rounds>\tRounds kept before and after each of the Top-K rounds (default %d).\n", PERSISTENCE_TOPK_DEFAULT_CONTEXT);
+    printf ("\t-W, --loss-window <window>\tDuration in nanoseconds of each window of the loss series of the Loss tracker (default %lu).\n", PERSISTENCE_LOSS_DEFAULT_WINDOW_NS);
+    printf ("\t-T, --timesource <source>\tSource of the timestamps: clock (clock_gettime, default) or tsc (calibrated invariant TSC).\n");
+    printf ("\t-A, --arrival <arrival>\tArrival process of the pings, durations in nanoseconds: fixed (default), poisson[:<mean>[:<seed>]], onoff:<burst>:<gap>, step:<packets>:<interval>, ramp:<interval> or trace:<file> (replay of an All Timestamps file).\n");
+    printf ("\t-F, --flows <flows>\tNumber of concurrent flows (1-%d, default 1), each with its own sender thread, id space and output files (<file>.flow<i>).\n", PINGPONG_MAX_FLOWS);
+    printf ("\t-x, --sweep <sweep>\tRate sweep <from>:<to>:<steps>:<dwell>: <steps> rates from <from> to <to> packets per second, each sent for <dwell> nanoseconds. Replaces -p, -i and -A; each step is written to <file>.step<i> and the summary to <file>.sweep.\n");
+    printf ("\t-B, --sweep-bound <bounds>\tLatency bounds <p99>[:<p99.9>] in nanoseconds of the sustainable rates of the sweep (default: no loss).\n");
+    printf ("\t-O, --window <pings>\tClosed loop: at most <pings> pings in flight per flow, the next one leaving when a pong arrives and not before its deadline (default: open loop).\n");
+    printf ("\t-G, --start-align <align>\tStart the first ping at the next multiple of <align> nanoseconds of the wall clock once the server is ready, so that clients with synchronized clocks start in lockstep (default: as soon as the server is ready).\n");
+    printf ("\t-P, --placement <placement>\tCores and scheduling of the threads, <thread>=<core>[:<policy>[:<priority>]],... with <thread> rx (measured loop), tx (sender of the first flow, flow i on <core> + i) or writer (-a), <core> a core or * and <policy> other, fifo or rr, e.g. rx=2:fifo:80,tx=3:fifo:70,writer=0. The placement is checked at startup and recorded in the metadata.\n");
+    printf ("\nThe server only needs --role server, the options of the device and the number of packets, -p or the -x of the client.\n");
+}
+
+static struct option long_options[] = {
+    {"dev", required_argument, 0, 'd'},
+    {"gidx", required_argument, 0, 'g'},
+    {"remove", no_argument, 0, 'r'},
+    {"packets", required_argument, 0, 'p'},
+    {"interval", required_argument, 0, 'i'},
+    {"server", required_argument, 0, 's'},
+    {"help", no_argument, 0, 'h'},
+    {"measurement", required_argument, 0, 'm'},
+    {"async", no_argument, 0, 'a'},
+    {"live", no_argument, 0, 'L'},
+    {"hdr-digits", required_argument, 0, 'H'},
+    {"quantiles", required_argument, 0, 'q'},
+    {"buckets", required_argument, 0, 'b'},
+    {"bucket-width", required_argument, 0, 'w'},
+    {"bucket-range", required_argument, 0, 'R'},
+    {"trace-sample", required_argument, 0, 'S'},
+    {"topk", required_argument, 0, 'k'},
+    {"topk-context", required_argument, 0, 'C'},
+    {"loss-window", required_argument, 0, 'W'},
+    {"timesource", required_argument, 0, 'T'},
+    {"arrival", required_argument, 0, 'A'},
+    {"flows", required_argument, 0, 'F'},
+    {"sweep", required_argument, 0, 'x'},
+    {"sweep-bound", required_argument, 0, 'B'},
+    {"window", required_argument, 0, 'O'},
+    {"start-align", required_argument, 0, 'G'},
+    {"placement", required_argument, 0, 'P'},
+    {"role", required_argument, 0, PP_ROLE_OPTION},
+    {0, 0, 0, 0}};
+
+static bool driver_parse_args (int argc, char **argv, const struct pp_datapath *datapath, struct pp_driver_config *config, uint32_t *pers_flags, struct pers_config *pers_config)
+{
+    int opt;
+    bool async = false;
+    bool live = false;
+    const char *sweep_bounds = NULL;
+    memset (config, 0, sizeof (*config));
+    config->role = PP_ROLE_CLIENT;
+    placement_init (&config->placement);
+
+    while ((opt = getopt_long (argc, argv, "d:g:rp:i:s:hm:aLH:q:b:w:R:S:k:C:W:T:A:F:x:B:O:G:P:", long_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'd':
+            if (!(datapath->flags & PP_DATAPATH_F_DEVICE))
+                return false;
+            config->device = optarg;
+            break;
+        case 'g':
+            if (!(datapath->flags & PP_DATAPATH_F_GID))
+                return false;
+            config->gid_idx = atoi (optarg);
+            break;
+        case 'r':
+            if (!datapath->remove)
+                return false;
+            config->remove = true;
+            break;
+        case 'p':
+            config->iters = atoll (optarg);
+            break;
+        case 'i':
+            config->interval = pers_parse_intervals (optarg, pers_config);
+            break;
+        case 's':
+            config->server_ip = optarg;
+            break;
+        case 'h':
+            return false;
+        case 'm': {
+            const int measurements = pers_parse_measurements (optarg, pers_config);
+            if (measurements < 0)
+                return false;
+            *pers_flags = measurements;
+            break;
+        }
+        case 'a':
+            async = true;
+            break;
+        case 'L':
+            live = true;
+            break;
+        case 'H':
+            pers_config->hdr_digits = atoi (optarg);
+            break;
+        case 'q':
+            if (pers_parse_quantiles (optarg, pers_config) != 0)
+                return false;
+            break;
+        case 'b':
+            pers_config->bucket_count = atoi (optarg);
+            break;
+        case 'w':
+            pers_config->bucket_width = atoll (optarg);
+            break;
+        case 'R':
+            pers_config->bucket_range = atoll (optarg);
+            break;
+        case 'S':
+            pers_config->trace_sample = atoi (optarg);
+            break;
+        case 'k':
+            pers_config->topk = atoi (optarg);
+            break;
+        case 'C':
+            pers_config->topk_context = atoi (optarg);
+            break;
+        case 'W':
+            pers_config->loss_window = atoll (optarg);
+            break;
+        case 'T': {
+            const int source = timesource_parse (optarg);
+            if (source < 0)
+                return false;
+            pers_config->timesource = source;
+            break;
+        }
+        case 'A': {
+            struct arrival arrival;
+            if (arrival_parse (optarg, &arrival) != 0)
+                return false;
+            pers_config->arrival = optarg;
+            break;
+        }
+        case 'F':
+            pers_config->flows = atoi (optarg);
+            if (pers_config->flows > PINGPONG_MAX_FLOWS)
+                return false;
+            break;
+        case 'x':
+            if (sweep_parse (optarg, &sweep) != 0)
+                return false;
+            pers_config->sweep = &sweep;
+            break;
+        case 'B':
+            sweep_bounds = optarg;
+            break;
+        case 'O':
+            pers_config->window = atoi (optarg);
+            break;
+        case 'G':
+            pers_config->start_align = atoll (optarg);
+            break;
+        case 'P':
+            if (placement_parse (optarg, &config->placement) != 0)
+                return false;
+            break;
+        case PP_ROLE_OPTION: {
+            const int parsed = pp_parse_role (optarg);
+            if (parsed < 0)
+                return false;
+            config->role = parsed;
+            break;
+        }
+        default:
+            return false;
+        }
+    }
+
+    if ((datapath->flags & PP_DATAPATH_F_DEVICE) && config->device == NULL)
+        return false;
+    if (config->remove)
+        return true;
+
+    if (pers_config->sweep)
+    {
+        // The sweep sets the number of packets and the rates
+        if (pers_config->arrival || (sweep_bounds && sweep_parse_bounds (sweep_bounds, &sweep) != 0))
+            return false;
+        config->iters = sweep_packets (&sweep);
+        config->interval = sweep.steps[0].interval;
+    }
+
+    if (config->iters == 0 || config->gid_idx < 0 || (config->role == PP_ROLE_CLIENT && (config->interval == 0 || config->server_ip == NULL)))
+        return false;
+
+    config->flows = max (pers_config->flows, 1U);
+    if (datapath->max_flows && config->flows > datapath->max_flows)
+    {
+        fprintf (stderr, "ERR: the %s datapath supports at most %u flows\n", datapath->name, datapath->max_flows);
+        return false;
+    }
+    if (datapath->max_window && pers_config->window > datapath->max_window)
+    {
+        fprintf (stderr, "ERR: the %s datapath supports at most %u pings in flight\n", datapath->name, datapath->max_window);
+        return false;
+    }
+
+    if (async)
+        *pers_flags |= PERSISTENCE_F_ASYNC;
+    if (live)
+        *pers_flags |= PERSISTENCE_F_LIVE;
+
+    return true;
+}
+
+static void sigint_handler (int sig __unused)
+{
+    pp_driver_exit = true;
+}
+
+/**
+ * Send callback of the sender threads: build the ping and hand it to the datapath.
+ */
+static int driver_send (char *buf __unused, const uint64_t id, const uint32_t flow, const uint64_t intended, struct sockaddr_ll *addr __unused, void *aux)
+{
+    const struct driver_run *run = aux;
+    struct pingpong_payload payload = new_pingpong_payload (id, flow, intended);
+    payload.ts[0] = get_time_ns ();
+
+    return run->datapath->send (run->ctx, &payload);
+}
+
+static const char *const backend_names[PP_BACKEND_COUNT] = {"generic", "all_timestamps", "min_max", "buckets", "hdr"};
+
+/**
+ * Variant of the measured loop picked by `driver_loop`: role, source of the timestamps and persistence backend, or
+ * "generic" when the datapath has no specialized loop for the run. Recorded in the metadata of the run.
+ */
+static struct {
+    const char *role;
+    const char *timesource;
+    const char *backend;
+} driver_variant;
+
+/**
+ * Generic measured loop: the operations of the datapath, the source of the timestamps and the write of the persistence
+ * are called through their pointers. Used when the datapath has no specialized loops or none matches the run.
+ */
+static int driver_generic_loop (const struct pp_datapath *datapath, void *ctx, struct flow_progress *progress, const bool server)
+{
+    if (server)
+        return pp_driver_loop (ctx, progress, persistence_agents, datapath->poll, datapath->reply, true, -1, PP_BACKEND_GENERIC);
+    return pp_driver_loop (ctx, progress, persistence_agents, datapath->poll, NULL, false, -1, PP_BACKEND_GENERIC);
+}
+
+/**
+ * Persistence backend of the agents of the flows, PP_BACKEND_GENERIC unless all of them write in the same way.
+ */
+static enum pp_driver_backend driver_backend (uint32_t flows)
+{
+    int (*write) (persistence_agent_t *, const struct pingpong_payload *) = persistence_agents[0]->write;
+    for (uint32_t i = 1; i < flows; ++i)
+    {
+        if (persistence_agents[i]->write != write)
+            return PP_BACKEND_GENERIC;
+    }
+
+    if (write == persistence_write_all_timestamps)
+        return PP_BACKEND_ALL_TIMESTAMPS;
+    if (write == persistence_write_min_max_latency)
+        return PP_BACKEND_MIN_MAX;
+    if (write == persistence_write_buckets)
+        return PP_BACKEND_BUCKETS;
+    if (write == persistence_write_hdr)
+        return PP_BACKEND_HDR;
+    return PP_BACKEND_GENERIC;
+}
+
+/**
+ * Run the measured loop, picking once the variant specialized for the datapath, the role, the source of the timestamps
+ * and the persistence backend of the run.
+ */
+static int driver_loop (const struct pp_datapath *datapath, void *ctx, struct flow_progress *progress, const bool server, uint32_t flows)
+{
+    driver_variant.role = server ? "server" : "client";
+    driver_variant.timesource = timesource_name (timesource.kind);
+
+    if (datapath->loops == NULL || (uint32_t) timesource.kind >= PP_DRIVER_TIMESOURCES)
+    {
+        driver_variant.backend = "generic";
+        LOG (stdout, "Measured loop: generic\n");
+        return driver_generic_loop (datapath, ctx, progress, server);
+    }
+
+    if (server)
+    {
+        // The server records nothing: its loops only differ by the source of the timestamps
+        driver_variant.backend = "none";
+        LOG (stdout, "Measured loop: server, timesource %s\n", driver_variant.timesource);
+        return datapath->loops->server[timesource.kind](ctx, progress, persistence_agents);
+    }
+
+    const enum pp_driver_backend backend = driver_backend (flows);
+    driver_variant.backend = backend_names[backend];
+    LOG (stdout, "Measured loop: client, timesource %s, backend %s\n", driver_variant.timesource, driver_variant.backend);
+    return datapath->loops->client[timesource.kind][backend](ctx, progress, persistence_agents);
+}
+
+/**
+ * Append the variant of the measured loop and the placement of the threads, as observed by each of them, to the
+ * metadata of the output file of each flow.
+ */
+static void driver_write_metadata (const char *filename, const struct pp_driver_config *config)
+{
+    for (uint32_t flow = 0; flow < config->flows; ++flow)
+    {
+        char meta_filename[PATH_MAX];
+        pp_flow_filename (meta_filename, sizeof (meta_filename), filename, flow, config->flows);
+        strncat (meta_filename, ".meta", sizeof (meta_filename) - strlen (meta_filename) - 1);
+
+        FILE *file = fopen (meta_filename, "a");
+        if (file == NULL)
+        {
+            LOG (stderr, "ERROR: Could not open %s\n", meta_filename);
+            continue;
+        }
+        if (driver_variant.role)
+            fprintf (file, "loop %s %s %s\n", driver_variant.role, driver_variant.timesource, driver_variant.backend);
+        placement_print (file, &config->placement);
+        fclose (file);
+    }
+}
+
+/**
+ * Lock the memory and move the calling thread, which runs the measured loop, where the placement puts it.
+ *
+ * @return 0 on success, -1 if the thread could not be placed
+ */
+static int driver_place (const struct pp_driver_config *config)
+{
+    placement_lock_memory ();
+
+    const struct thread_placement *rx = &config->placement.threads[PLACEMENT_RX];
+    const int ret = placement_apply (rx);
+    if (ret != 0)
+    {
+        fprintf (stderr, "ERR: could not place the rx thread: %s\n", strerror (ret));
+        return -1;
+    }
+    return placement_verify (pthread_self (), PLACEMENT_RX, 0, rx, 0);
+}
+
+static int run_server (const struct pp_datapath *datapath, const struct pp_driver_config *config)
+{
+    void *ctx = NULL;
+    if (datapath->setup (config, &ctx) < 0)
+    {
+        fprintf (stderr, "ERR: setup of the %s datapath failed\n", datapath->name);
+        return EXIT_FAILURE;
+    }
+
+    // The datapath is ready: tell the client that its pings will be answered
+    if (sync_server_start () != 0)
+    {
+        datapath->teardown (ctx);
+        return EXIT_FAILURE;
+    }
+
+    int ret = 0;
+    if (!(datapath->flags & PP_DATAPATH_F_KERNEL_SERVER))
+    {
+        struct flow_progress progress;
+        flow_progress_init (&progress, config->iters, 0);
+        ret = driver_loop (datapath, ctx, &progress, true, config->flows);
+    }
+    else
+    {
+        sync_server_wait ();
+    }
+
+    sync_server_stop ();
+    datapath->teardown (ctx);
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int run_client (const struct pp_datapath *datapath, const struct pp_driver_config *config, uint32_t pers_flags, struct pers_config *pers_config)
+{
+    pers_config->iters = config->iters;
+    pers_config->interval = config->interval;
+    pers_config->datapath = datapath->name;
+    pers_config->writer_placement = &config->placement.threads[PLACEMENT_WRITER];
+    if (persistence_init_flows (persistence_agents, datapath->outfile, pers_flags, pers_config) != 0)
+    {
+        fprintf (stderr, "ERR: persistence_init failed\n");
+        return EXIT_FAILURE;
+    }
+
+    sender_set_placement (&config->placement.threads[PLACEMENT_TX]);
+    sender_set_window (pers_config->window);
+    sender_set_start (config->server_ip, pers_config->start_align);
+    if (sender_set_flows (pers_config->flows, pers_config->flow_intervals) != 0 ||
+        (pers_config->sweep ? sender_set_sweep (pers_config->sweep) : sender_set_arrival (pers_config->arrival, config->iters, config->interval)) != 0)
+    {
+        fprintf (stderr, "ERR: sender_set_arrival failed\n");
+        persistence_close_flows (persistence_agents, config->flows);
+        return EXIT_FAILURE;
+    }
+
+    struct driver_run run = {.datapath = datapath, .ctx = NULL};
+    if (datapath->setup (config, &run.ctx) < 0)
+    {
+        fprintf (stderr, "ERR: setup of the %s datapath failed\n", datapath->name);
+        persistence_close_flows (persistence_agents, config->flows);
+        return EXIT_FAILURE;
+    }
+
+    int ret = start_sending_packets (config->iters, config->interval, NULL, NULL, driver_send, &run);
+    if (ret == 0)
+    {
+        struct flow_progress progress;
+        flow_progress_init (&progress, config->iters, config->flows);
+        ret = driver_loop (datapath, run.ctx, &progress, false, config->flows);
+        if (sender_failed)
+        {
+            fprintf (stderr, "ERR: a sender thread failed, the run is incomplete\n");
+            ret = -1;
+        }
+
+        stop_sending_packets ();
+        sender_write_schedule (datapath->outfile);
+        driver_write_metadata (datapath->outfile, config);
+    }
+    else
+    {
+        fprintf (stderr, "ERR: start_sending_packets failed\n");
+    }
+
+    datapath->teardown (run.ctx);
+    persistence_close_flows (persistence_agents, config->flows);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int pp_driver_main (int argc, char **argv, const struct pp_datapath *datapath)
+{
+    struct pp_driver_config config;
+    uint32_t pers_flags = PERSISTENCE_M_ALL_TIMESTAMPS;
+    struct pers_config pers_config = {0};
+    if (!driver_parse_args (argc, argv, datapath, &config, &pers_flags, &pers_config))
+    {
+        driver_print_usage (argv[0], datapath);
+        return EXIT_FAILURE;
+    }
+
+    if (config.remove)
+        return datapath->remove (&config) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    // Without SA_RESTART, so that a blocking receive returns when the run is interrupted
+    struct sigaction action = {.sa_handler = sigint_handler};
+    sigemptyset (&action.sa_mask);
+    sigaction (SIGINT, &action, NULL);
+
+    LOG (stdout, "Starting %s %s with iters=%lu\n", datapath->name, config.role == PP_ROLE_SERVER ? "server" : "client", config.iters);
+
+    if (driver_place (&config) != 0)
+        return EXIT_FAILURE;
+
+    // Both roles take timestamps: the server stamps ts[1] and ts[2] with the same source as the client
+    if (timesource_init (pers_config.timesource) != 0)
+    {
+        fprintf (stderr, "ERR: timesource_init failed\n");
+        return EXIT_FAILURE;
+    }
+
+    if (config.role == PP_ROLE_SERVER)
+        return run_server (datapath, &config);
+
+    return run_client (datapath, &config, pers_flags, &pers_config);
+}
@@ -0,0 +1,285 @@
+#pragma once
+
+#include "common.h"
+#include "net.h"
+#include "persistence.h"
+#include "placement.h"
+#include "utils.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Maximum number of packets returned by a single poll of a datapath.
+ */
+#define PP_DRIVER_BATCH 64
+
+/**
+ * The datapath takes the device to use as -d, e.g. the network interface or the IB device.
+ */
+#define PP_DATAPATH_F_DEVICE (1 << 0)
+/**
+ * The datapath takes the GID index of the IB port as -g.
+ */
+#define PP_DATAPATH_F_GID (1 << 1)
+/**
+ * The pongs are sent by the kernel (e.g. by an XDP program): the server has no user-space loop and returns once the
+ * client has been told that it is ready and the agreed start has passed, see `sync_server_wait`.
+ */
+#define PP_DATAPATH_F_KERNEL_SERVER (1 << 2)
+
+/**
+ * Configuration of the run, shared by the driver and the datapath.
+ */
+struct pp_driver_config {
+    enum pp_role role;
+    const char *device;   // -d, only for the datapaths with PP_DATAPATH_F_DEVICE
+    int gid_idx;          // -g, only for the datapaths with PP_DATAPATH_F_GID
+    const char *server_ip;// address of the server, NULL on the server
+    uint64_t iters;       // number of pings of each flow
+    uint64_t interval;    // interval between two pings of the first flow
+    uint32_t flows;       // number of concurrent flows, at least 1
+    bool remove;          // --remove, only for the datapaths with a `remove` operation
+    struct placement placement;// -P, placement of the threads, see placement.h
+};
+
+/**
+ * A packet returned by the poll of a datapath.
+ */
+struct pp_packet {
+    struct pingpong_payload *payload;// valid until the next poll of the datapath
+    uint64_t ts;                     // receive timestamp taken by the datapath, 0 to let the driver take it
+    uint64_t handle;                 // owned by the datapath, e.g. the buffer holding the packet
+};
+
+/**
+ * Measured loop of the driver: poll the packets of the datapath context `ctx`, timestamp them and either send them back
+ * (server) or record them with the agent of their flow (client), until every flow of `progress` is over.
+ *
+ * @return 0 on success, -1 if the datapath failed
+ */
+typedef int (*pp_driver_loop_t) (void *ctx, struct flow_progress *progress, persistence_agent_t **agents);
+
+/**
+ * Persistence backends that the client loop can be specialized for, i.e. the `write` operation of the agents.
+ * PP_BACKEND_GENERIC calls `write` through the agent, e.g. for a list of measurements or the async writer.
+ */
+enum pp_driver_backend {
+    PP_BACKEND_GENERIC = 0,
+    PP_BACKEND_ALL_TIMESTAMPS,
+    PP_BACKEND_MIN_MAX,
+    PP_BACKEND_BUCKETS,
+    PP_BACKEND_HDR,
+    PP_BACKEND_COUNT,
+};
+
+// Number of the sources of the timestamps, see `enum timesource_kind`
+#define PP_DRIVER_TIMESOURCES 2
+
+/**
+ * Variants of the measured loop of a datapath, specialized for the role, the source of the timestamps and the
+ * persistence backend. See `PP_DRIVER_DEFINE_LOOPS`.
+ */
+struct pp_driver_loops {
+    pp_driver_loop_t server[PP_DRIVER_TIMESOURCES];
+    pp_driver_loop_t client[PP_DRIVER_TIMESOURCES][PP_BACKEND_COUNT];
+};
+
+/**
+ * Operations of a datapath, i.e. of the transport under test.
+ *
+ * The driver owns everything else: argument parsing, signal handling, persistence, the sender threads and the measured
+ * loop, which builds the payloads, takes the timestamps and decides when the experiment is over. This way every transport
+ * is measured by exactly the same instrumentation.
+ *
+ * All the operations return 0 (or the number of packets for `poll`) on success and a negative value on failure.
+ */
+struct pp_datapath {
+    const char *name;   // recorded in the metadata of the run
+    const char *outfile;// file of the measurements
+    uint32_t flags;     // PP_DATAPATH_F_*
+    uint32_t max_flows; // maximum number of concurrent flows, 0 if unlimited
+    uint32_t max_window;// maximum number of pings in flight with -O, 0 if unlimited
+
+    /**
+     * Open the transport, connect to the peer and make it ready to send and receive.
+     * The returned context is passed to all the other operations.
+     */
+    int (*setup) (const struct pp_driver_config *config, void **ctx);
+
+    /**
+     * Client only: send the given ping, whose timestamp ts[0] has already been taken.
+     * Called concurrently by the sender threads, one per flow.
+     */
+    int (*send) (void *ctx, const struct pingpong_payload *payload);
+
+    /**
+     * Retrieve up to `max` received packets without blocking for long, 0 if there are none.
+     * The packets of the previous poll can be released.
+     */
+    int (*poll) (void *ctx, struct pp_packet *packets, uint32_t max);
+
+    /**
+     * Server only: send back the given packet of the last poll, whose timestamps ts[1] and ts[2] have been taken.
+     */
+    int (*reply) (void *ctx, struct pp_packet *packet);
+
+    /**
+     * Release the transport. Called once the experiment is over, or on failure after a successful setup.
+     */
+    void (*teardown) (void *ctx);
+
+    /**
+     * Optional: remove what the datapath left on the device, e.g. an XDP program. Enables the --remove option.
+     */
+    int (*remove) (const struct pp_driver_config *config);
+
+    /**
+     * Optional: the measured loop specialized for this datapath, defined with `PP_DRIVER_DEFINE_LOOPS`.
+     * Without it, the driver runs a generic loop calling the operations above through this table.
+     */
+    const struct pp_driver_loops *loops;
+};
+
+/**
+ * Run the pingpong experiment over the given datapath: parse the arguments, set up the datapath and run the client or
+ * the server, as selected by --role.
+ *
+ * @param argc the number of arguments
+ * @param argv the arguments
+ * @param datapath the operations of the transport
+ * @return the exit code of the program
+ */
+int pp_driver_main (int argc, char **argv, const struct pp_datapath *datapath);
+
+// Set when the experiment is interrupted, e.g. by SIGINT, see `pp_driver_interrupted`
+extern volatile bool pp_driver_exit;
+
+/**
+ * Whether the experiment has been interrupted, e.g. by SIGINT, or a sender thread has stopped before its last ping.
+ * A datapath busy-waiting inside one of its operations should stop when it is set.
+ */
+static inline bool pp_driver_interrupted (void)
+{
+    return pp_driver_exit || sender_failed;
+}
+
+/**
+ * Send back a packet through the `reply` operation of a datapath.
+ */
+typedef int (*pp_driver_reply_t) (void *ctx, struct pp_packet *packet);
+
+/**
+ * Poll packets through the `poll` operation of a datapath.
+ */
+typedef int (*pp_driver_poll_t) (void *ctx, struct pp_packet *packets, uint32_t max);
+
+/**
+ * Record a pong with the agent of its flow. Inlined with a constant `backend`, the write of the agent becomes a direct
+ * call, or for the in-memory backends no call at all.
+ */
+__always_inline static int pp_driver_write (persistence_agent_t *agent, const struct pingpong_payload *payload, const enum pp_driver_backend backend)
+{
+    switch (backend)
+    {
+    case PP_BACKEND_ALL_TIMESTAMPS:
+        return persistence_write_all_timestamps (agent, payload);
+    case PP_BACKEND_MIN_MAX:
+        return pers_write_min_max_latency (agent, payload);
+    case PP_BACKEND_BUCKETS:
+        return pers_write_buckets (agent, payload);
+    case PP_BACKEND_HDR:
+        return pers_write_hdr (agent, payload);
+    default:
+        return agent->write (agent, payload);
+    }
+}
+
+/**
+ * The measured loop, shared by all the datapaths: poll the received packets, timestamp them and either send them back
+ * (server) or record them (client), until every flow has received its last packet or the run is interrupted.
+ *
+ * The packets of a batch are timestamped when the poll returns, unless the datapath took its own timestamp.
+ * The function is always inlined: with constant arguments, the poll and the reply of the datapath, the timestamps
+ * and the write of the persistence are inlined or called directly instead of through their function pointers.
+ * A `kind` of -1 reads the source of the timestamps at each timestamp, as `get_time_ns`.
+ *
+ * @return 0 on success, -1 if the datapath failed
+ */
+__always_inline static int pp_driver_loop (void *ctx, struct flow_progress *progress, persistence_agent_t **agents,
+                                           const pp_driver_poll_t poll, const pp_driver_reply_t reply,
+                                           const bool server, const int kind, const enum pp_driver_backend backend)
+{
+    struct pp_packet packets[PP_DRIVER_BATCH];
+
+    // A datapath whose pongs are sent by the kernel has no reply
+    if (server && reply == NULL)
+        return -1;
+
+    while (LIKELY (!flow_progress_finished (progress) && !pp_driver_interrupted ()))
+    {
+        const int received = poll (ctx, packets, PP_DRIVER_BATCH);
+        if (UNLIKELY (received < 0))
+            return -1;
+        if (received == 0)
+            continue;
+
+        const uint64_t now = kind < 0 ? get_time_ns () : timesource_now_ns (kind);
+        for (int i = 0; i < received; ++i)
+        {
+            struct pingpong_payload *payload = packets[i].payload;
+            const uint64_t ts = packets[i].ts ? packets[i].ts : now;
+            if (server)
+            {
+                payload->ts[1] = ts;
+                flow_progress_update (progress, payload);
+                payload->ts[2] = kind < 0 ? get_time_ns () : timesource_now_ns (kind);
+                if (UNLIKELY (reply (ctx, &packets[i]) < 0))
+                    return -1;
+            }
+            else
+            {
+                payload->ts[3] = ts;
+                if (UNLIKELY (!flow_progress_update (progress, payload)))
+                    continue;
+
+                sender_pong_received (payload->flow, payload->id);
+                pp_driver_write (agents[payload->flow], payload, backend);
+            }
+        }
+    }
+
+    return 0;
+}
+
+#define PP_DRIVER_LOOP_VARIANT(name, poll, reply, server, kind, backend)                       \
+    static int name (void *ctx, struct flow_progress *progress, persistence_agent_t **agents) \
+    {                                                                                           \
+        return pp_driver_loop (ctx, progress, agents, poll, reply, server, kind, backend);     \
+    }
+
+#define PP_DRIVER_CLIENT_VARIANTS(name, poll, kind)                                                  \
+    PP_DRIVER_LOOP_VARIANT (name##_generic, poll, NULL, false, kind, PP_BACKEND_GENERIC)             \
+    PP_DRIVER_LOOP_VARIANT (name##_all_timestamps, poll, NULL, false, kind, PP_BACKEND_ALL_TIMESTAMPS) \
+    PP_DRIVER_LOOP_VARIANT (name##_min_max, poll, NULL, false, kind, PP_BACKEND_MIN_MAX)             \
+    PP_DRIVER_LOOP_VARIANT (name##_buckets, poll, NULL, false, kind, PP_BACKEND_BUCKETS)             \
+    PP_DRIVER_LOOP_VARIANT (name##_hdr, poll, NULL, false, kind, PP_BACKEND_HDR)
+
+#define PP_DRIVER_CLIENT_TABLE(name) \
+    {name##_generic, name##_all_timestamps, name##_min_max, name##_buckets, name##_hdr}
+
+/**
+ * Define `loops`, the `struct pp_driver_loops` of a datapath: one measured loop for each role, source of the timestamps
+ * and persistence backend, each calling the functions `poll` and `reply` of the datapath directly, so that the
+ * compiler can inline them. `reply` is NULL if the pongs are sent by the kernel.
+ * The driver picks the variant once at startup, see `pp_driver_main`.
+ */
+#define PP_DRIVER_DEFINE_LOOPS(loops, poll, reply)                                                 \
+    PP_DRIVER_LOOP_VARIANT (loops##_server_clock, poll, reply, true, TIMESOURCE_CLOCK, PP_BACKEND_GENERIC) \
+    PP_DRIVER_LOOP_VARIANT (loops##_server_tsc, poll, reply, true, TIMESOURCE_TSC, PP_BACKEND_GENERIC)     \
+    PP_DRIVER_CLIENT_VARIANTS (loops##_client_clock, poll, TIMESOURCE_CLOCK)                        \
+    PP_DRIVER_CLIENT_VARIANTS (loops##_client_tsc, poll, TIMESOURCE_TSC)                            \
+    static const struct pp_driver_loops loops = {                                                  \
+        .server = {loops##_server_clock, loops##_server_tsc},                                      \
+        .client = {PP_DRIVER_CLIENT_TABLE (loops##_client_clock), PP_DRIVER_CLIENT_TABLE (loops##_client_tsc)}, \
+    };
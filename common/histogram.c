@@ -0,0 +1,143 @@
+#include "histogram.h"
+#include "utils.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+int hdr_init (struct hdr_histogram *h, uint32_t significant_digits, uint64_t highest_trackable_value)
+{
+    if (significant_digits < 1 || significant_digits > 5 || highest_trackable_value < 2)
+        return -1;
+
+    memset (h, 0, sizeof (struct hdr_histogram));
+
+    // Number of sub-buckets needed to keep a single unit resolution up to 2 * 10^digits
+    uint64_t largest_value_with_single_unit_resolution = 2;
+    for (uint32_t i = 0; i < significant_digits; ++i)
+        largest_value_with_single_unit_resolution *= 10;
+
+    const uint32_t sub_bucket_count_magnitude = 64 - __builtin_clzll (largest_value_with_single_unit_resolution - 1);
+    h->sub_bucket_half_count_magnitude = sub_bucket_count_magnitude - 1;
+    h->sub_bucket_half_count = 1U << h->sub_bucket_half_count_magnitude;
+    h->sub_bucket_mask = (1ULL << sub_bucket_count_magnitude) - 1;
+    h->significant_digits = significant_digits;
+    h->highest_trackable_value = highest_trackable_value;
+
+    // One bucket for the values recorded exactly, plus one for each power of two up to the highest value
+    const uint32_t highest_bit = 63 - __builtin_clzll (highest_trackable_value);
+    h->bucket_count = highest_bit > h->sub_bucket_half_count_magnitude ? highest_bit - h->sub_bucket_half_count_magnitude + 1 : 1;
+    h->counts_len = (h->bucket_count + 1) * h->sub_bucket_half_count;
+
+    h->counts = aligned_alloc (CACHE_LINE_SIZE, ((h->counts_len * sizeof (uint64_t) + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE) * CACHE_LINE_SIZE);
+    if (h->counts == NULL)
+        return -1;
+
+    // Lock the memory to avoid major page faults
+    mlock (h->counts, h->counts_len * sizeof (uint64_t));
+    hdr_reset (h);
+
+    return 0;
+}
+
+void hdr_destroy (struct hdr_histogram *h)
+{
+    munlock (h->counts, h->counts_len * sizeof (uint64_t));
+    free (h->counts);
+    h->counts = NULL;
+}
+
+void hdr_reset (struct hdr_histogram *h)
+{
+    memset (h->counts, 0, h->counts_len * sizeof (uint64_t));
+    h->total_count = 0;
+    h->sum = 0;
+    h->min = UINT64_MAX;
+    h->max = 0;
+}
+
+int hdr_merge (struct hdr_histogram *dst, const struct hdr_histogram *src)
+{
+    if (dst->sub_bucket_half_count_magnitude != src->sub_bucket_half_count_magnitude || dst->counts_len != src->counts_len)
+        return -1;
+
+    for (uint32_t i = 0; i < src->counts_len; ++i)
+        dst->counts[i] += src->counts[i];
+
+    dst->total_count += src->total_count;
+    dst->sum += src->sum;
+    dst->min = min (dst->min, src->min);
+    dst->max = max (dst->max, src->max);
+
+    return 0;
+}
+
+uint64_t hdr_lowest_value_at_index (const struct hdr_histogram *h, uint32_t idx)
+{
+    int32_t bucket_index = (int32_t) (idx >> h->sub_bucket_half_count_magnitude) - 1;
+    if (bucket_index < 0)
+        bucket_index = 0;
+    const uint64_t sub_bucket_index = idx - ((uint64_t) bucket_index << h->sub_bucket_half_count_magnitude);
+    return sub_bucket_index << bucket_index;
+}
+
+uint64_t hdr_highest_value_at_index (const struct hdr_histogram *h, uint32_t idx)
+{
+    int32_t bucket_index = (int32_t) (idx >> h->sub_bucket_half_count_magnitude) - 1;
+    if (bucket_index < 0)
+        bucket_index = 0;
+    return hdr_lowest_value_at_index (h, idx) + (1ULL << bucket_index) - 1;
+}
+
+uint64_t hdr_value_at_percentile (const struct hdr_histogram *h, double percentile)
+{
+    if (h->total_count == 0)
+        return 0;
+
+    if (percentile > 100.0)
+        percentile = 100.0;
+
+    // Round up, without depending on libm
+    const double target = percentile / 100.0 * h->total_count;
+    uint64_t count_at_percentile = (uint64_t) target;
+    if (count_at_percentile < target || count_at_percentile == 0)
+        count_at_percentile++;
+
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < h->counts_len; ++i)
+    {
+        total += h->counts[i];
+        if (total >= count_at_percentile)
+            return min (hdr_highest_value_at_index (h, i), h->max);
+    }
+
+    return h->max;
+}
+
+double hdr_mean (const struct hdr_histogram *h)
+{
+    if (h->total_count == 0)
+        return 0;
+    return (double) h->sum / h->total_count;
+}
+
+static const double standard_percentiles[] = {50.0, 90.0, 99.0, 99.9, 99.99, 99.999, 99.9999};
+
+void hdr_print_percentiles (const struct hdr_histogram *h, FILE *file, const char *name)
+{
+    fprintf (file, "%s COUNT %lu MIN %lu MEAN %.1f MAX %lu", name, h->total_count,
+             h->total_count ? h->min : 0, hdr_mean (h), h->max);
+    for (size_t i = 0; i < sizeof (standard_percentiles) / sizeof (standard_percentiles[0]); ++i)
+        fprintf (file, " P%g %lu", standard_percentiles[i], hdr_value_at_percentile (h, standard_percentiles[i]));
+    fprintf (file, "\n");
+}
+
+void hdr_print_counts (const struct hdr_histogram *h, FILE *file, const char *name)
+{
+    for (uint32_t i = 0; i < h->counts_len; ++i)
+    {
+        if (h->counts[i] == 0)
+            continue;
+        fprintf (file, "%s %lu %lu %lu\n", name, hdr_lowest_value_at_index (h, i), hdr_highest_value_at_index (h, i), h->counts[i]);
+    }
+}
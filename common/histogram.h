@@ -0,0 +1,119 @@
+/**
+ * Log-linear latency histogram, in the style of HdrHistogram (http://hdrhistogram.org).
+ *
+ * Values are grouped in buckets covering [2^k, 2^(k+1)), each split in `sub_bucket_count / 2` linear sub-buckets,
+ * so that the relative error of any recorded value is bounded by the requested number of significant digits.
+ * Values below `sub_bucket_count` are recorded exactly.
+ *
+ * The counters are stored in a single contiguous array; computing the index of a value only takes a clz, two shifts
+ * and an add, without any division.
+ */
+#pragma once
+
+#include "common.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+struct hdr_histogram {
+    // log2 of half the number of sub-buckets of each bucket
+    uint32_t sub_bucket_half_count_magnitude;
+    uint32_t sub_bucket_half_count;
+    uint64_t sub_bucket_mask;
+    uint32_t significant_digits;
+    uint32_t bucket_count;
+    uint32_t counts_len;
+
+    uint64_t highest_trackable_value;
+    uint64_t total_count;
+    uint64_t min;
+    uint64_t max;
+    // Sum of the recorded values, used for the mean
+    __uint128_t sum;
+
+    uint64_t *counts;
+};
+
+/**
+ * Initialize a histogram able to record values in [0, highest_trackable_value] with the given precision.
+ * Values above `highest_trackable_value` are recorded in the last sub-bucket, but still count for min/max.
+ *
+ * @param h the histogram to initialize
+ * @param significant_digits number of significant decimal digits to preserve, between 1 and 5
+ * @param highest_trackable_value the highest value to be tracked with the given precision
+ * @return 0 on success, -1 on error
+ */
+int hdr_init (struct hdr_histogram *h, uint32_t significant_digits, uint64_t highest_trackable_value);
+
+void hdr_destroy (struct hdr_histogram *h);
+
+/**
+ * Reset all the counters of the histogram.
+ */
+void hdr_reset (struct hdr_histogram *h);
+
+static inline uint32_t hdr_counts_index (const struct hdr_histogram *h, uint64_t value)
+{
+    // Index of the power of two bucket, 0 for the values recorded exactly
+    const int32_t bucket_index = 63 - __builtin_clzll (value | h->sub_bucket_mask) - h->sub_bucket_half_count_magnitude;
+    const uint32_t sub_bucket_index = value >> bucket_index;
+    return (bucket_index << h->sub_bucket_half_count_magnitude) + sub_bucket_index;
+}
+
+/**
+ * Record a value in the histogram.
+ */
+static inline void hdr_record (struct hdr_histogram *h, uint64_t value)
+{
+    uint32_t idx = hdr_counts_index (h, value);
+    if (UNLIKELY (idx >= h->counts_len))
+        idx = h->counts_len - 1;
+
+    h->counts[idx]++;
+    h->total_count++;
+    h->sum += value;
+    if (UNLIKELY (value < h->min))
+        h->min = value;
+    if (UNLIKELY (value > h->max))
+        h->max = value;
+}
+
+/**
+ * Add all the values recorded in `src` to `dst`.
+ * The two histograms must have been initialized with the same parameters.
+ *
+ * @return 0 on success, -1 if the histograms are not compatible
+ */
+int hdr_merge (struct hdr_histogram *dst, const struct hdr_histogram *src);
+
+/**
+ * Lowest and highest values that are recorded in the same counter as the counter at index `idx`.
+ */
+uint64_t hdr_lowest_value_at_index (const struct hdr_histogram *h, uint32_t idx);
+uint64_t hdr_highest_value_at_index (const struct hdr_histogram *h, uint32_t idx);
+
+/**
+ * Return the value below which `percentile` percent of the recorded values fall.
+ * The returned value is the highest value equivalent to the one found, i.e. an upper bound within the histogram precision.
+ *
+ * @param h the histogram
+ * @param percentile the percentile, in [0, 100]
+ * @return the value at the given percentile, 0 if the histogram is empty
+ */
+uint64_t hdr_value_at_percentile (const struct hdr_histogram *h, double percentile);
+
+/**
+ * Return the mean of the recorded values.
+ */
+double hdr_mean (const struct hdr_histogram *h);
+
+/**
+ * Print a summary of the histogram: count, min, mean, max and the standard percentiles
+ * (p50, p90, p99, p99.9, p99.99, p99.999, p99.9999), all in a single line prefixed by `name`.
+ */
+void hdr_print_percentiles (const struct hdr_histogram *h, FILE *file, const char *name);
+
+/**
+ * Print the non-empty counters of the histogram, one per line: `<name> <lowest value> <highest value> <count>`.
+ */
+void hdr_print_counts (const struct hdr_histogram *h, FILE *file, const char *name);
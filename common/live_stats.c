@@ -0,0 +1,129 @@
+#include "live_stats.h"
+#include "utils.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+int live_stats_create (struct live_stats *stats)
+{
+    snprintf (stats->path, sizeof (stats->path), LIVE_STATS_PATH_FMT, getpid ());
+
+    int fd = open (stats->path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        LOG (stderr, "ERROR: Could not create %s\n", stats->path);
+        return -1;
+    }
+
+    if (ftruncate (fd, sizeof (struct live_stats_block)) != 0)
+    {
+        LOG (stderr, "ERROR: Could not resize %s\n", stats->path);
+        close (fd);
+        unlink (stats->path);
+        return -1;
+    }
+
+    // Prefaulted and locked: the writer must never take a page fault
+    void *ptr = mmap (NULL, sizeof (struct live_stats_block), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE | MAP_LOCKED, fd, 0);
+    close (fd);
+    if (ptr == MAP_FAILED)
+    {
+        LOG (stderr, "ERROR: Could not map %s\n", stats->path);
+        unlink (stats->path);
+        return -1;
+    }
+
+    struct live_stats_block *block = ptr;
+    memset (block, 0, sizeof (struct live_stats_block));
+    block->version = LIVE_STATS_VERSION;
+    block->header_size = sizeof (struct live_stats_block);
+    block->pid = getpid ();
+    block->window_size = LIVE_STATS_WINDOW;
+    block->start_ns = get_time_ns ();
+    atomic_store (&block->min, UINT64_MAX);
+
+    // The magic is written last, so that a reader never attaches to a half-initialized block
+    atomic_thread_fence (memory_order_release);
+    block->magic = LIVE_STATS_MAGIC;
+
+    stats->block = block;
+    return 0;
+}
+
+void live_stats_destroy (struct live_stats *stats)
+{
+    munmap (stats->block, sizeof (struct live_stats_block));
+    unlink (stats->path);
+    stats->block = NULL;
+}
+
+const struct live_stats_block *live_stats_attach (const char *path)
+{
+    int fd = open (path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    if (fstat (fd, &st) != 0 || (size_t) st.st_size < sizeof (struct live_stats_block))
+    {
+        close (fd);
+        return NULL;
+    }
+
+    void *ptr = mmap (NULL, sizeof (struct live_stats_block), PROT_READ, MAP_SHARED, fd, 0);
+    close (fd);
+    if (ptr == MAP_FAILED)
+        return NULL;
+
+    const struct live_stats_block *block = ptr;
+    if (block->magic != LIVE_STATS_MAGIC || block->version != LIVE_STATS_VERSION)
+    {
+        munmap (ptr, sizeof (struct live_stats_block));
+        return NULL;
+    }
+
+    return block;
+}
+
+void live_stats_detach (const struct live_stats_block *block)
+{
+    munmap ((void *) block, sizeof (struct live_stats_block));
+}
+
+void live_stats_read (const struct live_stats_block *block, struct live_stats_snapshot *snapshot)
+{
+    struct live_stats_block *b = (struct live_stats_block *) block;
+    uint64_t sum;
+    uint32_t seq;
+
+    do
+    {
+        seq = atomic_load_explicit (&b->seq, memory_order_acquire);
+        if (seq & 1)
+            continue;
+
+        snapshot->packets = atomic_load_explicit (&b->packets, memory_order_relaxed);
+        snapshot->highest_id = atomic_load_explicit (&b->highest_id, memory_order_relaxed);
+        snapshot->min = atomic_load_explicit (&b->min, memory_order_relaxed);
+        snapshot->max = atomic_load_explicit (&b->max, memory_order_relaxed);
+        sum = atomic_load_explicit (&b->sum, memory_order_relaxed);
+        snapshot->last_update_ns = atomic_load_explicit (&b->last_update_ns, memory_order_relaxed);
+
+        atomic_thread_fence (memory_order_acquire);
+    } while ((seq & 1) || atomic_load_explicit (&b->seq, memory_order_relaxed) != seq);
+
+    snapshot->lost = snapshot->highest_id > snapshot->packets ? snapshot->highest_id - snapshot->packets : 0;
+    snapshot->mean = snapshot->packets ? (double) sum / snapshot->packets : 0;
+    if (snapshot->packets == 0)
+        snapshot->min = 0;
+
+    // The window is only loosely synchronized with the counters, see live_stats.h
+    const uint64_t head = atomic_load_explicit (&b->window_head, memory_order_acquire);
+    snapshot->window_len = min (head, (uint64_t) LIVE_STATS_WINDOW);
+    for (uint32_t i = 0; i < snapshot->window_len; ++i)
+        snapshot->window[i] = atomic_load_explicit (&b->window[(head - 1 - i) & (LIVE_STATS_WINDOW - 1)], memory_order_relaxed);
+}
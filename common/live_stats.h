@@ -0,0 +1,141 @@
+/**
+ * Live statistics of a running experiment, published in a shared-memory file (`/dev/shm/det-bypass-<pid>`)
+ * so that an external reader can follow the run without waiting for the persistence file.
+ *
+ * The counters are protected by a seqlock: the writer makes the sequence odd, updates the counters and makes it even
+ * again, without ever waiting for the readers. A reader copies the counters and retries if the sequence was odd or
+ * changed in the meantime.
+ * The latencies of the last LIVE_STATS_WINDOW rounds are kept in a ring outside of the seqlock, since copying it can
+ * take longer than the interval between two rounds: each slot is a single aligned 64-bit store, so a reader may see
+ * a slightly more recent window but never a torn value. The percentiles of the window are computed by the reader.
+ */
+#pragma once
+
+#include "common.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define LIVE_STATS_MAGIC 0x4556494c// "LIVE"
+#define LIVE_STATS_VERSION 1
+#define LIVE_STATS_PATH_FMT "/dev/shm/det-bypass-%d"
+/* Number of recent latencies kept in the block, must be a power of 2 */
+#define LIVE_STATS_WINDOW 4096
+
+/**
+ * Layout of the shared-memory file.
+ */
+struct live_stats_block {
+    // Read-only after initialization
+    uint32_t magic;
+    uint16_t version;
+    uint16_t header_size;
+    int32_t pid;
+    uint32_t window_size;
+    uint64_t start_ns;
+
+    // Protected by `seq`
+    _Alignas (CACHE_LINE_SIZE) _Atomic uint32_t seq;
+    _Atomic uint64_t packets;
+    // Highest round id received: the rounds below it that were not received are lost
+    _Atomic uint64_t highest_id;
+    _Atomic uint64_t min;
+    _Atomic uint64_t max;
+    // Sum of the latencies, for the mean
+    _Atomic uint64_t sum;
+    _Atomic uint64_t last_update_ns;
+
+    // Written once per round, outside of the seqlock; `window_head` is the number of latencies written so far
+    _Alignas (CACHE_LINE_SIZE) _Atomic uint64_t window_head;
+    _Alignas (CACHE_LINE_SIZE) _Atomic uint64_t window[LIVE_STATS_WINDOW];
+};
+
+/**
+ * Consistent copy of the counters of a block, as taken by a reader.
+ */
+struct live_stats_snapshot {
+    uint64_t packets;
+    uint64_t highest_id;
+    uint64_t lost;
+    uint64_t min;
+    uint64_t max;
+    double mean;
+    uint64_t last_update_ns;
+    // Latencies of the recent window, `window_len` of them
+    uint32_t window_len;
+    uint64_t window[LIVE_STATS_WINDOW];
+};
+
+/**
+ * Writer side of the live statistics.
+ */
+struct live_stats {
+    struct live_stats_block *block;
+    char path[64];
+};
+
+/**
+ * Create the shared-memory file of the current process and map it.
+ *
+ * @param stats the live statistics to initialize
+ * @return 0 on success, -1 on error
+ */
+int live_stats_create (struct live_stats *stats);
+
+/**
+ * Unmap and remove the shared-memory file.
+ */
+void live_stats_destroy (struct live_stats *stats);
+
+/**
+ * Publish a round. Wait-free: it never waits for the readers.
+ * Must always be called by the same thread.
+ *
+ * @param stats the live statistics
+ * @param id the id of the round
+ * @param latency the latency of the round
+ * @param now_ns the current time, in nanoseconds
+ */
+static inline void live_stats_update (struct live_stats *stats, uint64_t id, uint64_t latency, uint64_t now_ns)
+{
+    struct live_stats_block *block = stats->block;
+
+    const uint64_t head = atomic_load_explicit (&block->window_head, memory_order_relaxed);
+    atomic_store_explicit (&block->window[head & (LIVE_STATS_WINDOW - 1)], latency, memory_order_relaxed);
+    atomic_store_explicit (&block->window_head, head + 1, memory_order_release);
+
+    // Only this thread writes the counters, relaxed loads are enough
+    const uint32_t seq = atomic_load_explicit (&block->seq, memory_order_relaxed);
+    atomic_store_explicit (&block->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence (memory_order_release);
+
+    atomic_store_explicit (&block->packets, atomic_load_explicit (&block->packets, memory_order_relaxed) + 1, memory_order_relaxed);
+    if (id > atomic_load_explicit (&block->highest_id, memory_order_relaxed))
+        atomic_store_explicit (&block->highest_id, id, memory_order_relaxed);
+    if (UNLIKELY (latency < atomic_load_explicit (&block->min, memory_order_relaxed)))
+        atomic_store_explicit (&block->min, latency, memory_order_relaxed);
+    if (UNLIKELY (latency > atomic_load_explicit (&block->max, memory_order_relaxed)))
+        atomic_store_explicit (&block->max, latency, memory_order_relaxed);
+    atomic_store_explicit (&block->sum, atomic_load_explicit (&block->sum, memory_order_relaxed) + latency, memory_order_relaxed);
+    atomic_store_explicit (&block->last_update_ns, now_ns, memory_order_relaxed);
+
+    atomic_store_explicit (&block->seq, seq + 2, memory_order_release);
+}
+
+/**
+ * Map, read-only, the shared-memory file at `path`.
+ *
+ * @param path the path of the file, e.g. as built from LIVE_STATS_PATH_FMT
+ * @return the block on success, NULL if the file does not exist or is not a live statistics block
+ */
+const struct live_stats_block *live_stats_attach (const char *path);
+
+void live_stats_detach (const struct live_stats_block *block);
+
+/**
+ * Take a consistent copy of the counters of `block`, and a copy of its recent window.
+ *
+ * @param block the block to read
+ * @param snapshot the copy
+ */
+void live_stats_read (const struct live_stats_block *block, struct live_stats_snapshot *snapshot);
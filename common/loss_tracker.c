@@ -0,0 +1,166 @@
+#include "loss_tracker.h"
+#include "utils.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+int loss_tracker_init (struct loss_tracker *lt, uint64_t slot_ns, uint64_t duration)
+{
+    memset (lt, 0, sizeof (struct loss_tracker));
+
+    lt->slot_ns = slot_ns;
+    lt->num_slots = slot_ns ? min (duration / slot_ns + 1, (uint64_t) LOSS_MAX_SLOTS) : 1;
+    lt->series = calloc (lt->num_slots, sizeof (uint64_t));
+    if (slot_ns)
+        lt->times = calloc (LOSS_WINDOW_BITS, sizeof (uint64_t));
+    if (lt->series == NULL || (slot_ns && lt->times == NULL))
+    {
+        loss_tracker_destroy (lt);
+        return -1;
+    }
+
+    // There is no round 0
+    lt->words[0] = 1;
+    return 0;
+}
+
+void loss_tracker_destroy (struct loss_tracker *lt)
+{
+    free (lt->series);
+    free (lt->times);
+    lt->series = NULL;
+    lt->times = NULL;
+}
+
+/**
+ * Slot of the loss series of the rounds intended to be sent at `time`, growing the series if needed.
+ */
+static uint32_t loss_tracker_slot (struct loss_tracker *lt, uint64_t time)
+{
+    if (lt->slot_ns == 0 || time <= lt->origin)
+        return 0;
+
+    const uint64_t slot = min ((time - lt->origin) / lt->slot_ns, (uint64_t) LOSS_MAX_SLOTS - 1);
+    if (LIKELY (slot < lt->num_slots))
+        return slot;
+
+    // The run lasts longer than expected, e.g. with gaps in the arrival process
+    const uint32_t num_slots = min (max (slot + 1, (uint64_t) lt->num_slots * 2), (uint64_t) LOSS_MAX_SLOTS);
+    uint64_t *series = realloc (lt->series, num_slots * sizeof (uint64_t));
+    if (series == NULL)
+        return lt->num_slots - 1;
+    memset (series + lt->num_slots, 0, (num_slots - lt->num_slots) * sizeof (uint64_t));
+    lt->series = series;
+    lt->num_slots = num_slots;
+    return slot;
+}
+
+/**
+ * Count `count` consecutive lost ids, at the time of the last id received before them.
+ */
+static inline void loss_tracker_count_lost (struct loss_tracker *lt, uint64_t count)
+{
+    lt->lost += count;
+    lt->burst += count;
+    // The slot first, the series may move when it grows
+    const uint32_t slot = loss_tracker_slot (lt, lt->last_time);
+    lt->series[slot] += count;
+}
+
+static inline void loss_tracker_end_burst (struct loss_tracker *lt)
+{
+    lt->longest_burst = max (lt->longest_burst, lt->burst);
+    lt->burst = 0;
+}
+
+/**
+ * Account for the ids of the word starting at `first_id` whose bit is set in `missing`, in order.
+ */
+static void loss_tracker_evict_word (struct loss_tracker *lt, uint64_t first_id, uint64_t missing)
+{
+    if (LIKELY (missing == 0))
+    {
+        loss_tracker_end_burst (lt);
+        if (lt->times)
+            lt->last_time = lt->times[(first_id + 63) & (LOSS_WINDOW_BITS - 1)];
+        return;
+    }
+    if (missing == UINT64_MAX)
+    {
+        loss_tracker_count_lost (lt, 64);
+        return;
+    }
+
+    for (uint32_t b = 0; b < 64; ++b)
+    {
+        if (missing & (1ULL << b))
+        {
+            loss_tracker_count_lost (lt, 1);
+        }
+        else
+        {
+            loss_tracker_end_burst (lt);
+            if (lt->times)
+                lt->last_time = lt->times[(first_id + b) & (LOSS_WINDOW_BITS - 1)];
+        }
+    }
+}
+
+void loss_tracker_slide (struct loss_tracker *lt, uint64_t id)
+{
+    // Lowest base such that `id` falls in the window
+    const uint64_t new_base = (id / 64 + 1) * 64 - LOSS_WINDOW_BITS;
+    const uint64_t window_end = lt->base + LOSS_WINDOW_BITS;
+
+    for (uint64_t first_id = lt->base; first_id < new_base && first_id < window_end; first_id += 64)
+    {
+        uint64_t *word = &lt->words[(first_id / 64) & (LOSS_WINDOW_WORDS - 1)];
+        loss_tracker_evict_word (lt, first_id, ~*word);
+        *word = 0;
+    }
+
+    // A jump longer than the window: the ids between the old window and the new one were never seen
+    if (new_base > window_end)
+        loss_tracker_count_lost (lt, new_base - window_end);
+
+    lt->base = new_base;
+}
+
+void loss_tracker_finish (struct loss_tracker *lt, uint64_t last_id)
+{
+    last_id = max (last_id, lt->highest);
+
+    for (uint64_t first_id = lt->base; first_id <= last_id && first_id < lt->base + LOSS_WINDOW_BITS; first_id += 64)
+    {
+        uint64_t missing = ~lt->words[(first_id / 64) & (LOSS_WINDOW_WORDS - 1)];
+        // Only the ids up to `last_id` were sent
+        if (last_id - first_id < 63)
+            missing &= (2ULL << (last_id - first_id)) - 1;
+        loss_tracker_evict_word (lt, first_id, missing);
+    }
+
+    const uint64_t window_end = lt->base + LOSS_WINDOW_BITS;
+    if (last_id >= window_end)
+        loss_tracker_count_lost (lt, last_id - window_end + 1);
+
+    loss_tracker_end_burst (lt);
+    memset (lt->words, 0xff, sizeof (lt->words));
+    lt->base = last_id + 1;
+}
+
+void loss_tracker_print (const struct loss_tracker *lt, FILE *file)
+{
+    fprintf (file, "RECEIVED %lu\n", lt->received);
+    fprintf (file, "HIGHEST %lu\n", lt->highest);
+    fprintf (file, "LOST %lu\n", lt->lost);
+    fprintf (file, "LATE %lu\n", lt->late);
+    fprintf (file, "REORDERED %lu\n", lt->reordered);
+    fprintf (file, "DUPLICATED %lu\n", lt->duplicated);
+    fprintf (file, "LONGEST_BURST %lu\n", lt->longest_burst);
+    fprintf (file, "SERIES %lu\n", lt->slot_ns);
+    for (uint32_t i = 0; i < lt->num_slots; ++i)
+    {
+        if (lt->series[i])
+            fprintf (file, "%u %lu\n", i, lt->series[i]);
+    }
+}
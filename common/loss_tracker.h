@@ -0,0 +1,129 @@
+/**
+ * Tracker of lost, late, reordered and duplicated rounds, based on their ids.
+ *
+ * The ids of the last LOSS_WINDOW_BITS rounds are kept in a sliding bitmap of 64-bit words. A round received in the
+ * window is either new, reordered (below the highest id received) or duplicated (its bit is already set).
+ * When the window slides forward, the ids that leave it without having been received are counted as lost, and the
+ * rounds received below the window afterwards are counted as late. The sliding is done one word at a time, so
+ * in the common case (in-order rounds) recording a round only sets a bit.
+ *
+ * The lost rounds are also counted in a series of windows of time, placed by the intended send time of the rounds.
+ * A lost round never arrives, so it takes the time of the last round received before it, or of the first round
+ * received if none was; the windows start at the time of the first round received.
+ */
+#pragma once
+
+#include "common.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Number of ids tracked by the window, must be a multiple of 64 and a power of 2 */
+#define LOSS_WINDOW_BITS 4096
+#define LOSS_WINDOW_WORDS (LOSS_WINDOW_BITS / 64)
+/* Highest number of slots of the loss series, the later losses are counted in the last one */
+#define LOSS_MAX_SLOTS (1 << 20)
+
+struct loss_tracker {
+    // Ring of the words of the window, the bit of id `i` is bit i % 64 of word (i / 64) % LOSS_WINDOW_WORDS
+    uint64_t words[LOSS_WINDOW_WORDS];
+    // First id of the window, a multiple of 64
+    uint64_t base;
+    uint64_t highest;
+
+    uint64_t received;
+    uint64_t lost;
+    uint64_t late;
+    uint64_t reordered;
+    uint64_t duplicated;
+
+    // Current and longest run of consecutive lost ids
+    uint64_t burst;
+    uint64_t longest_burst;
+
+    // Lost ids per slot of `slot_ns` nanoseconds, from `origin`; a single slot if `slot_ns` is 0
+    uint64_t slot_ns;
+    uint64_t origin;
+    uint32_t num_slots;
+    uint64_t *series;
+    // Intended send time of the received ids of the window, in the same ring as `words`; NULL without a series
+    uint64_t *times;
+    // Time of the last id received before the ones being evicted
+    uint64_t last_time;
+    bool timed;
+};
+
+/**
+ * Initialize the tracker. The ids are expected to start from 1.
+ *
+ * @param lt the tracker to initialize
+ * @param slot_ns duration of each slot of the loss series in nanoseconds, 0 for no series
+ * @param duration expected duration of the run in nanoseconds, to size the loss series; the series grows if the
+ *        run lasts longer
+ * @return 0 on success, -1 on error
+ */
+int loss_tracker_init (struct loss_tracker *lt, uint64_t slot_ns, uint64_t duration);
+
+void loss_tracker_destroy (struct loss_tracker *lt);
+
+/**
+ * Slide the window forward so that `id` falls in it, counting the ids that leave it without having been received.
+ */
+void loss_tracker_slide (struct loss_tracker *lt, uint64_t id);
+
+/**
+ * Record the reception of round `id`, intended to be sent at `time`, in nanoseconds from any origin.
+ */
+static inline void loss_tracker_add (struct loss_tracker *lt, uint64_t id, uint64_t time)
+{
+    lt->received++;
+
+    if (UNLIKELY (id < lt->base))
+    {
+        lt->late++;
+        return;
+    }
+    if (UNLIKELY (id >= lt->base + LOSS_WINDOW_BITS))
+        loss_tracker_slide (lt, id);
+
+    uint64_t *word = &lt->words[(id / 64) & (LOSS_WINDOW_WORDS - 1)];
+    const uint64_t bit = 1ULL << (id % 64);
+    if (UNLIKELY (id <= lt->highest))
+    {
+        if (*word & bit)
+        {
+            lt->duplicated++;
+            return;
+        }
+        lt->reordered++;
+    }
+    else
+    {
+        lt->highest = id;
+    }
+    *word |= bit;
+
+    if (lt->times)
+    {
+        if (UNLIKELY (!lt->timed))
+        {
+            lt->origin = time;
+            lt->last_time = time;
+            lt->timed = true;
+        }
+        lt->times[id & (LOSS_WINDOW_BITS - 1)] = time;
+    }
+}
+
+/**
+ * Count as lost all the ids up to `last_id` that were not received. The tracker must not be used afterwards.
+ *
+ * @param lt the tracker
+ * @param last_id the last id that was sent; if lower than the highest id received, the latter is used
+ */
+void loss_tracker_finish (struct loss_tracker *lt, uint64_t last_id);
+
+/**
+ * Print the counters, one per line, followed by the slots of the loss series with at least one lost id.
+ */
+void loss_tracker_print (const struct loss_tracker *lt, FILE *file);
@@ -175,6 +175,201 @@ int exchange_data (const char *server_ip, bool is_server, uint32_t packet_size,
     return 0;
 }
 
+/**
+ * Message of the readiness handshake. The times are in nanoseconds of CLOCK_REALTIME, in network byte order.
+ */
+struct sync_message {
+    uint32_t magic;
+    uint32_t type;
+    // HELLO: earliest start proposed by the client; READY: start agreed by the server
+    uint64_t start;
+    // HELLO: alignment of the start, 0 for none
+    uint64_t align;
+};
+
+enum sync_type {
+    SYNC_HELLO = 1,
+    SYNC_READY = 2,
+};
+
+static bool sync_message_is (const struct sync_message *message, int len, enum sync_type type)
+{
+    return len == sizeof (struct sync_message) && message->magic == PINGPONG_MAGIC && message->type == type;
+}
+
+static uint64_t realtime_ns (void)
+{
+    struct timespec t;
+    clock_gettime (CLOCK_REALTIME, &t);
+    return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+// Socket and thread answering the HELLOs, and the start agreed with the client, see `sync_server_start`
+static int sync_server_sock = -1;
+static pthread_t sync_server_thread;
+static _Atomic uint64_t sync_server_agreed;
+
+static void *sync_server_answer (void *arg __unused)
+{
+    // Every HELLO gets the start agreed for the first one, so that a lost READY is recovered by the next HELLO
+    uint64_t agreed = 0;
+    atomic_store (&sync_server_agreed, 0);
+    while (true)
+    {
+        struct sync_message message;
+        struct sockaddr_in client_addr;
+        socklen_t client_addr_len = sizeof (struct sockaddr_in);
+        int ret = recvfrom (sync_server_sock, &message, sizeof (message), 0, (struct sockaddr *) &client_addr, &client_addr_len);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            fprintf (stderr, "ERR: the readiness handshake stopped: %s\n", strerror (errno));
+            return NULL;
+        }
+        if (!sync_message_is (&message, ret, SYNC_HELLO))
+            continue;
+
+        if (agreed == 0)
+        {
+            // Not before the client proposes, nor before the server can take a ping
+            const uint64_t align = be64toh (message.align);
+            agreed = max (be64toh (message.start), realtime_ns () + SYNC_START_LEAD_NS);
+            if (align && agreed % align)
+                agreed += align - agreed % align;
+            atomic_store (&sync_server_agreed, agreed);
+        }
+
+        message.type = SYNC_READY;
+        message.start = htobe64 (agreed);
+        message.align = 0;
+        if (sendto (sync_server_sock, &message, sizeof (message), 0, (struct sockaddr *) &client_addr, client_addr_len) < 0)
+            fprintf (stderr, "WARN: could not answer the HELLO of the client: %s\n", strerror (errno));
+    }
+    return NULL;
+}
+
+int sync_server_start (void)
+{
+    int sock = socket (AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0)
+    {
+        fprintf (stderr, "ERR: socket: %s\n", strerror (errno));
+        return -1;
+    }
+
+    struct sockaddr_in local_addr;
+    local_addr.sin_family = AF_INET;
+    local_addr.sin_port = htons (SYNC_PORT);
+    local_addr.sin_addr.s_addr = INADDR_ANY;
+    if (bind (sock, (struct sockaddr *) &local_addr, sizeof (struct sockaddr_in)) < 0)
+    {
+        fprintf (stderr, "ERR: could not bind the readiness handshake to port %d: %s\n", SYNC_PORT, strerror (errno));
+        close (sock);
+        return -1;
+    }
+
+    sync_server_sock = sock;
+    int ret = pthread_create (&sync_server_thread, NULL, sync_server_answer, NULL);
+    if (ret != 0)
+    {
+        fprintf (stderr, "ERR: could not start the readiness handshake: %s\n", strerror (ret));
+        close (sock);
+        sync_server_sock = -1;
+        return -1;
+    }
+    return 0;
+}
+
+void sync_server_wait (void)
+{
+    const struct timespec poll = {.tv_sec = 0, .tv_nsec = SYNC_RETRY_NS};
+    uint64_t agreed;
+    while (!(agreed = atomic_load (&sync_server_agreed)))
+        nanosleep (&poll, NULL);
+
+    // A client whose READY was lost resends its HELLO within SYNC_RETRY_NS: keep answering for a few of them
+    const uint64_t until = agreed + 10 * SYNC_RETRY_NS;
+    for (uint64_t now = realtime_ns (); now < until; now = realtime_ns ())
+    {
+        const uint64_t left = until - now;
+        const struct timespec t = {.tv_sec = left / 1000000000UL, .tv_nsec = left % 1000000000UL};
+        nanosleep (&t, NULL);
+    }
+}
+
+void sync_server_stop (void)
+{
+    if (sync_server_sock < 0)
+        return;
+
+    // The thread is blocked in recvfrom, a cancellation point
+    pthread_cancel (sync_server_thread);
+    pthread_join (sync_server_thread, NULL);
+    close (sync_server_sock);
+    sync_server_sock = -1;
+}
+
+int sync_client_ready (const char *server_ip, uint64_t start, uint64_t align, uint64_t *agreed)
+{
+    // No bind: an ephemeral port lets the client and the server share a machine
+    int sock = socket (AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0)
+    {
+        fprintf (stderr, "ERR: socket: %s\n", strerror (errno));
+        return -1;
+    }
+
+    // The server may not be listening yet, or a datagram may be lost: resend HELLO until it answers
+    struct timeval timeout = {.tv_sec = 0, .tv_usec = SYNC_RETRY_NS / 1000};
+    if (setsockopt (sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof (timeout)) < 0)
+    {
+        fprintf (stderr, "ERR: setsockopt: %s\n", strerror (errno));
+        close (sock);
+        return -1;
+    }
+
+    struct sockaddr_in server_addr;
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons (SYNC_PORT);
+    server_addr.sin_addr.s_addr = inet_addr (server_ip);
+
+    const uint64_t give_up = get_time_ns () + SYNC_TIMEOUT_NS;
+    while (get_time_ns () < give_up)
+    {
+        struct sync_message message = {
+            .magic = PINGPONG_MAGIC,
+            .type = SYNC_HELLO,
+            .start = htobe64 (start),
+            .align = htobe64 (align),
+        };
+        if (sendto (sock, &message, sizeof (message), 0, (struct sockaddr *) &server_addr, sizeof (struct sockaddr_in)) < 0)
+        {
+            fprintf (stderr, "ERR: sendto: %s\n", strerror (errno));
+            close (sock);
+            return -1;
+        }
+
+        int ret = recvfrom (sock, &message, sizeof (message), 0, NULL, NULL);
+        if (ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && errno != ECONNREFUSED)
+        {
+            fprintf (stderr, "ERR: recvfrom: %s\n", strerror (errno));
+            close (sock);
+            return -1;
+        }
+        if (sync_message_is (&message, ret, SYNC_READY))
+        {
+            *agreed = be64toh (message.start);
+            close (sock);
+            return 0;
+        }
+    }
+
+    fprintf (stderr, "ERR: the server at %s did not become ready\n", server_ip);
+    close (sock);
+    return -1;
+}
+
 int exchange_eth_ip_addresses (const int ifindex, const char *restrict server_ip, bool is_server,
                                uint8_t *restrict src_mac, uint8_t *restrict dest_mac,
                                uint32_t *restrict src_ip, uint32_t *restrict dest_ip)
@@ -251,6 +446,7 @@ inline int send_pingpong_packet (int sock, const char *restrict buf, struct sock
 }
 
 struct sender_data {
+    uint32_t flow;
     uint64_t iters;
     uint64_t interval;
     char *base_packet;
@@ -259,113 +455,455 @@ struct sender_data {
     send_packet_t send_packet;
     // auxiliary data for the send function
     void *aux;
+    // departure time of each packet relative to the first one, NULL for one packet every interval
+    uint64_t *offsets;
+    struct sender_schedule schedule;
+    // Closed loop: lowest id that may still be in flight, see `sender_expire_oldest`
+    uint64_t oldest;
+    // where the thread runs, set when it is created
+    struct thread_placement placement;
+    pthread_t thread;
 };
 
-int stick_this_thread_to_core (int core_id)
+static struct sender_data senders[PINGPONG_MAX_FLOWS];
+static uint32_t num_senders = 1;
+
+struct sender_pongs sender_pongs[PINGPONG_MAX_FLOWS];
+volatile bool sender_failed = false;
+uint32_t sender_window = 0;
+
+// Placement of the sender of the first flow, see `sender_set_placement`
+static struct thread_placement sender_placement = {.core = -1, .policy = -1, .priority = -1};
+
+// Server to wait for before the first packet, and alignment of the start time, see `sender_set_start`
+static const char *sender_server_ip = NULL;
+static uint64_t sender_start_align = 0;
+// Start time of the flows, published once the server is ready; 0 until then
+static _Atomic uint64_t sender_start;
+
+/**
+ * Placement of the sender of `flow`: the explicit one of `sender_set_placement`, shifted by the flow, or by default
+ * the core following the one of the main thread, one per flow, if the main thread is pinned to a single core of a
+ * larger machine, i.e. we are running a test with isolation.
+ *
+ * @return 0 on success, -1 if the core of the sender is not online
+ */
+static int sender_flow_placement (uint32_t flow, struct thread_placement *placement)
 {
-    printf("Setting thread affinity to core %d\n", core_id);
-    int num_cores = sysconf (_SC_NPROCESSORS_ONLN);
-    if (core_id < 0 || core_id >= num_cores)
-        return -EINVAL;
+    bool online[CPU_SETSIZE];
+    char buf[256];
+    FILE *f = fopen ("/sys/devices/system/cpu/online", "r");
+    if (f == NULL || fgets (buf, sizeof (buf), f) == NULL || parse_cpu_list (buf, online, CPU_SETSIZE) != 0)
+    {
+        // Assume the cores are numbered from 0
+        const long num_cores = sysconf (_SC_NPROCESSORS_ONLN);
+        for (int i = 0; i < CPU_SETSIZE; ++i)
+            online[i] = i < num_cores;
+    }
+    if (f)
+        fclose (f);
 
-    cpu_set_t cpuset;
-    CPU_ZERO (&cpuset);
-    CPU_SET (core_id, &cpuset);
+    *placement = sender_placement;
+    if (placement->core >= 0)
+    {
+        placement->core += flow;
+    }
+    else
+    {
+        cpu_set_t current_mask;
+        if (sched_getaffinity (0, sizeof (cpu_set_t), &current_mask) < 0)
+        {
+            fprintf (stderr, "ERR: sched_getaffinity failed: %s\n", strerror (errno));
+            return -1;
+        }
+        int num_online = 0;
+        for (int i = 0; i < CPU_SETSIZE; ++i)
+            num_online += online[i];
+        // A single core that is the whole machine is not a test with isolation: leave the sender with the main thread
+        if (CPU_COUNT (&current_mask) != 1 || num_online <= 1)
+            return 0;
+        for (int i = 0; i < CPU_SETSIZE; ++i)
+        {
+            if (CPU_ISSET (i, &current_mask))
+                placement->core = i + 1 + flow;
+        }
+    }
 
-    pthread_t current_thread = pthread_self ();
-    return pthread_setaffinity_np (current_thread, sizeof (cpu_set_t), &cpuset);
+    if (placement->core >= CPU_SETSIZE || !online[placement->core])
+    {
+        fprintf (stderr, "ERR: the sender of flow %u would run on core %d, which is not online; place it with -P tx=<core>\n",
+                 flow, placement->core);
+        return -1;
+    }
+    return 0;
 }
 
-void *thread_send_packets (void *args)
+/**
+ * Measure the wake-up latency of absolute timers on the calling thread, to size the guard band of the sender.
+ */
+static uint64_t sender_calibrate_guard (void)
 {
-    sleep(2);
-    cpu_set_t current_mask;
-    if (sched_getaffinity (0, sizeof (cpu_set_t), &current_mask) < 0)
+    uint64_t worst = 0;
+    for (int i = 0; i < SENDER_GUARD_SAMPLES; ++i)
     {
-        PERROR ("sched_getaffinity");
-        return NULL;
+        const uint64_t deadline = get_time_ns () + SENDER_GUARD_PROBE_NS;
+        struct timespec t;
+        t.tv_sec = deadline / 1000000000;
+        t.tv_nsec = deadline % 1000000000;
+        clock_nanosleep (TIMESTAMP_CLOCK, TIMER_ABSTIME, &t, NULL);
+
+        const uint64_t now = get_time_ns ();
+        if (now > deadline)
+            worst = max (worst, now - deadline);
     }
-    // set the thread affinity to the next thread
-    int core_id = 0;
-    int cnt = 0;
-    for (int i = 0; i < CPU_SETSIZE; ++i)
+
+    // Margin for the wake-ups slower than the ones observed
+    const uint64_t guard = worst + worst / 2;
+    return min (max (guard, SENDER_MIN_GUARD_NS), SENDER_MAX_GUARD_NS);
+}
+
+/**
+ * Consider the oldest ping of the flow still in flight lost, unless its pong comes in the meantime.
+ */
+static void sender_expire_oldest (struct sender_data *data, uint64_t sent)
+{
+    struct sender_pongs *pongs = &sender_pongs[data->flow];
+    // The slots of the pings older than the history have been reused, see `sender_track_ping`
+    for (uint64_t id = max (data->oldest, sent > pongs->mask ? sent - pongs->mask : 1); id <= sent; ++id)
     {
-        if (CPU_ISSET (i, &current_mask))
+        uint64_t expected = id;
+        if (atomic_compare_exchange_strong_explicit (&pongs->slots[id & pongs->mask], &expected, 0, memory_order_acq_rel, memory_order_relaxed))
         {
-            core_id = i + 1;
-            ++cnt;
+            data->schedule.expired++;
+            data->oldest = id + 1;
+            return;
         }
     }
-    // set the sending thread affinity only if the main thread is pinned to a single core
-    // i.e. we are running a test with isolation.
-    if (cnt == 1 && stick_this_thread_to_core (core_id) < 0)
+    data->oldest = sent + 1;
+}
+
+/**
+ * Record that ping `id` is in flight, in the slot of the ping sent a whole history before, which is considered lost
+ * if it is still in flight.
+ */
+static void sender_track_ping (struct sender_data *data, uint64_t id)
+{
+    struct sender_pongs *pongs = &sender_pongs[data->flow];
+    if (atomic_exchange_explicit (&pongs->slots[id & pongs->mask], id, memory_order_acq_rel) != 0)
+        data->schedule.expired++;
+}
+
+/**
+ * Wait until the flow has fewer than `sender_window` pings in flight, `sent` being the number of pings sent so far.
+ *
+ * @return the time at which the window let the next ping go
+ */
+static uint64_t sender_wait_window (struct sender_data *data, uint64_t sent)
+{
+    struct sender_schedule *schedule = &data->schedule;
+    uint64_t answered = atomic_load_explicit (&sender_pongs[data->flow].count, memory_order_relaxed);
+    uint64_t now = get_time_ns ();
+    uint64_t progress = now;
+    while (sent > answered + schedule->expired && sent - answered - schedule->expired >= sender_window)
     {
-        PERROR ("stick_this_thread_to_core");
-        return NULL;
+        // The wait does not go through any cancellation point, and the pongs may never come
+        pthread_testcancel ();
+        now = get_time_ns ();
+        const uint64_t current = atomic_load_explicit (&sender_pongs[data->flow].count, memory_order_relaxed);
+        if (current != answered)
+        {
+            answered = current;
+            progress = now;
+        }
+        else if (UNLIKELY (now - progress > SENDER_WINDOW_TIMEOUT_NS))
+        {
+            sender_expire_oldest (data, sent);
+            progress = now;
+        }
     }
 
+    return now;
+}
+
+/**
+ * Stop the sender of `flow` before its last ping, see `sender_failed`.
+ */
+static void *sender_fail (uint32_t flow, const char *what)
+{
+    fprintf (stderr, "ERR: the sender of flow %u stopped: %s\n", flow, what);
+    sender_failed = true;
+    return NULL;
+}
+
+void *thread_send_packets (void *args)
+{
     struct sender_data *data = (struct sender_data *) args;
+    if (placement_verify (pthread_self (), PLACEMENT_TX, data->flow, &data->placement, 0) != 0)
+        return sender_fail (data->flow, "not placed as requested");
+
+    struct sender_schedule *schedule = &data->schedule;
 
+    // Wake up from the timers as precisely as the kernel allows
+    prctl (PR_SET_TIMERSLACK, 1UL);
+    schedule->interval = data->interval;
+    schedule->guard = sender_calibrate_guard ();
+
+    // Wait for the server to be ready; the handshake is done by the main thread, see `start_sending_packets`
+    uint64_t start;
+    while (!(start = atomic_load (&sender_start)))
+    {
+        pthread_testcancel ();
+        sched_yield ();
+    }
+    start = max (start, get_time_ns ());
     for (uint64_t id = 1; id <= data->iters; ++id)
     {
-        uint64_t __start = get_time_ns ();
-        int ret = data->send_packet (data->base_packet, id, data->sock_addr, data->aux);
+        uint64_t deadline = start + (data->offsets ? data->offsets[id - 1] : (id - 1) * data->interval);
+        // In closed loop, the lateness is counted from when the window lets the ping go
+        if (sender_window)
+            deadline = max (deadline, sender_wait_window (data, id - 1));
+        pp_sleep_until (deadline, schedule->guard);
+        if (sender_window)
+            sender_track_ping (data, id);
+
+        const uint64_t lateness = get_time_ns () - deadline;
+        int ret = data->send_packet (data->base_packet, id, data->flow, deadline, data->sock_addr, data->aux);
         if (ret < 0)
+            return sender_fail (data->flow, "could not send a ping");
+
+        schedule->sends++;
+        if (UNLIKELY (lateness > data->interval && !sender_window))
+            schedule->late++;
+        hdr_record (&schedule->lateness, lateness);
+    }
+
+    return NULL;
+}
+
+/**
+ * Wait for the server to be ready and publish the start time of the flows, see `sender_set_start`.
+ */
+static int sender_synchronize_start (void)
+{
+    // Proposed start, in CLOCK_REALTIME: the next multiple of the alignment, if any
+    uint64_t start = realtime_ns ();
+    if (sender_start_align)
+        start += sender_start_align - start % sender_start_align;
+    if (sender_server_ip && sync_client_ready (sender_server_ip, start, sender_start_align, &start) != 0)
+        return -1;
+
+    // Converted to the domain of the timestamps; a start already past, e.g. after a slow handshake, is now
+    const uint64_t now = realtime_ns ();
+    const uint64_t ts = get_time_ns ();
+    atomic_store (&sender_start, start > now ? ts + (start - now) : ts);
+    return 0;
+}
+
+int start_sending_packets (uint64_t iters, uint64_t interval, char *base_packet, struct sockaddr_ll *sock_addr, send_packet_t send_packet, void *aux)
+{
+    atomic_store (&sender_start, 0);
+    sender_failed = false;
+    for (uint32_t flow = 0; flow < num_senders; ++flow)
+    {
+        struct sender_data *data = &senders[flow];
+
+        hdr_destroy (&data->schedule.lateness);
+        memset (&data->schedule, 0, sizeof (data->schedule));
+        if (hdr_init (&data->schedule.lateness, 3, SENDER_LATENESS_HIGHEST) != 0)
+            return -1;
+
+        atomic_store (&sender_pongs[flow].count, 0);
+        free (sender_pongs[flow].slots);
+        sender_pongs[flow].slots = NULL;
+        if (sender_window)
         {
-            PERROR ("data->send_packet");
-            return NULL;
+            uint64_t slots = 1;
+            while (slots < (uint64_t) sender_window * SENDER_WINDOW_HISTORY)
+                slots <<= 1;
+            sender_pongs[flow].slots = calloc (slots, sizeof (uint64_t));
+            if (sender_pongs[flow].slots == NULL)
+                return -1;
+            sender_pongs[flow].mask = slots - 1;
+        }
+        data->oldest = 1;
+        data->flow = flow;
+        data->iters = iters;
+        data->interval = data->interval ? data->interval : interval;
+        data->send_packet = send_packet;
+        data->aux = aux;
+
+        // Each flow builds its packets in its own copy of the base packet
+        data->base_packet = NULL;
+        data->sock_addr = NULL;
+        if (base_packet)
+        {
+            data->base_packet = malloc (PACKET_SIZE);
+            memcpy (data->base_packet, base_packet, PACKET_SIZE);
+        }
+        if (sock_addr)
+        {
+            data->sock_addr = malloc (sizeof (struct sockaddr_ll));
+            memcpy (data->sock_addr, sock_addr, sizeof (struct sockaddr_ll));
+        }
+
+        if (sender_flow_placement (flow, &data->placement) != 0)
+        {
+            stop_sending_packets ();
+            return -1;
+        }
+
+        pthread_attr_t attr;
+        pthread_attr_init (&attr);
+        int ret = placement_set_attr (&data->placement, 0, &attr);
+        if (ret == 0)
+            ret = pthread_create (&data->thread, &attr, thread_send_packets, data);
+        pthread_attr_destroy (&attr);
+        if (ret != 0)
+        {
+            fprintf (stderr, "ERR: could not start the sender of flow %u: %s\n", flow, strerror (ret));
+            stop_sending_packets ();
+            return -1;
         }
-        uint64_t interval = get_time_ns () - __start;
-        if (interval < data->interval)
-            pp_sleep (data->interval - interval);
     }
 
-    free (data->base_packet);
-    free (data->sock_addr);
+    // The threads calibrate their guard band during the handshake
+    if (sender_synchronize_start () != 0)
+    {
+        stop_sending_packets ();
+        return -1;
+    }
 
-    return NULL;
+    return 0;
 }
 
-static pthread_t sender_thread;
+void stop_sending_packets (void)
+{
+    for (uint32_t flow = 0; flow < num_senders; ++flow)
+    {
+        struct sender_data *data = &senders[flow];
+        if (data->thread)
+        {
+            pthread_cancel (data->thread);
+            pthread_join (data->thread, NULL);
+            data->thread = 0;
+        }
 
-int start_sending_packets (uint64_t iters, uint64_t interval, char *base_packet, struct sockaddr_ll *sock_addr, send_packet_t send_packet, void *aux)
+        free (data->base_packet);
+        free (data->sock_addr);
+        free (data->offsets);
+        data->base_packet = NULL;
+        data->sock_addr = NULL;
+        data->offsets = NULL;
+    }
+}
+
+void sender_set_window (uint32_t window)
 {
-    struct sender_data *data = malloc (sizeof (struct sender_data));
-    if (!data)
+    sender_window = window;
+}
+
+void sender_set_placement (const struct thread_placement *placement)
+{
+    sender_placement = *placement;
+}
+
+void sender_set_start (const char *server_ip, uint64_t align)
+{
+    sender_server_ip = server_ip;
+    sender_start_align = align;
+}
+
+int sender_set_flows (uint32_t num_flows, const uint64_t *intervals)
+{
+    if (num_flows > PINGPONG_MAX_FLOWS)
     {
-        PERROR ("malloc");
+        LOG (stderr, "ERROR: At most %d flows are supported\n", PINGPONG_MAX_FLOWS);
         return -1;
     }
 
-    data->iters = iters;
-    data->interval = interval;
-    data->send_packet = send_packet;
-    data->aux = aux;
+    num_senders = max (num_flows, 1U);
+    for (uint32_t flow = 0; flow < num_senders; ++flow)
+        senders[flow].interval = intervals ? intervals[flow] : 0;
+    return 0;
+}
+
+int sender_set_arrival (const char *spec, uint64_t iters, uint64_t interval)
+{
+    struct arrival arrival;
+    if (arrival_parse (spec, &arrival) != 0)
+        return -1;
 
-    data->base_packet = NULL;
-    data->sock_addr = NULL;
-    if (base_packet)
+    const uint64_t seed = arrival.seed;
+    for (uint32_t flow = 0; flow < num_senders; ++flow)
     {
-        data->base_packet = malloc (PACKET_SIZE);
-        memcpy (data->base_packet, base_packet, PACKET_SIZE);
+        struct sender_data *data = &senders[flow];
+        // The random processes of the flows must not be correlated
+        arrival.seed = seed + flow;
+
+        free (data->offsets);
+        if (arrival_schedule (&arrival, iters, data->interval ? data->interval : interval, &data->offsets) != 0)
+            return -1;
     }
-    if (sock_addr)
+
+    return 0;
+}
+
+int sender_set_sweep (const struct sweep *sweep)
+{
+    for (uint32_t flow = 0; flow < num_senders; ++flow)
     {
-        data->sock_addr = malloc (sizeof (struct sockaddr_ll));
-        memcpy (data->sock_addr, sock_addr, sizeof (struct sockaddr_ll));
+        struct sender_data *data = &senders[flow];
+        free (data->offsets);
+        if (sweep_schedule (sweep, &data->offsets) != 0)
+            return -1;
     }
 
-    int ret = pthread_create (&sender_thread, NULL, thread_send_packets, data);
-    if (ret < 0)
+    return 0;
+}
+
+static int sender_write_flow_schedule (const char *filename, const struct sender_schedule *schedule)
+{
+    FILE *file = stdout;
+    if (filename)
     {
-        PERROR ("pthread_create");
-        return -1;
+        char schedule_filename[PATH_MAX];
+        if (snprintf (schedule_filename, sizeof (schedule_filename), "%s.schedule", filename) >= (int) sizeof (schedule_filename))
+            return -1;
+        file = fopen (schedule_filename, "w");
+        if (file == NULL)
+        {
+            LOG (stderr, "ERROR: Could not open %s\n", schedule_filename);
+            return -1;
+        }
     }
 
+    fprintf (file, "SENDS %lu\n", schedule->sends);
+    fprintf (file, "INTERVAL %lu\n", schedule->interval);
+    fprintf (file, "GUARD %lu\n", schedule->guard);
+    fprintf (file, "LATE %lu\n", schedule->late);
+    fprintf (file, "WINDOW %u\n", sender_window);
+    fprintf (file, "EXPIRED %lu\n", schedule->expired);
+    hdr_print_percentiles (&schedule->lateness, file, "LATENESS");
+    if (file != stdout)
+        hdr_print_percentiles (&schedule->lateness, stdout, "LATENESS");
+    hdr_print_counts (&schedule->lateness, file, "LATENESS");
+
+    if (file != stdout)
+        return fclose (file);
+    fflush (stdout);
     return 0;
 }
 
-pthread_t get_sender_thread (void)
+int sender_write_schedule (const char *filename)
 {
-    return sender_thread;
-}
\ No newline at end of file
+    int ret = 0;
+    for (uint32_t flow = 0; flow < num_senders; ++flow)
+    {
+        char flow_filename[PATH_MAX];
+        if (filename)
+            pp_flow_filename (flow_filename, sizeof (flow_filename), filename, flow, num_senders);
+        if (sender_write_flow_schedule (filename ? flow_filename : NULL, &senders[flow].schedule) != 0)
+            ret = -1;
+    }
+    return ret;
+}
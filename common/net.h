@@ -2,7 +2,11 @@
 
 #define _GNU_SOURCE
 
+#include "arrival.h"
 #include "common.h"
+#include "histogram.h"
+#include "placement.h"
+#include "sweep.h"
 #include "utils.h"
 
 #include <arpa/inet.h>
@@ -12,13 +16,16 @@
 #include <linux/in.h>
 #include <linux/ip.h>
 #include <linux/types.h>
+#include <limits.h>
 #include <net/if.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/prctl.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
@@ -77,24 +84,228 @@ struct sockaddr_ll build_sockaddr (int ifindex, const unsigned char *dest_mac);
  */
 int send_pingpong_packet (int sock, const char *buf, struct sockaddr_ll *sock_addr);
 
-typedef int (*send_packet_t) (char *, uint64_t, struct sockaddr_ll *, void *);
+/**
+ * Build and send the packet `id` of flow `flow`, see `start_sending_packets`.
+ * The first argument is the copy of the base packet owned by the sender thread of the flow, the fourth the time at
+ * which the packet was due, to be stored in the `intended` field of its payload.
+ */
+typedef int (*send_packet_t) (char *, uint64_t, uint32_t, uint64_t, struct sockaddr_ll *, void *);
+
+/* Bounds of the guard band of the sender, i.e. how long before each deadline it stops sleeping and starts spinning */
+#define SENDER_MIN_GUARD_NS 5000UL
+#define SENDER_MAX_GUARD_NS 1000000UL
+/* Sleeps used to measure the wake-up latency of the timer, and their duration */
+#define SENDER_GUARD_SAMPLES 32
+#define SENDER_GUARD_PROBE_NS 200000UL
+/* Highest lateness tracked with full precision by the schedule histogram */
+#define SENDER_LATENESS_HIGHEST (1ULL << 36)
+/* How long a full window waits for a pong before considering its oldest ping lost */
+#define SENDER_WINDOW_TIMEOUT_NS 100000000UL
+/* Pings whose pong is awaited, per flow, in windows: a ping still unanswered after this many windows of later pings
+ * is considered lost */
+#define SENDER_WINDOW_HISTORY 4
+/* Readiness handshake: UDP port of the server (not XDP_UDP_PORT, used by the data path of some programs), interval
+ * between two HELLOs of the client, how long it keeps trying, and the least time between the answer of the server and
+ * the agreed start */
+#define SYNC_PORT 1235
+#define SYNC_RETRY_NS 10000000UL
+#define SYNC_TIMEOUT_NS 60000000000UL
+#define SYNC_START_LEAD_NS 10000000UL
+
+/**
+ * Adherence of the sender to its schedule.
+ * Packet `id` is due at `start + (id - 1) * interval`; its lateness is the time between its deadline and the moment
+ * the sender hands it to `send_packet`. A packet more than one interval late means that the sender fell behind:
+ * the following ones are sent back-to-back until it catches up with the schedule. In closed loop, the deadline of a
+ * ping that waited for room in the window is the moment it got it, see `sender_set_window`, and no ping is late.
+ */
+struct sender_schedule {
+    uint64_t interval;
+    uint64_t guard;
+    uint64_t sends;
+    uint64_t late;
+    // Closed loop: pings considered lost because the window waited too long for their pong
+    uint64_t expired;
+    struct hdr_histogram lateness;
+};
 
 /**
- * Start a thread to send the packets every `interval` microseconds.
- * The thread will send `iters` packets and then exit.
+ * Start a thread per flow (see `sender_set_flows`, one flow by default) to send the packets every `interval`
+ * nanoseconds, or following the arrival process set with `sender_set_arrival`.
+ * Each thread will send `iters` packets, with ids from 1 to `iters`, and then exit. When the main thread is pinned to
+ * a single core, the thread of flow `i` is pinned to the `i + 1`-th following core.
+ * `send_packet` is called concurrently by the threads of the flows, each with its own copy of `base_packet`.
+ * The packets are sent at absolute deadlines, so that a late packet does not delay the following ones; the sender
+ * sleeps until shortly before each deadline and spins for the rest, see `pp_sleep_until`. The guard band is
+ * calibrated when the thread starts, and the lateness of each packet is recorded, see `struct sender_schedule`.
+ * If a server was given to `sender_set_start`, the threads hold the first packet until the server reports that it is
+ * polling (see `sync_client_ready`), and start together at the start time agreed with it.
  *
  * @param iters the number of packets to send
  * @param interval the interval between packets in microseconds
  * @param base_packet the base packet to send
  * @param sock_addr the sockaddr_ll structure to use to send the packets
  * @param send_packet the function to use to send the packets, called by the sending thread.
- * @return 0 on success, -1 on failure
+ * @return 0 on success, -1 on failure, including a server that never became ready; the threads are then cancelled
  */
 int start_sending_packets (uint64_t iters, uint64_t interval, char *base_packet, struct sockaddr_ll *sock_addr, send_packet_t send_packet, void *aux);
 
-#if !SERVER
-pthread_t get_sender_thread (void);
-#endif
+/**
+ * Stop the sender threads, if they are still running, and wait for them.
+ */
+void stop_sending_packets (void);
+
+/**
+ * Set the number of flows of the next `start_sending_packets`. Must be called before `sender_set_arrival`.
+ *
+ * @param num_flows number of flows, at most PINGPONG_MAX_FLOWS; 0 is the same as 1
+ * @param intervals interval of each flow in nanoseconds, 0 or NULL for the interval given to `start_sending_packets`
+ * @return 0 on success, -1 if there are too many flows
+ */
+int sender_set_flows (uint32_t num_flows, const uint64_t *intervals);
+
+/**
+ * Set the arrival process of the next `start_sending_packets`, and compute its schedule.
+ *
+ * @param spec the arrival process, see arrival.h; NULL for one packet every interval
+ * @param iters number of packets that will be sent
+ * @param interval interval between two packets in nanoseconds
+ * @return 0 on success, -1 on error
+ */
+int sender_set_arrival (const char *spec, uint64_t iters, uint64_t interval);
+
+/**
+ * Make the next `start_sending_packets` run the rate sweep `sweep` instead of its arrival process: every flow sends
+ * the packets of all the steps, see sweep.h.
+ *
+ * @param sweep the sweep
+ * @return 0 on success, -1 on error
+ */
+int sender_set_sweep (const struct sweep *sweep);
+
+/**
+ * Make the next `start_sending_packets` run in closed loop: each flow keeps at most `window` pings in flight, and
+ * a ping leaves at the later of its deadline and the moment the window has room for it. The receive path releases
+ * the window with `sender_pong_received`. A window of 1 measures the bare round-trip time, a larger one pipelines
+ * the pings. If the window stays full for SENDER_WINDOW_TIMEOUT_NS, its oldest ping is considered lost, and its pong,
+ * if it comes later, does not release the window again.
+ *
+ * @param window the number of pings in flight per flow, 0 for an open loop (the default)
+ */
+void sender_set_window (uint32_t window);
+
+/**
+ * Make the next `start_sending_packets` wait for the server at `server_ip` to be ready before the first packet.
+ * The flows start at the time agreed with the server, SYNC_START_LEAD_NS after it answers, or, if `align` is not 0, at
+ * a multiple of `align` nanoseconds of CLOCK_REALTIME: clients whose clocks are synchronized (NTP, PTP) then start in
+ * lockstep.
+ *
+ * @param server_ip the IP address of the server, NULL to start right away
+ * @param align alignment of the start time in nanoseconds, 0 for none
+ */
+void sender_set_start (const char *server_ip, uint64_t align);
+
+/**
+ * Place the sender threads of the next `start_sending_packets`, see placement.h: the sender of flow i runs on the core
+ * of `placement` + i. Each sender checks its placement when it starts.
+ *
+ * @param placement the placement of the first sender; its core is -1 to keep the default placement
+ */
+void sender_set_placement (const struct thread_placement *placement);
+
+/**
+ * Write the statistics of the schedule of each flow to `<flow filename>.schedule`, see `pp_flow_filename`, or to
+ * stdout if `filename` is NULL.
+ * Must be called once the sender threads have been stopped.
+ *
+ * @param filename the name of the output file of the run
+ * @return 0 on success, -1 on error
+ */
+int sender_write_schedule (const char *filename);
+
+/**
+ * Number of pongs received by each flow, in a cache line of its own since the receive path writes it while the
+ * sender thread of the flow reads it.
+ */
+struct sender_pongs {
+    _Atomic uint64_t count;
+    // Pings in flight: slot `id & mask` holds `id` until the ping is answered or expires, 0 otherwise
+    _Atomic uint64_t *slots;
+    uint64_t mask;
+} __attribute__ ((aligned (64)));
+
+extern struct sender_pongs sender_pongs[PINGPONG_MAX_FLOWS];
+extern uint32_t sender_window;
+
+// Set when a sender thread stops before its last ping, e.g. because the datapath failed to send; the pongs it did not
+// send will never come, so the loop waiting for them should stop
+extern volatile bool sender_failed;
+
+/**
+ * Let the next ping of `flow` leave in closed loop, see `sender_set_window`. Called by the receive path for each pong.
+ * Only the pong of a ping still in flight counts: the one of a ping that has expired, or a duplicate, is ignored.
+ */
+static inline void sender_pong_received (uint32_t flow, uint64_t id)
+{
+    if (!sender_window)
+        return;
+
+    struct sender_pongs *pongs = &sender_pongs[flow];
+    uint64_t expected = id;
+    if (atomic_compare_exchange_strong_explicit (&pongs->slots[id & pongs->mask], &expected, 0, memory_order_acq_rel, memory_order_relaxed))
+        atomic_fetch_add_explicit (&pongs->count, 1, memory_order_relaxed);
+}
+
+/**
+ * Progress of the flows of a run, to know when every flow has received its last packet.
+ * The client knows the number of flows; the server discovers them as their packets arrive, and considers the run
+ * finished when all the flows seen so far are.
+ */
+struct flow_progress {
+    uint64_t iters;
+    uint32_t num_flows;
+    uint32_t seen;
+    uint32_t done;
+    uint64_t last_id[PINGPONG_MAX_FLOWS];
+};
+
+/**
+ * @param num_flows number of flows of the run, 0 if unknown (on the server)
+ */
+static inline void flow_progress_init (struct flow_progress *progress, uint64_t iters, uint32_t num_flows)
+{
+    memset (progress, 0, sizeof (struct flow_progress));
+    progress->iters = iters;
+    progress->num_flows = num_flows;
+}
+
+/**
+ * Record the reception of a packet.
+ *
+ * @return false if the flow of the packet is not valid, in which case the packet must be ignored
+ */
+static inline bool flow_progress_update (struct flow_progress *progress, const struct pingpong_payload *payload)
+{
+    const uint32_t flow = payload->flow;
+    if (UNLIKELY (flow >= (progress->num_flows ? progress->num_flows : PINGPONG_MAX_FLOWS)))
+        return false;
+
+    const uint64_t last_id = progress->last_id[flow];
+    if (UNLIKELY (last_id == 0))
+        progress->seen++;
+    if (payload->id > last_id)
+    {
+        progress->last_id[flow] = payload->id;
+        if (last_id < progress->iters && payload->id >= progress->iters)
+            progress->done++;
+    }
+    return true;
+}
+
+static inline bool flow_progress_finished (const struct flow_progress *progress)
+{
+    return progress->done > 0 && progress->done == (progress->num_flows ? progress->num_flows : progress->seen);
+}
 
 /**
  * Retrieve the local interface MAC address.
@@ -154,3 +365,38 @@ int exchange_eth_ip_addresses (const int ifindex, const char *server_ip, bool is
  * @return
  */
 int exchange_data (const char *server_ip, bool is_server, uint32_t packet_size, uint8_t *buffer, uint8_t *out_buffer);
+
+/**
+ * Server side of the readiness handshake: answer every HELLO of the client on UDP port SYNC_PORT with READY and the
+ * agreed start of the flows, from a thread of its own until `sync_server_stop`. The start is the one proposed by the
+ * first HELLO, delayed to at least SYNC_START_LEAD_NS from then and aligned as the client asks; the later HELLOs,
+ * resent by a client whose READY was lost, get the same one.
+ * To be called once the server is set up, right before it starts polling, so that the first ping of the client finds
+ * it ready.
+ *
+ * @return 0 on success, -1 on failure
+ */
+int sync_server_start (void);
+
+/**
+ * Wait until the client has been answered and the agreed start has passed, for a server that has no loop of its own
+ * to run until the last ping, see `sync_server_start`.
+ */
+void sync_server_wait (void);
+
+/**
+ * Stop answering the HELLOs, see `sync_server_start`.
+ */
+void sync_server_stop (void);
+
+/**
+ * Client side of the readiness handshake: send HELLO to the server every SYNC_RETRY_NS until it answers READY, for at
+ * most SYNC_TIMEOUT_NS. The server may be started after the client.
+ *
+ * @param server_ip the IP address of the server
+ * @param start the earliest start proposed to the server, in nanoseconds of CLOCK_REALTIME
+ * @param align alignment of the start in nanoseconds, 0 for none
+ * @param agreed the start agreed by the server, in nanoseconds of CLOCK_REALTIME
+ * @return 0 once the server is ready, -1 on failure or timeout
+ */
+int sync_client_ready (const char *server_ip, uint64_t start, uint64_t align, uint64_t *agreed);
@@ -1,44 +1,56 @@
+#define _GNU_SOURCE
+
 #include "persistence.h"
 
-__always_inline uint32_t bucket_idx (const int64_t val, const int64_t min, const int64_t max)
-{
-    if (UNLIKELY (val < min))
-        return 0;
-    if (UNLIKELY (val > max))
-        return NUM_BUCKETS + 1;
-    const int64_t bucket_size = (max - min) / NUM_BUCKETS;
-    if (UNLIKELY (val < min || val > max))
-    {
-        return -1;
-    }
-    return (val - min) / bucket_size + 1;
-}
+#include <limits.h>
+#include <sched.h>
 
-__always_inline int bucket_compute_hugepage_size ()
+/**
+ * Size of the memory holding the buckets, rounded up to a huge page.
+ * num_buckets + 2 because bucket 0 is for values < min and bucket num_buckets + 1 is for values >= max.
+ */
+__always_inline uint64_t bucket_memory_size (const uint32_t num_buckets)
 {
-    const uint64_t page_size = sysconf (_SC_PAGESIZE);
-    // 4 arrays of NUM_BUCKETS elements (relative latencies), plus 1 array of NUM_BUCKETS elements (absolute latencies)
-    // + page_size - 1 to round up
-    // NUM_BUCKETS + 2 because bucket 0 is for values < min and bucket NUM_BUCKETS + 1 is for values > max
-    const uint32_t required_pages = (sizeof (uint64_t) * (NUM_BUCKETS + 2) * 5 + page_size - 1) / page_size;
-    return required_pages * page_size;
+    const uint64_t size = sizeof (struct bucket) * (num_buckets + 2);
+    return (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
 }
 
-__always_inline void bucket_ranges (const uint64_t interval, uint64_t *rel_min, uint64_t *rel_max, uint64_t *abs_min, uint64_t *abs_max)
+int bucket_geometry (const struct pers_config *config, uint32_t *num_buckets, struct bucket_range *rel, struct bucket_range *abs)
 {
-    // Always make sure that the range is 2*OFFSET, in order to ensure that every bucket has the same size
-    if (interval < OFFSET)
+    const uint64_t interval = config->interval;
+    uint64_t count = config->bucket_count;
+    uint64_t width = config->bucket_width;
+    uint64_t range = config->bucket_range;
+
+    if (count == 0)
+        count = width && range ? (2 * range + width - 1) / width : NUM_BUCKETS;
+    if (range == 0)
+        range = width ? (count * width + 1) / 2 : OFFSET;
+    if (count == 0 || count > MAX_BUCKETS)
+        return -1;
+
+    // Relative latencies: 2*range around the interval, or starting from 0 if the interval is smaller than the range
+    rel->min = interval < range ? 0 : interval - range;
+    rel->width = width ? width : (2 * range + count - 1) / count;
+    rel->max = rel->min + count * rel->width;
+
+    // Absolute latencies: up to interval + range, with the same width if it was given.
+    // Without a width, it is rounded up so that the last bucket still covers interval + range
+    const uint64_t abs_end = interval + range;
+    if (width)
     {
-        *rel_min = 0;
-        *rel_max = 2 * OFFSET;
+        abs->width = width;
+        abs->min = abs_end > count * width ? abs_end - count * width : 0;
     }
     else
     {
-        *rel_min = interval - OFFSET;
-        *rel_max = interval + OFFSET;
+        abs->width = (abs_end + count - 1) / count;
+        abs->min = 0;
     }
-    *abs_min = 0;
-    *abs_max = interval + OFFSET;
+    abs->max = abs->min + count * abs->width;
+
+    *num_buckets = count;
+    return 0;
 }
 
 int persistence_write_all_timestamps (persistence_agent_t *agent, const struct pingpong_payload *payload)
@@ -50,7 +62,7 @@ int persistence_write_all_timestamps (persistence_agent_t *agent, const struct p
     }
 
     // print the paylaod id to file
-    if (fprintf (agent->data->file, "%llu %llu %llu %llu %llu\n", payload->id, payload->ts[0], payload->ts[1], payload->ts[2], payload->ts[3]) < 0)
+    if (fprintf (agent->data->file, "%llu %llu %llu %llu %llu %llu\n", payload->id, payload->ts[0], payload->ts[1], payload->ts[2], payload->ts[3], payload->intended) < 0)
     {
         LOG (stderr, "ERROR: Could not write to persistence file\n");
         return -1;
@@ -59,87 +71,267 @@ int persistence_write_all_timestamps (persistence_agent_t *agent, const struct p
     return 0;
 }
 
-int persistence_write_min_max_latency (persistence_agent_t *agent, const struct pingpong_payload *payload)
+int persistence_write_all_timestamps_bin (persistence_agent_t *agent, const struct pingpong_payload *payload)
 {
-    struct min_max_latency_data *aux = agent->data->aux;
-    const uint64_t latency = compute_latency (payload);
-    if (latency < aux->min)
-    {
-        aux->min = latency;
-        aux->min_payload = *payload;
-    }
-    if (latency > aux->max)
+    const struct pers_bin_record record = {
+        .id = htole64 (payload->id),
+        .ts = {htole64 (payload->ts[0]), htole64 (payload->ts[1]), htole64 (payload->ts[2]), htole64 (payload->ts[3])},
+        .intended = htole64 (payload->intended)};
+
+    // The file is only accessed by the receiving thread, no need for stdio locking
+    if (UNLIKELY (fwrite_unlocked (&record, sizeof (record), 1, agent->data->file) != 1))
     {
-        aux->max = latency;
-        aux->max_payload = *payload;
+        LOG (stderr, "ERROR: Could not write to persistence file\n");
+        return -1;
     }
+
     return 0;
 }
 
+int persistence_write_all_timestamps_sampled (persistence_agent_t *agent, const struct pingpong_payload *payload)
+{
+    if (payload->id % agent->data->sample_every != 0)
+        return 0;
+
+    if (agent->flags & PERSISTENCE_F_BINARY)
+        return persistence_write_all_timestamps_bin (agent, payload);
+    return persistence_write_all_timestamps (agent, payload);
+}
+
+int persistence_record_all_timestamps (persistence_agent_t *agent, const struct pers_sample *sample)
+{
+    return persistence_write_all_timestamps_sampled (agent, sample->payload);
+}
+
+int persistence_record_min_max_latency (persistence_agent_t *agent, const struct pers_sample *sample)
+{
+    return pers_record_min_max_latency (agent, sample);
+}
+
+int persistence_write_min_max_latency (persistence_agent_t *agent, const struct pingpong_payload *payload)
+{
+    return pers_write_min_max_latency (agent, payload);
+}
+
+int persistence_record_buckets (persistence_agent_t *agent, const struct pers_sample *sample)
+{
+    return pers_record_buckets (agent, sample);
+}
+
 int persistence_write_buckets (persistence_agent_t *agent, const struct pingpong_payload *payload)
 {
-    struct bucket_data *aux = agent->data->aux;
+    return pers_write_buckets (agent, payload);
+}
+
+int persistence_record_hdr (persistence_agent_t *agent, const struct pers_sample *sample)
+{
+    return pers_record_hdr (agent, sample);
+}
+
+int persistence_write_hdr (persistence_agent_t *agent, const struct pingpong_payload *payload)
+{
+    return pers_write_hdr (agent, payload);
+}
+
+int persistence_record_quantiles (persistence_agent_t *agent, const struct pers_sample *sample)
+{
+    struct quantile_data *aux = agent->data->aux;
 
     aux->tot_packets++;
 
-    if (!valid_pingpong_payload (&aux->prev_payload))
-    {
-        aux->prev_payload = *payload;
+    tdigest_add (&aux->abs_latency, sample->abs_latency);
+    tdigest_add (&aux->corrected_latency, sample->corrected_latency);
+
+    if (!sample->has_prev)
+        return 0;
+
+    for (int i = 0; i < 4; i++)
+        tdigest_add (&aux->rel_latency[i], sample->ts_diff[i]);
+
+    return 0;
+}
+
+int persistence_write_quantiles (persistence_agent_t *agent, const struct pingpong_payload *payload)
+{
+    struct pers_sample sample;
+    if (pers_sample_compute (agent->data, payload, &sample) != 0)
         return -1;
+    return persistence_record_quantiles (agent, &sample);
+}
+
+__always_inline void topk_sift_up (struct topk_data *aux, uint32_t i)
+{
+    const uint64_t latency = aux->heap_latency[i];
+    const uint32_t entry = aux->heap_entry[i];
+    while (i > 0)
+    {
+        const uint32_t parent = (i - 1) / 2;
+        if (aux->heap_latency[parent] <= latency)
+            break;
+        aux->heap_latency[i] = aux->heap_latency[parent];
+        aux->heap_entry[i] = aux->heap_entry[parent];
+        i = parent;
     }
+    aux->heap_latency[i] = latency;
+    aux->heap_entry[i] = entry;
+}
 
-    if (UNLIKELY (payload->id % 1000000 == 0))
+__always_inline void topk_sift_down (struct topk_data *aux, uint32_t i)
+{
+    const uint64_t latency = aux->heap_latency[i];
+    const uint32_t entry = aux->heap_entry[i];
+    while (true)
     {
-        fprintf (stdout, "%llu\n", payload->id);
-        fflush (stdout);
+        uint32_t child = 2 * i + 1;
+        if (child >= aux->heap_size)
+            break;
+        if (child + 1 < aux->heap_size && aux->heap_latency[child + 1] < aux->heap_latency[child])
+            child++;
+        if (aux->heap_latency[child] >= latency)
+            break;
+        aux->heap_latency[i] = aux->heap_latency[child];
+        aux->heap_entry[i] = aux->heap_entry[child];
+        i = child;
     }
+    aux->heap_latency[i] = latency;
+    aux->heap_entry[i] = entry;
+}
 
-    uint64_t ts_diff[4];
-    for (int i = 0; i < 4; i++)
+/**
+ * Copy the `count` rounds that followed the captured round of `entry` from the ring.
+ */
+void topk_fill_after (struct topk_data *aux, struct topk_entry *entry, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; ++i)
+        entry->rounds[aux->context + 1 + i] = aux->ring[(entry->seq + 1 + i) & aux->ring_mask];
+    entry->after_len = count;
+}
+
+/**
+ * Store the round `seq`, which is in the ring, in `entry` together with the rounds before it.
+ */
+void topk_capture (struct topk_data *aux, uint32_t idx, uint64_t seq)
+{
+    struct topk_entry *entry = &aux->entries[idx];
+    entry->seq = seq;
+    entry->before_len = min (seq, (uint64_t) aux->context);
+    entry->after_len = 0;
+    for (uint64_t s = seq - entry->before_len; s <= seq; ++s)
+        entry->rounds[aux->context - (seq - s)] = aux->ring[s & aux->ring_mask];
+
+    if (aux->context > 0)
     {
-        if (UNLIKELY (payload->ts[i] < aux->prev_payload.ts[i]))
-        {
-            LOG (stderr, "ERROR: Timestamps are not monotonically increasing\n");
-            return -1;
-        }
-        ts_diff[i] = payload->ts[i] - aux->prev_payload.ts[i];
+        const uint64_t slot = aux->pending_head++ % (aux->context + 1);
+        aux->pending_entry[slot] = idx;
+        aux->pending_seq[slot] = seq;
     }
+}
 
-    uint64_t rel_min, rel_max, abs_min, abs_max;
-    bucket_ranges (aux->send_interval, &rel_min, &rel_max, &abs_min, &abs_max);
+int persistence_record_topk (persistence_agent_t *agent, const struct pers_sample *sample)
+{
+    struct topk_data *aux = agent->data->aux;
+    const uint64_t seq = aux->seq++;
+    const uint64_t latency = sample->abs_latency;
 
+    struct topk_round *round = &aux->ring[seq & aux->ring_mask];
+    round->id = sample->payload->id;
     for (int i = 0; i < 4; ++i)
     {
-        if (UNLIKELY (ts_diff[i] < aux->min_values.rel_latency[i]))
-        {
-            aux->min_values.rel_latency[i] = ts_diff[i];
-        }
-        if (UNLIKELY (ts_diff[i] > aux->max_values.rel_latency[i]))
+        round->ts[i] = sample->payload->ts[i];
+        round->gap[i] = sample->has_prev ? sample->ts_diff[i] : 0;
+    }
+    round->latency = latency;
+
+    // The oldest pending entry is complete once `context` rounds followed it, unless it was evicted meanwhile
+    if (UNLIKELY (aux->pending_tail != aux->pending_head))
+    {
+        const uint64_t slot = aux->pending_tail % (aux->context + 1);
+        if (aux->pending_seq[slot] + aux->context == seq)
         {
-            aux->max_values.rel_latency[i] = ts_diff[i];
+            struct topk_entry *entry = &aux->entries[aux->pending_entry[slot]];
+            if (entry->seq == aux->pending_seq[slot])
+                topk_fill_after (aux, entry, aux->context);
+            aux->pending_tail++;
         }
-        const uint32_t idx = bucket_idx (ts_diff[i], rel_min, rel_max);
-        aux->buckets[idx].rel_latency[i]++;
     }
 
-    const uint64_t abs_latency = compute_latency (payload);
-
-    if (UNLIKELY (abs_latency < aux->min_values.abs_latency))
+    if (aux->heap_size < aux->k)
     {
-        aux->min_values.abs_latency = abs_latency;
+        const uint32_t idx = aux->heap_size++;
+        aux->heap_latency[idx] = latency;
+        aux->heap_entry[idx] = idx;
+        topk_sift_up (aux, idx);
+        topk_capture (aux, idx, seq);
     }
-    if (UNLIKELY (abs_latency > aux->max_values.abs_latency))
+    else if (UNLIKELY (latency > aux->heap_latency[0]))
     {
-        aux->max_values.abs_latency = abs_latency;
+        // Evict the best of the worst rounds, and reuse its entry
+        const uint32_t idx = aux->heap_entry[0];
+        aux->heap_latency[0] = latency;
+        topk_sift_down (aux, 0);
+        topk_capture (aux, idx, seq);
     }
 
-    const uint32_t idx = bucket_idx (abs_latency, abs_min, abs_max);
-    aux->buckets[idx].abs_latency++;
+    return 0;
+}
+
+int persistence_write_topk (persistence_agent_t *agent, const struct pingpong_payload *payload)
+{
+    struct pers_sample sample;
+    if (pers_sample_compute (agent->data, payload, &sample) != 0)
+        return -1;
+    return persistence_record_topk (agent, &sample);
+}
+
+/**
+ * Intended send time of a round, for the loss series. The datapaths that do not set it send one round per interval.
+ */
+static inline uint64_t loss_time (const struct loss_data *aux, const struct pingpong_payload *payload)
+{
+    return payload->intended ? payload->intended : (payload->id - 1) * aux->interval;
+}
+
+int persistence_record_loss (persistence_agent_t *agent, const struct pers_sample *sample)
+{
+    struct loss_data *aux = agent->data->aux;
+    loss_tracker_add (&aux->tracker, sample->payload->id, loss_time (aux, sample->payload));
+    return 0;
+}
+
+int persistence_write_loss (persistence_agent_t *agent, const struct pingpong_payload *payload)
+{
+    struct loss_data *aux = agent->data->aux;
+    loss_tracker_add (&aux->tracker, payload->id, loss_time (aux, payload));
+    return 0;
+}
+
+int persistence_record_owd (persistence_agent_t *agent, const struct pers_sample *sample)
+{
+    struct owd_data *aux = agent->data->aux;
+    const struct pingpong_payload *payload = sample->payload;
+    const uint64_t ts[4] = {payload->ts[0], payload->ts[1], payload->ts[2], payload->ts[3]};
+
+    aux->tot_packets++;
+    clock_sync_add (&aux->sync, ts[0], ts[1], ts[2], ts[3]);
+
+    const int64_t forward = (int64_t) (ts[1] - ts[0]) - clock_sync_offset (&aux->sync, ts[0]);
+    const int64_t reverse = (int64_t) (ts[3] - ts[2]) + clock_sync_offset (&aux->sync, ts[3]);
+    if (UNLIKELY (forward < 0 || reverse < 0))
+        aux->negative++;
 
-    aux->prev_payload = *payload;
+    hdr_record (&aux->forward, forward > 0 ? forward : 0);
+    hdr_record (&aux->reverse, reverse > 0 ? reverse : 0);
     return 0;
 }
 
+int persistence_write_owd (persistence_agent_t *agent, const struct pingpong_payload *payload)
+{
+    struct pers_sample sample;
+    if (pers_sample_compute (agent->data, payload, &sample) != 0)
+        return -1;
+    return persistence_record_owd (agent, &sample);
+}
+
 int persistence_close (persistence_agent_t *agent)
 {
     if (!agent->data || !agent->data->file)
@@ -182,16 +374,13 @@ int persistence_close_min_max (persistence_agent_t *agent)
 int persistence_close_buckets (persistence_agent_t *agent)
 {
     struct bucket_data *aux = agent->data->aux;
-
-    uint64_t rel_min, rel_max, abs_min, abs_max;
-    bucket_ranges (aux->send_interval, &rel_min, &rel_max, &abs_min, &abs_max);
-
-    const uint64_t rel_bucket_size = (rel_max - rel_min) / NUM_BUCKETS;
-    const uint64_t abs_bucket_size = (abs_max - abs_min) / NUM_BUCKETS;
+    const struct bucket_range *rel = &aux->rel_range;
+    const struct bucket_range *abs = &aux->abs_range;
 
     fprintf (agent->data->file, "TOT %lu\n", aux->tot_packets);
-    fprintf (agent->data->file, "REL %lu %lu %lu\n", rel_min, rel_max, rel_bucket_size);
-    fprintf (agent->data->file, "ABS %lu %lu %lu\n", abs_min, abs_max, abs_bucket_size);
+    fprintf (agent->data->file, "REL %lu %lu %lu\n", rel->min, rel->max, rel->width);
+    fprintf (agent->data->file, "ABS %lu %lu %lu\n", abs->min, abs->max, abs->width);
+    fprintf (agent->data->file, "BUCKETS %u\n", aux->num_buckets);
 
     fprintf (agent->data->file, "MIN %lu %lu %lu %lu %lu\n",
              aux->min_values.rel_latency[0],
@@ -206,135 +395,1477 @@ int persistence_close_buckets (persistence_agent_t *agent)
              aux->max_values.rel_latency[3],
              aux->max_values.abs_latency);
 
-    for (size_t i = 0; i < NUM_BUCKETS + 2; ++i)
+    // Sparse output: only the non-empty buckets, prefixed by their index
+    for (size_t i = 0; i < aux->num_buckets + 2; ++i)
     {
-        fprintf (agent->data->file, "%lu %lu %lu %lu %lu\n",
-                 aux->buckets[i].rel_latency[0],
-                 aux->buckets[i].rel_latency[1],
-                 aux->buckets[i].rel_latency[2],
-                 aux->buckets[i].rel_latency[3],
-                 aux->buckets[i].abs_latency);
+        const struct bucket *b = &aux->buckets[i];
+        if ((b->rel_latency[0] | b->rel_latency[1] | b->rel_latency[2] | b->rel_latency[3] | b->abs_latency) == 0)
+            continue;
+
+        fprintf (agent->data->file, "%lu %lu %lu %lu %lu %lu\n", i,
+                 b->rel_latency[0],
+                 b->rel_latency[1],
+                 b->rel_latency[2],
+                 b->rel_latency[3],
+                 b->abs_latency);
     }
 
-    munmap (aux->ptr, bucket_compute_hugepage_size ());
+    munmap (aux->ptr, aux->memory_size);
     free (aux);
 
     return persistence_close (agent);
 }
 
-int persistence_init_min_max_latency (persistence_agent_t *agent, void *init_aux __unused)
+int persistence_close_hdr (persistence_agent_t *agent)
 {
-    struct min_max_latency_data *aux = malloc (sizeof (struct min_max_latency_data));
-    if (aux == NULL)
+    struct hdr_data *aux = agent->data->aux;
+    static const char *const rel_names[4] = {"REL0", "REL1", "REL2", "REL3"};
+
+    FILE *file = agent->data->file;
+    fprintf (file, "TOT %lu\n", aux->tot_packets);
+    fprintf (file, "DIGITS %u\n", aux->abs_latency.significant_digits);
+
+    // Summary first, so that the percentiles can be read without parsing the counters
+    hdr_print_percentiles (&aux->abs_latency, file, "ABS");
+    hdr_print_percentiles (&aux->corrected_latency, file, "CO");
+    for (int i = 0; i < 4; ++i)
+        hdr_print_percentiles (&aux->rel_latency[i], file, rel_names[i]);
+
+    if (file != stdout)
     {
-        LOG (stderr, "ERROR: Could not allocate memory for min_max_latency_data\n");
-        return -1;
+        hdr_print_percentiles (&aux->abs_latency, stdout, "ABS");
+        hdr_print_percentiles (&aux->corrected_latency, stdout, "CO");
+        fflush (stdout);
     }
-    aux->min = UINT64_MAX;
-    aux->max = 0;
-    agent->data->aux = aux;
 
-    agent->write = persistence_write_min_max_latency;
-    agent->close = persistence_close_min_max;
-    return 0;
+    hdr_print_counts (&aux->abs_latency, file, "ABS");
+    hdr_print_counts (&aux->corrected_latency, file, "CO");
+    for (int i = 0; i < 4; ++i)
+        hdr_print_counts (&aux->rel_latency[i], file, rel_names[i]);
+
+    hdr_destroy (&aux->abs_latency);
+    hdr_destroy (&aux->corrected_latency);
+    for (int i = 0; i < 4; ++i)
+        hdr_destroy (&aux->rel_latency[i]);
+    free (aux);
+
+    return persistence_close (agent);
 }
 
-int persistence_init_buckets (persistence_agent_t *agent, void *init_aux)
+int persistence_close_quantiles (persistence_agent_t *agent)
 {
-    const uint64_t interval = *(const uint64_t *) init_aux;
-    struct bucket_data *aux = calloc (1, sizeof (struct bucket_data));
-    if (aux == NULL)
+    struct quantile_data *aux = agent->data->aux;
+    static const char *const rel_names[4] = {"REL0", "REL1", "REL2", "REL3"};
+
+    FILE *file = agent->data->file;
+    fprintf (file, "TOT %lu\n", aux->tot_packets);
+    fprintf (file, "COMPRESSION %d\n", PERSISTENCE_TDIGEST_COMPRESSION);
+
+    tdigest_print_quantiles (&aux->abs_latency, file, "ABS", aux->quantiles, aux->num_quantiles);
+    tdigest_print_quantiles (&aux->corrected_latency, file, "CO", aux->quantiles, aux->num_quantiles);
+    for (int i = 0; i < 4; ++i)
+        tdigest_print_quantiles (&aux->rel_latency[i], file, rel_names[i], aux->quantiles, aux->num_quantiles);
+
+    if (file != stdout)
     {
-        LOG (stderr, "ERROR: Could not allocate memory for bucket_data\n");
-        return -1;
+        tdigest_print_quantiles (&aux->abs_latency, stdout, "ABS", aux->quantiles, aux->num_quantiles);
+        tdigest_print_quantiles (&aux->corrected_latency, stdout, "CO", aux->quantiles, aux->num_quantiles);
+        fflush (stdout);
     }
-    mlock (aux, sizeof (struct bucket_data));
-    aux->tot_packets = 0;
-    aux->send_interval = interval;
 
-    for (size_t i = 0; i < 4; ++i)
+    tdigest_destroy (&aux->abs_latency);
+    tdigest_destroy (&aux->corrected_latency);
+    for (int i = 0; i < 4; ++i)
+        tdigest_destroy (&aux->rel_latency[i]);
+    free (aux);
+
+    return persistence_close (agent);
+}
+
+int persistence_close_topk (persistence_agent_t *agent)
+{
+    struct topk_data *aux = agent->data->aux;
+    FILE *file = agent->data->file;
+
+    // The entries still waiting for their rounds after get the ones recorded so far
+    for (uint64_t p = aux->pending_tail; p != aux->pending_head; ++p)
     {
-        aux->min_values.rel_latency[i] = UINT64_MAX;
-        aux->max_values.rel_latency[i] = 0;
+        const uint64_t slot = p % (aux->context + 1);
+        struct topk_entry *entry = &aux->entries[aux->pending_entry[slot]];
+        if (entry->seq == aux->pending_seq[slot])
+            topk_fill_after (aux, entry, aux->seq - 1 - entry->seq);
     }
-    aux->min_values.abs_latency = UINT64_MAX;
-    aux->max_values.abs_latency = 0;
 
-    uint64_t memory_size = bucket_compute_hugepage_size ();
-    // Allocate memory for the buckets on a huge page
-    void *ptr = mmap (NULL, memory_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_LOCKED, -1, 0);
-    if (ptr == MAP_FAILED)
+    // Pop the heap: the rounds come out from the lowest latency, print them from the highest
+    const uint32_t count = aux->heap_size;
+    uint32_t *order = malloc (max (count, 1U) * sizeof (uint32_t));
+    for (uint32_t i = count; order && i > 0; --i)
     {
-        LOG (stderr, "ERROR: Could not allocate memory for buckets_rel_latency\n");
-        return -1;
+        order[i - 1] = aux->heap_entry[0];
+        aux->heap_size--;
+        aux->heap_latency[0] = aux->heap_latency[aux->heap_size];
+        aux->heap_entry[0] = aux->heap_entry[aux->heap_size];
+        topk_sift_down (aux, 0);
     }
 
-    // Lock the memory to avoid major page faults
-    mlock (ptr, memory_size);
+    fprintf (file, "TOT %lu\n", aux->seq);
+    fprintf (file, "TOPK %u CONTEXT %u\n", count, aux->context);
+    for (uint32_t rank = 0; order && rank < count; ++rank)
+    {
+        const struct topk_entry *entry = &aux->entries[order[rank]];
+        const struct topk_round *captured = &entry->rounds[aux->context];
+        fprintf (file, "ROUND %u ID %lu LATENCY %lu\n", rank, captured->id, captured->latency);
 
-    aux->ptr = ptr;
+        for (int offset = -(int) entry->before_len; offset <= (int) entry->after_len; ++offset)
+        {
+            const struct topk_round *r = &entry->rounds[aux->context + offset];
+            fprintf (file, "%d %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu\n", offset, r->id,
+                     r->ts[0], r->ts[1], r->ts[2], r->ts[3], r->latency,
+                     r->gap[0], r->gap[1], r->gap[2], r->gap[3]);
+        }
+    }
 
-    agent->data->aux = aux;
+    free (order);
+    free (aux->heap_latency);
+    free (aux->heap_entry);
+    free (aux->entries);
+    free (aux->rounds);
+    free (aux->ring);
+    free (aux->pending_entry);
+    free (aux->pending_seq);
+    free (aux);
 
-    agent->write = persistence_write_buckets;
-    agent->close = persistence_close_buckets;
-    return 0;
+    return persistence_close (agent);
 }
 
-int _persistence_init (persistence_agent_t *agent, const char *filename, void *init_aux)
+int persistence_close_loss (persistence_agent_t *agent)
 {
-    bool use_stdout = filename == NULL || (agent->flags & PERSISTENCE_F_STDOUT);
-    FILE *file = use_stdout ? stdout : fopen (filename, "w");
-    if (file == NULL)
+    struct loss_data *aux = agent->data->aux;
+    struct loss_tracker *lt = &aux->tracker;
+    FILE *file = agent->data->file;
+
+    loss_tracker_finish (lt, aux->iters);
+
+    fprintf (file, "INTERVAL %lu\n", aux->interval);
+    loss_tracker_print (lt, file);
+
+    if (file != stdout)
     {
-        LOG (stderr, "ERROR: Could not open persistence file\n");
-        return -1;
+        printf ("LOST %lu LATE %lu REORDERED %lu DUPLICATED %lu LONGEST_BURST %lu\n",
+                lt->lost, lt->late, lt->reordered, lt->duplicated, lt->longest_burst);
+        fflush (stdout);
     }
 
-    pers_base_data_t *data = malloc (sizeof (pers_base_data_t));
-    if (data == NULL)
+    loss_tracker_destroy (lt);
+    free (aux);
+
+    return persistence_close (agent);
+}
+
+int persistence_close_owd (persistence_agent_t *agent)
+{
+    struct owd_data *aux = agent->data->aux;
+    FILE *file = agent->data->file;
+
+    clock_sync_commit (&aux->sync);
+
+    fprintf (file, "TOT %lu\n", aux->tot_packets);
+    fprintf (file, "DIGITS %u\n", aux->forward.significant_digits);
+    fprintf (file, "OFFSET %ld\n", clock_sync_offset (&aux->sync, aux->sync.best_time));
+    fprintf (file, "SKEW %.3f\n", aux->sync.skew);
+    fprintf (file, "MIN_RTT %lu\n", aux->sync.points ? aux->sync.min_rtt : 0);
+    fprintf (file, "POINTS %lu\n", aux->sync.points);
+    fprintf (file, "NEGATIVE %lu\n", aux->negative);
+
+    hdr_print_percentiles (&aux->forward, file, "FWD");
+    hdr_print_percentiles (&aux->reverse, file, "REV");
+
+    if (file != stdout)
     {
-        LOG (stderr, "ERROR: Could not allocate memory for persistence data\n");
+        printf ("OFFSET %ld SKEW %.3f\n", clock_sync_offset (&aux->sync, aux->sync.best_time), aux->sync.skew);
+        hdr_print_percentiles (&aux->forward, stdout, "FWD");
+        hdr_print_percentiles (&aux->reverse, stdout, "REV");
+        fflush (stdout);
+    }
+
+    hdr_print_counts (&aux->forward, file, "FWD");
+    hdr_print_counts (&aux->reverse, file, "REV");
+
+    hdr_destroy (&aux->forward);
+    hdr_destroy (&aux->reverse);
+    free (aux);
+
+    return persistence_close (agent);
+}
+
+int persistence_write_bin_header (FILE *file, const struct pers_config *config)
+{
+    // Large buffer so that the records reach the disk in few big writes
+    if (setvbuf (file, NULL, _IOFBF, PERSISTENCE_BIN_BUFFER_SIZE) != 0)
+    {
+        LOG (stderr, "ERROR: Could not set persistence file buffer\n");
         return -1;
     }
 
-    data->file = file;
-    agent->data = data;
+    struct pers_bin_header header;
+    memset (&header, 0, sizeof (header));
+    header.magic = htole32 (PERSISTENCE_BIN_MAGIC);
+    header.version = htole16 (PERSISTENCE_BIN_VERSION);
+    header.header_size = htole16 (sizeof (struct pers_bin_header));
+    header.record_size = htole32 (sizeof (struct pers_bin_record));
+    header.packet_size = htole32 (PACKET_SIZE);
+    header.iters = htole64 (config->iters);
+    header.interval = htole64 (config->interval);
+    header.clock_id = htole32 (TIMESTAMP_CLOCK);
+    header.timesource = htole32 (timesource.kind);
+    header.tsc_hz = htole64 ((uint64_t) timesource_tsc_hz ());
+    if (config->datapath)
+        strncpy (header.datapath, config->datapath, PERSISTENCE_BIN_DATAPATH_LEN - 1);
 
-    if (agent->flags & PERSISTENCE_M_MIN_MAX_LATENCY)
+    if (fwrite (&header, sizeof (header), 1, file) != 1)
     {
-        if (persistence_init_min_max_latency (agent, init_aux) != 0)
-        {
-            return -1;
-        }
+        LOG (stderr, "ERROR: Could not write persistence file header\n");
+        return -1;
     }
-    else if (agent->flags & PERSISTENCE_M_BUCKETS)
+
+    return 0;
+}
+
+int persistence_init_all_timestamps_bin (persistence_agent_t *agent, const struct pers_config *config)
+{
+    if (persistence_write_bin_header (agent->data->file, config) != 0)
+        return -1;
+
+    agent->data->aux = NULL;
+
+    agent->write = agent->data->sample_every > 1 ? persistence_write_all_timestamps_sampled : persistence_write_all_timestamps_bin;
+    agent->record = persistence_record_all_timestamps;
+    agent->close = persistence_close;
+    return 0;
+}
+
+int persistence_write_capture (persistence_agent_t *agent, const struct pingpong_payload *payload)
+{
+    struct capture_data *aux = agent->data->aux;
+
+    // Once the capture is full, the extra payloads are written to the scratch slot at index `capacity`.
+    const uint64_t idx = min (aux->count, aux->capacity);
+    aux->payloads[idx] = *payload;
+    aux->count++;
+
+    return 0;
+}
+
+int persistence_record_capture (persistence_agent_t *agent, const struct pers_sample *sample)
+{
+    return persistence_write_capture (agent, sample->payload);
+}
+
+int persistence_close_capture (persistence_agent_t *agent)
+{
+    struct capture_data *aux = agent->data->aux;
+    const uint64_t stored = min (aux->count, aux->capacity);
+
+    if (agent->flags & PERSISTENCE_F_BINARY)
     {
-        if (persistence_init_buckets (agent, init_aux) != 0)
+        if (persistence_write_bin_header (agent->data->file, &aux->config) == 0)
         {
-            return -1;
+            for (uint64_t i = 0; i < stored; ++i)
+                persistence_write_all_timestamps_bin (agent, &aux->payloads[i]);
         }
     }
     else
     {
-        agent->write = persistence_write_all_timestamps;
-        agent->close = persistence_close;
+        for (uint64_t i = 0; i < stored; ++i)
+            persistence_write_all_timestamps (agent, &aux->payloads[i]);
+    }
 
-        data->aux = NULL;
+    if (aux->count > aux->capacity)
+    {
+        fprintf (stderr, "WARN: capture full, %lu rounds were not stored\n", aux->count - aux->capacity);
     }
 
-    return 0;
+    munmap (aux->payloads, aux->memory_size);
+    free (aux);
+
+    return persistence_close (agent);
 }
 
-persistence_agent_t *persistence_init (const char *filename, uint32_t flags, void *aux)
+/**
+ * Allocate the memory of the in-memory capture: `count` payloads plus a scratch slot.
+ * Huge pages are used if available; in any case the memory is locked and prefaulted.
+ */
+__always_inline void *capture_alloc (uint64_t count, uint64_t *memory_size)
 {
-    persistence_agent_t *agent = malloc (sizeof (persistence_agent_t));
-    agent->flags = flags;
+    const uint64_t size = (count + 1) * sizeof (struct pingpong_payload);
 
-    if (_persistence_init (agent, filename, aux) != 0)
-    {
+    *memory_size = (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    void *ptr = mmap (NULL, *memory_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_LOCKED | MAP_POPULATE, -1, 0);
+    if (ptr != MAP_FAILED)
+        return ptr;
+
+    LOG (stderr, "WARN: Could not allocate huge pages for the capture, falling back to normal pages\n");
+    *memory_size = size;
+    ptr = mmap (NULL, *memory_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_LOCKED | MAP_POPULATE, -1, 0);
+    if (ptr == MAP_FAILED)
         return NULL;
+
+    return ptr;
+}
+
+int persistence_init_capture (persistence_agent_t *agent, const struct pers_config *config)
+{
+    struct capture_data *aux = calloc (1, sizeof (struct capture_data));
+    if (aux == NULL)
+    {
+        LOG (stderr, "ERROR: Could not allocate memory for capture_data\n");
+        return -1;
     }
 
-    return agent;
-}
\ No newline at end of file
+    aux->payloads = capture_alloc (config->iters, &aux->memory_size);
+    if (aux->payloads == NULL)
+    {
+        LOG (stderr, "ERROR: Could not allocate memory for %lu payloads\n", config->iters);
+        free (aux);
+        return -1;
+    }
+
+    // Lock the memory to avoid major page faults
+    mlock (aux->payloads, aux->memory_size);
+
+    aux->capacity = config->iters;
+    aux->count = 0;
+    aux->config = *config;
+
+    agent->data->aux = aux;
+
+    agent->write = persistence_write_capture;
+    agent->record = persistence_record_capture;
+    agent->close = persistence_close_capture;
+    return 0;
+}
+
+int persistence_write_async (persistence_agent_t *agent, const struct pingpong_payload *payload)
+{
+    struct async_data *aux = agent->data->aux;
+    return spsc_ring_push (&aux->ring, payload) ? 0 : -1;
+}
+
+void *persistence_writer_thread (void *arg)
+{
+    struct async_data *aux = arg;
+    const struct timespec idle = {.tv_sec = 0, .tv_nsec = PERSISTENCE_WRITER_IDLE_NS};
+
+    while (true)
+    {
+        // Read the flag before draining, so that nothing pushed before the stop request is left in the ring
+        const bool running = aux->running;
+        BARRIER ();
+
+        const uint64_t available = spsc_ring_available (&aux->ring);
+        if (available == 0)
+        {
+            if (!running)
+                break;
+            nanosleep (&idle, NULL);
+            continue;
+        }
+
+        if (available > aux->high_water)
+            aux->high_water = available;
+
+        for (uint64_t i = 0; i < available; ++i)
+            aux->backend->write (aux->backend, spsc_ring_slot (&aux->ring, i));
+
+        spsc_ring_consume (&aux->ring, available);
+        aux->written += available;
+    }
+
+    return NULL;
+}
+
+int persistence_close_async (persistence_agent_t *agent)
+{
+    struct async_data *aux = agent->data->aux;
+
+    aux->running = false;
+    pthread_join (aux->writer, NULL);
+
+    fprintf (stdout, "Persistence writer (core %d): %lu payloads written, ring high-water %lu/%d, %lu overflows\n",
+             aux->writer_core, aux->written, aux->high_water, PERSISTENCE_RING_SIZE, aux->ring.overflows);
+    fflush (stdout);
+
+    int ret = aux->backend->close (aux->backend);
+
+    spsc_ring_destroy (&aux->ring);
+    free (aux);
+    free (agent->data);
+    free (agent);
+
+    return ret;
+}
+
+/**
+ * Wrap `backend` in an agent that only pushes the payloads into a ring, leaving the actual write
+ * to a writer thread pinned to a housekeeping core.
+ */
+int persistence_init_async (persistence_agent_t *agent, persistence_agent_t *backend, const struct pers_config *config)
+{
+    struct async_data *aux = calloc (1, sizeof (struct async_data));
+    if (aux == NULL)
+    {
+        LOG (stderr, "ERROR: Could not allocate memory for async_data\n");
+        return -1;
+    }
+
+    if (spsc_ring_init (&aux->ring, PERSISTENCE_RING_SIZE) != 0)
+    {
+        LOG (stderr, "ERROR: Could not allocate the persistence ring\n");
+        free (aux);
+        return -1;
+    }
+
+    aux->backend = backend;
+    aux->running = true;
+
+    // Without an explicit core, the writer runs on a housekeeping core
+    struct thread_placement placement = {.core = -1, .policy = -1, .priority = -1};
+    if (config->writer_placement)
+        placement = *config->writer_placement;
+    if (placement.core < 0)
+        placement.core = find_housekeeping_core ();
+    aux->writer_core = placement.core;
+
+    pthread_attr_t attr;
+    pthread_attr_init (&attr);
+    int ret = placement_set_attr (&placement, 0, &attr);
+    if (ret == 0)
+        ret = pthread_create (&aux->writer, &attr, persistence_writer_thread, aux);
+    pthread_attr_destroy (&attr);
+    if (ret != 0)
+    {
+        fprintf (stderr, "ERR: could not start the persistence writer thread: %s\n", strerror (ret));
+        spsc_ring_destroy (&aux->ring);
+        free (aux);
+        return -1;
+    }
+
+    if (placement_verify (aux->writer, PLACEMENT_WRITER, config->flow, &placement, 0) != 0)
+    {
+        aux->running = false;
+        pthread_join (aux->writer, NULL);
+        spsc_ring_destroy (&aux->ring);
+        free (aux);
+        return -1;
+    }
+
+    agent->data->file = NULL;
+    agent->data->aux = aux;
+
+    agent->write = persistence_write_async;
+    agent->record = NULL;
+    agent->close = persistence_close_async;
+    return 0;
+}
+
+int persistence_write_live (persistence_agent_t *agent, const struct pingpong_payload *payload)
+{
+    struct live_data *aux = agent->data->aux;
+
+    // The receive timestamp of the round is recent enough, no need to read the clock again
+    live_stats_update (&aux->stats, payload->id, compute_latency (payload), payload->ts[3]);
+    return aux->backend->write (aux->backend, payload);
+}
+
+int persistence_close_live (persistence_agent_t *agent)
+{
+    struct live_data *aux = agent->data->aux;
+
+    int ret = aux->backend->close (aux->backend);
+
+    live_stats_destroy (&aux->stats);
+    free (aux);
+    free (agent->data);
+    free (agent);
+
+    return ret;
+}
+
+/**
+ * Wrap `backend` in an agent that publishes the live statistics before forwarding the payloads to it.
+ * When combined with PERSISTENCE_F_ASYNC, the statistics are updated by the writer thread.
+ */
+int persistence_init_live (persistence_agent_t *agent, persistence_agent_t *backend)
+{
+    struct live_data *aux = calloc (1, sizeof (struct live_data));
+    if (aux == NULL)
+    {
+        LOG (stderr, "ERROR: Could not allocate memory for live_data\n");
+        return -1;
+    }
+
+    if (live_stats_create (&aux->stats) != 0)
+    {
+        free (aux);
+        return -1;
+    }
+    fprintf (stdout, "Live statistics published in %s\n", aux->stats.path);
+
+    aux->backend = backend;
+
+    agent->data->file = NULL;
+    agent->data->aux = aux;
+
+    agent->write = persistence_write_live;
+    agent->record = NULL;
+    agent->close = persistence_close_live;
+    return 0;
+}
+
+int persistence_init_min_max_latency (persistence_agent_t *agent, const struct pers_config *config __unused)
+{
+    struct min_max_latency_data *aux = malloc (sizeof (struct min_max_latency_data));
+    if (aux == NULL)
+    {
+        LOG (stderr, "ERROR: Could not allocate memory for min_max_latency_data\n");
+        return -1;
+    }
+    aux->min = UINT64_MAX;
+    aux->max = 0;
+    agent->data->aux = aux;
+
+    agent->write = persistence_write_min_max_latency;
+    agent->record = persistence_record_min_max_latency;
+    agent->close = persistence_close_min_max;
+    return 0;
+}
+
+int persistence_init_buckets (persistence_agent_t *agent, const struct pers_config *config)
+{
+    struct bucket_data *aux = calloc (1, sizeof (struct bucket_data));
+    if (aux == NULL)
+    {
+        LOG (stderr, "ERROR: Could not allocate memory for bucket_data\n");
+        return -1;
+    }
+    mlock (aux, sizeof (struct bucket_data));
+    aux->tot_packets = 0;
+    aux->send_interval = config->interval;
+
+    if (bucket_geometry (config, &aux->num_buckets, &aux->rel_range, &aux->abs_range) != 0)
+    {
+        LOG (stderr, "ERROR: Invalid bucket geometry\n");
+        free (aux);
+        return -1;
+    }
+
+    for (size_t i = 0; i < 4; ++i)
+    {
+        aux->min_values.rel_latency[i] = UINT64_MAX;
+        aux->max_values.rel_latency[i] = 0;
+    }
+    aux->min_values.abs_latency = UINT64_MAX;
+    aux->max_values.abs_latency = 0;
+
+    // Allocate memory for the buckets on huge pages, sized after the geometry
+    aux->memory_size = bucket_memory_size (aux->num_buckets);
+    void *ptr = mmap (NULL, aux->memory_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_LOCKED, -1, 0);
+    if (ptr == MAP_FAILED)
+    {
+        LOG (stderr, "WARN: Could not allocate huge pages for the buckets, falling back to normal pages\n");
+        ptr = mmap (NULL, aux->memory_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_LOCKED, -1, 0);
+    }
+    if (ptr == MAP_FAILED)
+    {
+        LOG (stderr, "ERROR: Could not allocate memory for %u buckets\n", aux->num_buckets);
+        free (aux);
+        return -1;
+    }
+
+    // Lock the memory to avoid major page faults
+    mlock (ptr, aux->memory_size);
+
+    aux->ptr = ptr;
+
+    agent->data->aux = aux;
+
+    agent->write = persistence_write_buckets;
+    agent->record = persistence_record_buckets;
+    agent->close = persistence_close_buckets;
+    return 0;
+}
+
+int persistence_init_hdr (persistence_agent_t *agent, const struct pers_config *config)
+{
+    const uint32_t digits = config->hdr_digits ? config->hdr_digits : PERSISTENCE_HDR_DEFAULT_DIGITS;
+    struct hdr_data *aux = calloc (1, sizeof (struct hdr_data));
+    if (aux == NULL)
+    {
+        LOG (stderr, "ERROR: Could not allocate memory for hdr_data\n");
+        return -1;
+    }
+    mlock (aux, sizeof (struct hdr_data));
+
+    if (hdr_init (&aux->abs_latency, digits, PERSISTENCE_HDR_HIGHEST) != 0)
+    {
+        LOG (stderr, "ERROR: Could not allocate the histogram with %u significant digits\n", digits);
+        free (aux);
+        return -1;
+    }
+    if (hdr_init (&aux->corrected_latency, digits, PERSISTENCE_HDR_HIGHEST) != 0)
+    {
+        LOG (stderr, "ERROR: Could not allocate the histogram with %u significant digits\n", digits);
+        hdr_destroy (&aux->abs_latency);
+        free (aux);
+        return -1;
+    }
+    for (int i = 0; i < 4; ++i)
+    {
+        if (hdr_init (&aux->rel_latency[i], digits, PERSISTENCE_HDR_HIGHEST) != 0)
+        {
+            LOG (stderr, "ERROR: Could not allocate the histogram with %u significant digits\n", digits);
+            while (--i >= 0)
+                hdr_destroy (&aux->rel_latency[i]);
+            hdr_destroy (&aux->corrected_latency);
+            hdr_destroy (&aux->abs_latency);
+            free (aux);
+            return -1;
+        }
+    }
+
+    agent->data->aux = aux;
+
+    agent->write = persistence_write_hdr;
+    agent->record = persistence_record_hdr;
+    agent->close = persistence_close_hdr;
+    return 0;
+}
+
+int persistence_init_quantiles (persistence_agent_t *agent, const struct pers_config *config)
+{
+    static const double default_quantiles[] = {0.5, 0.9, 0.99, 0.999, 0.9999, 0.99999, 0.999999};
+
+    struct quantile_data *aux = calloc (1, sizeof (struct quantile_data));
+    if (aux == NULL)
+    {
+        LOG (stderr, "ERROR: Could not allocate memory for quantile_data\n");
+        return -1;
+    }
+
+    if (config->num_quantiles > 0)
+    {
+        aux->num_quantiles = config->num_quantiles;
+        memcpy (aux->quantiles, config->quantiles, config->num_quantiles * sizeof (double));
+    }
+    else
+    {
+        aux->num_quantiles = sizeof (default_quantiles) / sizeof (default_quantiles[0]);
+        memcpy (aux->quantiles, default_quantiles, sizeof (default_quantiles));
+    }
+
+    if (tdigest_init (&aux->abs_latency, PERSISTENCE_TDIGEST_COMPRESSION) != 0)
+    {
+        LOG (stderr, "ERROR: Could not allocate the t-digest\n");
+        free (aux);
+        return -1;
+    }
+    if (tdigest_init (&aux->corrected_latency, PERSISTENCE_TDIGEST_COMPRESSION) != 0)
+    {
+        LOG (stderr, "ERROR: Could not allocate the t-digest\n");
+        tdigest_destroy (&aux->abs_latency);
+        free (aux);
+        return -1;
+    }
+    for (int i = 0; i < 4; ++i)
+    {
+        if (tdigest_init (&aux->rel_latency[i], PERSISTENCE_TDIGEST_COMPRESSION) != 0)
+        {
+            LOG (stderr, "ERROR: Could not allocate the t-digest\n");
+            while (--i >= 0)
+                tdigest_destroy (&aux->rel_latency[i]);
+            tdigest_destroy (&aux->corrected_latency);
+            tdigest_destroy (&aux->abs_latency);
+            free (aux);
+            return -1;
+        }
+    }
+
+    agent->data->aux = aux;
+
+    agent->write = persistence_write_quantiles;
+    agent->record = persistence_record_quantiles;
+    agent->close = persistence_close_quantiles;
+    return 0;
+}
+
+int persistence_write_multi (persistence_agent_t *agent, const struct pingpong_payload *payload)
+{
+    struct multi_data *aux = agent->data->aux;
+
+    // Shared work, done once for all the sinks
+    struct pers_sample sample;
+    if (pers_sample_compute (agent->data, payload, &sample) != 0)
+        return -1;
+
+    int ret = 0;
+    for (uint32_t i = 0; i < aux->num_sinks; ++i)
+        ret |= aux->sinks[i]->record (aux->sinks[i], &sample);
+
+    return ret;
+}
+
+int persistence_close_multi (persistence_agent_t *agent)
+{
+    struct multi_data *aux = agent->data->aux;
+
+    int ret = 0;
+    for (uint32_t i = 0; i < aux->num_sinks; ++i)
+        ret |= aux->sinks[i]->close (aux->sinks[i]);
+
+    free (aux);
+    free (agent->data);
+    free (agent);
+
+    return ret;
+}
+
+/**
+ * Name used for the file of a sink of a multi-sink agent.
+ */
+const char *pers_measurement_name (uint32_t flag)
+{
+    switch (flag)
+    {
+    case PERSISTENCE_M_ALL_TIMESTAMPS:
+        return "timestamps";
+    case PERSISTENCE_M_MIN_MAX_LATENCY:
+        return "minmax";
+    case PERSISTENCE_M_BUCKETS:
+        return "buckets";
+    case PERSISTENCE_M_CAPTURE:
+        return "capture";
+    case PERSISTENCE_M_HDR:
+        return "hdr";
+    case PERSISTENCE_M_QUANTILES:
+        return "quantiles";
+    case PERSISTENCE_M_TOPK:
+        return "topk";
+    case PERSISTENCE_M_LOSS:
+        return "loss";
+    case PERSISTENCE_M_OWD:
+        return "owd";
+    default:
+        return "unknown";
+    }
+}
+
+persistence_agent_t *persistence_init_agent (const char *filename, uint32_t flags, const struct pers_config *config);
+
+/**
+ * Create one agent per sink, each writing to `<filename>` with `-<measurement name>` inserted before the extension,
+ * e.g. `pp_poll-buckets.dat`, and `-bin` after the name for the binary sinks. Each sink keeps its own output
+ * flags, see `struct pers_config`; the other flags of the agent are passed to all of them.
+ */
+int persistence_init_multi (persistence_agent_t *agent, const char *filename, const struct pers_config *config)
+{
+    struct multi_data *aux = calloc (1, sizeof (struct multi_data));
+    if (aux == NULL)
+    {
+        LOG (stderr, "ERROR: Could not allocate memory for multi_data\n");
+        return -1;
+    }
+
+    uint32_t sinks[PERSISTENCE_MAX_SINKS];
+    uint32_t num_sinks = config->num_sinks;
+    uint32_t shared_flags = agent->flags & ~(PERSISTENCE_M_ALL | PERSISTENCE_F_BINARY);
+    if (num_sinks > 0)
+    {
+        memcpy (sinks, config->sinks, num_sinks * sizeof (uint32_t));
+    }
+    else
+    {
+        for (uint32_t measurements = agent->flags & PERSISTENCE_M_ALL; measurements; measurements &= measurements - 1)
+            sinks[num_sinks++] = measurements & -measurements;
+        shared_flags |= agent->flags & PERSISTENCE_F_BINARY;
+    }
+
+    for (uint32_t s = 0; s < num_sinks; ++s)
+    {
+        const uint32_t flag = sinks[s] & PERSISTENCE_M_ALL;
+        const bool binary = sinks[s] & PERSISTENCE_F_BINARY;
+
+        char sink_filename[PATH_MAX];
+        if (filename)
+        {
+            const char *ext = strrchr (filename, '.');
+            const int stem_len = ext ? (int) (ext - filename) : (int) strlen (filename);
+            snprintf (sink_filename, sizeof (sink_filename), "%.*s-%s%s%s", stem_len, filename, pers_measurement_name (flag),
+                      binary ? "-bin" : "", ext ? ext : "");
+        }
+
+        // The sinks are single agents: only the flags of this one
+        struct pers_config sink_config = *config;
+        sink_config.num_sinks = 0;
+        persistence_agent_t *sink = persistence_init_agent (filename ? sink_filename : NULL, sinks[s] | shared_flags, &sink_config);
+        if (sink == NULL)
+        {
+            LOG (stderr, "ERROR: Could not initialize the %s sink\n", pers_measurement_name (flag));
+            for (uint32_t i = 0; i < aux->num_sinks; ++i)
+                aux->sinks[i]->close (aux->sinks[i]);
+            free (aux);
+            return -1;
+        }
+        aux->sinks[aux->num_sinks++] = sink;
+    }
+
+    agent->data->file = NULL;
+    agent->data->aux = aux;
+
+    agent->write = persistence_write_multi;
+    agent->record = NULL;
+    agent->close = persistence_close_multi;
+    return 0;
+}
+
+int persistence_write_sweep (persistence_agent_t *agent, const struct pingpong_payload *payload)
+{
+    struct sweep_data *aux = agent->data->aux;
+    const uint32_t idx = sweep_step_of (aux->sweep, payload->id, aux->current);
+    const struct sweep_step *step = &aux->sweep->steps[idx];
+    aux->current = idx;
+
+    // The agent of the step sees an ordinary run, with ids from 1
+    struct pingpong_payload step_payload = *payload;
+    step_payload.id -= step->first_id - 1;
+
+    hdr_record (&aux->latency[idx], compute_latency (payload));
+    loss_tracker_add (&aux->loss[idx], step_payload.id, 0);
+    return aux->steps[idx]->write (aux->steps[idx], &step_payload);
+}
+
+static void persistence_print_sweep_step (FILE *file, uint32_t idx, const struct sweep_step *step,
+                                          const struct hdr_histogram *latency, uint64_t lost, bool sustainable)
+{
+    fprintf (file, "STEP %u RATE %lu INTERVAL %lu PACKETS %lu RECEIVED %lu LOST %lu P50 %lu P99 %lu P999 %lu MAX %lu SUSTAINABLE %d\n",
+             idx, step->rate, step->interval, step->packets, latency->total_count, lost,
+             hdr_value_at_percentile (latency, 50.0), hdr_value_at_percentile (latency, 99.0),
+             hdr_value_at_percentile (latency, 99.9), latency->total_count ? latency->max : 0, sustainable);
+}
+
+static int persistence_free_sweep (struct sweep_data *aux, uint32_t num_steps)
+{
+    int ret = 0;
+    for (uint32_t i = 0; i < num_steps; ++i)
+    {
+        if (aux->steps[i])
+            ret |= aux->steps[i]->close (aux->steps[i]);
+        hdr_destroy (&aux->latency[i]);
+        loss_tracker_destroy (&aux->loss[i]);
+    }
+    free (aux);
+    return ret;
+}
+
+int persistence_close_sweep (persistence_agent_t *agent)
+{
+    struct sweep_data *aux = agent->data->aux;
+    const struct sweep *sweep = aux->sweep;
+    FILE *file = agent->data->file;
+
+    fprintf (file, "STEPS %u\n", sweep->num_steps);
+    fprintf (file, "DWELL %lu\n", sweep->dwell);
+    fprintf (file, "BOUND_P99 %lu\n", sweep->bound_p99);
+    fprintf (file, "BOUND_P999 %lu\n", sweep->bound_p999);
+
+    uint64_t max_rate = 0;
+    bool sustained = true;
+    for (uint32_t i = 0; i < sweep->num_steps; ++i)
+    {
+        loss_tracker_finish (&aux->loss[i], sweep->steps[i].packets);
+        const uint64_t lost = aux->loss[i].lost;
+        const bool sustainable = sweep_sustainable (sweep, &aux->latency[i], lost);
+
+        // The rates past the first step that is not sustainable do not count, even if they happen to be
+        sustained &= sustainable;
+        if (sustained)
+            max_rate = sweep->steps[i].rate;
+
+        persistence_print_sweep_step (file, i, &sweep->steps[i], &aux->latency[i], lost, sustainable);
+        if (file != stdout)
+            persistence_print_sweep_step (stdout, i, &sweep->steps[i], &aux->latency[i], lost, sustainable);
+    }
+
+    fprintf (file, "MAX_RATE %lu\n", max_rate);
+    if (file != stdout)
+        fprintf (stdout, "MAX_RATE %lu\n", max_rate);
+    fflush (stdout);
+
+    for (uint32_t i = 0; i < sweep->num_steps; ++i)
+    {
+        char name[32];
+        snprintf (name, sizeof (name), "STEP%u", i);
+        hdr_print_counts (&aux->latency[i], file, name);
+    }
+
+    int ret = persistence_free_sweep (aux, sweep->num_steps);
+    if (file != stdout && fclose (file) != 0)
+        ret = -1;
+
+    free (agent->data);
+    free (agent);
+
+    return ret;
+}
+
+/**
+ * Create one agent per step of the sweep, each writing to `<filename>.step<i>` with the packets and the interval of
+ * its step. The summary of the steps and the maximum sustainable rate are written at close to `<filename>.sweep`.
+ */
+int persistence_init_sweep (persistence_agent_t *agent, const char *filename, const struct pers_config *config)
+{
+    const struct sweep *sweep = config->sweep;
+    const uint32_t digits = config->hdr_digits ? config->hdr_digits : PERSISTENCE_HDR_DEFAULT_DIGITS;
+    struct sweep_data *aux = calloc (1, sizeof (struct sweep_data));
+    if (aux == NULL)
+    {
+        LOG (stderr, "ERROR: Could not allocate memory for sweep_data\n");
+        return -1;
+    }
+    aux->sweep = sweep;
+
+    struct pers_config step_config = *config;
+    step_config.sweep = NULL;
+    for (uint32_t i = 0; i < sweep->num_steps; ++i)
+    {
+        const struct sweep_step *step = &sweep->steps[i];
+        step_config.iters = step->packets;
+        step_config.interval = step->interval;
+
+        char step_filename[PATH_MAX];
+        if (filename)
+            snprintf (step_filename, sizeof (step_filename), "%s.step%u", filename, i);
+
+        aux->steps[i] = persistence_init (filename ? step_filename : NULL, agent->flags, &step_config);
+        if (aux->steps[i] == NULL || hdr_init (&aux->latency[i], digits, PERSISTENCE_HDR_HIGHEST) != 0 ||
+            loss_tracker_init (&aux->loss[i], 0, 0) != 0)
+        {
+            LOG (stderr, "ERROR: Could not initialize step %u of the sweep\n", i);
+            persistence_free_sweep (aux, i + 1);
+            return -1;
+        }
+    }
+
+    FILE *file = stdout;
+    if (filename && !(agent->flags & PERSISTENCE_F_STDOUT))
+    {
+        char sweep_filename[PATH_MAX];
+        snprintf (sweep_filename, sizeof (sweep_filename), "%s.sweep", filename);
+        file = fopen (sweep_filename, "w");
+        if (file == NULL)
+        {
+            LOG (stderr, "ERROR: Could not open %s\n", sweep_filename);
+            persistence_free_sweep (aux, sweep->num_steps);
+            return -1;
+        }
+    }
+
+    agent->data->file = file;
+    agent->data->aux = aux;
+
+    agent->write = persistence_write_sweep;
+    agent->record = NULL;
+    agent->close = persistence_close_sweep;
+    return 0;
+}
+
+int persistence_init_topk (persistence_agent_t *agent, const struct pers_config *config)
+{
+    const uint32_t k = config->topk ? config->topk : PERSISTENCE_TOPK_DEFAULT;
+    const uint32_t context = config->topk_context ? config->topk_context : PERSISTENCE_TOPK_DEFAULT_CONTEXT;
+    if (k > PERSISTENCE_TOPK_MAX || context > PERSISTENCE_TOPK_MAX_CONTEXT)
+    {
+        LOG (stderr, "ERROR: Invalid top-K size %u or context %u\n", k, context);
+        return -1;
+    }
+
+    struct topk_data *aux = calloc (1, sizeof (struct topk_data));
+    if (aux == NULL)
+    {
+        LOG (stderr, "ERROR: Could not allocate memory for topk_data\n");
+        return -1;
+    }
+
+    // The ring holds the current round and the `context` ones before it
+    uint64_t ring_size = 1;
+    while (ring_size < context + 1)
+        ring_size <<= 1;
+
+    const uint32_t entry_rounds = 2 * context + 1;
+    aux->k = k;
+    aux->context = context;
+    aux->ring_mask = ring_size - 1;
+    aux->heap_latency = calloc (k, sizeof (uint64_t));
+    aux->heap_entry = calloc (k, sizeof (uint32_t));
+    aux->entries = calloc (k, sizeof (struct topk_entry));
+    aux->rounds = calloc ((uint64_t) k * entry_rounds, sizeof (struct topk_round));
+    aux->ring = calloc (ring_size, sizeof (struct topk_round));
+    aux->pending_entry = calloc (context + 1, sizeof (uint32_t));
+    aux->pending_seq = calloc (context + 1, sizeof (uint64_t));
+    if (!aux->heap_latency || !aux->heap_entry || !aux->entries || !aux->rounds || !aux->ring || !aux->pending_entry || !aux->pending_seq)
+    {
+        LOG (stderr, "ERROR: Could not allocate memory for the top-K rounds\n");
+        free (aux->heap_latency);
+        free (aux->heap_entry);
+        free (aux->entries);
+        free (aux->rounds);
+        free (aux->ring);
+        free (aux->pending_entry);
+        free (aux->pending_seq);
+        free (aux);
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < k; ++i)
+        aux->entries[i].rounds = &aux->rounds[(uint64_t) i * entry_rounds];
+
+    // Lock the memory to avoid page faults when a round is captured
+    mlock (aux->rounds, (uint64_t) k * entry_rounds * sizeof (struct topk_round));
+    mlock (aux->ring, ring_size * sizeof (struct topk_round));
+
+    agent->data->aux = aux;
+
+    agent->write = persistence_write_topk;
+    agent->record = persistence_record_topk;
+    agent->close = persistence_close_topk;
+    return 0;
+}
+
+int persistence_init_loss (persistence_agent_t *agent, const struct pers_config *config)
+{
+    struct loss_data *aux = calloc (1, sizeof (struct loss_data));
+    if (aux == NULL)
+    {
+        LOG (stderr, "ERROR: Could not allocate memory for loss_data\n");
+        return -1;
+    }
+
+    // The loss series is indexed by the intended send time of the rounds, sized for one round per interval
+    const uint64_t window = config->loss_window ? config->loss_window : PERSISTENCE_LOSS_DEFAULT_WINDOW_NS;
+    if (loss_tracker_init (&aux->tracker, window, config->iters * config->interval) != 0)
+    {
+        LOG (stderr, "ERROR: Could not allocate memory for the loss series\n");
+        free (aux);
+        return -1;
+    }
+    aux->iters = config->iters;
+    aux->interval = config->interval;
+
+    agent->data->aux = aux;
+
+    agent->write = persistence_write_loss;
+    agent->record = persistence_record_loss;
+    agent->close = persistence_close_loss;
+    return 0;
+}
+
+int persistence_init_owd (persistence_agent_t *agent, const struct pers_config *config)
+{
+    const uint32_t digits = config->hdr_digits ? config->hdr_digits : PERSISTENCE_HDR_DEFAULT_DIGITS;
+    struct owd_data *aux = calloc (1, sizeof (struct owd_data));
+    if (aux == NULL)
+    {
+        LOG (stderr, "ERROR: Could not allocate memory for owd_data\n");
+        return -1;
+    }
+    mlock (aux, sizeof (struct owd_data));
+
+    if (hdr_init (&aux->forward, digits, PERSISTENCE_HDR_HIGHEST) != 0)
+    {
+        LOG (stderr, "ERROR: Could not allocate the histogram with %u significant digits\n", digits);
+        free (aux);
+        return -1;
+    }
+    if (hdr_init (&aux->reverse, digits, PERSISTENCE_HDR_HIGHEST) != 0)
+    {
+        LOG (stderr, "ERROR: Could not allocate the histogram with %u significant digits\n", digits);
+        hdr_destroy (&aux->forward);
+        free (aux);
+        return -1;
+    }
+
+    clock_sync_init (&aux->sync, config->owd_filter ? config->owd_filter : PERSISTENCE_OWD_DEFAULT_FILTER_NS, PERSISTENCE_OWD_HALF_LIFE);
+
+    agent->data->aux = aux;
+
+    agent->write = persistence_write_owd;
+    agent->record = persistence_record_owd;
+    agent->close = persistence_close_owd;
+    return 0;
+}
+
+int _persistence_init (persistence_agent_t *agent, const char *filename, const struct pers_config *config)
+{
+    bool use_stdout = filename == NULL || (agent->flags & PERSISTENCE_F_STDOUT);
+    FILE *file = use_stdout ? stdout : fopen (filename, (agent->flags & PERSISTENCE_F_BINARY) ? "wb" : "w");
+    if (file == NULL)
+    {
+        LOG (stderr, "ERROR: Could not open persistence file\n");
+        return -1;
+    }
+
+    pers_base_data_t *data = calloc (1, sizeof (pers_base_data_t));
+    if (data == NULL)
+    {
+        LOG (stderr, "ERROR: Could not allocate memory for persistence data\n");
+        if (file != stdout)
+            fclose (file);
+        return -1;
+    }
+
+    data->file = file;
+    data->sample_every = max (config->trace_sample, 1U);
+    agent->data = data;
+
+    if (agent->flags & PERSISTENCE_M_MIN_MAX_LATENCY)
+    {
+        if (persistence_init_min_max_latency (agent, config) != 0)
+        {
+            return -1;
+        }
+    }
+    else if (agent->flags & PERSISTENCE_M_BUCKETS)
+    {
+        if (persistence_init_buckets (agent, config) != 0)
+        {
+            return -1;
+        }
+    }
+    else if (agent->flags & PERSISTENCE_M_CAPTURE)
+    {
+        if (persistence_init_capture (agent, config) != 0)
+        {
+            return -1;
+        }
+    }
+    else if (agent->flags & PERSISTENCE_M_HDR)
+    {
+        if (persistence_init_hdr (agent, config) != 0)
+        {
+            return -1;
+        }
+    }
+    else if (agent->flags & PERSISTENCE_M_QUANTILES)
+    {
+        if (persistence_init_quantiles (agent, config) != 0)
+        {
+            return -1;
+        }
+    }
+    else if (agent->flags & PERSISTENCE_M_TOPK)
+    {
+        if (persistence_init_topk (agent, config) != 0)
+        {
+            return -1;
+        }
+    }
+    else if (agent->flags & PERSISTENCE_M_LOSS)
+    {
+        if (persistence_init_loss (agent, config) != 0)
+        {
+            return -1;
+        }
+    }
+    else if (agent->flags & PERSISTENCE_M_OWD)
+    {
+        if (persistence_init_owd (agent, config) != 0)
+        {
+            return -1;
+        }
+    }
+    else if (agent->flags & PERSISTENCE_F_BINARY)
+    {
+        if (persistence_init_all_timestamps_bin (agent, config) != 0)
+        {
+            return -1;
+        }
+    }
+    else
+    {
+        agent->write = data->sample_every > 1 ? persistence_write_all_timestamps_sampled : persistence_write_all_timestamps;
+        agent->record = persistence_record_all_timestamps;
+        agent->close = persistence_close;
+
+        data->aux = NULL;
+    }
+
+    return 0;
+}
+
+/**
+ * Allocate an agent with empty base data, for the agents that wrap other ones.
+ */
+static persistence_agent_t *persistence_alloc_agent (uint32_t flags)
+{
+    persistence_agent_t *agent = malloc (sizeof (persistence_agent_t));
+    if (agent == NULL)
+    {
+        LOG (stderr, "ERROR: Could not allocate memory for the persistence agent\n");
+        return NULL;
+    }
+
+    agent->flags = flags;
+    agent->data = calloc (1, sizeof (pers_base_data_t));
+    if (agent->data == NULL)
+    {
+        LOG (stderr, "ERROR: Could not allocate memory for persistence data\n");
+        free (agent);
+        return NULL;
+    }
+
+    return agent;
+}
+
+/**
+ * Free an agent whose initialization failed, the measurement having already freed its own data.
+ */
+static void persistence_free_agent (persistence_agent_t *agent)
+{
+    if (agent->data && agent->data->file && agent->data->file != stdout)
+        fclose (agent->data->file);
+    free (agent->data);
+    free (agent);
+}
+
+persistence_agent_t *persistence_init_agent (const char *filename, uint32_t flags, const struct pers_config *config)
+{
+    if (flags & PERSISTENCE_F_ASYNC)
+    {
+        persistence_agent_t *backend = persistence_init_agent (filename, flags & ~PERSISTENCE_F_ASYNC, config);
+        if (!backend)
+            return NULL;
+
+        persistence_agent_t *agent = persistence_alloc_agent (flags);
+        if (agent == NULL || persistence_init_async (agent, backend, config) != 0)
+        {
+            if (agent)
+                persistence_free_agent (agent);
+            backend->close (backend);
+            return NULL;
+        }
+
+        return agent;
+    }
+
+    if (flags & PERSISTENCE_F_LIVE)
+    {
+        persistence_agent_t *backend = persistence_init_agent (filename, flags & ~PERSISTENCE_F_LIVE, config);
+        if (!backend)
+            return NULL;
+
+        persistence_agent_t *agent = persistence_alloc_agent (flags);
+        if (agent == NULL || persistence_init_live (agent, backend) != 0)
+        {
+            if (agent)
+                persistence_free_agent (agent);
+            backend->close (backend);
+            return NULL;
+        }
+
+        return agent;
+    }
+
+    if (config->sweep)
+    {
+        persistence_agent_t *agent = persistence_alloc_agent (flags);
+        if (agent == NULL || persistence_init_sweep (agent, filename, config) != 0)
+        {
+            if (agent)
+                persistence_free_agent (agent);
+            return NULL;
+        }
+
+        return agent;
+    }
+
+    if (config->num_sinks > 1 || __builtin_popcount (flags & PERSISTENCE_M_ALL) > 1)
+    {
+        persistence_agent_t *agent = persistence_alloc_agent (flags);
+        if (agent == NULL || persistence_init_multi (agent, filename, config) != 0)
+        {
+            if (agent)
+                persistence_free_agent (agent);
+            return NULL;
+        }
+
+        return agent;
+    }
+
+    persistence_agent_t *agent = malloc (sizeof (persistence_agent_t));
+    if (agent == NULL)
+    {
+        LOG (stderr, "ERROR: Could not allocate memory for the persistence agent\n");
+        return NULL;
+    }
+    agent->flags = flags;
+    agent->data = NULL;
+
+    if (_persistence_init (agent, filename, config) != 0)
+    {
+        persistence_free_agent (agent);
+        return NULL;
+    }
+
+    return agent;
+}
+
+int persistence_write_metadata (const char *filename, uint32_t flags, const struct pers_config *config)
+{
+    char meta_filename[PATH_MAX];
+    snprintf (meta_filename, sizeof (meta_filename), "%s.meta", filename);
+    FILE *file = fopen (meta_filename, "w");
+    if (file == NULL)
+    {
+        LOG (stderr, "ERROR: Could not open %s\n", meta_filename);
+        return -1;
+    }
+
+    fprintf (file, "datapath %s\n", config->datapath ? config->datapath : "unknown");
+    fprintf (file, "iters %lu\n", config->iters);
+    fprintf (file, "interval %lu\n", config->interval);
+    fprintf (file, "flags 0x%x\n", flags);
+    fprintf (file, "arrival %s\n", config->arrival ? config->arrival : "fixed");
+    fprintf (file, "flows %u\n", max (config->flows, 1U));
+    fprintf (file, "flow %u\n", config->flow);
+    fprintf (file, "window %u\n", config->window);
+    fprintf (file, "start_align %lu\n", config->start_align);
+    if (config->sweep)
+        fprintf (file, "sweep %lu:%lu:%u:%lu\n", config->sweep->from, config->sweep->to, config->sweep->num_steps, config->sweep->dwell);
+    timesource_print (file);
+
+    return fclose (file);
+}
+
+persistence_agent_t *persistence_init (const char *filename, uint32_t flags, const struct pers_config *config)
+{
+    persistence_agent_t *agent = persistence_init_agent (filename, flags, config);
+    if (agent && filename && !(flags & PERSISTENCE_F_STDOUT))
+        persistence_write_metadata (filename, flags, config);
+    return agent;
+}
+
+int persistence_init_flows (persistence_agent_t **agents, const char *filename, uint32_t flags, const struct pers_config *config)
+{
+    const uint32_t num_flows = max (config->flows, 1U);
+    if (num_flows > 1 && (flags & PERSISTENCE_F_LIVE))
+        fprintf (stderr, "WARN: the live statistics only cover flow 0 of the %u flows\n", num_flows);
+
+    for (uint32_t flow = 0; flow < num_flows; ++flow)
+    {
+        struct pers_config flow_config = *config;
+        flow_config.flow = flow;
+        if (config->flow_intervals[flow])
+            flow_config.interval = config->flow_intervals[flow];
+
+        char flow_filename[PATH_MAX];
+        if (filename)
+            pp_flow_filename (flow_filename, sizeof (flow_filename), filename, flow, num_flows);
+
+        // The live statistics are published in a single file per process, and the loss they count assumes the
+        // consecutive ids of a single flow: only flow 0 publishes them
+        const uint32_t flow_flags = flow == 0 ? flags : flags & ~PERSISTENCE_F_LIVE;
+        agents[flow] = persistence_init (filename ? flow_filename : NULL, flow_flags, &flow_config);
+        if (agents[flow] == NULL)
+        {
+            persistence_close_flows (agents, flow);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+void persistence_close_flows (persistence_agent_t **agents, uint32_t num_flows)
+{
+    for (uint32_t flow = 0; flow < max (num_flows, 1U); ++flow)
+    {
+        if (agents[flow])
+            agents[flow]->close (agents[flow]);
+        agents[flow] = NULL;
+    }
+}
+
+uint64_t pers_parse_intervals (const char *list, struct pers_config *config)
+{
+    uint32_t count = 0;
+    const char *cur = list;
+    while (*cur != '\0')
+    {
+        char *end;
+        const uint64_t interval = strtoull (cur, &end, 10);
+        if (end == cur || interval == 0 || count == PINGPONG_MAX_FLOWS)
+            return 0;
+
+        config->flow_intervals[count++] = interval;
+        if (*end == ',')
+            end++;
+        else if (*end != '\0')
+            return 0;
+        cur = end;
+    }
+
+    for (uint32_t flow = count; flow > 0 && flow < PINGPONG_MAX_FLOWS; ++flow)
+        config->flow_intervals[flow] = config->flow_intervals[count - 1];
+    return config->flow_intervals[0];
+}
+
+int pers_parse_quantiles (const char *list, struct pers_config *config)
+{
+    uint32_t count = 0;
+    const char *cur = list;
+    while (*cur != '\0')
+    {
+        char *end;
+        const double q = strtod (cur, &end);
+        if (end == cur || q < 0 || q > 1 || count == PERSISTENCE_MAX_QUANTILES)
+            return -1;
+
+        config->quantiles[count++] = q;
+        if (*end == ',')
+            end++;
+        else if (*end != '\0')
+            return -1;
+        cur = end;
+    }
+
+    config->num_quantiles = count;
+    return count > 0 ? 0 : -1;
+}
+
+int pers_parse_measurements (const char *list, struct pers_config *config)
+{
+    int flags = 0;
+    uint32_t num_sinks = 0;
+    const char *cur = list;
+    do
+    {
+        char *end;
+        const long index = strtol (cur, &end, 10);
+        const int flag = end == cur ? -1 : pers_measurement_to_flag (index);
+        if (flag < 0 || (*end != ',' && *end != '\0'))
+            return -1;
+
+        // The same sink twice would write twice to the same file
+        for (uint32_t i = 0; i < num_sinks; ++i)
+        {
+            if (config->sinks[i] == (uint32_t) flag)
+                return -1;
+        }
+
+        config->sinks[num_sinks++] = flag;
+        flags |= flag;
+        cur = *end == ',' ? end + 1 : end;
+    } while (*cur != '\0');
+
+    config->num_sinks = num_sinks;
+    return flags;
+}
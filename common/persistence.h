@@ -1,12 +1,24 @@
 #pragma once
 
+#include "clock_sync.h"
 #include "common.h"
+#include "histogram.h"
+#include "live_stats.h"
+#include "loss_tracker.h"
+#include "placement.h"
+#include "spsc_ring.h"
+#include "sweep.h"
+#include "tdigest.h"
+#include "timesource.h"
+#include "utils.h"
 #include <assert.h>
+#include <endian.h>
 #include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/mman.h>
 #include <sys/queue.h>
 #include <unistd.h>
@@ -14,20 +26,43 @@
 enum persistence_output_flags {
     PERSISTENCE_F_FILE = 1U << 0,
     PERSISTENCE_F_STDOUT = 1U << 1,
+    // Write fixed-size little-endian binary records instead of text. Output flags use the upper half of the flags.
+    PERSISTENCE_F_BINARY = 1U << 16,
+    // Hand the payloads to a writer thread on a housekeeping core, which feeds the selected measurement backend.
+    PERSISTENCE_F_ASYNC = 1U << 17,
+    // Publish live statistics in a shared-memory file during the run, see live_stats.h
+    PERSISTENCE_F_LIVE = 1U << 18,
 };
 
 /**
  * Flags defining what should be persisted.
  */
 enum persistence_measurement_flags {
-    // Store all rounds timestamps. Default option.
+    // Store all rounds timestamps and intended send times. Default option.
     PERSISTENCE_M_ALL_TIMESTAMPS = 1U << 2,
     // Store rounds with minimum and maximum latency
     PERSISTENCE_M_MIN_MAX_LATENCY = 1U << 3,
     // TODO: Store rounds in buckets
     PERSISTENCE_M_BUCKETS = 1U << 4,
+    // Store all rounds in a preallocated in-memory array, written to file only at close
+    PERSISTENCE_M_CAPTURE = 1U << 5,
+    // Store rounds in log-linear histograms with bounded relative error, and report percentiles
+    PERSISTENCE_M_HDR = 1U << 6,
+    // Estimate the quantiles of the rounds with a streaming t-digest, in bounded memory
+    PERSISTENCE_M_QUANTILES = 1U << 7,
+    // Keep the K rounds with the highest latency, each with the rounds before and after it
+    PERSISTENCE_M_TOPK = 1U << 8,
+    // Count lost, late, reordered and duplicated rounds from their ids, see loss_tracker.h
+    PERSISTENCE_M_LOSS = 1U << 9,
+    // Estimate the offset and skew of the server clock, and store the forward and reverse one-way delays in HDR histograms
+    PERSISTENCE_M_OWD = 1U << 10,
 };
 
+/* All the measurement flags. When more than one is set, a single agent feeds all of them, see `struct multi_data` */
+#define PERSISTENCE_M_ALL (PERSISTENCE_M_ALL_TIMESTAMPS | PERSISTENCE_M_MIN_MAX_LATENCY | PERSISTENCE_M_BUCKETS | \
+                           PERSISTENCE_M_CAPTURE | PERSISTENCE_M_HDR | PERSISTENCE_M_QUANTILES | PERSISTENCE_M_TOPK | \
+                           PERSISTENCE_M_LOSS | PERSISTENCE_M_OWD)
+
 /**
  * Convert the index of the flag to the value of the flag.
  * This function is useful when the user provides the index of the flag as an argument of the experiment program.
@@ -45,11 +80,158 @@ inline int pers_measurement_to_flag (const int value)
         return PERSISTENCE_M_MIN_MAX_LATENCY;
     case 2:
         return PERSISTENCE_M_BUCKETS;
+    case 3:
+        return PERSISTENCE_M_ALL_TIMESTAMPS | PERSISTENCE_F_BINARY;
+    case 4:
+        return PERSISTENCE_M_CAPTURE;
+    case 5:
+        return PERSISTENCE_M_CAPTURE | PERSISTENCE_F_BINARY;
+    case 6:
+        return PERSISTENCE_M_HDR;
+    case 7:
+        return PERSISTENCE_M_QUANTILES;
+    case 8:
+        return PERSISTENCE_M_TOPK;
+    case 9:
+        return PERSISTENCE_M_LOSS;
+    case 10:
+        return PERSISTENCE_M_OWD;
     default:
         return -1;
     }
 }
 
+struct pers_config;
+
+/**
+ * Parse a comma-separated list of measurement indexes, e.g. "2,1,0", as accepted by `pers_measurement_to_flag`.
+ * Each index is a sink of its own, with its own output flags, so that e.g. "0,3" records the timestamps both as text
+ * and in binary.
+ *
+ * @param list the list to parse
+ * @param config filled with the flags of each sink
+ * @return the union of the flags of the measurements, -1 if the list is not valid
+ */
+int pers_parse_measurements (const char *list, struct pers_config *config);
+
+/* Maximum number of sinks of a multi-sink agent, one per measurement index */
+#define PERSISTENCE_MAX_SINKS 11
+
+/* Maximum number of quantiles that can be requested to PERSISTENCE_M_QUANTILES */
+#define PERSISTENCE_MAX_QUANTILES 16
+
+/**
+ * Information about the experiment, passed to the persistence agent at initialization.
+ */
+struct pers_config {
+    // Number of pingpong rounds
+    uint64_t iters;
+    // Interval between two pings in nanoseconds
+    uint64_t interval;
+    // Name of the program running the experiment, e.g. "pp_poll"
+    const char *datapath;
+    // Significant digits of the PERSISTENCE_M_HDR histograms, 0 for the default
+    uint32_t hdr_digits;
+    // Quantiles reported by PERSISTENCE_M_QUANTILES, in [0, 1]. If none is given, the default ones are used
+    double quantiles[PERSISTENCE_MAX_QUANTILES];
+    uint32_t num_quantiles;
+    // Geometry of the PERSISTENCE_M_BUCKETS buckets, 0 for the defaults, see `bucket_geometry`:
+    // number of buckets, width of each bucket and half-width of the range of inter-arrival times around the interval,
+    // all in nanoseconds
+    uint32_t bucket_count;
+    uint64_t bucket_width;
+    uint64_t bucket_range;
+    // Keep one round out of `trace_sample` in PERSISTENCE_M_ALL_TIMESTAMPS, 0 or 1 to keep all of them
+    uint32_t trace_sample;
+    // Number of rounds kept by PERSISTENCE_M_TOPK and of rounds of context on each side, 0 for the defaults
+    uint32_t topk;
+    uint32_t topk_context;
+    // Duration of each window of the PERSISTENCE_M_LOSS loss series in nanoseconds, 0 for the default
+    uint64_t loss_window;
+    // Duration of each filter window of the PERSISTENCE_M_OWD clock estimator in nanoseconds, 0 for the default
+    uint64_t owd_filter;
+    // Source of the timestamps, an `enum timesource_kind`, to be passed to `timesource_init`
+    uint32_t timesource;
+    // Arrival process of the pings, see arrival.h, NULL for one ping every interval
+    const char *arrival;
+    // Number of flows, each with its own sender thread and id space, 0 for a single flow
+    uint32_t flows;
+    // Interval of each flow in nanoseconds, 0 for `interval`
+    uint64_t flow_intervals[PINGPONG_MAX_FLOWS];
+    // Flow recorded by the agent, set by `persistence_init_flows`
+    uint32_t flow;
+    // Rate sweep of the run, see sweep.h, NULL if the run has a single rate
+    const struct sweep *sweep;
+    // Pings in flight per flow in closed loop, 0 for an open loop
+    uint32_t window;
+    // Alignment in nanoseconds of the start time on CLOCK_REALTIME, 0 to start as soon as the server is ready
+    uint64_t start_align;
+    // Placement of the PERSISTENCE_F_ASYNC writer threads, see placement.h; NULL or a core of -1 for a housekeeping core
+    const struct thread_placement *writer_placement;
+    // Measurement and output flags of each sink, see `pers_parse_measurements`; without any, the measurement flags of
+    // the agent are split in one sink each, sharing the output flags
+    uint32_t sinks[PERSISTENCE_MAX_SINKS];
+    uint32_t num_sinks;
+};
+
+/**
+ * Parse a comma-separated list of quantiles, e.g. "0.5,0.99,0.9999", into `config->quantiles`.
+ *
+ * @param list the list to parse
+ * @param config the configuration to fill
+ * @return 0 on success, -1 if the list is not valid
+ */
+int pers_parse_quantiles (const char *list, struct pers_config *config);
+
+/**
+ * Parse a comma-separated list of intervals in nanoseconds, one per flow, into `config->flow_intervals`.
+ * The last interval of the list is used for the flows after it, e.g. "1000" for all of them.
+ *
+ * @param list the list to parse
+ * @param config the configuration to fill
+ * @return the first interval, 0 if the list is not valid
+ */
+uint64_t pers_parse_intervals (const char *list, struct pers_config *config);
+
+/**
+ * Binary format of PERSISTENCE_M_ALL_TIMESTAMPS when PERSISTENCE_F_BINARY is set.
+ * The file starts with a `struct pers_bin_header`, followed by one `struct pers_bin_record` per round.
+ * All the fields are little-endian.
+ */
+#define PERSISTENCE_BIN_MAGIC 0x53545050// "PPTS"
+#define PERSISTENCE_BIN_VERSION 3
+#define PERSISTENCE_BIN_DATAPATH_LEN 28
+// Size of the stdio buffer of the binary file
+#define PERSISTENCE_BIN_BUFFER_SIZE (1 << 20)
+
+#pragma pack (push, 1)
+struct pers_bin_header {
+    uint32_t magic;
+    uint16_t version;
+    // Size of this header, to allow readers to skip fields they do not know
+    uint16_t header_size;
+    uint32_t record_size;
+    // Size of the pingpong packet on the wire
+    uint32_t packet_size;
+    uint64_t iters;
+    uint64_t interval;
+    // Clock used for the timestamps, as a clockid_t
+    int32_t clock_id;
+    char datapath[PERSISTENCE_BIN_DATAPATH_LEN];
+    // Since version 2: source of the timestamps, as an `enum timesource_kind`, and calibrated TSC frequency in Hz
+    // (0 if the TSC is not used). The timestamps are always in the `clock_id` domain.
+    uint32_t timesource;
+    uint64_t tsc_hz;
+};
+
+struct pers_bin_record {
+    uint64_t id;
+    uint64_t ts[4];
+    // Since version 3: intended send time of the ping, see `struct pingpong_payload`
+    uint64_t intended;
+};
+#pragma pack (pop)
+
 struct min_max_latency_data {
     uint64_t min;
     uint64_t max;
@@ -57,9 +239,21 @@ struct min_max_latency_data {
     struct pingpong_payload max_payload;
 };
 
-/* Range in nanoseconds of each bucket */
+/* Default number of buckets and half-width in nanoseconds of the range of the buckets */
 #define NUM_BUCKETS 20000
 #define OFFSET 1000000
+/* Highest number of buckets accepted from the command line (~400 MB of counters) */
+#define MAX_BUCKETS 10000000
+
+/**
+ * Range of a set of buckets: bucket `i` (1 <= i <= count) holds the values in [min + (i-1)*width, min + i*width).
+ * Bucket 0 holds the values below `min`, bucket count + 1 the values from `max = min + count*width` on.
+ */
+struct bucket_range {
+    uint64_t min;
+    uint64_t max;
+    uint64_t width;
+};
 
 struct bucket {
     uint64_t rel_latency[4];
@@ -69,6 +263,11 @@ struct bucket {
 struct bucket_data {
     uint64_t tot_packets;
     uint64_t send_interval;
+    uint32_t num_buckets;
+    struct bucket_range rel_range;
+    struct bucket_range abs_range;
+    // Size of the mapping of the buckets
+    uint64_t memory_size;
     struct bucket min_values;
     struct bucket max_values;
 
@@ -79,7 +278,233 @@ struct bucket_data {
         uint64_t *ptr;
         struct bucket *buckets;
     };
-    struct pingpong_payload prev_payload;
+};
+
+/**
+ * Compute the range of the buckets of the relative and absolute latencies from the configuration.
+ * Any of `bucket_count`, `bucket_width` and `bucket_range` left to 0 is derived from the others, or set to its
+ * default (NUM_BUCKETS buckets over +/- OFFSET ns around the interval). Both sets have the same number of buckets.
+ *
+ * @param config the configuration of the experiment
+ * @param num_buckets set to the number of buckets, excluding the two overflow buckets
+ * @param rel set to the range of the relative latencies (inter-arrival times)
+ * @param abs set to the range of the absolute latencies
+ * @return 0 on success, -1 if the geometry is not valid
+ */
+int bucket_geometry (const struct pers_config *config, uint32_t *num_buckets, struct bucket_range *rel, struct bucket_range *abs);
+
+/* Default precision of the PERSISTENCE_M_HDR histograms, i.e. 1% relative error */
+#define PERSISTENCE_HDR_DEFAULT_DIGITS 2
+/* Highest latency tracked with full precision by the PERSISTENCE_M_HDR histograms (~68 s) */
+#define PERSISTENCE_HDR_HIGHEST (1ULL << 36)
+
+/**
+ * Data of the PERSISTENCE_M_HDR agent.
+ * Same quantities as the buckets: the absolute latency and the difference of each timestamp from the previous round,
+ * plus the latency corrected for coordinated omission.
+ */
+struct hdr_data {
+    uint64_t tot_packets;
+    struct hdr_histogram abs_latency;
+    struct hdr_histogram corrected_latency;
+    struct hdr_histogram rel_latency[4];
+};
+
+/* Compression of the PERSISTENCE_M_QUANTILES t-digests, bounding their number of centroids */
+#define PERSISTENCE_TDIGEST_COMPRESSION 200
+
+/**
+ * Data of the PERSISTENCE_M_QUANTILES agent.
+ * Same quantities as the buckets: the absolute latency and the difference of each timestamp from the previous round,
+ * plus the latency corrected for coordinated omission.
+ */
+struct quantile_data {
+    uint64_t tot_packets;
+    struct tdigest abs_latency;
+    struct tdigest corrected_latency;
+    struct tdigest rel_latency[4];
+    double quantiles[PERSISTENCE_MAX_QUANTILES];
+    uint32_t num_quantiles;
+};
+
+/* Defaults of PERSISTENCE_M_TOPK: rounds kept, and rounds of context before and after each of them */
+#define PERSISTENCE_TOPK_DEFAULT 16
+#define PERSISTENCE_TOPK_DEFAULT_CONTEXT 8
+#define PERSISTENCE_TOPK_MAX 4096
+#define PERSISTENCE_TOPK_MAX_CONTEXT 4096
+
+/**
+ * A round as stored by PERSISTENCE_M_TOPK: its timestamps, its latency and the difference of each timestamp
+ * from the previous round (0 for the first round).
+ */
+struct topk_round {
+    uint64_t id;
+    uint64_t ts[4];
+    uint64_t latency;
+    uint64_t gap[4];
+};
+
+/**
+ * One of the K worst rounds, with its context. `rounds` holds 2 * context + 1 rounds, the captured one at index `context`:
+ * the `before_len` rounds before it end at index context - 1, the `after_len` rounds after it start at context + 1.
+ */
+struct topk_entry {
+    // Index of the captured round among all the rounds recorded
+    uint64_t seq;
+    uint32_t before_len;
+    uint32_t after_len;
+    struct topk_round *rounds;
+};
+
+/**
+ * Data of the PERSISTENCE_M_TOPK agent.
+ *
+ * The K worst latencies are kept in a binary min-heap of (latency, entry) pairs: a round enters it only if its latency
+ * is higher than the root, in O(log K). The entries never move, so that the heap only swaps 16-byte pairs.
+ * The last `context` rounds are kept in a ring: when a round enters the heap, the ring gives its rounds before, and
+ * its rounds after are copied from the ring `context` rounds later. The pending copies are queued in order of
+ * capture; since at most one round is captured per round recorded, the queue never holds more than `context` entries.
+ * All the memory is allocated at initialization.
+ */
+struct topk_data {
+    uint32_t k;
+    uint32_t context;
+    uint64_t seq;
+
+    // Min-heap of the worst latencies
+    uint32_t heap_size;
+    uint64_t *heap_latency;
+    uint32_t *heap_entry;
+    struct topk_entry *entries;
+    struct topk_round *rounds;
+
+    // Last rounds recorded, `ring_mask + 1` slots
+    uint64_t ring_mask;
+    struct topk_round *ring;
+
+    // Entries waiting for their rounds after, as (entry, seq) pairs
+    uint64_t pending_head;
+    uint64_t pending_tail;
+    uint32_t *pending_entry;
+    uint64_t *pending_seq;
+};
+
+/* Default duration of each window of the PERSISTENCE_M_LOSS loss series */
+#define PERSISTENCE_LOSS_DEFAULT_WINDOW_NS 1000000000UL
+
+/**
+ * Data of the PERSISTENCE_M_LOSS agent.
+ */
+struct loss_data {
+    struct loss_tracker tracker;
+    // Last id sent by the client, the ids above the highest received up to it are lost
+    uint64_t iters;
+    uint64_t interval;
+};
+
+/* Defaults of the PERSISTENCE_M_OWD clock estimator: duration of each filter window, and half-life of the points of
+ * the fit in number of windows */
+#define PERSISTENCE_OWD_DEFAULT_FILTER_NS 10000000UL
+#define PERSISTENCE_OWD_HALF_LIFE 1000
+
+/**
+ * Data of the PERSISTENCE_M_OWD agent.
+ * Each round first updates the clock estimator, then its one-way delays are computed with the current estimate.
+ * The delays that the estimate makes negative are recorded as 0 and counted.
+ */
+struct owd_data {
+    uint64_t tot_packets;
+    uint64_t negative;
+    struct clock_sync sync;
+    struct hdr_histogram forward;
+    struct hdr_histogram reverse;
+};
+
+/* Number of payloads the asynchronous writer ring can hold */
+#define PERSISTENCE_RING_SIZE (1 << 16)
+/* How long the writer thread sleeps when the ring is empty */
+#define PERSISTENCE_WRITER_IDLE_NS 20000
+
+struct persistence_agent;
+
+/**
+ * Data of the PERSISTENCE_F_ASYNC agent.
+ * The receiving thread pushes the payloads into the ring, the writer thread pops them and forwards them to `backend`.
+ */
+struct async_data {
+    struct spsc_ring ring;
+    struct persistence_agent *backend;
+    pthread_t writer;
+    int writer_core;// -1 if the writer is not pinned
+    volatile bool running;
+
+    // Maintained by the writer thread
+    uint64_t written;
+    uint64_t high_water;
+};
+
+/**
+ * Data of the PERSISTENCE_F_LIVE agent.
+ * Each payload updates the live statistics and is then forwarded to `backend`.
+ */
+struct live_data {
+    struct live_stats stats;
+    struct persistence_agent *backend;
+};
+
+/**
+ * Data of the sweep agent, used when the run is a rate sweep.
+ * Each step has its own agent, writing to `<filename>.step<i>`, which sees the rounds of the step as an ordinary run:
+ * their ids are shifted to start from 1. The sweep agent also keeps the latency histogram and the losses of each
+ * step, to find the maximum sustainable rate at close.
+ */
+struct sweep_data {
+    const struct sweep *sweep;
+    // Step of the last round, where the search for the step of the next one starts
+    uint32_t current;
+    struct persistence_agent *steps[SWEEP_MAX_STEPS];
+    struct hdr_histogram latency[SWEEP_MAX_STEPS];
+    struct loss_tracker loss[SWEEP_MAX_STEPS];
+};
+
+#define HUGE_PAGE_SIZE (2UL << 20)
+
+/**
+ * Quantities derived from a payload. They are computed once per payload and shared by all the sinks of an agent.
+ */
+struct pers_sample {
+    const struct pingpong_payload *payload;
+    uint64_t abs_latency;
+    // Latency from the intended send time, see `compute_corrected_latency`
+    uint64_t corrected_latency;
+    // Difference of each timestamp from the previous round, only valid if `has_prev`
+    uint64_t ts_diff[4];
+    bool has_prev;
+};
+
+/**
+ * Data of the multi-sink agent, used when several measurement flags are set or several sinks are configured.
+ * Each sink is a complete agent with its own file; the multi-sink agent computes the `struct pers_sample` of each payload
+ * and hands it to the `record` function of every sink.
+ */
+struct multi_data {
+    uint32_t num_sinks;
+    struct persistence_agent *sinks[PERSISTENCE_MAX_SINKS];
+};
+
+/**
+ * Data of the PERSISTENCE_M_CAPTURE agent.
+ * The array holds `capacity` payloads plus a scratch slot, used once the capture is full so that
+ * the write does not need to branch.
+ */
+struct capture_data {
+    struct pingpong_payload *payloads;
+    uint64_t capacity;
+    // Number of payloads written, including those that did not fit
+    uint64_t count;
+    uint64_t memory_size;
+    // Needed at close to write the binary header
+    struct pers_config config;
 };
 
 /**
@@ -89,11 +514,26 @@ typedef struct pers_base_data {
     // Output stream to write to
     FILE *file;
 
+    // Previous payload, to compute the differences between rounds
+    struct pingpong_payload prev_payload;
+    // Keep one round out of `sample_every` in PERSISTENCE_M_ALL_TIMESTAMPS
+    uint64_t sample_every;
+
     /**
      * Auxiliary data, depending on the flags.
      * - PERSISTENCE_M_ALL_TIMESTAMPS: NULL
      * - PERSISTENCE_M_MIN_MAX_LATENCY: struct min_max_latency_data
      * - PERSISTENCE_M_BUCKETS: struct bucket_data
+     * - PERSISTENCE_M_CAPTURE: struct capture_data
+     * - PERSISTENCE_M_HDR: struct hdr_data
+     * - PERSISTENCE_M_QUANTILES: struct quantile_data
+     * - PERSISTENCE_M_TOPK: struct topk_data
+     * - PERSISTENCE_M_LOSS: struct loss_data
+     * - PERSISTENCE_M_OWD: struct owd_data
+     * - PERSISTENCE_F_ASYNC: struct async_data
+     * - PERSISTENCE_F_LIVE: struct live_data
+     * - rate sweep: struct sweep_data
+     * - several measurement flags: struct multi_data
      */
     void *aux;
 } pers_base_data_t;
@@ -122,6 +562,16 @@ typedef struct persistence_agent {
      */
     int (*write) (struct persistence_agent *agent, const struct pingpong_payload *data);
 
+    /**
+     * Record a payload whose derived quantities are already computed, used when the agent is a sink of a multi-sink agent.
+     * NULL for the agents that cannot be sinks (asynchronous, live and multi-sink agents).
+     *
+     * @param agent the agent to use
+     * @param sample the payload and its derived quantities
+     * @return 0 on success, -1 on error
+     */
+    int (*record) (struct persistence_agent *agent, const struct pers_sample *sample);
+
     /**
      * Close and cleanup the persistence agent and its data.
      * This function takes ownership of the pointer and frees it. After this function returns,
@@ -133,13 +583,196 @@ typedef struct persistence_agent {
     int (*close) (struct persistence_agent *agent);
 } persistence_agent_t;
 
+/*
+ * Hot path of the sinks that the measured loop of the driver can be specialized for, see `PP_DRIVER_DEFINE_LOOPS`.
+ * They are defined here so that the specialized loops inline them; the `persistence_write_*` functions below are the
+ * same code out of line, used as the `write` operation of the agents and to recognize them.
+ */
+
+__always_inline static uint32_t bucket_idx (const uint64_t val, const struct bucket_range *range, const uint32_t num_buckets)
+{
+    if (UNLIKELY (val < range->min))
+        return 0;
+    if (UNLIKELY (val >= range->max))
+        return num_buckets + 1;
+    return (val - range->min) / range->width + 1;
+}
+
+/**
+ * Compute the quantities shared by all the sinks from `payload` and the previous payload seen by `data`,
+ * then remember `payload` as the previous one.
+ * A reordered or duplicated round, whose id is not above the previous one, has no differences and is not remembered.
+ *
+ * @return 0 on success, -1 if the timestamps are not monotonically increasing
+ */
+__always_inline static int pers_sample_compute (pers_base_data_t *data, const struct pingpong_payload *payload, struct pers_sample *sample)
+{
+    sample->payload = payload;
+    sample->abs_latency = compute_latency (payload);
+    sample->corrected_latency = compute_corrected_latency (payload);
+    sample->has_prev = valid_pingpong_payload (&data->prev_payload);
+
+    if (UNLIKELY (sample->has_prev && payload->id <= data->prev_payload.id))
+    {
+        sample->has_prev = false;
+        return 0;
+    }
+
+    if (sample->has_prev)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            if (UNLIKELY (payload->ts[i] < data->prev_payload.ts[i]))
+            {
+                LOG (stderr, "ERROR: Timestamps are not monotonically increasing\n");
+                return -1;
+            }
+            sample->ts_diff[i] = payload->ts[i] - data->prev_payload.ts[i];
+        }
+    }
+
+    data->prev_payload = *payload;
+    return 0;
+}
+
+__always_inline static int pers_record_min_max_latency (persistence_agent_t *agent, const struct pers_sample *sample)
+{
+    struct min_max_latency_data *aux = agent->data->aux;
+    const uint64_t latency = sample->abs_latency;
+    if (latency < aux->min)
+    {
+        aux->min = latency;
+        aux->min_payload = *sample->payload;
+    }
+    if (latency > aux->max)
+    {
+        aux->max = latency;
+        aux->max_payload = *sample->payload;
+    }
+    return 0;
+}
+
+__always_inline static int pers_write_min_max_latency (persistence_agent_t *agent, const struct pingpong_payload *payload)
+{
+    // Only the latency is needed, the differences with the previous round are not computed
+    const struct pers_sample sample = {.payload = payload, .abs_latency = compute_latency (payload)};
+    return pers_record_min_max_latency (agent, &sample);
+}
+
+__always_inline static int pers_record_buckets (persistence_agent_t *agent, const struct pers_sample *sample)
+{
+    struct bucket_data *aux = agent->data->aux;
+
+    aux->tot_packets++;
+
+    if (!sample->has_prev)
+        return 0;
+
+    if (UNLIKELY (sample->payload->id % 1000000 == 0))
+    {
+        fprintf (stdout, "%llu\n", sample->payload->id);
+        fflush (stdout);
+    }
+
+    for (int i = 0; i < 4; ++i)
+    {
+        const uint64_t ts_diff = sample->ts_diff[i];
+        if (UNLIKELY (ts_diff < aux->min_values.rel_latency[i]))
+        {
+            aux->min_values.rel_latency[i] = ts_diff;
+        }
+        if (UNLIKELY (ts_diff > aux->max_values.rel_latency[i]))
+        {
+            aux->max_values.rel_latency[i] = ts_diff;
+        }
+        const uint32_t idx = bucket_idx (ts_diff, &aux->rel_range, aux->num_buckets);
+        aux->buckets[idx].rel_latency[i]++;
+    }
+
+    const uint64_t abs_latency = sample->abs_latency;
+
+    if (UNLIKELY (abs_latency < aux->min_values.abs_latency))
+    {
+        aux->min_values.abs_latency = abs_latency;
+    }
+    if (UNLIKELY (abs_latency > aux->max_values.abs_latency))
+    {
+        aux->max_values.abs_latency = abs_latency;
+    }
+
+    const uint32_t idx = bucket_idx (abs_latency, &aux->abs_range, aux->num_buckets);
+    aux->buckets[idx].abs_latency++;
+
+    return 0;
+}
+
+__always_inline static int pers_write_buckets (persistence_agent_t *agent, const struct pingpong_payload *payload)
+{
+    // Zeroed, since the differences are only computed when there is a previous round
+    struct pers_sample sample = {0};
+    if (pers_sample_compute (agent->data, payload, &sample) != 0)
+        return -1;
+    return pers_record_buckets (agent, &sample);
+}
+
+__always_inline static int pers_record_hdr (persistence_agent_t *agent, const struct pers_sample *sample)
+{
+    struct hdr_data *aux = agent->data->aux;
+
+    aux->tot_packets++;
+
+    hdr_record (&aux->abs_latency, sample->abs_latency);
+    hdr_record (&aux->corrected_latency, sample->corrected_latency);
+
+    if (!sample->has_prev)
+        return 0;
+
+    for (int i = 0; i < 4; i++)
+        hdr_record (&aux->rel_latency[i], sample->ts_diff[i]);
+
+    return 0;
+}
+
+__always_inline static int pers_write_hdr (persistence_agent_t *agent, const struct pingpong_payload *payload)
+{
+    // Zeroed, since the differences are only computed when there is a previous round
+    struct pers_sample sample = {0};
+    if (pers_sample_compute (agent->data, payload, &sample) != 0)
+        return -1;
+    return pers_record_hdr (agent, &sample);
+}
+
+int persistence_write_all_timestamps (persistence_agent_t *agent, const struct pingpong_payload *payload);
+int persistence_write_min_max_latency (persistence_agent_t *agent, const struct pingpong_payload *payload);
+int persistence_write_buckets (persistence_agent_t *agent, const struct pingpong_payload *payload);
+int persistence_write_hdr (persistence_agent_t *agent, const struct pingpong_payload *payload);
+
 /**
  * Initialize persistence module.
  * This function should be called before any other persistence function and only once.
+ * Unless the output is stdout, the experiment information and the source of the timestamps are also written,
+ * one `key value` pair per line, to `<filename>.meta`.
  *
  * @param filename the name of the file to store data
  * @param flags flags to define the type of measurement to store
- * @param aux auxiliary data to be used by the persistence agent
- * @return 0 on success, -1 on error
+ * @param config information about the experiment
+ * @return the persistence agent on success, NULL on error
+ */
+persistence_agent_t *persistence_init (const char *filename, uint32_t flags, const struct pers_config *config);
+
+/**
+ * Initialize one persistence agent per flow of `config`, writing to the file of the flow, see `pp_flow_filename`.
+ * The agent of each flow gets the interval of the flow. Only the agent of flow 0 publishes live statistics.
+ *
+ * @param agents array of PINGPONG_MAX_FLOWS agents, filled with the agent of each flow
+ * @param filename the name of the file to store data
+ * @param flags flags to define the type of measurement to store
+ * @param config information about the experiment
+ * @return 0 on success, -1 on error, in which case the agents already initialized are closed
+ */
+int persistence_init_flows (persistence_agent_t **agents, const char *filename, uint32_t flags, const struct pers_config *config);
+
+/**
+ * Close the agents initialized by `persistence_init_flows`.
  */
-persistence_agent_t *persistence_init (const char *filename, uint32_t flags, void *aux);
\ No newline at end of file
+void persistence_close_flows (persistence_agent_t **agents, uint32_t num_flows);
\ No newline at end of file
@@ -0,0 +1,290 @@
+#define _GNU_SOURCE
+#include "placement.h"
+#include "utils.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+static const char *placement_thread_names[] = {
+    [PLACEMENT_RX] = "rx",
+    [PLACEMENT_TX] = "tx",
+    [PLACEMENT_WRITER] = "writer",
+    [PLACEMENT_STATS] = "stats",
+};
+
+/**
+ * Where a thread actually runs, as recorded by `placement_verify`.
+ */
+struct placement_observed {
+    bool recorded;
+    char cpus[64];
+    int policy;
+    int priority;
+};
+
+// Written by each thread when it starts, read once the run is over
+static struct placement_observed observed[PLACEMENT_THREADS][PLACEMENT_MAX_INSTANCES];
+static pthread_mutex_t observed_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool memory_locked = false;
+
+static const char *policy_name (int policy)
+{
+    switch (policy)
+    {
+    case SCHED_OTHER:
+        return "other";
+    case SCHED_FIFO:
+        return "fifo";
+    case SCHED_RR:
+        return "rr";
+    default:
+        return "unknown";
+    }
+}
+
+static int policy_parse (const char *name, size_t len)
+{
+    if (len == 5 && strncmp (name, "other", len) == 0)
+        return SCHED_OTHER;
+    if (len == 4 && strncmp (name, "fifo", len) == 0)
+        return SCHED_FIFO;
+    if (len == 2 && strncmp (name, "rr", len) == 0)
+        return SCHED_RR;
+    return -1;
+}
+
+void placement_init (struct placement *placement)
+{
+    for (int i = 0; i < PLACEMENT_THREADS; ++i)
+        placement->threads[i] = (struct thread_placement) {.core = -1, .policy = -1, .priority = -1};
+    placement->spec = NULL;
+}
+
+/**
+ * Parse one `<core>[:<policy>[:<priority>]]`, ending at `end`.
+ */
+static int placement_parse_thread (const char *p, const char *end, struct thread_placement *thread)
+{
+    if (*p == '*')
+    {
+        thread->core = -1;
+        ++p;
+    }
+    else
+    {
+        char *num_end;
+        const long core = strtol (p, &num_end, 10);
+        if (num_end == p || core < 0 || core >= CPU_SETSIZE)
+            return -1;
+        thread->core = core;
+        p = num_end;
+    }
+
+    if (p == end)
+        return 0;
+    if (*p++ != ':')
+        return -1;
+
+    const char *colon = memchr (p, ':', end - p);
+    const char *policy_end = colon ? colon : end;
+    thread->policy = policy_parse (p, policy_end - p);
+    if (thread->policy < 0)
+        return -1;
+
+    thread->priority = 0;
+    if (colon)
+    {
+        char *num_end;
+        thread->priority = strtol (colon + 1, &num_end, 10);
+        if (num_end != end)
+            return -1;
+    }
+
+    const int min_priority = sched_get_priority_min (thread->policy);
+    const int max_priority = sched_get_priority_max (thread->policy);
+    return thread->priority >= min_priority && thread->priority <= max_priority ? 0 : -1;
+}
+
+int placement_parse (const char *spec, struct placement *placement)
+{
+    const char *p = spec;
+    while (*p != '\0')
+    {
+        const char *comma = strchr (p, ',');
+        const char *end = comma ? comma : p + strlen (p);
+        const char *equal = memchr (p, '=', end - p);
+        if (equal == NULL)
+            return -1;
+
+        int kind = -1;
+        for (int i = 0; i < PLACEMENT_THREADS; ++i)
+        {
+            if (strlen (placement_thread_names[i]) == (size_t) (equal - p) && strncmp (p, placement_thread_names[i], equal - p) == 0)
+                kind = i;
+        }
+        if (kind < 0 || placement_parse_thread (equal + 1, end, &placement->threads[kind]) != 0)
+            return -1;
+
+        p = comma ? comma + 1 : end;
+    }
+
+    placement->spec = spec;
+    return 0;
+}
+
+int placement_set_attr (const struct thread_placement *thread, int offset, pthread_attr_t *attr)
+{
+    int ret;
+    if (thread->core >= 0)
+    {
+        cpu_set_t cpuset;
+        CPU_ZERO (&cpuset);
+        CPU_SET (thread->core + offset, &cpuset);
+        if ((ret = pthread_attr_setaffinity_np (attr, sizeof (cpu_set_t), &cpuset)) != 0)
+            return ret;
+    }
+
+    if (thread->policy >= 0)
+    {
+        const struct sched_param param = {.sched_priority = thread->priority};
+        if ((ret = pthread_attr_setinheritsched (attr, PTHREAD_EXPLICIT_SCHED)) != 0 ||
+            (ret = pthread_attr_setschedpolicy (attr, thread->policy)) != 0 ||
+            (ret = pthread_attr_setschedparam (attr, &param)) != 0)
+            return ret;
+    }
+
+    return 0;
+}
+
+int placement_apply (const struct thread_placement *thread)
+{
+    int ret;
+    if (thread->core >= 0)
+    {
+        cpu_set_t cpuset;
+        CPU_ZERO (&cpuset);
+        CPU_SET (thread->core, &cpuset);
+        if ((ret = pthread_setaffinity_np (pthread_self (), sizeof (cpu_set_t), &cpuset)) != 0)
+            return ret;
+    }
+
+    if (thread->policy >= 0)
+    {
+        const struct sched_param param = {.sched_priority = thread->priority};
+        if ((ret = pthread_setschedparam (pthread_self (), thread->policy, &param)) != 0)
+            return ret;
+    }
+
+    return 0;
+}
+
+/**
+ * Write the cores of `cpuset` as a CPU list, e.g. 0-3,8.
+ */
+static void cpuset_format (const cpu_set_t *cpuset, char *buf, size_t size)
+{
+    size_t len = 0;
+    buf[0] = '\0';
+    for (int i = 0; i < CPU_SETSIZE && len < size; ++i)
+    {
+        if (!CPU_ISSET (i, cpuset))
+            continue;
+        int last = i;
+        while (last + 1 < CPU_SETSIZE && CPU_ISSET (last + 1, cpuset))
+            ++last;
+        if (last == i)
+            len += snprintf (buf + len, size - len, "%s%d", len ? "," : "", i);
+        else
+            len += snprintf (buf + len, size - len, "%s%d-%d", len ? "," : "", i, last);
+        i = last;
+    }
+}
+
+int placement_verify (pthread_t tid, enum placement_thread kind, uint32_t instance, const struct thread_placement *thread, int offset)
+{
+    cpu_set_t cpuset;
+    CPU_ZERO (&cpuset);
+    int policy;
+    struct sched_param param;
+    if (pthread_getaffinity_np (tid, sizeof (cpu_set_t), &cpuset) != 0 || pthread_getschedparam (tid, &policy, &param) != 0)
+    {
+        fprintf (stderr, "ERR: could not read the placement of the %s thread\n", placement_thread_names[kind]);
+        return -1;
+    }
+
+    if (instance < PLACEMENT_MAX_INSTANCES)
+    {
+        pthread_mutex_lock (&observed_lock);
+        struct placement_observed *entry = &observed[kind][instance];
+        cpuset_format (&cpuset, entry->cpus, sizeof (entry->cpus));
+        entry->policy = policy;
+        entry->priority = param.sched_priority;
+        entry->recorded = true;
+        pthread_mutex_unlock (&observed_lock);
+    }
+
+    if (thread == NULL)
+        return 0;
+
+    int ret = 0;
+    if (thread->core >= 0 && (CPU_COUNT (&cpuset) != 1 || !CPU_ISSET (thread->core + offset, &cpuset)))
+    {
+        fprintf (stderr, "ERR: the %s thread %u does not run on core %d\n", placement_thread_names[kind], instance, thread->core + offset);
+        ret = -1;
+    }
+    if (thread->policy >= 0 && (policy != thread->policy || param.sched_priority != thread->priority))
+    {
+        fprintf (stderr, "ERR: the %s thread %u runs with policy %s:%d instead of %s:%d\n", placement_thread_names[kind], instance,
+                 policy_name (policy), param.sched_priority, policy_name (thread->policy), thread->priority);
+        ret = -1;
+    }
+    return ret;
+}
+
+int placement_lock_memory (void)
+{
+    // With a limit, MCL_FUTURE makes every allocation beyond it fail: only lock when the limit does not apply
+    struct rlimit limit;
+    if (geteuid () != 0 && (getrlimit (RLIMIT_MEMLOCK, &limit) != 0 || limit.rlim_cur != RLIM_INFINITY))
+    {
+        fprintf (stderr, "WARN: the locked memory is limited, not locking the memory of the process\n");
+        return -1;
+    }
+
+    if (mlockall (MCL_CURRENT | MCL_FUTURE) != 0)
+    {
+        fprintf (stderr, "WARN: mlockall failed: %s\n", strerror (errno));
+        return -1;
+    }
+
+    memory_locked = true;
+    return 0;
+}
+
+void placement_print (FILE *file, const struct placement *placement)
+{
+    fprintf (file, "mlockall %d\n", memory_locked);
+    fprintf (file, "placement %s\n", placement && placement->spec ? placement->spec : "default");
+
+    pthread_mutex_lock (&observed_lock);
+    for (int kind = 0; kind < PLACEMENT_THREADS; ++kind)
+    {
+        for (uint32_t i = 0; i < PLACEMENT_MAX_INSTANCES; ++i)
+        {
+            const struct placement_observed *entry = &observed[kind][i];
+            if (!entry->recorded)
+                continue;
+            // The senders and the writers are numbered by flow, the other threads are single
+            if (kind == PLACEMENT_TX || kind == PLACEMENT_WRITER)
+                fprintf (file, "thread_%s%u %s:%s:%d\n", placement_thread_names[kind], i, entry->cpus, policy_name (entry->policy), entry->priority);
+            else
+                fprintf (file, "thread_%s %s:%s:%d\n", placement_thread_names[kind], entry->cpus, policy_name (entry->policy), entry->priority);
+        }
+    }
+    pthread_mutex_unlock (&observed_lock);
+}
@@ -0,0 +1,100 @@
+/**
+ * Placement of the threads of a run: the core and the scheduling policy of each of them.
+ *
+ * A placement is given as a comma-separated list of `<thread>=<core>[:<policy>[:<priority>]]`, e.g.
+ * `rx=2:fifo:80,tx=3:fifo:70,writer=0`, where:
+ * - <thread> is rx (the measured loop, i.e. the main thread), tx (the sender of the first flow, the sender of flow i
+ *   running on <core> + i), writer (the persistence writer of -a) or stats (the reader of the live statistics);
+ * - <core> is a core id, or * to leave the affinity as it is;
+ * - <policy> is other, fifo or rr, and <priority> its priority (1-99 for fifo and rr).
+ *
+ * The threads that are not listed keep the default placement: the sender runs on the core following the one of the
+ * main thread when that one is pinned to a single core of a machine with more than one, failing if that core is not
+ * online, and the writer on a housekeeping core. A thread without a policy inherits the one of the thread creating it.
+ *
+ * Each thread checks at startup that it runs where it was placed and records where it actually runs, so that the
+ * placement can be written in the metadata of the run, see `placement_print`.
+ */
+#pragma once
+
+#include "common.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+enum placement_thread {
+    PLACEMENT_RX = 0,
+    PLACEMENT_TX,
+    PLACEMENT_WRITER,
+    PLACEMENT_STATS,
+    PLACEMENT_THREADS,
+};
+
+/* Instances of a kind of thread whose placement is recorded, e.g. one sender per flow */
+#define PLACEMENT_MAX_INSTANCES PINGPONG_MAX_FLOWS
+
+/**
+ * Requested placement of a thread, -1 for what is not set.
+ */
+struct thread_placement {
+    int core;
+    int policy;// SCHED_OTHER, SCHED_FIFO or SCHED_RR
+    int priority;
+};
+
+struct placement {
+    struct thread_placement threads[PLACEMENT_THREADS];
+    // The specification as given, NULL if none
+    const char *spec;
+};
+
+/**
+ * Initialize a placement where nothing is set.
+ */
+void placement_init (struct placement *placement);
+
+/**
+ * Parse a placement, see above. The threads not in `spec` are left as they are.
+ *
+ * @return 0 on success, -1 if the placement is not valid
+ */
+int placement_parse (const char *spec, struct placement *placement);
+
+/**
+ * Set the affinity and the scheduling policy of `thread`, shifted by `offset` cores, in the attributes of the
+ * thread to create.
+ *
+ * @return 0 on success, an error number otherwise
+ */
+int placement_set_attr (const struct thread_placement *thread, int offset, pthread_attr_t *attr);
+
+/**
+ * Apply `thread` to the calling thread.
+ *
+ * @return 0 on success, an error number otherwise
+ */
+int placement_apply (const struct thread_placement *thread);
+
+/**
+ * Record where `tid` runs, as instance `instance` of `kind`, and check that it matches `thread`, shifted by `offset`
+ * cores.
+ *
+ * @param thread the requested placement, NULL if none
+ * @return 0 if the thread runs as requested, -1 otherwise
+ */
+int placement_verify (pthread_t tid, enum placement_thread kind, uint32_t instance, const struct thread_placement *thread, int offset);
+
+/**
+ * Lock the current and future memory of the process, so that the measured threads never take a page fault.
+ * Skipped, with a warning, if the limit of locked memory would make the later allocations fail.
+ *
+ * @return 0 if the memory is locked, -1 otherwise
+ */
+int placement_lock_memory (void);
+
+/**
+ * Print the requested placement and where each recorded thread runs, one `key value` pair per line, e.g.
+ * `thread_tx1 0-3:other:0` for the sender of the second flow; the senders and the writers are numbered by flow.
+ */
+void placement_print (FILE *file, const struct placement *placement);
@@ -0,0 +1,124 @@
+/**
+ * Lock-free single-producer/single-consumer ring of pingpong payloads.
+ *
+ * The producer and the consumer only share the `head` and `tail` indexes, which live on different cache lines.
+ * Each side keeps a private copy of the other side's index and reloads it only when the ring looks full (producer)
+ * or empty (consumer), so in the common case a push is a copy of the payload plus one release store.
+ */
+#pragma once
+
+#include "common.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/mman.h>
+
+struct spsc_ring {
+    // Written by the producer
+    _Alignas (CACHE_LINE_SIZE) _Atomic uint64_t head;
+    uint64_t cached_tail;
+    // Number of payloads dropped because the ring was full
+    uint64_t overflows;
+
+    // Written by the consumer
+    _Alignas (CACHE_LINE_SIZE) _Atomic uint64_t tail;
+    uint64_t cached_head;
+
+    // Read-only after initialization
+    _Alignas (CACHE_LINE_SIZE) uint64_t mask;
+    struct pingpong_payload *slots;
+};
+
+/**
+ * Initialize the ring and allocate its slots.
+ * The slots are locked and prefaulted so that the producer never takes a page fault.
+ *
+ * @param ring the ring to initialize
+ * @param capacity the number of slots of the ring, must be a power of 2
+ * @return 0 on success, -1 on error
+ */
+static inline int spsc_ring_init (struct spsc_ring *ring, uint64_t capacity)
+{
+    if (capacity == 0 || (capacity & (capacity - 1)) != 0)
+        return -1;
+
+    void *slots = mmap (NULL, capacity * sizeof (struct pingpong_payload), PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_LOCKED | MAP_POPULATE, -1, 0);
+    if (slots == MAP_FAILED)
+        return -1;
+
+    atomic_init (&ring->head, 0);
+    atomic_init (&ring->tail, 0);
+    ring->cached_tail = 0;
+    ring->cached_head = 0;
+    ring->overflows = 0;
+    ring->mask = capacity - 1;
+    ring->slots = slots;
+    return 0;
+}
+
+static inline void spsc_ring_destroy (struct spsc_ring *ring)
+{
+    munmap (ring->slots, (ring->mask + 1) * sizeof (struct pingpong_payload));
+    ring->slots = NULL;
+}
+
+/**
+ * Push a payload into the ring. Must be called only by the producer.
+ * If the ring is full, the payload is dropped and the overflow counter is incremented: the producer never waits.
+ *
+ * @param ring the ring
+ * @param payload the payload to copy into the ring
+ * @return true if the payload was pushed, false if it was dropped
+ */
+static inline bool spsc_ring_push (struct spsc_ring *ring, const struct pingpong_payload *payload)
+{
+    const uint64_t head = atomic_load_explicit (&ring->head, memory_order_relaxed);
+    if (UNLIKELY (head - ring->cached_tail > ring->mask))
+    {
+        ring->cached_tail = atomic_load_explicit (&ring->tail, memory_order_acquire);
+        if (head - ring->cached_tail > ring->mask)
+        {
+            ring->overflows++;
+            return false;
+        }
+    }
+
+    ring->slots[head & ring->mask] = *payload;
+    atomic_store_explicit (&ring->head, head + 1, memory_order_release);
+    return true;
+}
+
+/**
+ * Return the number of payloads that can be consumed. Must be called only by the consumer.
+ * The payloads are accessed with `spsc_ring_slot` and released with `spsc_ring_consume`.
+ *
+ * @param ring the ring
+ * @return the number of payloads available
+ */
+static inline uint64_t spsc_ring_available (struct spsc_ring *ring)
+{
+    const uint64_t tail = atomic_load_explicit (&ring->tail, memory_order_relaxed);
+    if (ring->cached_head == tail)
+        ring->cached_head = atomic_load_explicit (&ring->head, memory_order_acquire);
+    return ring->cached_head - tail;
+}
+
+/**
+ * Return the i-th available payload, starting from the oldest one.
+ */
+static inline const struct pingpong_payload *spsc_ring_slot (struct spsc_ring *ring, uint64_t i)
+{
+    const uint64_t tail = atomic_load_explicit (&ring->tail, memory_order_relaxed);
+    return &ring->slots[(tail + i) & ring->mask];
+}
+
+/**
+ * Release `n` payloads, making their slots available to the producer again.
+ */
+static inline void spsc_ring_consume (struct spsc_ring *ring, uint64_t n)
+{
+    const uint64_t tail = atomic_load_explicit (&ring->tail, memory_order_relaxed);
+    atomic_store_explicit (&ring->tail, tail + n, memory_order_release);
+}
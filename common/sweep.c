@@ -0,0 +1,112 @@
+#include "sweep.h"
+#include "utils.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Parse up to `count` numbers separated by ':', of which the first `required` must be present.
+ */
+static int sweep_parse_numbers (const char *spec, uint64_t *values, int count, int required)
+{
+    int parsed = 0;
+    const char *cur = spec;
+    while (cur != NULL && parsed < count)
+    {
+        char *end;
+        values[parsed++] = strtoull (cur, &end, 10);
+        if (end == cur || (*end != ':' && *end != '\0'))
+            return -1;
+        cur = *end == ':' ? end + 1 : NULL;
+    }
+
+    if (cur != NULL)
+        return -1;
+    return parsed >= required ? 0 : -1;
+}
+
+int sweep_parse (const char *spec, struct sweep *sweep)
+{
+    memset (sweep, 0, sizeof (struct sweep));
+
+    uint64_t values[4];
+    if (sweep_parse_numbers (spec, values, 4, 4) != 0 || values[0] == 0 || values[1] < values[0] ||
+        values[1] > 1000000000UL || values[2] == 0 || values[2] > SWEEP_MAX_STEPS || values[3] == 0)
+    {
+        LOG (stderr, "ERROR: Invalid sweep %s\n", spec);
+        return -1;
+    }
+
+    sweep->from = values[0];
+    sweep->to = values[1];
+    sweep->num_steps = values[2];
+    sweep->dwell = values[3];
+
+    uint64_t first_id = 1;
+    for (uint32_t i = 0; i < sweep->num_steps; ++i)
+    {
+        struct sweep_step *step = &sweep->steps[i];
+        step->rate = sweep->num_steps > 1 ? sweep->from + (sweep->to - sweep->from) * i / (sweep->num_steps - 1) : sweep->from;
+        step->interval = (1000000000UL + step->rate / 2) / step->rate;
+        step->packets = max (sweep->dwell / step->interval, 1UL);
+        step->first_id = first_id;
+        first_id += step->packets;
+    }
+
+    return 0;
+}
+
+int sweep_parse_bounds (const char *spec, struct sweep *sweep)
+{
+    uint64_t values[2] = {0, 0};
+    if (sweep_parse_numbers (spec, values, 2, 1) != 0 || values[0] == 0)
+    {
+        LOG (stderr, "ERROR: Invalid sweep bounds %s\n", spec);
+        return -1;
+    }
+
+    sweep->bound_p99 = values[0];
+    sweep->bound_p999 = values[1];
+    return 0;
+}
+
+int sweep_schedule (const struct sweep *sweep, uint64_t **offsets)
+{
+    const uint64_t packets = sweep_packets (sweep);
+    *offsets = malloc (packets * sizeof (uint64_t));
+    if (*offsets == NULL)
+    {
+        PERROR ("malloc");
+        return -1;
+    }
+
+    // Each step starts one interval of the new rate after the last packet of the previous one
+    uint64_t offset = 0;
+    for (uint32_t i = 0; i < sweep->num_steps; ++i)
+    {
+        const struct sweep_step *step = &sweep->steps[i];
+        for (uint64_t j = 0; j < step->packets; ++j)
+        {
+            (*offsets)[step->first_id - 1 + j] = offset;
+            offset += step->interval;
+        }
+    }
+
+    return 0;
+}
+
+bool sweep_within_bound (const struct hdr_histogram *latency, uint64_t lost, double percentile, uint64_t bound)
+{
+    const uint64_t total = latency->total_count + lost;
+    if (total == 0 || percentile > 100.0 * latency->total_count / total)
+        return false;
+    return hdr_value_at_percentile (latency, percentile * total / latency->total_count) <= bound;
+}
+
+bool sweep_sustainable (const struct sweep *sweep, const struct hdr_histogram *latency, uint64_t lost)
+{
+    if (sweep->bound_p99 == 0)
+        return latency->total_count > 0 && lost == 0;
+    return sweep_within_bound (latency, lost, 99.0, sweep->bound_p99) &&
+           (sweep->bound_p999 == 0 || sweep_within_bound (latency, lost, 99.9, sweep->bound_p999));
+}
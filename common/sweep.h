@@ -0,0 +1,100 @@
+/**
+ * Rate sweep: a single run made of consecutive steps of increasing offered rate, to find the highest rate the
+ * system sustains under a latency bound.
+ *
+ * A sweep is given as `<from>:<to>:<steps>:<dwell>`: `steps` rates linearly spaced from `from` to `to` packets per
+ * second, each offered for `dwell` nanoseconds. The ids of the packets are contiguous across the steps, so that the
+ * senders and the receive loops see an ordinary run of `sweep_packets` packets; the persistence agents split it again
+ * by step, see `persistence_init`.
+ *
+ * A step is sustainable when the p99 and p99.9 latencies, with the lost rounds counted as infinitely late, are
+ * within the bounds given as `<p99>[:<p99.9>]` in nanoseconds. Without bounds, a step is sustainable when no
+ * round is lost. The maximum sustainable rate is the rate of the last step of the initial run of sustainable steps.
+ */
+#pragma once
+
+#include "common.h"
+#include "histogram.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SWEEP_MAX_STEPS 64
+
+struct sweep_step {
+    // Offered rate in packets per second, and the corresponding interval in nanoseconds
+    uint64_t rate;
+    uint64_t interval;
+    // Ids of the step: [first_id, first_id + packets)
+    uint64_t first_id;
+    uint64_t packets;
+};
+
+struct sweep {
+    uint64_t from;
+    uint64_t to;
+    uint64_t dwell;
+    // Latency bounds in nanoseconds, 0 if not set
+    uint64_t bound_p99;
+    uint64_t bound_p999;
+
+    uint32_t num_steps;
+    struct sweep_step steps[SWEEP_MAX_STEPS];
+};
+
+/**
+ * Parse a sweep, see above, and compute its steps.
+ *
+ * @param spec the sweep to parse
+ * @param sweep the sweep to fill
+ * @return 0 on success, -1 if the sweep is not valid
+ */
+int sweep_parse (const char *spec, struct sweep *sweep);
+
+/**
+ * Parse the latency bounds of a sweep, `<p99>[:<p99.9>]` in nanoseconds.
+ *
+ * @return 0 on success, -1 if the bounds are not valid
+ */
+int sweep_parse_bounds (const char *spec, struct sweep *sweep);
+
+/**
+ * Total number of packets of the sweep.
+ */
+static inline uint64_t sweep_packets (const struct sweep *sweep)
+{
+    const struct sweep_step *last = &sweep->steps[sweep->num_steps - 1];
+    return last->first_id + last->packets - 1;
+}
+
+/**
+ * Step of packet `id`, starting the search from step `hint` since the packets mostly arrive in order.
+ */
+static inline uint32_t sweep_step_of (const struct sweep *sweep, uint64_t id, uint32_t hint)
+{
+    uint32_t step = hint;
+    while (UNLIKELY (step > 0 && id < sweep->steps[step].first_id))
+        --step;
+    while (UNLIKELY (step + 1 < sweep->num_steps && id >= sweep->steps[step + 1].first_id))
+        ++step;
+    return step;
+}
+
+/**
+ * Compute the departure time of each packet of the sweep, relative to the first one, in the format of
+ * `arrival_schedule`.
+ *
+ * @param sweep the sweep
+ * @param offsets filled with an array of `sweep_packets` offsets in nanoseconds, to be freed by the caller
+ * @return 0 on success, -1 on error
+ */
+int sweep_schedule (const struct sweep *sweep, uint64_t **offsets);
+
+/**
+ * Whether the latency of a step at `percentile`, counting the `lost` rounds as infinitely late, is within `bound`.
+ */
+bool sweep_within_bound (const struct hdr_histogram *latency, uint64_t lost, double percentile, uint64_t bound);
+
+/**
+ * Whether a step is sustainable under the bounds of the sweep, see above.
+ */
+bool sweep_sustainable (const struct sweep *sweep, const struct hdr_histogram *latency, uint64_t lost);
@@ -0,0 +1,502 @@
+#include "tdigest.h"
+#include "utils.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+static void tdigest_batch_reset (struct tdigest_batch *batch, uint64_t base)
+{
+    batch->base = base;
+    batch->num_outliers = 0;
+    batch->outliers_or = 0;
+    batch->outliers_and = UINT64_MAX;
+}
+
+/**
+ * Base of the window centered on `value`.
+ */
+static inline uint64_t tdigest_center (uint64_t value)
+{
+    return value > TDIGEST_DIRECT_RANGE / 2 ? value - TDIGEST_DIRECT_RANGE / 2 : 0;
+}
+
+int tdigest_init (struct tdigest *td, double compression)
+{
+    if (compression < 10)
+        return -1;
+
+    memset (td, 0, sizeof (struct tdigest));
+    td->compression = compression;
+    // The k2 scale function keeps the number of centroids below `compression`; the margin covers the greedy merge
+    td->max_centroids = 2 * (uint32_t) compression + 8;
+
+    // A single prefaulted area, so that the thread adding the values never takes a page fault
+    const size_t merge_size = TDIGEST_BATCH_SIZE + td->max_centroids;
+    const size_t doubles = 2 * td->max_centroids + 2 * merge_size;
+    const size_t values = 3 * TDIGEST_BATCH_SIZE;
+    td->memory_size = doubles * sizeof (double) + values * sizeof (uint64_t) + 2 * TDIGEST_DIRECT_RANGE * sizeof (uint32_t);
+    void *memory = mmap (NULL, td->memory_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (memory == MAP_FAILED)
+        return -1;
+    td->memory = memory;
+
+    double *d = memory;
+    td->means = d;
+    td->weights = d + td->max_centroids;
+    td->merge_means = d + 2 * td->max_centroids;
+    td->merge_weights = td->merge_means + merge_size;
+    uint64_t *v = (uint64_t *) (d + doubles);
+    td->batches[0].outliers = v;
+    td->batches[1].outliers = v + TDIGEST_BATCH_SIZE;
+    td->sort_tmp = v + 2 * TDIGEST_BATCH_SIZE;
+    uint32_t *c = (uint32_t *) (v + values);
+    td->batches[0].counts = c;
+    td->batches[1].counts = c + TDIGEST_DIRECT_RANGE;
+
+    tdigest_batch_reset (&td->batches[0], TDIGEST_NO_BASE);
+    tdigest_batch_reset (&td->batches[1], TDIGEST_NO_BASE);
+    td->base = TDIGEST_NO_BASE;
+    td->counts = td->batches[0].counts;
+    td->countdown = TDIGEST_TICK;
+    td->step = TDIGEST_STEP;
+    td->next_base = TDIGEST_NO_BASE;
+    td->min = UINT64_MAX;
+    td->max = 0;
+    return 0;
+}
+
+void tdigest_destroy (struct tdigest *td)
+{
+    if (td->memory)
+        munmap (td->memory, td->memory_size);
+    td->memory = NULL;
+    td->means = td->weights = td->merge_means = td->merge_weights = NULL;
+    td->batches[0].outliers = td->batches[1].outliers = td->sort_tmp = td->sorted = NULL;
+    td->batches[0].counts = td->batches[1].counts = td->counts = NULL;
+}
+
+/**
+ * Move to the next byte of the radix sort that varies among the outliers, or to the merge once there is none left.
+ */
+static void tdigest_sort_next (struct tdigest *td, uint32_t shift)
+{
+    while (shift < 64 && ((td->sort_varying >> shift) & 0xff) == 0)
+        shift += 8;
+
+    td->cursor = 0;
+    if (shift >= 64)
+    {
+        td->phase = TDIGEST_MERGE;
+        return;
+    }
+    td->sort_shift = shift;
+    memset (td->sort_offsets, 0, sizeof (td->sort_offsets));
+    td->phase = TDIGEST_SORT_COUNT;
+}
+
+/**
+ * LSD radix sort of the outliers of `batch`, one byte at a time. The bytes that are the same in all the values are
+ * skipped.
+ */
+static void tdigest_sort_step (struct tdigest *td, struct tdigest_batch *batch)
+{
+    const uint32_t n = batch->num_outliers;
+    const uint32_t end = min (td->cursor + td->step, n);
+    const uint32_t shift = td->sort_shift;
+
+    if (td->phase == TDIGEST_SORT_COUNT)
+    {
+        for (uint32_t i = td->cursor; i < end; ++i)
+            td->sort_offsets[(td->sorted[i] >> shift) & 0xff]++;
+        td->cursor = end;
+        if (end < n)
+            return;
+
+        uint32_t sum = 0;
+        for (uint32_t b = 0; b < 256; ++b)
+        {
+            const uint32_t count = td->sort_offsets[b];
+            td->sort_offsets[b] = sum;
+            sum += count;
+        }
+        td->cursor = 0;
+        td->phase = TDIGEST_SORT_MOVE;
+        return;
+    }
+
+    // The values go back and forth between the outliers of the batch and the scratch array
+    uint64_t *dst = td->sorted == batch->outliers ? td->sort_tmp : batch->outliers;
+    for (uint32_t i = td->cursor; i < end; ++i)
+        dst[td->sort_offsets[(td->sorted[i] >> shift) & 0xff]++] = td->sorted[i];
+    td->cursor = end;
+    if (end < n)
+        return;
+
+    td->sorted = dst;
+    tdigest_sort_next (td, shift + 8);
+}
+
+/**
+ * Start the compression of the `n` sorted (mean, weight) pairs of the merge arrays into the centroids.
+ * Adjacent pairs are merged as long as the resulting centroid spans less than one unit of the k2 scale function,
+ * k(q) = compression / Z(n) * log(q / (1 - q)), with Z(n) = 4 * log(n / compression) + 24.
+ */
+static void tdigest_compress_start (struct tdigest *td, uint32_t n)
+{
+    const double total = td->merged_count;
+    const double z = 4 * log (max (total / td->compression, 1.0)) + 24;
+    // Moving one unit along the k scale multiplies q / (1 - q) by this factor
+    td->compress_step = exp (z / td->compression);
+
+    td->weight_so_far = 0;
+    // Maximum cumulative weight of the current centroid
+    td->weight_limit = 0;
+    td->cur_sum = td->merge_means[0] * td->merge_weights[0];
+    td->cur_weight = td->merge_weights[0];
+    td->num_compressed = 0;
+    td->num_merged = n;
+    td->cursor = 1;
+    td->phase = TDIGEST_COMPRESS;
+}
+
+static void tdigest_compress_step (struct tdigest *td)
+{
+    const double total = td->merged_count;
+    const double step = td->compress_step;
+    const uint32_t last = td->max_centroids - 1;
+    const double *merge_means = td->merge_means;
+    const double *merge_weights = td->merge_weights;
+    double *means = td->means;
+    double *weights = td->weights;
+
+    double weight_so_far = td->weight_so_far;
+    double weight_limit = td->weight_limit;
+    double cur_sum = td->cur_sum;
+    double cur_weight = td->cur_weight;
+    uint32_t out = td->num_compressed;
+
+    const uint32_t end = min (td->cursor + td->step, td->num_merged);
+    for (uint32_t i = td->cursor; i < end; ++i)
+    {
+        const double weight = merge_weights[i];
+        if (weight_so_far + cur_weight + weight <= weight_limit || out == last)
+        {
+            cur_sum += merge_means[i] * weight;
+            cur_weight += weight;
+            continue;
+        }
+
+        means[out] = cur_sum / cur_weight;
+        weights[out++] = cur_weight;
+
+        weight_so_far += cur_weight;
+        const double ratio = weight_so_far / (total - weight_so_far) * step;
+        weight_limit = ratio / (1 + ratio) * total;
+
+        cur_sum = merge_means[i] * weight;
+        cur_weight = weight;
+    }
+    td->cursor = end;
+
+    if (end < td->num_merged)
+    {
+        td->weight_so_far = weight_so_far;
+        td->weight_limit = weight_limit;
+        td->cur_sum = cur_sum;
+        td->cur_weight = cur_weight;
+        td->num_compressed = out;
+        return;
+    }
+
+    means[out] = cur_sum / cur_weight;
+    weights[out] = cur_weight;
+    td->num_centroids = out + 1;
+    td->phase = TDIGEST_IDLE;
+}
+
+/**
+ * Merge the next runs of values of the batch with the centroids, in the merge arrays. The runs are taken in the order
+ * of the values: the outliers below the window, the counted values, the outliers above the window. On the way, they
+ * give the minimum, the maximum and the median of the batch.
+ * The state is kept in locals during the step, since the stores to the arrays could alias the fields of the digest.
+ */
+static void tdigest_merge_step (struct tdigest *td, struct tdigest_batch *batch)
+{
+    const uint64_t *outliers = td->sorted;
+    const uint32_t num_outliers = batch->num_outliers;
+    uint32_t *counts = batch->counts;
+    const uint64_t base = batch->base;
+    const uint32_t num_counters = td->num_counters;
+    const double *means = td->means;
+    const double *weights = td->weights;
+    const uint32_t num_centroids = td->num_centroids;
+    double *merge_means = td->merge_means;
+    double *merge_weights = td->merge_weights;
+
+    uint32_t next_outlier = td->next_outlier;
+    uint32_t next_counter = td->next_counter;
+    uint32_t next_centroid = td->next_centroid;
+    uint32_t n = td->num_merged;
+    bool has_run = td->has_run;
+    bool runs_done = td->runs_done;
+    uint64_t run_value = td->run_value;
+    uint32_t run_weight = td->run_weight;
+    uint32_t to_median = td->to_median;
+    uint64_t next_base = td->next_base;
+    uint64_t lowest = td->min;
+    uint64_t highest = td->max;
+
+    for (uint32_t budget = td->step; budget > 0; --budget)
+    {
+        if (!has_run && !runs_done)
+        {
+            if (next_outlier < num_outliers && (next_counter == num_counters || outliers[next_outlier] < base))
+            {
+                run_value = outliers[next_outlier++];
+                run_weight = 1;
+            }
+            else if (next_counter < num_counters)
+            {
+                const uint32_t limit = min (next_counter + TDIGEST_SKIP, num_counters);
+                while (next_counter < limit && counts[next_counter] == 0)
+                    ++next_counter;
+                if (next_counter == limit)
+                    continue;
+                run_value = base + next_counter;
+                run_weight = counts[next_counter];
+                counts[next_counter++] = 0;
+            }
+            else
+            {
+                runs_done = true;
+                continue;
+            }
+
+            has_run = true;
+            lowest = min (lowest, run_value);
+            highest = max (highest, run_value);
+            if (to_median > 0 && run_weight >= to_median)
+                next_base = tdigest_center (run_value);
+            to_median -= min (to_median, run_weight);
+        }
+
+        if (has_run && (next_centroid == num_centroids || run_value < means[next_centroid]))
+        {
+            merge_means[n] = run_value;
+            merge_weights[n++] = run_weight;
+            has_run = false;
+        }
+        else if (next_centroid < num_centroids)
+        {
+            merge_means[n] = means[next_centroid];
+            merge_weights[n++] = weights[next_centroid++];
+        }
+        else
+        {
+            td->next_base = next_base;
+            td->min = lowest;
+            td->max = highest;
+            tdigest_compress_start (td, n);
+            return;
+        }
+    }
+
+    td->next_outlier = next_outlier;
+    td->next_counter = next_counter;
+    td->next_centroid = next_centroid;
+    td->num_merged = n;
+    td->has_run = has_run;
+    td->runs_done = runs_done;
+    td->run_value = run_value;
+    td->run_weight = run_weight;
+    td->to_median = to_median;
+    td->next_base = next_base;
+    td->min = lowest;
+    td->max = highest;
+}
+
+void tdigest_step (struct tdigest *td)
+{
+    struct tdigest_batch *batch = &td->batches[td->active ^ 1];
+    switch (td->phase)
+    {
+    case TDIGEST_SORT_COUNT:
+    case TDIGEST_SORT_MOVE:
+        tdigest_sort_step (td, batch);
+        break;
+    case TDIGEST_MERGE:
+        tdigest_merge_step (td, batch);
+        break;
+    case TDIGEST_COMPRESS:
+        tdigest_compress_step (td);
+        break;
+    case TDIGEST_IDLE:
+        break;
+    }
+}
+
+static void tdigest_finish (struct tdigest *td)
+{
+    while (td->phase != TDIGEST_IDLE)
+        tdigest_step (td);
+}
+
+void tdigest_rotate (struct tdigest *td)
+{
+    // The previous merge should be over by now; if not, e.g. with many outliers, it is finished at once
+    tdigest_finish (td);
+    const uint32_t buffered = td->num_buffered + TDIGEST_TICK - td->countdown;
+    if (buffered == 0)
+        return;
+
+    struct tdigest_batch *full = &td->batches[td->active];
+    td->active ^= 1;
+    // The window of the next batch is centered on the median of the batch merged last, one batch behind this one
+    struct tdigest_batch *next = &td->batches[td->active];
+    tdigest_batch_reset (next, td->next_base != TDIGEST_NO_BASE ? td->next_base : full->base);
+    td->base = next->base;
+    td->counts = next->counts;
+
+    td->merged_count += buffered;
+    td->num_buffered = 0;
+    td->countdown = TDIGEST_TICK;
+
+    td->sorted = full->outliers;
+    td->sort_varying = full->num_outliers ? full->outliers_or ^ full->outliers_and : 0;
+    td->next_outlier = 0;
+    td->next_counter = 0;
+    td->num_counters = full->base != TDIGEST_NO_BASE ? TDIGEST_DIRECT_RANGE : 0;
+    td->next_centroid = 0;
+    td->has_run = false;
+    td->runs_done = false;
+    td->num_merged = 0;
+    td->to_median = (buffered + 1) / 2;
+
+    // Elements of work of the merge: two per varying byte of each outlier for the radix sort, then the runs and the
+    // centroids, merged and compressed. Each tick does enough of it for the merge to end within 3/4 of a batch
+    uint32_t passes = 0;
+    for (uint32_t shift = 0; shift < 64; shift += 8)
+        passes += ((td->sort_varying >> shift) & 0xff) != 0;
+    const uint64_t runs = full->num_outliers + min (buffered, (uint32_t) TDIGEST_DIRECT_RANGE);
+    const uint64_t work = 2ULL * passes * full->num_outliers + 2 * (runs + td->num_centroids) +
+                          TDIGEST_DIRECT_RANGE / TDIGEST_SKIP;
+    const uint64_t ticks = TDIGEST_BATCH_SIZE / TDIGEST_TICK * 3 / 4;
+    td->step = max ((uint64_t) TDIGEST_STEP, (work + ticks - 1) / ticks);
+    tdigest_sort_next (td, 0);
+}
+
+void tdigest_add_outlier (struct tdigest *td, uint64_t value)
+{
+    struct tdigest_batch *batch = &td->batches[td->active];
+    if (UNLIKELY (batch->base == TDIGEST_NO_BASE))
+    {
+        // The window of the first batch is centered on its first value
+        batch->base = td->base = tdigest_center (value);
+        td->counts[value - td->base]++;
+        return;
+    }
+    batch->outliers[batch->num_outliers++] = value;
+    batch->outliers_or |= value;
+    batch->outliers_and &= value;
+}
+
+void tdigest_tick (struct tdigest *td)
+{
+    td->countdown = TDIGEST_TICK;
+    td->num_buffered += TDIGEST_TICK;
+    if (td->phase != TDIGEST_IDLE)
+        tdigest_step (td);
+    if (td->num_buffered == TDIGEST_BATCH_SIZE)
+        tdigest_rotate (td);
+}
+
+void tdigest_flush (struct tdigest *td)
+{
+    tdigest_rotate (td);
+    tdigest_finish (td);
+}
+
+uint64_t tdigest_count (const struct tdigest *td)
+{
+    return td->merged_count + td->num_buffered + TDIGEST_TICK - td->countdown;
+}
+
+int tdigest_merge (struct tdigest *dst, struct tdigest *src)
+{
+    tdigest_flush (dst);
+    tdigest_flush (src);
+
+    if (src->num_centroids == 0)
+        return 0;
+    if (dst->num_centroids + src->num_centroids > TDIGEST_BATCH_SIZE + dst->max_centroids)
+        return -1;
+
+    uint32_t n = 0, i = 0, j = 0;
+    while (i < dst->num_centroids || j < src->num_centroids)
+    {
+        if (j == src->num_centroids || (i < dst->num_centroids && dst->means[i] < src->means[j]))
+        {
+            dst->merge_means[n] = dst->means[i];
+            dst->merge_weights[n++] = dst->weights[i++];
+        }
+        else
+        {
+            dst->merge_means[n] = src->means[j];
+            dst->merge_weights[n++] = src->weights[j++];
+        }
+    }
+
+    dst->merged_count += src->merged_count;
+    dst->min = min (dst->min, src->min);
+    dst->max = max (dst->max, src->max);
+    tdigest_compress_start (dst, n);
+    tdigest_finish (dst);
+
+    return 0;
+}
+
+double tdigest_quantile (struct tdigest *td, double q)
+{
+    tdigest_flush (td);
+
+    if (td->num_centroids == 0)
+        return 0;
+    if (q <= 0)
+        return td->min;
+    if (q >= 1)
+        return td->max;
+
+    // Each centroid sits at the middle of its weight; the min and the max are the two ends of the distribution
+    const double total = td->merged_count;
+    const double index = q * total;
+    double prev_mean = td->min;
+    double prev_center = 0;
+    double cumulative = 0;
+
+    for (uint32_t i = 0; i < td->num_centroids; ++i)
+    {
+        const double center = cumulative + td->weights[i] / 2;
+        if (index < center)
+            return prev_mean + (td->means[i] - prev_mean) * (index - prev_center) / (center - prev_center);
+
+        prev_mean = td->means[i];
+        prev_center = center;
+        cumulative += td->weights[i];
+    }
+
+    if (total <= prev_center)
+        return td->max;
+    return prev_mean + (td->max - prev_mean) * (index - prev_center) / (total - prev_center);
+}
+
+void tdigest_print_quantiles (struct tdigest *td, FILE *file, const char *name, const double *quantiles, uint32_t num_quantiles)
+{
+    tdigest_flush (td);
+    const uint64_t count = tdigest_count (td);
+    fprintf (file, "%s COUNT %lu MIN %lu MAX %lu", name, count, count ? td->min : 0, td->max);
+    for (uint32_t i = 0; i < num_quantiles; ++i)
+        fprintf (file, " P%g %.1f", quantiles[i] * 100, tdigest_quantile (td, quantiles[i]));
+    fprintf (file, "\n");
+}
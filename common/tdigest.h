@@ -0,0 +1,203 @@
+/**
+ * Streaming quantile estimator based on the merging t-digest (Dunning, "Computing Extremely Accurate Quantiles
+ * Using t-Digests", 2019).
+ *
+ * The values are added to a batch; when the batch is full it is sorted and merged with the existing centroids, which
+ * are then compressed with the k2 scale function. Since latencies are mostly close to each other, a batch is sorted
+ * by counting, as they are added, the values in a window of TDIGEST_DIRECT_RANGE centered on the median of the last
+ * merged batch; only the values outside of the window are kept aside and radix sorted. Centroids near the tails are
+ * kept small, so the relative accuracy of extreme quantiles (p99.99 and above) is much better than the one of the
+ * median.
+ *
+ * The merge of a full batch is amortized over the following additions: while the next batch fills up, every
+ * TDIGEST_TICK additions a tick does a few elements of work of the merge, as many as needed for the merge to end
+ * within three quarters of a batch but at least TDIGEST_STEP, so that no addition stalls the thread recording the
+ * values; an addition in the window is a counter increment and a countdown. The minimum and the maximum are found by
+ * the merge, which takes the values in order.
+ * The memory is bounded, allocated and prefaulted at initialization: it does not depend on the number of recorded
+ * values.
+ */
+#pragma once
+
+#include "common.h"
+#include "utils.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Width of the range of values sorted by counting */
+#define TDIGEST_DIRECT_RANGE 16384
+/* Values of a batch */
+#define TDIGEST_BATCH_SIZE 32768
+/* Additions between two ticks, a divisor of TDIGEST_BATCH_SIZE */
+#define TDIGEST_TICK 4
+/* Minimum elements of the merge of the previous batch processed by each tick */
+#define TDIGEST_STEP 8
+/* Empty counters skipped by the merge for one element of work */
+#define TDIGEST_SKIP 16
+/* Base of the first batch: every value is outside of its window, the first one then sets it */
+#define TDIGEST_NO_BASE (UINT64_MAX - TDIGEST_DIRECT_RANGE)
+
+/**
+ * Values added since the last merge: the ones in the window are counted, the others kept aside.
+ */
+struct tdigest_batch {
+    uint64_t base;
+    uint32_t *counts;
+    uint64_t *outliers;
+    uint32_t num_outliers;
+    // Bytes that vary among the outliers
+    uint64_t outliers_or;
+    uint64_t outliers_and;
+};
+
+enum tdigest_phase {
+    TDIGEST_IDLE = 0,
+    // Radix sort of the outliers, one byte at a time, counting the bytes and then moving the values
+    TDIGEST_SORT_COUNT,
+    TDIGEST_SORT_MOVE,
+    // Merge of the sorted values with the centroids
+    TDIGEST_MERGE,
+    // Compression of the merged values into the centroids
+    TDIGEST_COMPRESS,
+};
+
+struct tdigest {
+    double compression;
+
+    // Centroids, sorted by mean
+    uint32_t num_centroids;
+    uint32_t max_centroids;
+    double *means;
+    double *weights;
+    // Total weight of the centroids, including the batch being merged
+    uint64_t merged_count;
+
+    // Window of the batch being filled, copied from batches[active]
+    uint64_t base;
+    uint32_t *counts;
+    // Additions left before the next tick, and values of the batch being filled before the last tick
+    uint32_t countdown;
+    uint32_t num_buffered;
+    uint32_t active;
+    struct tdigest_batch batches[2];
+
+    // Merge of the other batch, see `tdigest_step`, `step` elements of work at a time
+    enum tdigest_phase phase;
+    uint32_t step;
+    uint32_t cursor;
+    // Radix sort: the outliers move back and forth between the batch and `sort_tmp`, `sorted` being the last pass
+    uint64_t *sorted;
+    uint64_t *sort_tmp;
+    uint64_t sort_varying;
+    uint32_t sort_shift;
+    uint32_t sort_offsets[256];
+    // Merge: next outlier, next counter and next centroid; the run of values waiting for its turn
+    uint32_t next_outlier;
+    uint32_t next_counter;
+    uint32_t num_counters;
+    uint32_t next_centroid;
+    bool has_run;
+    bool runs_done;
+    uint64_t run_value;
+    uint32_t run_weight;
+    uint32_t num_merged;
+    // Values of the batch left before its median, and the base of the window centered on it
+    uint32_t to_median;
+    uint64_t next_base;
+    double *merge_means;
+    double *merge_weights;
+    // Compression, see `tdigest_compress_step`
+    double compress_step;
+    double weight_so_far;
+    double weight_limit;
+    double cur_sum;
+    double cur_weight;
+    uint32_t num_compressed;
+
+    // Updated by the merge
+    uint64_t min;
+    uint64_t max;
+
+    void *memory;
+    size_t memory_size;
+};
+
+/**
+ * Initialize a t-digest.
+ *
+ * @param td the digest to initialize
+ * @param compression the compression factor: the number of centroids is bounded by about `compression`,
+ *        the error of the quantiles is inversely proportional to it
+ * @return 0 on success, -1 on error
+ */
+int tdigest_init (struct tdigest *td, double compression);
+
+void tdigest_destroy (struct tdigest *td);
+
+/**
+ * Merge all the added values in the centroids, at once.
+ */
+void tdigest_flush (struct tdigest *td);
+
+/**
+ * Do the next `step` elements of work of the merge in progress.
+ */
+void tdigest_step (struct tdigest *td);
+
+/**
+ * Start the merge of the full batch, and start filling the other one.
+ */
+void tdigest_rotate (struct tdigest *td);
+
+/**
+ * Keep aside a value outside of the window of the batch being filled.
+ */
+void tdigest_add_outlier (struct tdigest *td, uint64_t value);
+
+/**
+ * Account for the last TDIGEST_TICK additions: step the merge in progress, and rotate the batch once it is full.
+ */
+void tdigest_tick (struct tdigest *td);
+
+/**
+ * Add a value to the digest.
+ */
+static inline void tdigest_add (struct tdigest *td, uint64_t value)
+{
+    const uint64_t offset = value - td->base;
+    if (LIKELY (offset < TDIGEST_DIRECT_RANGE))
+        td->counts[offset]++;
+    else
+        tdigest_add_outlier (td, value);
+
+    if (UNLIKELY (--td->countdown == 0))
+        tdigest_tick (td);
+}
+
+/**
+ * Return the number of values added to the digest.
+ */
+uint64_t tdigest_count (const struct tdigest *td);
+
+/**
+ * Add all the values of `src` to `dst`. `src` is flushed, but otherwise not modified.
+ *
+ * @return 0 on success, -1 on error
+ */
+int tdigest_merge (struct tdigest *dst, struct tdigest *src);
+
+/**
+ * Return an estimate of the value at quantile `q`. The digest is flushed first.
+ *
+ * @param td the digest
+ * @param q the quantile, in [0, 1]
+ * @return the estimated value, 0 if the digest is empty
+ */
+double tdigest_quantile (struct tdigest *td, double q);
+
+/**
+ * Print count, min, max and the given quantiles in a single line prefixed by `name`.
+ * The quantiles are printed as percentiles, e.g. `P99.9 <value>`.
+ */
+void tdigest_print_quantiles (struct tdigest *td, FILE *file, const char *name, const double *quantiles, uint32_t num_quantiles);
@@ -0,0 +1,210 @@
+#include "timesource.h"
+#include "placement.h"
+#include "utils.h"
+
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+#if TIMESOURCE_HAS_TSC
+#include <cpuid.h>
+#endif
+
+struct timesource timesource = {
+    .kind = TIMESOURCE_CLOCK,
+};
+
+// Re-anchoring thread of the TSC, running while the source is the TSC
+static pthread_t reanchor_thread;
+static bool reanchor_running = false;
+
+static uint64_t clock_ns (void)
+{
+    struct timespec t;
+    clock_gettime (TIMESTAMP_CLOCK, &t);
+    return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+/**
+ * Read the TSC and the clock at the same instant, as closely as possible: the TSC is read between two clock
+ * readings, and the pair with the closest clock readings out of a few tries is kept.
+ *
+ * @param tsc the TSC
+ * @param ns the clock, in the middle of the two readings
+ * @return the half-distance between the two clock readings, bounding the error of the pair
+ */
+static uint64_t tsc_clock_pair (uint64_t *tsc, uint64_t *ns)
+{
+    uint64_t best = UINT64_MAX;
+    for (int i = 0; i < 16; ++i)
+    {
+        const uint64_t before = clock_ns ();
+        const uint64_t t = tsc_read ();
+        const uint64_t after = clock_ns ();
+        if (after - before < best)
+        {
+            best = after - before;
+            *tsc = t;
+            *ns = before + best / 2;
+        }
+    }
+    return best / 2;
+}
+
+static bool tsc_invariant (void)
+{
+#if TIMESOURCE_HAS_TSC
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid (0x80000007, &eax, &ebx, &ecx, &edx))
+        return false;
+    return edx & (1U << 8);
+#else
+    return false;
+#endif
+}
+
+static inline uint64_t tsc_mult (double ns_per_cycle)
+{
+    return (uint64_t) (ns_per_cycle * (double) (1ULL << 32) + 0.5);
+}
+
+static void *timesource_reanchor_thread (void *arg __unused)
+{
+    const struct timespec period = {
+        .tv_sec = TIMESOURCE_REANCHOR_NS / 1000000000UL,
+        .tv_nsec = TIMESOURCE_REANCHOR_NS % 1000000000UL,
+    };
+    while (true)
+    {
+        // The thread is only cancelled while it sleeps, never in the middle of a re-anchoring
+        nanosleep (&period, NULL);
+        pthread_setcancelstate (PTHREAD_CANCEL_DISABLE, NULL);
+        timesource_reanchor ();
+        pthread_setcancelstate (PTHREAD_CANCEL_ENABLE, NULL);
+    }
+    return NULL;
+}
+
+static void timesource_stop_reanchor (void)
+{
+    if (!reanchor_running)
+        return;
+    pthread_cancel (reanchor_thread);
+    pthread_join (reanchor_thread, NULL);
+    reanchor_running = false;
+}
+
+static int timesource_start_reanchor (void)
+{
+    // Away from the measured threads, like the persistence writer
+    struct thread_placement placement = {.core = find_housekeeping_core (), .policy = -1, .priority = -1};
+    pthread_attr_t attr;
+    pthread_attr_init (&attr);
+    int ret = placement_set_attr (&placement, 0, &attr);
+    if (ret == 0)
+        ret = pthread_create (&reanchor_thread, &attr, timesource_reanchor_thread, NULL);
+    pthread_attr_destroy (&attr);
+    if (ret != 0)
+    {
+        fprintf (stderr, "ERR: could not start the re-anchoring thread of the TSC: %s\n", strerror (ret));
+        return -1;
+    }
+    reanchor_running = true;
+    return 0;
+}
+
+int timesource_init (enum timesource_kind kind)
+{
+    timesource_stop_reanchor ();
+    timesource.kind = TIMESOURCE_CLOCK;
+    if (kind == TIMESOURCE_CLOCK)
+        return 0;
+
+    if (kind != TIMESOURCE_TSC || !tsc_invariant ())
+    {
+        LOG (stderr, "ERROR: The CPU has no invariant TSC\n");
+        return -1;
+    }
+
+    uint64_t tsc_start = 0, ns_start = 0, tsc_end = 0, ns_end = 0;
+    const uint64_t error_start = tsc_clock_pair (&tsc_start, &ns_start);
+    while (clock_ns () - ns_start < TIMESOURCE_CALIBRATION_NS)
+        BARRIER ();
+    const uint64_t error_end = tsc_clock_pair (&tsc_end, &ns_end);
+
+    if (tsc_end <= tsc_start || ns_end <= ns_start)
+    {
+        LOG (stderr, "ERROR: Could not calibrate the TSC\n");
+        return -1;
+    }
+
+    const double tsc_hz = (double) (tsc_end - tsc_start) * 1e9 / (double) (ns_end - ns_start);
+    timesource.calibration_tsc = tsc_start;
+    timesource.calibration_ns = ns_start;
+    timesource.calibration_error_ppb = (double) (error_start + error_end) * 1e9 / (double) (ns_end - ns_start);
+
+    timesource.params[0] = (struct tsc_params) {
+        .base_tsc = tsc_end,
+        .base_ns = ns_end,
+        .mult = tsc_mult (1e9 / tsc_hz),
+        .tsc_hz = tsc_hz,
+    };
+    atomic_store (&timesource.current, 0);
+    timesource.kind = TIMESOURCE_TSC;
+
+    return timesource_start_reanchor ();
+}
+
+void timesource_reanchor (void)
+{
+    const uint32_t current = atomic_load_explicit (&timesource.current, memory_order_relaxed);
+    const struct tsc_params *old = &timesource.params[current];
+
+    uint64_t tsc = 0, ns = 0;
+    tsc_clock_pair (&tsc, &ns);
+    const uint64_t converted = tsc_params_ns (old, tsc);
+    const int64_t error = (int64_t) (ns - converted);
+
+    // The frequency measured over the whole run is more accurate than the initial calibration
+    double tsc_hz = old->tsc_hz;
+    if (tsc > timesource.calibration_tsc && ns > timesource.calibration_ns)
+        tsc_hz = (double) (tsc - timesource.calibration_tsc) * 1e9 / (double) (ns - timesource.calibration_ns);
+
+    // Catch up with the clock over the next period, without ever going backwards
+    const int64_t limit = (int64_t) TIMESOURCE_REANCHOR_NS * TIMESOURCE_MAX_SLEW_PPM / 1000000;
+    const int64_t slew = error > limit ? limit : (error < -limit ? -limit : error);
+    struct tsc_params *next = &timesource.params[current ^ 1];
+    next->base_tsc = tsc;
+    next->base_ns = converted + (error > limit ? (uint64_t) (error - limit) : 0);
+    next->mult = tsc_mult (1e9 / tsc_hz * (1.0 + (double) slew / TIMESOURCE_REANCHOR_NS));
+    next->tsc_hz = tsc_hz;
+
+    atomic_store_explicit (&timesource.current, current ^ 1, memory_order_release);
+}
+
+int timesource_parse (const char *name)
+{
+    if (strcmp (name, "clock") == 0)
+        return TIMESOURCE_CLOCK;
+    if (strcmp (name, "tsc") == 0)
+        return TIMESOURCE_TSC;
+    return -1;
+}
+
+const char *timesource_name (enum timesource_kind kind)
+{
+    return kind == TIMESOURCE_TSC ? "tsc" : "clock";
+}
+
+void timesource_print (FILE *file)
+{
+    fprintf (file, "timesource %s\n", timesource_name (timesource.kind));
+    fprintf (file, "clock_id %d\n", TIMESTAMP_CLOCK);
+    if (timesource.kind != TIMESOURCE_TSC)
+        return;
+
+    fprintf (file, "tsc_hz %.0f\n", timesource_tsc_hz ());
+    fprintf (file, "tsc_calibration_ns %lu\n", TIMESOURCE_CALIBRATION_NS);
+    fprintf (file, "tsc_calibration_error_ppb %.1f\n", timesource.calibration_error_ppb);
+    fprintf (file, "tsc_reanchor_ns %lu\n", TIMESOURCE_REANCHOR_NS);
+}
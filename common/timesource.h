@@ -0,0 +1,156 @@
+/**
+ * Source of the timestamps returned by `get_time_ns`.
+ *
+ * - TIMESOURCE_CLOCK: clock_gettime (TIMESTAMP_CLOCK), the default.
+ * - TIMESOURCE_TSC: the invariant TSC of x86 CPUs, converted to nanoseconds. The TSC is calibrated against
+ *   TIMESTAMP_CLOCK at initialization and the conversion is anchored to it, so the timestamps stay in the
+ *   TIMESTAMP_CLOCK domain and can be compared with the ones taken by clock_gettime or, in the XDP programs, by
+ *   bpf_ktime_get_ns (both CLOCK_MONOTONIC).
+ *   Every TIMESOURCE_REANCHOR_NS, a housekeeping thread compares the conversion with the clock and corrects the
+ *   conversion over the next period, so that the error does not accumulate while the measured threads only read it.
+ *   The correction is a change of slope, never a step backwards, so the timestamps stay monotonic.
+ */
+#pragma once
+
+#include "common.h"
+#include "utils.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define TIMESOURCE_HAS_TSC 1
+#else
+#define TIMESOURCE_HAS_TSC 0
+#endif
+
+enum timesource_kind {
+    TIMESOURCE_CLOCK = 0,
+    TIMESOURCE_TSC = 1,
+};
+
+/* Duration of the initial calibration of the TSC */
+#define TIMESOURCE_CALIBRATION_NS 20000000UL
+/* Interval between two re-anchorings of the TSC conversion */
+#define TIMESOURCE_REANCHOR_NS 1000000000UL
+/* Highest correction of the slope of the conversion at each re-anchoring, in parts per million; larger errors
+ * are corrected with a forward step */
+#define TIMESOURCE_MAX_SLEW_PPM 1000
+
+/**
+ * Conversion of the TSC to nanoseconds: ns = base_ns + ((tsc - base_tsc) * mult) >> 32, and the frequency it was
+ * computed from.
+ */
+struct tsc_params {
+    uint64_t base_tsc;
+    uint64_t base_ns;
+    uint64_t mult;
+    double tsc_hz;
+};
+
+struct timesource {
+    enum timesource_kind kind;
+
+    // The readers use params[current]; a re-anchoring writes the other one and then switches, so a buffer is only
+    // written again a whole period after the readers stopped using it
+    _Atomic uint32_t current;
+    struct tsc_params params[2];
+
+    // Calibration, against the first pair of TSC and clock readings; written by `timesource_init` only
+    uint64_t calibration_tsc;
+    uint64_t calibration_ns;
+    // Uncertainty of the calibration, in parts per billion
+    double calibration_error_ppb;
+};
+
+extern struct timesource timesource;
+
+/**
+ * Select the source of the timestamps, and start the re-anchoring thread of the TSC, on a housekeeping core.
+ * Must be called before any timestamp is taken, in a single thread.
+ *
+ * @param kind the source to use
+ * @return 0 on success, -1 if the source is not available, e.g. the CPU has no invariant TSC
+ */
+int timesource_init (enum timesource_kind kind);
+
+/**
+ * Parse the name of a source, "clock" or "tsc".
+ *
+ * @return the source, -1 if the name is not valid
+ */
+int timesource_parse (const char *name);
+
+const char *timesource_name (enum timesource_kind kind);
+
+/**
+ * Print the source and its calibration, one `key value` pair per line.
+ */
+void timesource_print (FILE *file);
+
+/**
+ * Compare the TSC conversion with the clock and correct it, see above.
+ * Called every TIMESOURCE_REANCHOR_NS by the re-anchoring thread.
+ */
+void timesource_reanchor (void);
+
+/**
+ * Read the TSC once all the previous instructions have completed, and before the next ones start.
+ */
+static inline uint64_t tsc_read (void)
+{
+#if TIMESOURCE_HAS_TSC
+    unsigned int aux;
+    const uint64_t tsc = __rdtscp (&aux);
+    _mm_lfence ();
+    return tsc;
+#else
+    return 0;
+#endif
+}
+
+__extension__ typedef unsigned __int128 tsc_u128;
+
+static inline uint64_t tsc_params_ns (const struct tsc_params *params, uint64_t tsc)
+{
+    return params->base_ns + (uint64_t) (((tsc_u128) (tsc - params->base_tsc) * params->mult) >> 32);
+}
+
+static inline const struct tsc_params *timesource_params (void)
+{
+    return &timesource.params[atomic_load_explicit (&timesource.current, memory_order_acquire)];
+}
+
+/**
+ * Frequency of the TSC, as last measured against the clock; 0 if the source is not the TSC.
+ */
+static inline double timesource_tsc_hz (void)
+{
+    return timesource.kind == TIMESOURCE_TSC ? timesource_params ()->tsc_hz : 0;
+}
+
+/**
+ * Current time in nanoseconds from the TSC, in the TIMESTAMP_CLOCK domain.
+ */
+static inline uint64_t timesource_tsc_ns (void)
+{
+    // The parameters are loaded before the TSC is read, so that the TSC is never below their base
+    const struct tsc_params *params = timesource_params ();
+    return tsc_params_ns (params, tsc_read ());
+}
+
+/**
+ * Current time in nanoseconds from the source `kind`, which `get_time_ns` reads from `timesource.kind`.
+ * Inlined with a constant `kind`, it takes the timestamp without the function call and the branch of `get_time_ns`.
+ */
+__always_inline static uint64_t timesource_now_ns (const enum timesource_kind kind)
+{
+    if (kind == TIMESOURCE_TSC)
+        return timesource_tsc_ns ();
+
+    struct timespec t;
+    clock_gettime (TIMESTAMP_CLOCK, &t);
+    return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
@@ -1,12 +1,17 @@
+#define _GNU_SOURCE
+
 #include "utils.h"
+#include "timesource.h"
 
-#define CPU_FREQ (2.4 * 1000000000)
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 inline uint64_t get_time_ns (void)
 {
-    struct timespec t;
-    clock_gettime (CLOCK_MONOTONIC, &t);
-    return t.tv_sec * 1000000000LL + t.tv_nsec;
+    return timesource_now_ns (timesource.kind);
 }
 
 inline void pp_sleep (uint64_t ns)
@@ -30,6 +35,101 @@ inline void pp_sleep (uint64_t ns)
     }
 }
 
+void pp_sleep_until (uint64_t deadline, uint64_t guard)
+{
+    const uint64_t now = get_time_ns ();
+    if (deadline > now + guard)
+    {
+        // The timestamps are in the TIMESTAMP_CLOCK domain, whatever their source
+        const uint64_t wake = deadline - guard;
+        struct timespec t;
+        t.tv_sec = wake / 1000000000;
+        t.tv_nsec = wake % 1000000000;
+        while (clock_nanosleep (TIMESTAMP_CLOCK, TIMER_ABSTIME, &t, NULL) == EINTR)
+            ;
+    }
+
+    while (get_time_ns () < deadline)
+        BARRIER ();
+}
+
+int pp_parse_role (const char *name)
+{
+    if (strcmp (name, "client") == 0)
+        return PP_ROLE_CLIENT;
+    if (strcmp (name, "server") == 0)
+        return PP_ROLE_SERVER;
+    return -1;
+}
+
+int parse_cpu_list (const char *list, bool *cpus, int max_cpus)
+{
+    memset (cpus, 0, max_cpus * sizeof (bool));
+
+    const char *p = list;
+    while (*p && *p != '\n')
+    {
+        char *end;
+        long first = strtol (p, &end, 10);
+        if (end == p || first < 0)
+            return -1;
+        long last = first;
+        p = end;
+        if (*p == '-')
+        {
+            ++p;
+            last = strtol (p, &end, 10);
+            if (end == p || last < first)
+                return -1;
+            p = end;
+        }
+        for (long i = first; i <= last && i < max_cpus; ++i)
+            cpus[i] = true;
+        if (*p == ',')
+            ++p;
+        else if (*p && *p != '\n')
+            return -1;
+    }
+
+    return 0;
+}
+
+int find_housekeeping_core (void)
+{
+    bool isolated[CPU_SETSIZE];
+    memset (isolated, 0, sizeof (isolated));
+
+    FILE *f = fopen ("/sys/devices/system/cpu/isolated", "r");
+    if (f)
+    {
+        char buf[256];
+        if (fgets (buf, sizeof (buf), f) != NULL)
+            parse_cpu_list (buf, isolated, CPU_SETSIZE);
+        fclose (f);
+    }
+
+    cpu_set_t current_mask;
+    CPU_ZERO (&current_mask);
+    if (sched_getaffinity (0, sizeof (cpu_set_t), &current_mask) < 0)
+    {
+        PERROR ("sched_getaffinity");
+    }
+
+    const int num_cores = min (sysconf (_SC_NPROCESSORS_ONLN), CPU_SETSIZE);
+    int fallback = -1;
+    for (int i = 0; i < num_cores; ++i)
+    {
+        if (isolated[i])
+            continue;
+        if (!CPU_ISSET (i, &current_mask))
+            return i;
+        if (fallback < 0)
+            fallback = i;
+    }
+
+    return fallback;
+}
+
 void hex_dump (const void *data, size_t size)
 {
     // source: https://gist.github.com/ccbrown/9722406
@@ -70,3 +170,11 @@ void hex_dump (const void *data, size_t size)
         }
     }
 }
+
+void pp_flow_filename (char *buf, size_t size, const char *filename, uint32_t flow, uint32_t num_flows)
+{
+    if (num_flows <= 1)
+        snprintf (buf, size, "%s", filename);
+    else
+        snprintf (buf, size, "%s.flow%u", filename, flow);
+}
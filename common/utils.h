@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <time.h>
@@ -8,18 +9,73 @@
 #define max(a, b) ((a) > (b) ? (a) : (b))
 #define min(a, b) ((a) > (b) ? (b) : (a))
 
+// Clock used by get_time_ns to take the pingpong timestamps
+#define TIMESTAMP_CLOCK CLOCK_MONOTONIC
+
+/**
+ * Role of a program in the experiment, chosen at startup with --role.
+ */
+enum pp_role {
+    PP_ROLE_CLIENT = 0,
+    PP_ROLE_SERVER = 1,
+};
+
+// getopt value of --role, which has no short form
+#define PP_ROLE_OPTION 0x100
+
+/**
+ * Parse the name of a role: "client" or "server".
+ *
+ * @param name the name to parse
+ * @return the `enum pp_role`, -1 if the name is not valid
+ */
+int pp_parse_role (const char *name);
+
 /**
- * Retrieve the current time in nanoseconds.
+ * Retrieve the current time in nanoseconds, from the source selected with `timesource_init` (see timesource.h).
  * @return The current time in nanoseconds.
  */
 uint64_t get_time_ns (void);
 
 void pp_sleep (uint64_t ns);
 
+/**
+ * Wait until the absolute time `deadline`, as returned by `get_time_ns`: sleep with clock_nanosleep (TIMER_ABSTIME)
+ * until `guard` nanoseconds before it, then spin, so that the wake-up latency of the timer does not delay the return.
+ *
+ * @param deadline the time to wait for, in nanoseconds
+ * @param guard the duration of the final spin, larger than the wake-up latency of the timer
+ */
+void pp_sleep_until (uint64_t deadline, uint64_t guard);
+
+/**
+ * Parse a Linux CPU list (e.g. "0-3,8,10-11", as found in /sys/devices/system/cpu/isolated).
+ *
+ * @param list the CPU list to parse
+ * @param cpus output array, cpus[i] is set to true if CPU i is in the list
+ * @param max_cpus the size of the `cpus` array
+ * @return 0 on success, -1 if the list is malformed
+ */
+int parse_cpu_list (const char *list, bool *cpus, int max_cpus);
+
+/**
+ * Find a core that is not isolated from the scheduler (i.e. not in the `isolcpus` list), to be used
+ * by auxiliary threads that must not disturb the isolated cores running the experiment.
+ * Cores the calling thread is allowed to run on are avoided when possible.
+ *
+ * @return the id of the core, or -1 if no suitable core is found
+ */
+int find_housekeeping_core (void);
+
 /**
  * Print a hex dump of the given data.
  *
  * @param data the data to print
  * @param size the size of the data
  */
-void hex_dump (const void *data, size_t size);
\ No newline at end of file
+void hex_dump (const void *data, size_t size);
+
+/**
+ * Name of the output file of a flow: `filename` itself when there is a single flow, `<filename>.flow<flow>` otherwise.
+ */
+void pp_flow_filename (char *buf, size_t size, const char *filename, uint32_t flow, uint32_t num_flows);
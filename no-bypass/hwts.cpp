@@ -2,6 +2,7 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <getopt.h>
 #include <iostream>
 #include <linux/errqueue.h>
 #include <linux/net_tstamp.h>
@@ -16,14 +17,6 @@
 
 using namespace std;
 
-#ifndef SERVER
-#define SERVER 0
-#endif
-
-#if CLIENT
-#define SERVER 0
-#endif
-
 using u64 = uint64_t;
 
 static constexpr int PACKET_SIZE = 1024;
@@ -238,7 +231,7 @@ void client_loop (int socket, string &remote, u64 packets, u64 interval)
     }
 }
 
-int start_program (string ifname, string remote, u64 packets, u64 interval)
+int start_program (bool server, string ifname, string remote, u64 packets, u64 interval)
 {
     int socket_fd = socket (AF_INET, SOCK_DGRAM, 0);
     if (socket_fd < 0)
@@ -276,11 +269,10 @@ int start_program (string ifname, string remote, u64 packets, u64 interval)
         return EXIT_FAILURE;
     }
 
-#if SERVER
-    server_loop (socket_fd, remote, packets, interval);
-#else
-    client_loop (socket_fd, remote, packets, interval);
-#endif
+    if (server)
+        server_loop (socket_fd, remote, packets, interval);
+    else
+        client_loop (socket_fd, remote, packets, interval);
 
     while (send_ts_cnt < packets)
     {
@@ -296,17 +288,36 @@ int start_program (string ifname, string remote, u64 packets, u64 interval)
     return EXIT_SUCCESS;
 }
 
+// Same option as the other datapaths, see PP_ROLE_OPTION in common/utils.h, whose headers are C only
+static constexpr int ROLE_OPTION = 0x100;
+
+static const struct option long_options[] = {
+    {"role", required_argument, 0, ROLE_OPTION},
+    {0, 0, 0, 0}};
+
 int main (int argc, char **argv)
 {
-    if (argc < 4)
+    string role = "client";
+    bool valid = true;
+    int opt;
+    while ((opt = getopt_long (argc, argv, "", long_options, NULL)) != -1)
+    {
+        if (opt == ROLE_OPTION)
+            role = optarg;
+        else
+            valid = false;
+    }
+
+    if (!valid || (role != "client" && role != "server") || argc - optind != 3)
     {
-        cout << "Usage: " << argv[0] << " <interface name> <remote peer ip> <num_packets>" << endl;
+        cout << "Usage: " << argv[0] << " [--role client|server] <interface name> <remote peer ip> <num_packets>" << endl;
         return EXIT_FAILURE;
     }
 
-    string ifname (argv[1]);
-    string remote (argv[2]);
-    u64 packets = stoll (argv[3]);
+    string ifname (argv[optind]);
+    string remote (argv[optind + 1]);
+    u64 packets = stoll (argv[optind + 2]);
+    bool server = role == "server";
 
     send_ts.assign (packets, 0);
     recv_ts.assign (packets, 0);
@@ -314,6 +325,6 @@ int main (int argc, char **argv)
     vector<int> intervals{0};
     for (auto &interval : intervals)
     {
-        start_program (ifname, remote, packets, interval);
+        start_program (server, ifname, remote, packets, interval);
     }
 }
@@ -1,18 +1,23 @@
 #include "../common/common.h"
+#include "../common/driver.h"
 #include "../common/net.h"
-#include "../common/persistence.h"
-#include "src/args.h"
 #include <arpa/inet.h>
 #include <netinet/in.h>
-#include <signal.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
 
-persistence_agent_t *persistence_agent;
-
-static volatile bool global_exit = false;
+/**
+ * Context of the datapath: a plain UDP socket, going through the whole kernel network stack.
+ */
+struct nobypass_ctx {
+    int socket;
+    struct sockaddr_in server_addr;// client only
+    struct sockaddr_in client_addr;// server only, source of the last ping
+    uint8_t recv_buf[PACKET_SIZE];
+    uint8_t send_bufs[PINGPONG_MAX_FLOWS][PACKET_SIZE];// one per flow, since each flow has its own sender thread
+};
 
 int new_socket (void)
 {
@@ -41,138 +46,108 @@ struct sockaddr_in new_sockaddr (const char *ip, uint16_t port)
     return addr;
 }
 
-void start_server (uint64_t iters)
+static int nobypass_setup (const struct pp_driver_config *config, void **out)
 {
-    int socket = new_socket ();
-    // wait for the client to connect
-    struct sockaddr_in server_addr;
-    memset (&server_addr, 0, sizeof (server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons (XDP_UDP_PORT);
-    server_addr.sin_addr.s_addr = htonl (INADDR_ANY);
-
-    int ret = bind (socket, (struct sockaddr *) &server_addr, sizeof (server_addr));
-    if (ret < 0)
+    struct nobypass_ctx *ctx = calloc (1, sizeof (struct nobypass_ctx));
+    if (!ctx)
     {
-        PERROR ("bind");
-        return;
+        PERROR ("calloc");
+        return -1;
     }
 
-    struct sockaddr_in client_addr;
-    socklen_t client_addr_len = sizeof (client_addr);
-    memset (&client_addr, 0, sizeof (client_addr));
-
-    uint8_t recv_buf[PACKET_SIZE];
-    uint64_t last_idx = 0;
-    while (last_idx < iters && !global_exit)
+    ctx->socket = new_socket ();
+    if (ctx->socket < 0)
     {
-        int ret = recvfrom (socket, recv_buf, PACKET_SIZE, 0, (struct sockaddr *) &client_addr, &client_addr_len);
-        uint64_t ts = get_time_ns ();
-        if (ret < 0)
-        {
-            PERROR ("recvfrom");
-            return;
-        }
-
-        struct pingpong_payload *payload = (struct pingpong_payload *) recv_buf;
-        payload->ts[1] = ts;
-
-        last_idx = max (last_idx, payload->id);
+        free (ctx);
+        return -1;
+    }
 
-        payload->ts[2] = get_time_ns ();
-        // send the packet back to the client
-        ret = sendto (socket, recv_buf, PACKET_SIZE, 0, (struct sockaddr *) &client_addr, sizeof (client_addr));
-        if (ret < 0)
+    if (config->role == PP_ROLE_SERVER)
+    {
+        // wait for the client to connect
+        struct sockaddr_in server_addr;
+        memset (&server_addr, 0, sizeof (server_addr));
+        server_addr.sin_family = AF_INET;
+        server_addr.sin_port = htons (XDP_UDP_PORT);
+        server_addr.sin_addr.s_addr = htonl (INADDR_ANY);
+
+        if (bind (ctx->socket, (struct sockaddr *) &server_addr, sizeof (server_addr)) < 0)
         {
-            PERROR ("sendto");
-            return;
+            PERROR ("bind");
+            close (ctx->socket);
+            free (ctx);
+            return -1;
         }
     }
+    else
+    {
+        ctx->server_addr = new_sockaddr (config->server_ip, XDP_UDP_PORT);
+    }
+
+    *out = ctx;
+    return 0;
 }
 
-int send_single_packet (char *buf, const uint64_t packet_idx, struct sockaddr_ll *addr, void *aux)
+static int nobypass_send (void *aux, const struct pingpong_payload *payload)
 {
-    int socket = *(int *) aux;
-    struct pingpong_payload *payload = (struct pingpong_payload *) buf;
-    *payload = new_pingpong_payload (packet_idx);
-    payload->ts[0] = get_time_ns ();
+    struct nobypass_ctx *ctx = aux;
+    uint8_t *buf = ctx->send_bufs[payload->flow];
+    memcpy (buf, payload, sizeof (struct pingpong_payload));
 
-    return sendto (socket, buf, PACKET_SIZE, 0, (struct sockaddr *) addr, sizeof (*addr));
+    return sendto (ctx->socket, buf, PACKET_SIZE, 0, (struct sockaddr *) &ctx->server_addr, sizeof (ctx->server_addr)) < 0 ? -1 : 0;
 }
 
-void start_client (uint64_t iters, uint64_t interval, const char *server_ip)
+static int nobypass_poll (void *aux, struct pp_packet *packets, uint32_t max __unused)
 {
-    int socket = new_socket ();
-    struct sockaddr_in server_addr = new_sockaddr (server_ip, XDP_UDP_PORT);
-    uint8_t send_buf[PACKET_SIZE];
-    memset (send_buf, 0, PACKET_SIZE);
-    // passing a ref to the local socket should work fine since the current function will not return until the pingpong is finished.
-    start_sending_packets (iters, interval, (char *) send_buf, (struct sockaddr_ll *) &server_addr, send_single_packet, &socket);
+    struct nobypass_ctx *ctx = aux;
+    socklen_t addr_len = sizeof (ctx->client_addr);
 
-    uint8_t recv_buf[PACKET_SIZE];
-    uint32_t last_idx = 0;
-    while (last_idx < iters && !global_exit)
+    if (recvfrom (ctx->socket, ctx->recv_buf, PACKET_SIZE, 0, (struct sockaddr *) &ctx->client_addr, &addr_len) < 0)
     {
-        int ret = recvfrom (socket, recv_buf, PACKET_SIZE, 0, NULL, NULL);
-        if (ret < 0)
-        {
-            PERROR ("recv");
-            break;
-        }
-
-        struct pingpong_payload *payload = (struct pingpong_payload *) recv_buf;
-        payload->ts[3] = get_time_ns ();
-        persistence_agent->write (persistence_agent, payload);
-
-        last_idx = max (last_idx, payload->id);
+        if (errno == EINTR)
+            return 0;
+        PERROR ("recvfrom");
+        return -1;
     }
 
-    close (socket);
+    packets[0].payload = (struct pingpong_payload *) ctx->recv_buf;
+    packets[0].ts = 0;
+    return 1;
 }
 
-void sigint_handler (int signum __unused)
-{
-    global_exit = true;
-}
-
-int main (int argc, char **argv)
+static int nobypass_reply (void *aux, struct pp_packet *packet __unused)
 {
-    signal (SIGINT, sigint_handler);
-#if SERVER
-    uint64_t iters = 0;
-    if (!nobypass_parse_args (argc, argv, &iters))
-    {
-        nobypass_print_usage (argv[0]);
-        return EXIT_FAILURE;
-    }
-
-    LOG (stdout, "Starting server with iters=%lu\n", iters);
-
-    start_server (iters);
-#else
-    uint32_t persistence_flag = PERSISTENCE_M_ALL_TIMESTAMPS;
-
-    uint64_t iters = 0;
-    uint64_t interval = 0;
-    char *server_ip = NULL;
-    if (!nobypass_parse_args (argc, argv, &iters, &interval, &server_ip, &persistence_flag))
+    struct nobypass_ctx *ctx = aux;
+    // send the packet back to the client
+    if (sendto (ctx->socket, ctx->recv_buf, PACKET_SIZE, 0, (struct sockaddr *) &ctx->client_addr, sizeof (ctx->client_addr)) < 0)
     {
-        nobypass_print_usage (argv[0]);
-        return EXIT_FAILURE;
+        PERROR ("sendto");
+        return -1;
     }
+    return 0;
+}
 
-    persistence_agent = persistence_init ("no-bypass.dat", persistence_flag, &interval);
-    if (!persistence_agent)
-    {
-        LOG (stderr, "Failed to initialize persistence agent\n");
-        return EXIT_FAILURE;
-    }
+static void nobypass_teardown (void *aux)
+{
+    struct nobypass_ctx *ctx = aux;
+    close (ctx->socket);
+    free (ctx);
+}
 
-    LOG (stdout, "Starting client with iters=%lu, interval=%lu, server_ip=%s\n", iters, interval, server_ip);
+PP_DRIVER_DEFINE_LOOPS (nobypass_loops, nobypass_poll, nobypass_reply)
 
-    start_client (iters, interval, server_ip);
-    persistence_agent->close (persistence_agent);
-#endif
+static const struct pp_datapath nobypass_datapath = {
+    .name = "no-bypass",
+    .outfile = "no-bypass.dat",
+    .setup = nobypass_setup,
+    .send = nobypass_send,
+    .poll = nobypass_poll,
+    .reply = nobypass_reply,
+    .teardown = nobypass_teardown,
+    .loops = &nobypass_loops,
+};
 
-    return EXIT_SUCCESS;
-}
\ No newline at end of file
+int main (int argc, char **argv)
+{
+    return pp_driver_main (argc, argv, &nobypass_datapath);
+}
@@ -9,10 +9,9 @@
 #include <unistd.h>
 
 #include "../common/common.h"
+#include "../common/driver.h"
 #include "../common/net.h"
-#include "../common/persistence.h"
 //#include "ccan/minmax.h"
-#include "src/args.h"
 #include "src/ib_net.h"
 #include "src/pingpong.h"
 
@@ -32,7 +31,6 @@ enum {
 
 static int page_size;
 static int available_recv;
-static persistence_agent_t *persistence;
 
 struct pingpong_context {
     volatile atomic_uint_fast8_t pending;// WID of the pending WR
@@ -334,15 +332,6 @@ int pp_post_send (struct pingpong_context *ctx, const uint8_t *buffer)
     return 0;
 }
 
-int pp_send_single_packet (char *buf __unused, const uint64_t packet_id, struct sockaddr_ll *dest_addr __unused, void *aux)
-{
-    struct pingpong_context *ctx = (struct pingpong_context *) aux;
-    *ctx->send_payload = new_pingpong_payload (packet_id);
-    ctx->send_payload->ts[1] = get_time_ns ();
-
-    return pp_post_send (ctx, NULL);//(const uint8_t *) buf);
-}
-
 static int pp_post_recv (struct pingpong_context *ctx, int n)
 {
     struct ibv_sge list = {
@@ -367,16 +356,23 @@ static int pp_post_recv (struct pingpong_context *ctx, int n)
     return i;
 }
 
-int parse_single_wc (struct pingpong_context *ctx)
+/**
+ * Parse the current work completion of the CQ.
+ *
+ * @param ctx the pingpong context
+ * @param packet where the received packet is stored, if the completion is for a receive WR
+ * @return 1 if a packet was received, 0 if the completion is for a send WR, -1 on failure
+ */
+static int parse_single_wc (struct pingpong_context *ctx, struct pp_packet *packet)
 {
     const enum ibv_wc_status status = ctx->cq->status;
     const uint64_t wr_id = ctx->cq->wr_id;
-    const uint64_t ts = ibv_wc_read_completion_ts (ctx->cq);
+    int received = 0;
 
     if (status != IBV_WC_SUCCESS)
     {
         LOG (stdout, "Failed status %d for wr_id %lu\n", status, wr_id);
-        return 1;
+        return -1;
     }
 
     switch (wr_id)
@@ -386,163 +382,165 @@ int parse_single_wc (struct pingpong_context *ctx)
         break;
     case PINGPONG_RECV_WRID:
         LOG (stdout, "Received packet\n");
-#if SERVER
-        memcpy (ctx->send_payload, ctx->recv_payload, sizeof (struct pingpong_payload));
-        ctx->send_payload->ts[1] = ts;
-        ctx->send_payload->ts[2] = get_time_ns ();
-        // In this case, using the ctx->buf is safe because the server has no send thread concurrently accessing it.
-        pp_post_send (ctx, NULL);
-#else
-        ctx->recv_payload->ts[3] = get_time_ns ();
-        persistence->write (persistence, ctx->recv_payload);
-#endif
+        packet->payload = ctx->recv_payload;
+        packet->ts = 0;
+        packet->handle = 0;
+        received = 1;
         if (--available_recv <= 1)
         {
             available_recv += pp_post_recv (ctx, RECEIVE_DEPTH - available_recv);
             if (available_recv < RECEIVE_DEPTH)
             {
                 LOG (stdout, "Couldn't post enough receives, there are only %d\n", available_recv);
-                return 1;
+                return -1;
             }
         }
         break;
     default:
         LOG (stdout, "Completion for unknown wr_id %lu\n", wr_id);
-        return 1;
+        return -1;
     }
 
     ctx->pending &= ~wr_id;
 
-    return 0;
+    return received;
 }
 
-int main (int argc, char **argv)
+static int rc_setup (const struct pp_driver_config *config, void **out)
 {
-    char *ib_devname = NULL;
-    int port_gid_idx = 0;
-    uint64_t iters = 0;
-    char *server_ip = NULL;
-
-#if SERVER
-    if (!ib_parse_args (argc, argv, &ib_devname, &port_gid_idx, &iters))
-    {
-        ib_print_usage (argv[0]);
-        return 1;
-    }
-#else
-    uint64_t interval = 0;
-    uint32_t persistence_flags = PERSISTENCE_M_ALL_TIMESTAMPS;
-    if (!ib_parse_args (argc, argv, &ib_devname, &port_gid_idx, &iters, &interval, &server_ip, &persistence_flags))
-    {
-        ib_print_usage (argv[0]);
-        return 1;
-    }
-    persistence = persistence_init ("rc.dat", persistence_flags, &interval);
-    if (!persistence)
-    {
-        fprintf (stderr, "Couldn't initialize persistence agent\n");
-        return 1;
-    }
-#endif
-
     srand48 (getpid () * time (NULL));
 
     page_size = sysconf (_SC_PAGESIZE);
 
-    struct ibv_device *ib_dev = ib_device_find_by_name (ib_devname);
+    struct ibv_device *ib_dev = ib_device_find_by_name (config->device);
     if (!ib_dev)
     {
-        fprintf (stderr, "IB device %s not found\n", ib_devname);
-        return 1;
+        fprintf (stderr, "IB device %s not found\n", config->device);
+        return -1;
     }
 
     struct pingpong_context *ctx = pp_init_context (ib_dev);
     if (!ctx)
     {
         fprintf (stderr, "Couldn't initialize context\n");
-        return 1;
+        return -1;
     }
 
     struct ib_node_info local_info;
-    if (ib_get_local_info (ctx->context, IB_PORT, port_gid_idx, ctx->qp, &local_info))
+    if (ib_get_local_info (ctx->context, IB_PORT, config->gid_idx, ctx->qp, &local_info))
     {
         fprintf (stderr, "Couldn't get local info\n");
-        return 1;
+        pp_close_context (ctx);
+        return -1;
     }
     ib_print_node_info (&local_info);
 
     struct ib_node_info remote_info;
-    if (exchange_data (server_ip, SERVER, sizeof (local_info), (uint8_t *) &local_info, (uint8_t *) &remote_info))
+    if (exchange_data (config->server_ip, config->role == PP_ROLE_SERVER, sizeof (local_info), (uint8_t *) &local_info, (uint8_t *) &remote_info))
     {
         fprintf (stderr, "Couldn't exchange data\n");
-        return 1;
+        pp_close_context (ctx);
+        return -1;
     }
     ib_print_node_info (&remote_info);
 
-    pp_ib_connect (ctx, IB_PORT, local_info.psn, IB_MTU, PRIORITY, &remote_info, port_gid_idx);
+    if (pp_ib_connect (ctx, IB_PORT, local_info.psn, IB_MTU, PRIORITY, &remote_info, config->gid_idx))
+    {
+        fprintf (stderr, "Couldn't connect\n");
+        pp_close_context (ctx);
+        return -1;
+    }
 
     ctx->pending = PINGPONG_RECV_WRID;
 
     available_recv = pp_post_recv (ctx, RECEIVE_DEPTH);
 
-    uint8_t *send_buffer = NULL;
+    *out = ctx;
+    return 0;
+}
+
+static int rc_send (void *aux, const struct pingpong_payload *payload)
+{
+    struct pingpong_context *ctx = aux;
+    *ctx->send_payload = *payload;
 
-#if !SERVER
-    start_sending_packets (iters, interval, (char *) ctx->send_buf, NULL, pp_send_single_packet, ctx);
-#endif
+    return pp_post_send (ctx, NULL) ? -1 : 0;
+}
 
-    uint64_t recv_count, send_count;
-    recv_count = send_count = 0;
+static int rc_poll (void *aux, struct pp_packet *packets, uint32_t max __unused)
+{
+    struct pingpong_context *ctx = aux;
+    struct ibv_poll_cq_attr attr = {0};
 
-    while (recv_count < iters)
+    int ret = ibv_start_poll (ctx->cq, &attr);
+    if (ret == ENOENT)
+        return 0;
+    if (ret)
     {
-        int ret;
-        struct ibv_poll_cq_attr attr;
-        do
-        {
-            ret = ibv_start_poll (ctx->cq, &attr);
-        } while (ret == ENOENT);
-
-        if (ret)
-        {
-            LOG (stdout, "Failed to poll CQ\n");
-            return 1;
-        }
+        LOG (stdout, "Failed to poll CQ\n");
+        return -1;
+    }
 
-        ret = parse_single_wc (ctx);
-        if (ret)
+    // All the receives share a single buffer: stop at the first packet, which must be handled before the next one lands
+    int received = 0;
+    do
+    {
+        int parsed = parse_single_wc (ctx, &packets[received]);
+        if (UNLIKELY (parsed < 0))
         {
             LOG (stdout, "Failed to parse WC\n");
             ibv_end_poll (ctx->cq);
-            return 1;
-        }
-        recv_count++;
-        ret = ibv_next_poll (ctx->cq);
-        if (!ret)
-        {
-            ret = parse_single_wc (ctx);
-            if (!ret)
-                ++recv_count;
+            return -1;
         }
-        ibv_end_poll (ctx->cq);
-        if (ret && ret != ENOENT)
-        {
-            LOG (stdout, "Failed to poll CQ\n");
-            return 1;
-        }
-    }
+        received += parsed;
+    } while (!received && (ret = ibv_next_poll (ctx->cq)) == 0);
 
-    if (pp_close_context (ctx))
+    ibv_end_poll (ctx->cq);
+    if (!received && ret != ENOENT)
     {
-        fprintf (stderr, "Couldn't close context\n");
-        return 1;
+        LOG (stdout, "Failed to poll CQ\n");
+        return -1;
     }
 
-    if (persistence)
-        persistence->close (persistence);
+    return received;
+}
 
-    if (send_buffer)
-        free (send_buffer);
+static int rc_reply (void *aux, struct pp_packet *packet)
+{
+    struct pingpong_context *ctx = aux;
+    memcpy (ctx->send_payload, packet->payload, sizeof (struct pingpong_payload));
+    // In this case, using the ctx->buf is safe because the server has no send thread concurrently accessing it.
+    return pp_post_send (ctx, NULL) ? -1 : 0;
+}
 
-    return 0;
-}
\ No newline at end of file
+static void rc_teardown (void *aux)
+{
+    if (pp_close_context (aux))
+        fprintf (stderr, "Couldn't close context\n");
+}
+
+/**
+ * A single send buffer is posted with the extended QP API, which cannot be shared by several sender threads; for the
+ * same reason, the buffer can only be reused once the previous ping has been answered. Use UD for several flows or
+ * larger windows.
+ */
+PP_DRIVER_DEFINE_LOOPS (rc_loops, rc_poll, rc_reply)
+
+static const struct pp_datapath rc_datapath = {
+    .name = "rc_pingpong",
+    .outfile = "rc.dat",
+    .flags = PP_DATAPATH_F_DEVICE | PP_DATAPATH_F_GID,
+    .max_flows = 1,
+    .max_window = 1,
+    .setup = rc_setup,
+    .send = rc_send,
+    .poll = rc_poll,
+    .reply = rc_reply,
+    .teardown = rc_teardown,
+    .loops = &rc_loops,
+};
+
+int main (int argc, char **argv)
+{
+    return pp_driver_main (argc, argv, &rc_datapath);
+}
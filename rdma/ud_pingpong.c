@@ -1,6 +1,5 @@
 // Require information: Device name, Port GID Index, Server IP
 #include <malloc.h>
-#include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -10,9 +9,8 @@
 
 #include "../common/bitset.h"
 #include "../common/common.h"
+#include "../common/driver.h"
 #include "../common/net.h"
-#include "../common/persistence.h"
-#include "src/args.h"
 #include "src/ib_net.h"
 #include "src/pingpong.h"
 
@@ -25,15 +23,12 @@
 // Priority (i.e. service level) for the traffic
 #define PRIORITY 0
 
-persistence_agent_t *persistence_agent;
-
-static volatile bool global_exit = false;
-
 /**
  * Work Request IDs.
  * Range [0, QUEUE_SIZE) is used for send WRs, [QUEUE_SIZE, 2*QUEUE_SIZE) is used for receive WRs.
  * The different IDs in the reception are used to determine which queue index was used to receive the packet.
- * The IDs in the send are used only by the server, in order to remember which queue index is now available to receive a new packet, i.e. to be used in a new recv WR.
+ * The IDs in the send are used by the server to remember which queue index is now available to receive a new packet, i.e. to be used in a new recv WR,
+ * and by the client to know which flow can reuse its send buffer.
  */
 enum {
     PINGPONG_SEND_WRID = 0,
@@ -45,7 +40,8 @@ static int page_size;
 struct pingpong_context {
     /**
      * Bitset to keep track of the send WRs that are still pending.
-     * On the client only the first bit is used, since there is only one buffer used to send (`send_buf`).
+     * On the client, each bit represents a flow, which has its own buffer in `send_buf`; the bits are set by the sender
+     * threads of the flows and cleared by the polling thread, so they are modified atomically.
      * On the server, each bit represents a different queue index, keeping track of the buffers that have a pending send request.
      */
     BITSET_DECLARE (pending_send, QUEUE_SIZE);
@@ -62,10 +58,15 @@ struct pingpong_context {
     struct ib_node_info remote_info;
 
     uint8_t *send_buf;
-    struct pingpong_payload *send_payload;
+    struct pingpong_payload *send_payloads[PINGPONG_MAX_FLOWS];
 
     uint8_t *recv_bufs;
     struct pingpong_payload *recv_payloads[QUEUE_SIZE];
+
+    bool server;
+    // Client only: queue indexes of the pongs returned by the last poll, whose receives are posted again by the next one
+    uint32_t deferred_recv[PP_DRIVER_BATCH];
+    uint32_t deferred_count;
 };
 
 int init_pp_buffer (void **buffer, size_t size)
@@ -83,7 +84,7 @@ int init_pp_buffer (void **buffer, size_t size)
 
 struct pingpong_context *pp_init_context (struct ibv_device *ib_dev)
 {
-    struct pingpong_context *ctx = malloc (sizeof (struct pingpong_context));
+    struct pingpong_context *ctx = calloc (1, sizeof (struct pingpong_context));
     if (!ctx)
         return NULL;
 
@@ -91,12 +92,15 @@ struct pingpong_context *pp_init_context (struct ibv_device *ib_dev)
 
     ctx->send_flags = IBV_SEND_SIGNALED;
 
-    if (init_pp_buffer ((void **) &ctx->send_buf, PACKET_SIZE))
+    if (init_pp_buffer ((void **) &ctx->send_buf, PACKET_SIZE * PINGPONG_MAX_FLOWS))
     {
         LOG (stderr, "Couldn't allocate send_buf\n");
         goto clean_ctx;
     }
-    ctx->send_payload = (struct pingpong_payload *) (ctx->send_buf + 40);
+    for (unsigned i = 0; i < PINGPONG_MAX_FLOWS; ++i)
+    {
+        ctx->send_payloads[i] = (struct pingpong_payload *) (ctx->send_buf + i * PACKET_SIZE + 40);
+    }
 
     if (init_pp_buffer ((void **) &ctx->recv_bufs, PACKET_SIZE * QUEUE_SIZE))
     {
@@ -123,7 +127,7 @@ struct pingpong_context *pp_init_context (struct ibv_device *ib_dev)
         goto clean_context;
     }
 
-    ctx->send_mr = ibv_reg_mr (ctx->pd, ctx->send_buf, PACKET_SIZE, IBV_ACCESS_LOCAL_WRITE);
+    ctx->send_mr = ibv_reg_mr (ctx->pd, ctx->send_buf, PACKET_SIZE * PINGPONG_MAX_FLOWS, IBV_ACCESS_LOCAL_WRITE);
     if (!ctx->send_mr)
     {
         LOG (stderr, "Couldn't register MR for send_buf\n");
@@ -298,9 +302,10 @@ int pp_post_recv (struct pingpong_context *ctx, int queue_idx)
  * @param buffer the buffer containing the packet to send
  * @param lkey the local key of the buffer, obtained from the MR
  * @param queue_idx if the packet being sent is the response to a received packet, this is the queue index used to receive the packet. Otherwise, -1.
+ * @param server whether the caller is the server, whose single thread does not need atomic updates of the pending bitset
  * @return 0 on success, -1 on failure
  */
-int pp_post_send (struct pingpong_context *ctx, uintptr_t buffer, uint32_t lkey, int queue_idx)
+__always_inline static int pp_post_send (struct pingpong_context *ctx, uintptr_t buffer, uint32_t lkey, int queue_idx, const bool server)
 {
     const struct ib_node_info *remote = &ctx->remote_info;
     struct ibv_sge list = {
@@ -320,71 +325,66 @@ int pp_post_send (struct pingpong_context *ctx, uintptr_t buffer, uint32_t lkey,
                 .remote_qpn = remote->qpn,
                 .remote_qkey = 0x11111111}}};
     struct ibv_send_wr *bad_wr;
-    BITSET_SET (ctx->pending_send, queue_idx != -1 ? queue_idx : 0);
+    if (server)
+        BITSET_SET (ctx->pending_send, queue_idx != -1 ? queue_idx : 0);
+    else
+        BITSET_SET_ATOMIC (ctx->pending_send, queue_idx != -1 ? queue_idx : 0);
     return ibv_post_send (ctx->qp, &wr, &bad_wr);
 }
 
-int parse_single_wc (struct pingpong_context *ctx, struct ibv_wc wc)
+/**
+ * Parse a work completion.
+ *
+ * @param ctx the pingpong context
+ * @param wc the work completion
+ * @param packet where the received packet is stored, if the completion is for a receive WR
+ * @return 1 if a packet was received, 0 if the completion is for a send WR, -1 on failure
+ */
+static int parse_single_wc (struct pingpong_context *ctx, const struct ibv_wc *wc, struct pp_packet *packet)
 {
-    const uint64_t ts = get_time_ns ();
-    if (wc.status != IBV_WC_SUCCESS)
+    if (wc->status != IBV_WC_SUCCESS)
     {
-        LOG (stderr, "Failed status %s (%d) for wr_id %d\n", ibv_wc_status_str (wc.status), wc.status, (int) wc.wr_id);
-        return 1;
+        LOG (stderr, "Failed status %s (%d) for wr_id %d\n", ibv_wc_status_str (wc->status), wc->status, (int) wc->wr_id);
+        return -1;
     }
 
     // Unknown WRID
-    if (wc.wr_id >= PINGPONG_RECV_WRID + QUEUE_SIZE)
+    if (wc->wr_id >= PINGPONG_RECV_WRID + QUEUE_SIZE)
     {
-        LOG (stderr, "Completion for unknown wr_id %d\n", (int) wc.wr_id);
-        return 1;
+        LOG (stderr, "Completion for unknown wr_id %d\n", (int) wc->wr_id);
+        return -1;
     }
 
     // Send WRID
-    if (wc.wr_id < PINGPONG_SEND_WRID + QUEUE_SIZE)
+    if (wc->wr_id < PINGPONG_SEND_WRID + QUEUE_SIZE)
     {
         // Received a completion for a send WR, the corresponding bit can be unset.
-        BITSET_CLEAR (ctx->pending_send, wc.wr_id - PINGPONG_SEND_WRID);
+        if (ctx->server)
+            BITSET_CLEAR (ctx->pending_send, wc->wr_id - PINGPONG_SEND_WRID);
+        else
+            BITSET_CLEAR_ATOMIC (ctx->pending_send, wc->wr_id - PINGPONG_SEND_WRID);
 
-        // Only the server needs to wait for the completion of a send operation in order to post the receive.
-        // Since the client reads the content immediately and only once, the recv is posted immediatly because overwriting the buffer is not a problem.
-#if SERVER
-        if (UNLIKELY (pp_post_recv (ctx, wc.wr_id - PINGPONG_SEND_WRID)))
+        // Only the server needs to wait for the completion of a send operation in order to post the receive, since the
+        // pong is sent from the receive buffer itself.
+        if (ctx->server && UNLIKELY (pp_post_recv (ctx, wc->wr_id - PINGPONG_SEND_WRID)))
         {
-            LOG (stderr, "Couldn't post receive on queue_idx %lu\n", wc.wr_id - PINGPONG_SEND_WRID);
-            return 1;
+            LOG (stderr, "Couldn't post receive on queue_idx %lu\n", wc->wr_id - PINGPONG_SEND_WRID);
+            return -1;
         }
-#endif
         return 0;
     }
 
     // Recv WRID
-    uint32_t queue_idx = wc.wr_id - PINGPONG_RECV_WRID;
-    // LOG (stdout, "Received packet on queue_idx %d\n", queue_idx);
-#if SERVER
-    // Make sure the send buffer is not being used by an outgoing packet.
-    BUSY_WAIT (BITSET_TEST (ctx->pending_send, queue_idx));
-    ctx->recv_payloads[queue_idx]->ts[1] = ts;
-    ctx->recv_payloads[queue_idx]->ts[2] = get_time_ns ();
-    LOG (stdout, "Sending back packet %llu from queue %d\n", ctx->recv_payloads[queue_idx]->id, queue_idx);
-    if (pp_post_send (ctx, (uintptr_t) ctx->recv_bufs + queue_idx * PACKET_SIZE, ctx->recv_mr->lkey, queue_idx))
-    {
-        LOG (stderr, "Couldn't post send\n");
-        return 1;
-    }
-#else
-    ctx->recv_payloads[queue_idx]->ts[3] = get_time_ns ();
-    persistence_agent->write (persistence_agent, ctx->recv_payloads[queue_idx]);
+    uint32_t queue_idx = wc->wr_id - PINGPONG_RECV_WRID;
+    packet->payload = ctx->recv_payloads[queue_idx];
+    packet->ts = 0;
+    packet->handle = queue_idx;
 
-    // The client can post the receive for the used queue index immediately, since the packet is not used anymore.
-    if (UNLIKELY (pp_post_recv (ctx, queue_idx)))
-    {
-        LOG (stderr, "Couldn't post receive on queue_idx %d\n", queue_idx);
-        return 1;
-    }
-#endif
+    // The client reads the pong only once, so its receive is posted again as soon as the driver has recorded it.
+    if (!ctx->server)
+        ctx->deferred_recv[ctx->deferred_count++] = queue_idx;
 
-    return 0;
+    return 1;
 }
 
 int pp_ib_connect (struct pingpong_context *ctx, int gidx, struct ib_node_info *local, struct ib_node_info *dest)
@@ -430,94 +430,51 @@ int pp_ib_connect (struct pingpong_context *ctx, int gidx, struct ib_node_info *
     return 0;
 }
 
-int pp_send_single_packet (char *buf __unused, const uint64_t packet_id, struct sockaddr_ll *dest_addr __unused, void *aux)
+static int ud_setup (const struct pp_driver_config *config, void **out)
 {
-    struct pingpong_context *ctx = (struct pingpong_context *) aux;
-
-    // Make sure the buffer is available before writing on it.
-    BUSY_WAIT (BITSET_TEST (ctx->pending_send, 0));
-
-    *ctx->send_payload = new_pingpong_payload (packet_id);
-    ctx->send_payload->ts[0] = get_time_ns ();
-
-    return pp_post_send (ctx, (uintptr_t) ctx->send_buf, ctx->send_mr->lkey, -1);
-}
-
-void sigint_handler (int sig __unused)
-{
-    global_exit = true;
-}
-
-int main (int argc, char **argv)
-{
-    char *ib_devname = NULL;
-    int port_gid_idx = 0;
-    uint64_t iters = 0;
-
-    char *server_ip = NULL;
-#if SERVER
-    if (!ib_parse_args (argc, argv, &ib_devname, &port_gid_idx, &iters))
-    {
-        ib_print_usage (argv[0]);
-        return 1;
-    }
-#else
-    uint64_t interval = 0;
-    uint32_t persistence_flags = 0;
-    if (!ib_parse_args (argc, argv, &ib_devname, &port_gid_idx, &iters, &interval, &server_ip, &persistence_flags))
-    {
-        ib_print_usage (argv[0]);
-        return 1;
-    }
-
-    persistence_agent = persistence_init ("ud.dat", persistence_flags, &interval);
-    if (!persistence_agent)
-    {
-        LOG (stderr, "Failed to initialize persistence agent\n");
-        return 1;
-    }
-#endif
+    const bool server = config->role == PP_ROLE_SERVER;
 
     srand48 (getpid () * time (NULL));
 
     page_size = sysconf (_SC_PAGESIZE);
 
-    struct ibv_device *ib_dev = ib_device_find_by_name (ib_devname);
+    struct ibv_device *ib_dev = ib_device_find_by_name (config->device);
     if (!ib_dev)
     {
-        fprintf (stderr, "IB device %s not found\n", ib_devname);
-        return 1;
+        fprintf (stderr, "IB device %s not found\n", config->device);
+        return -1;
     }
 
     struct pingpong_context *ctx = pp_init_context (ib_dev);
     if (!ctx)
     {
         fprintf (stderr, "Couldn't initialize context\n");
-        return 1;
+        return -1;
     }
+    ctx->server = server;
 
     struct ib_node_info local_info;
-    if (ib_get_local_info (ctx->context, IB_PORT, port_gid_idx, ctx->qp, &local_info))
+    if (ib_get_local_info (ctx->context, IB_PORT, config->gid_idx, ctx->qp, &local_info))
     {
         fprintf (stderr, "Couldn't get local info\n");
         pp_close_context (ctx);
-        return 1;
+        return -1;
     }
     ib_print_node_info (&local_info);
 
-    if (exchange_data (server_ip, SERVER, sizeof (local_info), (uint8_t *) &local_info, (uint8_t *) &ctx->remote_info))
+    if (exchange_data (config->server_ip, server, sizeof (local_info), (uint8_t *) &local_info, (uint8_t *) &ctx->remote_info))
     {
         fprintf (stderr, "Couldn't exchange data\n");
         pp_close_context (ctx);
-        return 1;
+        return -1;
     }
     ib_print_node_info (&ctx->remote_info);
 
-    if (pp_ib_connect (ctx, port_gid_idx, &local_info, &ctx->remote_info))
+    if (pp_ib_connect (ctx, config->gid_idx, &local_info, &ctx->remote_info))
     {
         fprintf (stderr, "Couldn't connect\n");
         pp_close_context (ctx);
-        return 1;
+        return -1;
     }
 
     LOG (stdout, "Connected\n");
@@ -528,58 +485,101 @@ int main (int argc, char **argv)
         {
             fprintf (stderr, "Couldn't post receive\n");
             pp_close_context (ctx);
-            return 1;
+            return -1;
         }
     }
 
-    signal (SIGINT, sigint_handler);
+    *out = ctx;
+    return 0;
+}
 
-#if !SERVER
-    start_sending_packets (iters, interval, (char *) ctx->send_buf, NULL, pp_send_single_packet, ctx);
-#endif
+static int ud_send (void *aux, const struct pingpong_payload *payload)
+{
+    struct pingpong_context *ctx = aux;
+    const uint32_t flow = payload->flow;
 
-    uint64_t recv_idx = 0;
-    while (LIKELY (recv_idx < iters && !global_exit))
-    {
-        struct ibv_wc wc[2];
-        int ne;
+    // Make sure the buffer of the flow is available before writing on it.
+    BUSY_WAIT (BITSET_TEST (ctx->pending_send, flow));
 
-        do
-        {
-            ne = ibv_poll_cq (ctx->cq, 2, wc);
-            if (ne < 0)
-            {
-                fprintf (stderr, "Poll CQ failed %d\n", ne);
-                return 1;
-            }
-        } while (!ne && !global_exit);
-
-        if (UNLIKELY (global_exit))
-            break;
-
-        for (int i = 0; i < ne; ++i)
+    *ctx->send_payloads[flow] = *payload;
+
+    return pp_post_send (ctx, (uintptr_t) ctx->send_buf + flow * PACKET_SIZE, ctx->send_mr->lkey, flow, false) ? -1 : 0;
+}
+
+static int ud_poll (void *aux, struct pp_packet *packets, uint32_t max)
+{
+    struct pingpong_context *ctx = aux;
+    struct ibv_wc wc[PP_DRIVER_BATCH];
+
+    for (uint32_t i = 0; i < ctx->deferred_count; ++i)
+    {
+        if (UNLIKELY (pp_post_recv (ctx, ctx->deferred_recv[i])))
         {
-            if (UNLIKELY (parse_single_wc (ctx, wc[i])))
-            {
-                fprintf (stderr, "Couldn't parse WC\n");
-                goto done;
-            }
-
-            if (wc[i].wr_id >= PINGPONG_RECV_WRID)
-                recv_idx = max (recv_idx, ctx->recv_payloads[wc[i].wr_id - PINGPONG_RECV_WRID]->id);
+            LOG (stderr, "Couldn't post receive on queue_idx %d\n", ctx->deferred_recv[i]);
+            return -1;
         }
     }
-done:
-    LOG (stdout, "Received all packets\n");
+    ctx->deferred_count = 0;
 
-    if (persistence_agent)
+    int ne = ibv_poll_cq (ctx->cq, max < PP_DRIVER_BATCH ? max : PP_DRIVER_BATCH, wc);
+    if (ne < 0)
     {
-        persistence_agent->close (persistence_agent);
+        fprintf (stderr, "Poll CQ failed %d\n", ne);
+        return -1;
     }
-    if (pp_close_context (ctx))
+
+    int received = 0;
+    for (int i = 0; i < ne; ++i)
     {
-        fprintf (stderr, "Couldn't close context\n");
-        return 1;
+        int ret = parse_single_wc (ctx, &wc[i], &packets[received]);
+        if (UNLIKELY (ret < 0))
+        {
+            fprintf (stderr, "Couldn't parse WC\n");
+            return -1;
+        }
+        received += ret;
+    }
+
+    return received;
+}
+
+static int ud_reply (void *aux, struct pp_packet *packet)
+{
+    struct pingpong_context *ctx = aux;
+    const uint32_t queue_idx = packet->handle;
+
+    // Make sure the send buffer is not being used by an outgoing packet.
+    BUSY_WAIT (BITSET_TEST (ctx->pending_send, queue_idx));
+    LOG (stdout, "Sending back packet %llu from queue %d\n", packet->payload->id, queue_idx);
+    if (pp_post_send (ctx, (uintptr_t) ctx->recv_bufs + queue_idx * PACKET_SIZE, ctx->recv_mr->lkey, queue_idx, true))
+    {
+        LOG (stderr, "Couldn't post send\n");
+        return -1;
     }
     return 0;
-}
\ No newline at end of file
+}
+
+static void ud_teardown (void *aux)
+{
+    if (pp_close_context (aux))
+        fprintf (stderr, "Couldn't close context\n");
+}
+
+PP_DRIVER_DEFINE_LOOPS (ud_loops, ud_poll, ud_reply)
+
+static const struct pp_datapath ud_datapath = {
+    .name = "ud_pingpong",
+    .outfile = "ud.dat",
+    .flags = PP_DATAPATH_F_DEVICE | PP_DATAPATH_F_GID,
+    .setup = ud_setup,
+    .send = ud_send,
+    .poll = ud_poll,
+    .reply = ud_reply,
+    .teardown = ud_teardown,
+    .loops = &ud_loops,
+};
+
+int main (int argc, char **argv)
+{
+    return pp_driver_main (argc, argv, &ud_datapath);
+}
@@ -0,0 +1,33 @@
+/**
+ * Minimal checks for the unit tests: each failed check is printed, and the test fails if any check did.
+ */
+#pragma once
+
+#include <math.h>
+#include <stdio.h>
+
+static int test_failures = 0;
+
+#define CHECK(cond)                                                           \
+    do                                                                        \
+    {                                                                         \
+        if (!(cond))                                                          \
+        {                                                                     \
+            fprintf (stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            test_failures++;                                                  \
+        }                                                                     \
+    } while (0)
+
+/* Check that `value` is within `tolerance`, relative, of `expected` */
+#define CHECK_NEAR(value, expected, tolerance)                                                                  \
+    do                                                                                                          \
+    {                                                                                                           \
+        const double _value = (value), _expected = (expected);                                                  \
+        if (fabs (_value - _expected) > (tolerance) * fabs (_expected))                                         \
+        {                                                                                                       \
+            fprintf (stderr, "%s:%d: %s = %f, expected %f\n", __FILE__, __LINE__, #value, _value, _expected); \
+            test_failures++;                                                                                    \
+        }                                                                                                       \
+    } while (0)
+
+#define TEST_RESULT() (test_failures ? (fprintf (stderr, "%d checks failed\n", test_failures), 1) : 0)
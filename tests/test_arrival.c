@@ -0,0 +1,84 @@
+#include "../common/arrival.h"
+#include "test.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+int main (void)
+{
+    struct arrival arrival;
+
+    // Parse
+    CHECK (arrival_parse (NULL, &arrival) == 0 && arrival.kind == ARRIVAL_FIXED);
+    CHECK (arrival_parse ("fixed", &arrival) == 0 && arrival.kind == ARRIVAL_FIXED);
+    CHECK (arrival_parse ("poisson", &arrival) == 0 && arrival.kind == ARRIVAL_POISSON && arrival.mean == 0 &&
+           arrival.seed == ARRIVAL_DEFAULT_SEED);
+    CHECK (arrival_parse ("poisson:5000:42", &arrival) == 0 && arrival.mean == 5000 && arrival.seed == 42);
+    CHECK (arrival_parse ("onoff:10:1000000", &arrival) == 0 && arrival.kind == ARRIVAL_ONOFF && arrival.burst == 10 &&
+           arrival.gap == 1000000);
+    CHECK (arrival_parse ("step:100:2000", &arrival) == 0 && arrival.step == 100 && arrival.next_interval == 2000);
+    CHECK (arrival_parse ("ramp:500", &arrival) == 0 && arrival.kind == ARRIVAL_RAMP && arrival.next_interval == 500);
+    CHECK (arrival_parse ("trace:run.dat", &arrival) == 0 && arrival.kind == ARRIVAL_TRACE);
+    CHECK (arrival_parse ("fixed:1", &arrival) != 0);
+    CHECK (arrival_parse ("constant", &arrival) != 0);
+    CHECK (arrival_parse ("poisso", &arrival) != 0);
+    CHECK (arrival_parse ("poisson:1:2:3", &arrival) != 0);
+    CHECK (arrival_parse ("poisson:x", &arrival) != 0);
+    CHECK (arrival_parse ("onoff:10", &arrival) != 0);
+    CHECK (arrival_parse ("onoff:0:1000", &arrival) != 0);
+    CHECK (arrival_parse ("step:100", &arrival) != 0);
+    CHECK (arrival_parse ("ramp", &arrival) != 0);
+    CHECK (arrival_parse ("ramp:10:20", &arrival) != 0);
+    CHECK (arrival_parse ("trace", &arrival) != 0);
+    CHECK (arrival_parse ("trace:", &arrival) != 0);
+
+    uint64_t *offsets;
+
+    // Fixed: no schedule
+    arrival_parse (NULL, &arrival);
+    CHECK (arrival_schedule (&arrival, 100, 1000, &offsets) == 0 && offsets == NULL);
+
+    // Onoff: bursts of 3, 1000 apart, then 10000 more
+    arrival_parse ("onoff:3:10000", &arrival);
+    CHECK (arrival_schedule (&arrival, 7, 1000, &offsets) == 0 && offsets != NULL);
+    const uint64_t onoff[] = {0, 1000, 2000, 13000, 14000, 15000, 26000};
+    for (int i = 0; i < 7; ++i)
+        CHECK (offsets[i] == onoff[i]);
+    free (offsets);
+
+    // Step: 1000 for the first 2 packets, then 3000
+    arrival_parse ("step:2:3000", &arrival);
+    CHECK (arrival_schedule (&arrival, 5, 1000, &offsets) == 0);
+    const uint64_t step[] = {0, 1000, 2000, 5000, 8000};
+    for (int i = 0; i < 5; ++i)
+        CHECK (offsets[i] == step[i]);
+    free (offsets);
+
+    // Ramp: from 1000 to 2000 over the run
+    arrival_parse ("ramp:2000", &arrival);
+    CHECK (arrival_schedule (&arrival, 101, 1000, &offsets) == 0);
+    CHECK (offsets[1] - offsets[0] == 1000);
+    CHECK (offsets[100] - offsets[99] == 2000);
+    CHECK_NEAR (offsets[100], 150000, 1e-3);
+    free (offsets);
+
+    // Poisson: the same seed gives the same schedule, with the requested mean
+    arrival_parse ("poisson:2000:7", &arrival);
+    uint64_t *again;
+    const uint64_t n = 200000;
+    CHECK (arrival_schedule (&arrival, n, 1000, &offsets) == 0);
+    CHECK (arrival_schedule (&arrival, n, 1000, &again) == 0);
+    bool same = true, increasing = true;
+    for (uint64_t i = 1; i < n; ++i)
+    {
+        same &= offsets[i] == again[i];
+        increasing &= offsets[i] >= offsets[i - 1];
+    }
+    CHECK (same);
+    CHECK (increasing);
+    CHECK_NEAR ((double) offsets[n - 1] / (n - 1), 2000, 1e-2);
+    free (again);
+    free (offsets);
+
+    return TEST_RESULT ();
+}
@@ -0,0 +1,66 @@
+#include "../common/histogram.h"
+#include "test.h"
+
+int main (void)
+{
+    struct hdr_histogram h;
+    CHECK (hdr_init (&h, 3, 1000000000UL) == 0);
+
+    // Empty
+    CHECK (h.total_count == 0);
+    CHECK (hdr_value_at_percentile (&h, 50.0) == 0);
+
+    // Uniform over [1, 100000]
+    for (uint64_t v = 1; v <= 100000; ++v)
+        hdr_record (&h, v);
+    CHECK (h.total_count == 100000);
+    CHECK (h.min == 1);
+    CHECK (h.max == 100000);
+    CHECK_NEAR (hdr_mean (&h), 50000.5, 1e-9);
+    CHECK_NEAR (hdr_value_at_percentile (&h, 50.0), 50000, 1e-3);
+    CHECK_NEAR (hdr_value_at_percentile (&h, 99.0), 99000, 1e-3);
+    CHECK_NEAR (hdr_value_at_percentile (&h, 99.9), 99900, 1e-3);
+    CHECK_NEAR (hdr_value_at_percentile (&h, 100.0), 100000, 1e-3);
+    // The value at a percentile is an upper bound within the precision
+    CHECK (hdr_value_at_percentile (&h, 50.0) >= 50000);
+
+    // The small values are recorded exactly
+    hdr_reset (&h);
+    CHECK (h.total_count == 0);
+    for (uint64_t v = 0; v < 1000; ++v)
+        hdr_record (&h, v);
+    CHECK (hdr_value_at_percentile (&h, 50.0) == 499);
+    CHECK (hdr_value_at_percentile (&h, 100.0) == 999);
+    for (uint32_t idx = 0; idx < 1000; ++idx)
+        CHECK (hdr_lowest_value_at_index (&h, hdr_counts_index (&h, idx)) == idx);
+
+    // Two modes: 99% at 10 us, 1% at 1 ms
+    hdr_reset (&h);
+    for (int i = 0; i < 9900; ++i)
+        hdr_record (&h, 10000);
+    for (int i = 0; i < 100; ++i)
+        hdr_record (&h, 1000000);
+    CHECK_NEAR (hdr_value_at_percentile (&h, 99.0), 10000, 1e-3);
+    CHECK_NEAR (hdr_value_at_percentile (&h, 99.5), 1000000, 1e-3);
+
+    // Values above the highest trackable one land in the last counter, but keep the max
+    hdr_record (&h, 5000000000UL);
+    CHECK (h.max == 5000000000UL);
+    CHECK (hdr_value_at_percentile (&h, 100.0) >= 1000000000UL && hdr_value_at_percentile (&h, 100.0) < h.max);
+
+    // Merge
+    struct hdr_histogram other, incompatible;
+    CHECK (hdr_init (&other, 3, 1000000000UL) == 0);
+    CHECK (hdr_init (&incompatible, 2, 1000000000UL) == 0);
+    for (int i = 0; i < 10001; ++i)
+        hdr_record (&other, 1000000);
+    CHECK (hdr_merge (&h, &other) == 0);
+    CHECK (h.total_count == 20002);
+    CHECK_NEAR (hdr_value_at_percentile (&h, 50.0), 1000000, 1e-3);
+    CHECK (hdr_merge (&h, &incompatible) != 0);
+
+    hdr_destroy (&incompatible);
+    hdr_destroy (&other);
+    hdr_destroy (&h);
+    return TEST_RESULT ();
+}
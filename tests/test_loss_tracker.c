@@ -0,0 +1,80 @@
+#include "../common/loss_tracker.h"
+#include "test.h"
+
+/* Lost rounds of each slot of the series */
+static uint64_t slot (const struct loss_tracker *lt, uint32_t i)
+{
+    return i < lt->num_slots ? lt->series[i] : 0;
+}
+
+int main (void)
+{
+    struct loss_tracker lt;
+
+    // In order, nothing lost
+    CHECK (loss_tracker_init (&lt, 1000, 100000) == 0);
+    for (uint64_t id = 1; id <= 100000; ++id)
+        loss_tracker_add (&lt, id, id);
+    loss_tracker_finish (&lt, 100000);
+    CHECK (lt.received == 100000);
+    CHECK (lt.highest == 100000);
+    CHECK (lt.lost == 0 && lt.late == 0 && lt.reordered == 0 && lt.duplicated == 0);
+    CHECK (lt.longest_burst == 0);
+    loss_tracker_destroy (&lt);
+
+    // Losses, a burst longer than the window, reordering, duplicates and late rounds
+    CHECK (loss_tracker_init (&lt, 0, 0) == 0);
+    for (uint64_t id = 1; id <= 20000; ++id)
+    {
+        if (id % 1000 == 0 || (id > 5000 && id <= 5000 + 2 * LOSS_WINDOW_BITS) || id == 15001)
+            continue;
+        loss_tracker_add (&lt, id, 0);
+        if (id == 14001)
+            loss_tracker_add (&lt, 14001, 0);
+        if (id == 15002)
+            loss_tracker_add (&lt, 15001, 0);
+    }
+    // Left the window long ago
+    loss_tracker_add (&lt, 1000, 0);
+    // The last 10 rounds sent are lost
+    loss_tracker_finish (&lt, 20010);
+    CHECK (lt.duplicated == 1);
+    CHECK (lt.reordered == 1);
+    CHECK (lt.late == 1);
+    // The burst, every 1000th outside of it, and the tail
+    CHECK (lt.lost == 2 * LOSS_WINDOW_BITS + 20 - 8 + 10);
+    // With round 5000 before it
+    CHECK (lt.longest_burst == 2 * LOSS_WINDOW_BITS + 1);
+    CHECK (lt.num_slots == 1 && lt.series[0] == lt.lost);
+    loss_tracker_destroy (&lt);
+
+    // Series by intended send time: bursts of 100 rounds 100 us apart, separated by 50 ms, in slots of 10 ms; the
+    // expected duration is too short, the series grows
+    CHECK (loss_tracker_init (&lt, 10000000, 10000000) == 0);
+    uint64_t time = 1000000000;
+    for (uint64_t id = 1; id <= 10000; ++id)
+    {
+        time += id % 100 == 1 && id > 1 ? 50000000 : 100000;
+        // The first 5 rounds, the burst 9001-9100 and the round before it, and every 1000th
+        if (id <= 5 || (id >= 9000 && id <= 9100) || id % 1000 == 0)
+            continue;
+        loss_tracker_add (&lt, id, time);
+    }
+    loss_tracker_finish (&lt, 10010);
+    CHECK (lt.lost == 5 + 9 + 101 + 10);
+    CHECK (lt.num_slots > 600);
+    // Before the first round received: in the first slot
+    CHECK (slot (&lt, 0) == 5);
+    // Round 1000 is sent at about 549 ms after round 6
+    CHECK (slot (&lt, 54) == 1);
+    CHECK (slot (&lt, 534) == 101);
+    // Rounds 10000 to 10010, after the last round received
+    CHECK (slot (&lt, 593) == 11);
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < lt.num_slots; ++i)
+        total += lt.series[i];
+    CHECK (total == lt.lost);
+    loss_tracker_destroy (&lt);
+
+    return TEST_RESULT ();
+}
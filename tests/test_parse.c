@@ -0,0 +1,98 @@
+#include "../common/persistence.h"
+#include "../common/placement.h"
+#include "../common/utils.h"
+#include "test.h"
+
+#include <sched.h>
+
+int main (void)
+{
+    // Roles
+    CHECK (pp_parse_role ("client") == PP_ROLE_CLIENT);
+    CHECK (pp_parse_role ("server") == PP_ROLE_SERVER);
+    CHECK (pp_parse_role ("Client") == -1);
+    CHECK (pp_parse_role ("") == -1);
+
+    // CPU lists
+    bool cpus[16];
+    CHECK (parse_cpu_list ("0-3,8,10-11\n", cpus, 16) == 0);
+    CHECK (cpus[0] && cpus[3] && !cpus[4] && cpus[8] && !cpus[9] && cpus[10] && cpus[11] && !cpus[12]);
+    CHECK (parse_cpu_list ("", cpus, 16) == 0 && !cpus[0]);
+    CHECK (parse_cpu_list ("12-20", cpus, 16) == 0 && cpus[15]);
+    CHECK (parse_cpu_list ("3-1", cpus, 16) != 0);
+    CHECK (parse_cpu_list ("a", cpus, 16) != 0);
+    CHECK (parse_cpu_list ("1;2", cpus, 16) != 0);
+    CHECK (parse_cpu_list ("-1", cpus, 16) != 0);
+
+    // Placements
+    struct placement placement;
+    placement_init (&placement);
+    CHECK (placement.spec == NULL);
+    for (int i = 0; i < PLACEMENT_THREADS; ++i)
+        CHECK (placement.threads[i].core == -1 && placement.threads[i].policy == -1);
+
+    const char *spec = "rx=2:fifo:80,tx=3:rr:70,writer=0,stats=*:other";
+    CHECK (placement_parse (spec, &placement) == 0);
+    CHECK (placement.spec == spec);
+    CHECK (placement.threads[PLACEMENT_RX].core == 2 && placement.threads[PLACEMENT_RX].policy == SCHED_FIFO &&
+           placement.threads[PLACEMENT_RX].priority == 80);
+    CHECK (placement.threads[PLACEMENT_TX].core == 3 && placement.threads[PLACEMENT_TX].policy == SCHED_RR &&
+           placement.threads[PLACEMENT_TX].priority == 70);
+    CHECK (placement.threads[PLACEMENT_WRITER].core == 0 && placement.threads[PLACEMENT_WRITER].policy == -1);
+    CHECK (placement.threads[PLACEMENT_STATS].core == -1 && placement.threads[PLACEMENT_STATS].policy == SCHED_OTHER &&
+           placement.threads[PLACEMENT_STATS].priority == 0);
+
+    const char *invalid[] = {
+        "rx",
+        "rx=",
+        "rx=a",
+        "rx=-1",
+        "rx=2:",
+        "rx=2:batch",
+        "rx=2:fifo:0",
+        "rx=2:fifo:100",
+        "rx=2:other:1",
+        "rx=2:fifo:80x",
+        "rx=2x",
+        "main=2",
+        "rx=2,,tx=3",
+    };
+    for (size_t i = 0; i < sizeof (invalid) / sizeof (invalid[0]); ++i)
+    {
+        placement_init (&placement);
+        if (placement_parse (invalid[i], &placement) == 0)
+        {
+            fprintf (stderr, "placement %s accepted\n", invalid[i]);
+            test_failures++;
+        }
+    }
+
+    // Measurements: one sink per index, with its own output flags
+    struct pers_config config = {0};
+    CHECK (pers_parse_measurements ("6", &config) == PERSISTENCE_M_HDR && config.num_sinks == 1);
+    CHECK (pers_parse_measurements ("0,3,4", &config) ==
+           (PERSISTENCE_M_ALL_TIMESTAMPS | PERSISTENCE_M_CAPTURE | PERSISTENCE_F_BINARY));
+    CHECK (config.num_sinks == 3);
+    CHECK (config.sinks[0] == PERSISTENCE_M_ALL_TIMESTAMPS);
+    CHECK (config.sinks[1] == (PERSISTENCE_M_ALL_TIMESTAMPS | PERSISTENCE_F_BINARY));
+    CHECK (config.sinks[2] == PERSISTENCE_M_CAPTURE);
+    CHECK (pers_parse_measurements ("0,1,2,3,4,5,6,7,8,9,10", &config) > 0 && config.num_sinks == PERSISTENCE_MAX_SINKS);
+    CHECK (pers_parse_measurements ("", &config) == -1);
+    CHECK (pers_parse_measurements ("11", &config) == -1);
+    CHECK (pers_parse_measurements ("1,1", &config) == -1);
+    CHECK (pers_parse_measurements ("1;2", &config) == -1);
+
+    // Intervals of the flows: the last one applies to the following flows
+    CHECK (pers_parse_intervals ("1000", &config) == 1000);
+    CHECK (config.flow_intervals[0] == 1000 && config.flow_intervals[PINGPONG_MAX_FLOWS - 1] == 1000);
+    CHECK (pers_parse_intervals ("1000,2000,500", &config) == 1000);
+    CHECK (config.flow_intervals[1] == 2000 && config.flow_intervals[2] == 500);
+    CHECK (config.flow_intervals[3] == 500 && config.flow_intervals[PINGPONG_MAX_FLOWS - 1] == 500);
+    CHECK (pers_parse_intervals ("0", &config) == 0);
+    CHECK (pers_parse_intervals ("1000,0", &config) == 0);
+    CHECK (pers_parse_intervals ("1000,x", &config) == 0);
+    CHECK (pers_parse_intervals ("1000;2000", &config) == 0);
+    CHECK (pers_parse_intervals ("1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16,17", &config) == 0);
+
+    return TEST_RESULT ();
+}
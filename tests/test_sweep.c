@@ -0,0 +1,84 @@
+#include "../common/sweep.h"
+#include "test.h"
+
+#include <stdlib.h>
+
+int main (void)
+{
+    struct sweep sweep;
+
+    // Parse
+    CHECK (sweep_parse ("1000:3000:3:1000000000", &sweep) == 0);
+    CHECK (sweep.num_steps == 3);
+    CHECK (sweep.steps[0].rate == 1000 && sweep.steps[1].rate == 2000 && sweep.steps[2].rate == 3000);
+    CHECK (sweep.steps[0].interval == 1000000 && sweep.steps[1].interval == 500000 && sweep.steps[2].interval == 333333);
+    CHECK (sweep.steps[0].packets == 1000 && sweep.steps[1].packets == 2000 && sweep.steps[2].packets == 3000);
+    CHECK (sweep.steps[0].first_id == 1 && sweep.steps[1].first_id == 1001 && sweep.steps[2].first_id == 3001);
+    CHECK (sweep_packets (&sweep) == 6000);
+    CHECK (sweep.bound_p99 == 0 && sweep.bound_p999 == 0);
+    CHECK (sweep_parse ("1000:1000:1:1000", &sweep) == 0 && sweep.steps[0].packets == 1);
+
+    CHECK (sweep_parse ("1000:3000:3", &sweep) != 0);
+    CHECK (sweep_parse ("1000:3000:3:1000:1", &sweep) != 0);
+    CHECK (sweep_parse ("0:3000:3:1000", &sweep) != 0);
+    CHECK (sweep_parse ("3000:1000:3:1000", &sweep) != 0);
+    CHECK (sweep_parse ("1000:3000:0:1000", &sweep) != 0);
+    CHECK (sweep_parse ("1000:3000:65:1000", &sweep) != 0);
+    CHECK (sweep_parse ("1000:3000:3:0", &sweep) != 0);
+    CHECK (sweep_parse ("1000:2000000000:3:1000", &sweep) != 0);
+    CHECK (sweep_parse ("1000:3000:3:10x", &sweep) != 0);
+
+    CHECK (sweep_parse ("1000:3000:3:1000000000", &sweep) == 0);
+    CHECK (sweep_parse_bounds ("50000", &sweep) == 0 && sweep.bound_p99 == 50000 && sweep.bound_p999 == 0);
+    CHECK (sweep_parse_bounds ("50000:200000", &sweep) == 0 && sweep.bound_p999 == 200000);
+    CHECK (sweep_parse_bounds ("0", &sweep) != 0);
+    CHECK (sweep_parse_bounds ("", &sweep) != 0);
+    CHECK (sweep_parse_bounds ("1:2:3", &sweep) != 0);
+
+    // Step of each id, from any hint
+    CHECK (sweep_step_of (&sweep, 1, 2) == 0);
+    CHECK (sweep_step_of (&sweep, 1000, 0) == 0);
+    CHECK (sweep_step_of (&sweep, 1001, 0) == 1);
+    CHECK (sweep_step_of (&sweep, 3000, 2) == 1);
+    CHECK (sweep_step_of (&sweep, 6000, 0) == 2);
+
+    // Schedule: contiguous steps
+    uint64_t *offsets;
+    CHECK (sweep_schedule (&sweep, &offsets) == 0);
+    CHECK (offsets[0] == 0);
+    CHECK (offsets[999] == 999000000);
+    CHECK (offsets[1000] == 1000000000);
+    CHECK (offsets[1001] == 1000500000);
+    CHECK (offsets[3001] == offsets[3000] + 333333);
+    free (offsets);
+
+    // Bounds, with the lost rounds counted as infinitely late: 990 rounds at 10 us and 10 at 100 us
+    struct hdr_histogram latency;
+    CHECK (hdr_init (&latency, 3, 1000000000UL) == 0);
+    CHECK (!sweep_within_bound (&latency, 0, 99.0, 1000000));
+    for (int i = 0; i < 990; ++i)
+        hdr_record (&latency, 10000);
+    for (int i = 0; i < 10; ++i)
+        hdr_record (&latency, 100000);
+    CHECK (sweep_within_bound (&latency, 0, 99.0, 10010));
+    CHECK (!sweep_within_bound (&latency, 0, 99.9, 10010));
+    CHECK (sweep_within_bound (&latency, 0, 99.9, 100100));
+    // 5 lost: p99 of the 1005 rounds is now among the slow ones
+    CHECK (!sweep_within_bound (&latency, 5, 99.0, 10010));
+    CHECK (sweep_within_bound (&latency, 5, 99.0, 100100));
+    // 20 lost: more than 1% of the rounds never arrived, no bound holds
+    CHECK (!sweep_within_bound (&latency, 20, 99.0, UINT64_MAX));
+    CHECK (!sweep_within_bound (&latency, 2, 99.9, UINT64_MAX));
+
+    sweep_parse_bounds ("10010:100100", &sweep);
+    CHECK (sweep_sustainable (&sweep, &latency, 0));
+    CHECK (!sweep_sustainable (&sweep, &latency, 5));
+    sweep.bound_p99 = sweep.bound_p999 = 0;
+    CHECK (sweep_sustainable (&sweep, &latency, 0));
+    CHECK (!sweep_sustainable (&sweep, &latency, 1));
+    hdr_reset (&latency);
+    CHECK (!sweep_sustainable (&sweep, &latency, 0));
+
+    hdr_destroy (&latency);
+    return TEST_RESULT ();
+}
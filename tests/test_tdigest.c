@@ -0,0 +1,69 @@
+#include "../common/tdigest.h"
+#include "test.h"
+
+#include <stdlib.h>
+
+/**
+ * Deterministic permutation of [0, n): a multiplicative step coprime with n.
+ */
+static uint64_t permute (uint64_t i, uint64_t n)
+{
+    return (i * 7919) % n;
+}
+
+int main (void)
+{
+    struct tdigest td;
+    CHECK (tdigest_init (&td, 200) == 0);
+    CHECK (tdigest_count (&td) == 0);
+    CHECK (tdigest_quantile (&td, 0.5) == 0);
+
+    // Uniform over [10000, 1010000), in shuffled order and over several batches, so that most of the merges are
+    // done while adding
+    const uint64_t n = 1000000;
+    for (uint64_t i = 0; i < n; ++i)
+        tdigest_add (&td, 10000 + permute (i, n));
+    CHECK (tdigest_count (&td) == n);
+    CHECK_NEAR (tdigest_quantile (&td, 0.0), 10000, 1e-9);
+    CHECK_NEAR (tdigest_quantile (&td, 1.0), 10000 + n - 1, 1e-9);
+    CHECK_NEAR (tdigest_quantile (&td, 0.5), 10000 + n * 0.5, 1e-2);
+    CHECK_NEAR (tdigest_quantile (&td, 0.9), 10000 + n * 0.9, 1e-2);
+    CHECK_NEAR (tdigest_quantile (&td, 0.99), 10000 + n * 0.99, 1e-3);
+    CHECK_NEAR (tdigest_quantile (&td, 0.999), 10000 + n * 0.999, 1e-3);
+    CHECK_NEAR (tdigest_quantile (&td, 0.9999), 10000 + n * 0.9999, 1e-4);
+    tdigest_destroy (&td);
+
+    // Exponential of mean 20000 above 5000, in the order of the quantiles of a sorted sample: the tail is in the
+    // outliers of the batches
+    CHECK (tdigest_init (&td, 200) == 0);
+    const uint64_t m = 200000;
+    for (uint64_t i = 0; i < m; ++i)
+    {
+        const double q = (permute (i, m) + 0.5) / m;
+        tdigest_add (&td, 5000 + (uint64_t) (-log (1 - q) * 20000));
+    }
+    CHECK_NEAR (tdigest_quantile (&td, 0.5), 5000 - log (0.5) * 20000, 2e-2);
+    CHECK_NEAR (tdigest_quantile (&td, 0.99), 5000 - log (0.01) * 20000, 1e-2);
+    CHECK_NEAR (tdigest_quantile (&td, 0.999), 5000 - log (0.001) * 20000, 1e-2);
+
+    // Merge: two halves of a uniform
+    struct tdigest low, high;
+    CHECK (tdigest_init (&low, 200) == 0);
+    CHECK (tdigest_init (&high, 200) == 0);
+    for (uint64_t i = 0; i < 50000; ++i)
+    {
+        tdigest_add (&low, 1000 + i);
+        tdigest_add (&high, 51000 + i);
+    }
+    CHECK (tdigest_merge (&low, &high) == 0);
+    CHECK (tdigest_count (&low) == 100000);
+    CHECK (tdigest_count (&high) == 50000);
+    CHECK_NEAR (tdigest_quantile (&low, 0.25), 26000, 1e-2);
+    CHECK_NEAR (tdigest_quantile (&low, 0.75), 76000, 1e-2);
+    CHECK_NEAR (tdigest_quantile (&high, 0.5), 76000, 1e-2);
+
+    tdigest_destroy (&high);
+    tdigest_destroy (&low);
+    tdigest_destroy (&td);
+    return TEST_RESULT ();
+}
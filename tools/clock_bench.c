@@ -0,0 +1,378 @@
+/**
+ * Microbenchmark of the clock sources that can be used to take the pingpong timestamps, to know the floor below
+ * which the measured jitter is only measurement noise.
+ *
+ * For each source it reports:
+ * - the distribution of the difference between two back-to-back readings, i.e. the cost of a reading, in the unit of
+ *   the source (ns for the clocks, cycles for the TSC): the tail shows the rare slow paths, e.g. of the vDSO;
+ * - the smallest non-zero step, the number of readings equal to the previous one and of readings going backwards;
+ * - for each other core, the offset of the source between the first core and that core, measured with a
+ *   ping-pong on a shared cache line: the offset is bounded by half the round trip of the fastest round, and a
+ *   reading outside of the round trip is a cross-core monotonicity violation.
+ */
+#define _GNU_SOURCE
+
+#include "../common/histogram.h"
+#include "../common/timesource.h"
+#include "../common/utils.h"
+
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Readings taken back-to-back before their differences are recorded */
+#define BATCH_SIZE (1 << 16)
+#define DEFAULT_READINGS 10000000UL
+#define DEFAULT_SKEW_ROUNDS 100000UL
+
+static inline uint64_t clock_read (clockid_t clock)
+{
+    struct timespec t;
+    clock_gettime (clock, &t);
+    return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+static inline uint64_t rdtsc_read (void)
+{
+#if TIMESOURCE_HAS_TSC
+    return __rdtsc ();
+#else
+    return 0;
+#endif
+}
+
+/**
+ * Define, for a source, the function taking one reading and the one filling a batch with back-to-back readings,
+ * so that the batch loop does not pay an indirect call.
+ */
+#define DEFINE_SOURCE(name, expr)                                  \
+    static uint64_t read_##name (void)                             \
+    {                                                              \
+        return (expr);                                             \
+    }                                                              \
+    static void fill_##name (uint64_t *batch, size_t n)            \
+    {                                                              \
+        for (size_t i = 0; i < n; ++i)                             \
+            batch[i] = (expr);                                     \
+    }
+
+DEFINE_SOURCE (monotonic, clock_read (CLOCK_MONOTONIC))
+DEFINE_SOURCE (monotonic_raw, clock_read (CLOCK_MONOTONIC_RAW))
+DEFINE_SOURCE (tai, clock_read (CLOCK_TAI))
+DEFINE_SOURCE (rdtsc, rdtsc_read ())
+DEFINE_SOURCE (rdtscp, tsc_read ())
+DEFINE_SOURCE (get_time_ns, get_time_ns ())
+
+struct clock_source {
+    const char *name;
+    uint64_t (*read) (void);
+    void (*fill) (uint64_t *batch, size_t n);
+    // Clock to query for the resolution, -1 for the TSC
+    clockid_t clock;
+    bool tsc;
+    // Source of `get_time_ns` to select before the benchmark
+    int timesource;
+};
+
+static const struct clock_source sources[] = {
+    {"monotonic", read_monotonic, fill_monotonic, CLOCK_MONOTONIC, false, -1},
+    {"monotonic_raw", read_monotonic_raw, fill_monotonic_raw, CLOCK_MONOTONIC_RAW, false, -1},
+    {"tai", read_tai, fill_tai, CLOCK_TAI, false, -1},
+    {"rdtsc", read_rdtsc, fill_rdtsc, -1, true, -1},
+    {"rdtscp_lfence", read_rdtscp, fill_rdtscp, -1, true, -1},
+    {"get_time_ns_clock", read_get_time_ns, fill_get_time_ns, TIMESTAMP_CLOCK, false, TIMESOURCE_CLOCK},
+    {"get_time_ns_tsc", read_get_time_ns, fill_get_time_ns, -1, false, TIMESOURCE_TSC},
+};
+
+/**
+ * State shared by the two threads of the cross-core ping-pong.
+ */
+struct skew_shared {
+    _Alignas (CACHE_LINE_SIZE) _Atomic uint64_t request;
+    _Alignas (CACHE_LINE_SIZE) _Atomic uint64_t response;
+    uint64_t remote_time;
+    const struct clock_source *source;
+    uint64_t rounds;
+    int core;
+};
+
+static int pin_to_core (int core)
+{
+    cpu_set_t set;
+    CPU_ZERO (&set);
+    CPU_SET (core, &set);
+    return pthread_setaffinity_np (pthread_self (), sizeof (cpu_set_t), &set);
+}
+
+static void *skew_responder (void *arg)
+{
+    struct skew_shared *shared = arg;
+    pin_to_core (shared->core);
+
+    for (uint64_t r = 1; r <= shared->rounds; ++r)
+    {
+        while (atomic_load_explicit (&shared->request, memory_order_acquire) != r)
+            ;
+        shared->remote_time = shared->source->read ();
+        atomic_store_explicit (&shared->response, r, memory_order_release);
+    }
+
+    return NULL;
+}
+
+/**
+ * Measure the offset of `source` on `core` with respect to the calling thread, pinned on `local_core`.
+ */
+static int measure_skew (const struct clock_source *source, int local_core, int core, uint64_t rounds, double unit_ns)
+{
+    struct skew_shared *shared = aligned_alloc (CACHE_LINE_SIZE, sizeof (struct skew_shared));
+    if (shared == NULL)
+        return -1;
+    memset (shared, 0, sizeof (struct skew_shared));
+    shared->source = source;
+    shared->rounds = rounds;
+    shared->core = core;
+
+    pthread_t thread;
+    if (pthread_create (&thread, NULL, skew_responder, shared) != 0)
+    {
+        free (shared);
+        return -1;
+    }
+    pin_to_core (local_core);
+
+    uint64_t best_rtt = UINT64_MAX;
+    int64_t best_offset = 0;
+    uint64_t violations = 0;
+    for (uint64_t r = 1; r <= rounds; ++r)
+    {
+        const uint64_t before = source->read ();
+        atomic_store_explicit (&shared->request, r, memory_order_release);
+        while (atomic_load_explicit (&shared->response, memory_order_acquire) != r)
+            ;
+        const uint64_t after = source->read ();
+        const uint64_t remote = shared->remote_time;
+
+        if (remote < before || remote > after)
+            violations++;
+        if (after - before < best_rtt)
+        {
+            best_rtt = after - before;
+            best_offset = (int64_t) (remote - before) - (int64_t) (best_rtt / 2);
+        }
+    }
+
+    pthread_join (thread, NULL);
+    free (shared);
+
+    printf ("%s SKEW CORE %d OFFSET %.1f BOUND %.1f VIOLATIONS %lu\n", source->name, core,
+            best_offset * unit_ns, best_rtt / 2 * unit_ns, violations);
+    return 0;
+}
+
+static int benchmark_source (const struct clock_source *source, uint64_t readings, uint64_t skew_rounds,
+                             const int *cores, int num_cores, bool print_counts)
+{
+    if (source->tsc && !TIMESOURCE_HAS_TSC)
+    {
+        printf ("%s UNAVAILABLE\n", source->name);
+        return 0;
+    }
+    if (source->timesource >= 0 && timesource_init (source->timesource) != 0)
+    {
+        printf ("%s UNAVAILABLE\n", source->name);
+        return 0;
+    }
+
+    uint64_t *batch = malloc (BATCH_SIZE * sizeof (uint64_t));
+    struct hdr_histogram steps;
+    if (batch == NULL || hdr_init (&steps, 3, 1ULL << 40) != 0)
+    {
+        free (batch);
+        return -1;
+    }
+
+    // Warm up the code and the vDSO page
+    source->fill (batch, BATCH_SIZE);
+
+    uint64_t min_step = UINT64_MAX;
+    uint64_t zero_steps = 0;
+    uint64_t backwards = 0;
+    uint64_t prev = source->read ();
+    for (uint64_t done = 0; done < readings; done += BATCH_SIZE)
+    {
+        const size_t n = min (readings - done, (uint64_t) BATCH_SIZE);
+        source->fill (batch, n);
+        for (size_t i = 0; i < n; ++i)
+        {
+            if (UNLIKELY (batch[i] < prev))
+            {
+                backwards++;
+            }
+            else
+            {
+                const uint64_t step = batch[i] - prev;
+                if (step == 0)
+                    zero_steps++;
+                else if (step < min_step)
+                    min_step = step;
+                hdr_record (&steps, step);
+            }
+            prev = batch[i];
+        }
+        // The step across two batches includes the recording of the previous batch
+        prev = source->read ();
+    }
+
+    const bool cycles = source->tsc;
+    const double unit_ns = cycles && timesource_tsc_hz () > 0 ? 1e9 / timesource_tsc_hz () : 1.0;
+    printf ("%s UNIT %s", source->name, cycles ? "cycles" : "ns");
+    if (source->clock >= 0)
+    {
+        struct timespec res;
+        clock_getres (source->clock, &res);
+        printf (" RESOLUTION %ld", res.tv_sec * 1000000000L + res.tv_nsec);
+    }
+    printf (" MIN_STEP %lu ZERO_STEPS %lu BACKWARDS %lu\n", min_step == UINT64_MAX ? 0 : min_step, zero_steps, backwards);
+    hdr_print_percentiles (&steps, stdout, source->name);
+    if (print_counts)
+        hdr_print_counts (&steps, stdout, source->name);
+
+    for (int i = 1; i < num_cores; ++i)
+    {
+        if (measure_skew (source, cores[0], cores[i], skew_rounds, unit_ns) != 0)
+            printf ("%s SKEW CORE %d FAILED\n", source->name, cores[i]);
+    }
+    fflush (stdout);
+
+    hdr_destroy (&steps);
+    free (batch);
+    return 0;
+}
+
+void clock_bench_print_usage (char *prog)
+{
+    printf ("Usage: %s [-n <readings>] [-r <rounds>] [-c <cores>] [-s <sources>] [-C]\n", prog);
+    printf ("\t-n, --readings <readings>\tBack-to-back readings of each source (default %lu).\n", DEFAULT_READINGS);
+    printf ("\t-r, --rounds <rounds>\tRounds of the cross-core ping-pong for each core (default %lu).\n", DEFAULT_SKEW_ROUNDS);
+    printf ("\t-c, --cores <cores>\tCPU list, e.g. 2-5: the skew is measured between the first core and each other one (default: the allowed cores).\n");
+    printf ("\t-s, --sources <sources>\tComma-separated sources to benchmark (default: all):");
+    for (size_t i = 0; i < sizeof (sources) / sizeof (sources[0]); ++i)
+        printf (" %s", sources[i].name);
+    printf (".\n");
+    printf ("\t-C, --counts\tAlso print the non-empty counters of the histograms of the steps.\n");
+}
+
+int main (int argc, char **argv)
+{
+    static struct option long_options[] = {
+        {"readings", required_argument, 0, 'n'},
+        {"rounds", required_argument, 0, 'r'},
+        {"cores", required_argument, 0, 'c'},
+        {"sources", required_argument, 0, 's'},
+        {"counts", no_argument, 0, 'C'},
+        {"help", no_argument, 0, 'h'},
+        {0, 0, 0, 0}};
+
+    uint64_t readings = DEFAULT_READINGS;
+    uint64_t skew_rounds = DEFAULT_SKEW_ROUNDS;
+    const char *core_list = NULL;
+    const char *source_list = NULL;
+    bool print_counts = false;
+    int opt;
+    while ((opt = getopt_long (argc, argv, "n:r:c:s:Ch", long_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            readings = atoll (optarg);
+            break;
+        case 'r':
+            skew_rounds = atoll (optarg);
+            break;
+        case 'c':
+            core_list = optarg;
+            break;
+        case 's':
+            source_list = optarg;
+            break;
+        case 'C':
+            print_counts = true;
+            break;
+        default:
+            clock_bench_print_usage (argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (readings == 0)
+    {
+        clock_bench_print_usage (argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    bool selected[CPU_SETSIZE];
+    if (core_list)
+    {
+        if (parse_cpu_list (core_list, selected, CPU_SETSIZE) != 0)
+        {
+            clock_bench_print_usage (argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    else
+    {
+        cpu_set_t allowed;
+        CPU_ZERO (&allowed);
+        sched_getaffinity (0, sizeof (cpu_set_t), &allowed);
+        for (int i = 0; i < CPU_SETSIZE; ++i)
+            selected[i] = CPU_ISSET (i, &allowed);
+    }
+
+    int cores[CPU_SETSIZE];
+    int num_cores = 0;
+    for (int i = 0; i < CPU_SETSIZE; ++i)
+    {
+        if (selected[i])
+            cores[num_cores++] = i;
+    }
+    if (num_cores == 0 || pin_to_core (cores[0]) != 0)
+    {
+        fprintf (stderr, "ERR: could not pin to the first core\n");
+        return EXIT_FAILURE;
+    }
+
+    // The TSC frequency is needed to convert the cycles of the TSC sources
+    if (timesource_init (TIMESOURCE_TSC) == 0)
+        printf ("TSC_HZ %.0f\n", timesource_tsc_hz ());
+
+    for (size_t i = 0; i < sizeof (sources) / sizeof (sources[0]); ++i)
+    {
+        if (source_list)
+        {
+            // Match whole names in the comma-separated list
+            const size_t len = strlen (sources[i].name);
+            const char *p = source_list;
+            bool found = false;
+            while ((p = strstr (p, sources[i].name)) != NULL && !found)
+            {
+                found = (p == source_list || p[-1] == ',') && (p[len] == ',' || p[len] == '\0');
+                p += len;
+            }
+            if (!found)
+                continue;
+        }
+
+        if (benchmark_source (&sources[i], readings, skew_rounds, cores, num_cores, print_counts) != 0)
+        {
+            fprintf (stderr, "ERR: could not benchmark %s\n", sources[i].name);
+            return EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,190 @@
+/**
+ * Comparison of the HDR histogram written by a run with -m 6 against a baseline run, to catch latency regressions.
+ *
+ * For each of the checked percentiles it fails if the new value exceeds the baseline by more than a relative
+ * tolerance plus an absolute slack; it also reports the Kolmogorov-Smirnov distance between the two distributions,
+ * i.e. the largest difference of their cumulative distributions, which fails the comparison only if a bound is given.
+ *
+ * Exit status: 0 if the run is within bounds, 1 on regression, 2 if a file cannot be read.
+ */
+#include "../common/histogram.h"
+#include "../common/persistence.h"
+#include "../common/utils.h"
+
+#include <getopt.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_TOLERANCE 0.2
+#define DEFAULT_SLACK_NS 1000
+
+static const double checked_percentiles[] = {50.0, 90.0, 99.0, 99.9};
+
+void hdr_compare_print_usage (char *prog)
+{
+    printf ("Usage: %s [-n <name>] [-t <tolerance>] [-s <slack>] [-k <distance>] <baseline> <result>\n", prog);
+    printf ("\t-n, --name <name>\tHistogram to compare: ABS (default), CO, REL0..REL3.\n");
+    printf ("\t-t, --tolerance <tolerance>\tRelative increase of a percentile allowed over the baseline (default %g).\n", DEFAULT_TOLERANCE);
+    printf ("\t-s, --slack <slack>\tAbsolute increase in nanoseconds allowed on top of the tolerance (default %d).\n", DEFAULT_SLACK_NS);
+    printf ("\t-k, --ks <distance>\tFail if the Kolmogorov-Smirnov distance exceeds <distance>, in [0, 1] (default: only reported).\n");
+}
+
+/**
+ * Rebuild the histogram `name` from the counters of an HDR output file.
+ * The values of each counter are accounted at its midpoint, which is within the precision of the histogram.
+ *
+ * @return 0 on success, -1 if the file cannot be read or holds no such histogram
+ */
+static int hdr_load (const char *filename, const char *name, struct hdr_histogram *h)
+{
+    FILE *file = fopen (filename, "r");
+    if (file == NULL)
+    {
+        fprintf (stderr, "ERR: could not open %s\n", filename);
+        return -1;
+    }
+
+    char line[512];
+    char line_name[16];
+    uint32_t digits = 0;
+    uint64_t lowest, highest, count;
+    while (fgets (line, sizeof (line), file))
+    {
+        if (digits == 0)
+        {
+            if (sscanf (line, "DIGITS %u", &digits) == 1 && hdr_init (h, digits, PERSISTENCE_HDR_HIGHEST) != 0)
+            {
+                fprintf (stderr, "ERR: invalid precision %u in %s\n", digits, filename);
+                fclose (file);
+                return -1;
+            }
+            continue;
+        }
+
+        // The summary lines share the name but not the format of the counters
+        if (sscanf (line, "%15s %lu %lu %lu", line_name, &lowest, &highest, &count) != 4 || strcmp (line_name, name) != 0)
+            continue;
+
+        h->counts[hdr_counts_index (h, lowest)] += count;
+        h->total_count += count;
+        h->sum += (__uint128_t) ((lowest + highest) / 2) * count;
+        h->min = min (h->min, lowest);
+        h->max = max (h->max, highest);
+    }
+    fclose (file);
+
+    if (digits == 0)
+    {
+        fprintf (stderr, "ERR: %s is not an HDR histogram file (-m 6)\n", filename);
+        return -1;
+    }
+    if (h->total_count == 0)
+    {
+        fprintf (stderr, "ERR: no %s values in %s\n", name, filename);
+        hdr_destroy (h);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Largest difference between the cumulative distributions of two histograms with the same precision.
+ */
+static double ks_distance (const struct hdr_histogram *a, const struct hdr_histogram *b)
+{
+    uint64_t cum_a = 0, cum_b = 0;
+    double distance = 0;
+    for (uint32_t i = 0; i < a->counts_len; ++i)
+    {
+        cum_a += a->counts[i];
+        cum_b += b->counts[i];
+        const double diff = (double) cum_a / a->total_count - (double) cum_b / b->total_count;
+        if (diff > distance)
+            distance = diff;
+        else if (-diff > distance)
+            distance = -diff;
+    }
+    return distance;
+}
+
+int main (int argc, char **argv)
+{
+    static struct option long_options[] = {
+        {"name", required_argument, 0, 'n'},
+        {"tolerance", required_argument, 0, 't'},
+        {"slack", required_argument, 0, 's'},
+        {"ks", required_argument, 0, 'k'},
+        {"help", no_argument, 0, 'h'},
+        {0, 0, 0, 0}};
+
+    const char *name = "ABS";
+    double tolerance = DEFAULT_TOLERANCE;
+    uint64_t slack = DEFAULT_SLACK_NS;
+    double max_distance = 1.0;
+    int opt;
+    while ((opt = getopt_long (argc, argv, "n:t:s:k:h", long_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            name = optarg;
+            break;
+        case 't':
+            tolerance = atof (optarg);
+            break;
+        case 's':
+            slack = atoll (optarg);
+            break;
+        case 'k':
+            max_distance = atof (optarg);
+            break;
+        default:
+            hdr_compare_print_usage (argv[0]);
+            return 2;
+        }
+    }
+
+    if (optind != argc - 2 || tolerance < 0 || max_distance < 0)
+    {
+        hdr_compare_print_usage (argv[0]);
+        return 2;
+    }
+
+    struct hdr_histogram baseline, result;
+    if (hdr_load (argv[optind], name, &baseline) != 0)
+        return 2;
+    if (hdr_load (argv[optind + 1], name, &result) != 0)
+    {
+        hdr_destroy (&baseline);
+        return 2;
+    }
+    if (baseline.counts_len != result.counts_len)
+    {
+        fprintf (stderr, "ERR: the histograms have a different precision, rerun with the same -H\n");
+        hdr_destroy (&baseline);
+        hdr_destroy (&result);
+        return 2;
+    }
+
+    bool regression = false;
+    printf ("%s COUNT %lu %lu MEAN %.1f %.1f\n", name, baseline.total_count, result.total_count, hdr_mean (&baseline), hdr_mean (&result));
+    for (size_t i = 0; i < sizeof (checked_percentiles) / sizeof (checked_percentiles[0]); ++i)
+    {
+        const uint64_t before = hdr_value_at_percentile (&baseline, checked_percentiles[i]);
+        const uint64_t after = hdr_value_at_percentile (&result, checked_percentiles[i]);
+        const bool failed = after > before * (1 + tolerance) + slack;
+        printf ("P%g %lu %lu %+.1f%%%s\n", checked_percentiles[i], before, after,
+                before ? 100.0 * ((double) after - before) / before : 0, failed ? " REGRESSION" : "");
+        regression |= failed;
+    }
+
+    const double distance = ks_distance (&baseline, &result);
+    const bool failed = distance > max_distance;
+    printf ("KS %.4f%s\n", distance, failed ? " REGRESSION" : "");
+    regression |= failed;
+
+    hdr_destroy (&baseline);
+    hdr_destroy (&result);
+    return regression ? 1 : 0;
+}
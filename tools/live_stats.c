@@ -0,0 +1,147 @@
+/**
+ * Reader of the live statistics published by a client run with -L/--live.
+ * Prints the counters and the percentiles of the recent window once, or every interval with -f.
+ */
+#include "../common/live_stats.h"
+#include "../common/placement.h"
+#include "../common/utils.h"
+
+#include <getopt.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static const double window_percentiles[] = {50.0, 90.0, 99.0, 99.9};
+
+void live_stats_print_usage (char *prog)
+{
+    printf ("Usage: %s [-f] [-i <interval>] [-P <placement>] <pid | path>\n", prog);
+    printf ("\t-f, --follow\tKeep printing the statistics until the run ends.\n");
+    printf ("\t-i, --interval <interval>\tInterval between two prints in milliseconds (default 1000).\n");
+    printf ("\t-P, --placement <placement>\tCore and scheduling of the reader, stats=<core>[:<policy>[:<priority>]], see the -P of the programs.\n");
+}
+
+static int compare_u64 (const void *a, const void *b)
+{
+    const uint64_t x = *(const uint64_t *) a;
+    const uint64_t y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+void print_snapshot (struct live_stats_snapshot *snapshot, uint64_t prev_packets, uint64_t elapsed_ns)
+{
+    printf ("PACKETS %lu LOST %lu MIN %lu MEAN %.1f MAX %lu", snapshot->packets, snapshot->lost,
+            snapshot->min, snapshot->mean, snapshot->max);
+    if (elapsed_ns)
+        printf (" RATE %.0f", (snapshot->packets - prev_packets) * 1e9 / elapsed_ns);
+
+    qsort (snapshot->window, snapshot->window_len, sizeof (uint64_t), compare_u64);
+    for (size_t i = 0; i < sizeof (window_percentiles) / sizeof (window_percentiles[0]); ++i)
+    {
+        uint64_t value = 0;
+        if (snapshot->window_len > 0)
+        {
+            const uint32_t idx = (uint32_t) (window_percentiles[i] / 100.0 * (snapshot->window_len - 1) + 0.5);
+            value = snapshot->window[idx];
+        }
+        printf (" W_P%g %lu", window_percentiles[i], value);
+    }
+    printf ("\n");
+    fflush (stdout);
+}
+
+int main (int argc, char **argv)
+{
+    static struct option long_options[] = {
+        {"follow", no_argument, 0, 'f'},
+        {"interval", required_argument, 0, 'i'},
+        {"placement", required_argument, 0, 'P'},
+        {"help", no_argument, 0, 'h'},
+        {0, 0, 0, 0}};
+
+    bool follow = false;
+    uint64_t interval_ms = 1000;
+    struct placement placement;
+    placement_init (&placement);
+    int opt;
+    while ((opt = getopt_long (argc, argv, "fi:P:h", long_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'f':
+            follow = true;
+            break;
+        case 'i':
+            interval_ms = atoll (optarg);
+            break;
+        case 'P':
+            if (placement_parse (optarg, &placement) != 0)
+            {
+                live_stats_print_usage (argv[0]);
+                return EXIT_FAILURE;
+            }
+            break;
+        default:
+            live_stats_print_usage (argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (optind != argc - 1 || interval_ms == 0)
+    {
+        live_stats_print_usage (argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // Keep the reader away from the cores of the measured threads
+    const struct thread_placement *stats = &placement.threads[PLACEMENT_STATS];
+    const int ret = placement_apply (stats);
+    if (ret != 0)
+    {
+        fprintf (stderr, "ERR: could not place the stats thread: %s\n", strerror (ret));
+        return EXIT_FAILURE;
+    }
+    if (placement_verify (pthread_self (), PLACEMENT_STATS, 0, stats, 0) != 0)
+        return EXIT_FAILURE;
+
+    char path[64];
+    if (strchr (argv[optind], '/'))
+        snprintf (path, sizeof (path), "%s", argv[optind]);
+    else
+        snprintf (path, sizeof (path), LIVE_STATS_PATH_FMT, atoi (argv[optind]));
+
+    const struct live_stats_block *block = live_stats_attach (path);
+    if (block == NULL)
+    {
+        fprintf (stderr, "ERR: could not attach to %s\n", path);
+        return EXIT_FAILURE;
+    }
+
+    struct live_stats_snapshot *snapshot = malloc (sizeof (struct live_stats_snapshot));
+    if (snapshot == NULL)
+    {
+        live_stats_detach (block);
+        return EXIT_FAILURE;
+    }
+
+    uint64_t prev_packets = 0;
+    uint64_t prev_time = 0;
+    do
+    {
+        live_stats_read (block, snapshot);
+        const uint64_t now = get_time_ns ();
+        print_snapshot (snapshot, prev_packets, prev_time ? now - prev_time : 0);
+        prev_packets = snapshot->packets;
+        prev_time = now;
+
+        // The file is removed at the end of the run
+        if (follow && access (path, F_OK) != 0)
+            break;
+        if (follow)
+            usleep (interval_ms * 1000);
+    } while (follow);
+
+    free (snapshot);
+    live_stats_detach (block);
+    return EXIT_SUCCESS;
+}
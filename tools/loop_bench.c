@@ -0,0 +1,274 @@
+/**
+ * Microbenchmark of the measured loop of the driver: the cost of a round with the generic loop, which calls the poll
+ * and the reply of the datapath, the source of the timestamps and the write of the persistence through function
+ * pointers, against the loop specialized at compile time for them (see PP_DRIVER_DEFINE_LOOPS).
+ *
+ * The datapath is synthetic: its poll builds the pongs in memory, so that the difference between the two loops is
+ * the overhead of the indirect calls and branches, which the network would otherwise hide. For each source of the
+ * timestamps and each specialized backend it reports the cost per round of both loops, in cycles of the TSC (ns
+ * where there is none), the best of several runs.
+ */
+#include "../common/driver.h"
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DEFAULT_ROUNDS 1000000UL
+#define DEFAULT_REPEAT 5
+
+/**
+ * Synthetic datapath: each poll returns `batch` pongs with increasing ids.
+ */
+struct bench_ctx {
+    struct pingpong_payload payloads[PP_DRIVER_BATCH];
+    uint64_t next_id;
+    uint32_t batch;
+    uint64_t last_ts;// last timestamp taken by the loop, the send time of the next pongs
+};
+
+static int bench_poll (void *aux, struct pp_packet *packets, uint32_t max)
+{
+    struct bench_ctx *ctx = aux;
+    const uint32_t n = min (ctx->batch, max);
+    const struct pingpong_payload *last = &ctx->payloads[ctx->batch - 1];
+    if (last->id)
+        ctx->last_ts = max (last->ts[2], last->ts[3]);
+
+    // The pongs are sent and bounced when the previous ones are received, so that the latency is one round of the loop
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        const uint64_t id = ctx->next_id++;
+        ctx->payloads[i] = new_pingpong_payload (id, 0, ctx->last_ts);
+        ctx->payloads[i].ts[0] = ctx->last_ts;
+        ctx->payloads[i].ts[1] = ctx->last_ts;
+        ctx->payloads[i].ts[2] = ctx->last_ts;
+        packets[i].payload = &ctx->payloads[i];
+        packets[i].ts = 0;
+    }
+    return n;
+}
+
+static int bench_reply (void *aux __unused, struct pp_packet *packet)
+{
+    // Keep the reply from being optimized away
+    BARRIER ();
+    return packet->payload->ts[2] ? 0 : -1;
+}
+
+PP_DRIVER_DEFINE_LOOPS (bench_loops, bench_poll, bench_reply)
+
+// Not const, so that the generic loop cannot see through its operations, as in the driver
+struct pp_datapath bench_datapath = {
+    .name = "loop_bench",
+    .poll = bench_poll,
+    .reply = bench_reply,
+    .loops = &bench_loops,
+};
+
+/**
+ * The generic loop of the driver, see `driver_generic_loop`.
+ */
+__attribute__ ((noipa)) static int generic_loop (const struct pp_datapath *datapath, void *ctx, struct flow_progress *progress, persistence_agent_t **agents, const bool server)
+{
+    if (server)
+        return pp_driver_loop (ctx, progress, agents, datapath->poll, datapath->reply, true, -1, PP_BACKEND_GENERIC);
+    return pp_driver_loop (ctx, progress, agents, datapath->poll, NULL, false, -1, PP_BACKEND_GENERIC);
+}
+
+struct bench_case {
+    const char *name;
+    bool server;
+    enum pp_driver_backend backend;
+    uint32_t flags;// persistence measurement of the client
+};
+
+static const struct bench_case cases[] = {
+    {"server", true, PP_BACKEND_GENERIC, 0},
+    {"all_timestamps", false, PP_BACKEND_ALL_TIMESTAMPS, PERSISTENCE_M_ALL_TIMESTAMPS},
+    {"min_max", false, PP_BACKEND_MIN_MAX, PERSISTENCE_M_MIN_MAX_LATENCY},
+    {"buckets", false, PP_BACKEND_BUCKETS, PERSISTENCE_M_BUCKETS},
+    {"hdr", false, PP_BACKEND_HDR, PERSISTENCE_M_HDR},
+    // No specialized backend: both loops write through the agent
+    {"quantiles", false, PP_BACKEND_GENERIC, PERSISTENCE_M_QUANTILES},
+};
+
+static inline uint64_t bench_now (void)
+{
+#if TIMESOURCE_HAS_TSC
+    return tsc_read ();
+#else
+    struct timespec t;
+    clock_gettime (CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000ULL + t.tv_nsec;
+#endif
+}
+
+/**
+ * Run one loop over `rounds` rounds.
+ *
+ * @return the cost of a round, negative on failure
+ */
+static double bench_run (const struct bench_case *bench, enum timesource_kind kind, bool specialized, uint64_t rounds,
+                         uint32_t batch, const char *filename)
+{
+    persistence_agent_t *agents[PINGPONG_MAX_FLOWS] = {0};
+    if (!bench->server)
+    {
+        struct pers_config config = {.iters = rounds, .interval = 1000, .datapath = bench_datapath.name, .timesource = kind};
+        agents[0] = persistence_init (filename, bench->flags, &config);
+        if (agents[0] == NULL)
+            return -1;
+    }
+
+    struct bench_ctx *ctx = calloc (1, sizeof (struct bench_ctx));
+    if (ctx == NULL)
+    {
+        if (agents[0])
+            agents[0]->close (agents[0]);
+        return -1;
+    }
+    ctx->next_id = 1;
+    ctx->batch = batch;
+    ctx->last_ts = get_time_ns ();
+
+    struct flow_progress progress;
+    flow_progress_init (&progress, rounds, 1);
+
+    int ret;
+    const uint64_t start = bench_now ();
+    if (!specialized)
+        ret = generic_loop (&bench_datapath, ctx, &progress, agents, bench->server);
+    else if (bench->server)
+        ret = bench_datapath.loops->server[kind](ctx, &progress, agents);
+    else
+        ret = bench_datapath.loops->client[kind][bench->backend](ctx, &progress, agents);
+    const uint64_t end = bench_now ();
+
+    const uint64_t done = ctx->next_id - 1;
+    free (ctx);
+    if (agents[0])
+        agents[0]->close (agents[0]);
+
+    return ret == 0 && done ? (double) (end - start) / done : -1;
+}
+
+void loop_bench_print_usage (char *prog)
+{
+    printf ("Usage: %s [-n <rounds>] [-b <batch>] [-r <repeat>] [-o <dir>]\n", prog);
+    printf ("\t-n, --rounds <rounds>\tRounds of each run (default %lu).\n", DEFAULT_ROUNDS);
+    printf ("\t-b, --batch <batch>\tPongs returned by each poll (1-%d, default 1).\n", PP_DRIVER_BATCH);
+    printf ("\t-r, --repeat <repeat>\tRuns of each loop, the best one being reported (default %d).\n", DEFAULT_REPEAT);
+    printf ("\t-o, --output <dir>\tDirectory of the files written by the persistence (default: the current one).\n");
+}
+
+int main (int argc, char **argv)
+{
+    static struct option long_options[] = {
+        {"rounds", required_argument, 0, 'n'},
+        {"batch", required_argument, 0, 'b'},
+        {"repeat", required_argument, 0, 'r'},
+        {"output", required_argument, 0, 'o'},
+        {"help", no_argument, 0, 'h'},
+        {0, 0, 0, 0}};
+
+    uint64_t rounds = DEFAULT_ROUNDS;
+    uint32_t batch = 1;
+    uint32_t repeat = DEFAULT_REPEAT;
+    const char *dir = ".";
+    int opt;
+    while ((opt = getopt_long (argc, argv, "n:b:r:o:h", long_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            rounds = atoll (optarg);
+            break;
+        case 'b':
+            batch = atoi (optarg);
+            break;
+        case 'r':
+            repeat = atoi (optarg);
+            break;
+        case 'o':
+            dir = optarg;
+            break;
+        default:
+            loop_bench_print_usage (argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (rounds == 0 || batch == 0 || batch > PP_DRIVER_BATCH || repeat == 0)
+    {
+        loop_bench_print_usage (argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // The summaries the agents print when they are closed go to /dev/null, the results are printed at the end
+    fflush (stdout);
+    const int saved_stdout = dup (STDOUT_FILENO);
+    const int null_fd = open ("/dev/null", O_WRONLY);
+    if (saved_stdout < 0 || null_fd < 0 || dup2 (null_fd, STDOUT_FILENO) < 0)
+    {
+        fprintf (stderr, "ERR: could not redirect the output of the persistence to /dev/null\n");
+        return EXIT_FAILURE;
+    }
+    close (null_fd);
+
+    const size_t num_cases = sizeof (cases) / sizeof (cases[0]);
+    double best[PP_DRIVER_TIMESOURCES][sizeof (cases) / sizeof (cases[0])][2];
+    bool available[PP_DRIVER_TIMESOURCES];
+    for (int kind = 0; kind < PP_DRIVER_TIMESOURCES; ++kind)
+    {
+        available[kind] = timesource_init (kind) == 0;
+        if (!available[kind])
+            continue;
+
+        for (size_t i = 0; i < num_cases; ++i)
+        {
+            char filename[PATH_MAX];
+            snprintf (filename, sizeof (filename), "%s/loop_bench-%s.dat", dir, cases[i].name);
+
+            best[kind][i][0] = best[kind][i][1] = -1;
+            for (uint32_t r = 0; r < repeat; ++r)
+            {
+                for (int specialized = 0; specialized < 2; ++specialized)
+                {
+                    const double cost = bench_run (&cases[i], kind, specialized, rounds, batch, filename);
+                    if (cost < 0)
+                    {
+                        fprintf (stderr, "ERR: could not run the %s loop of %s\n", specialized ? "specialized" : "generic", cases[i].name);
+                        return EXIT_FAILURE;
+                    }
+                    if (best[kind][i][specialized] < 0 || cost < best[kind][i][specialized])
+                        best[kind][i][specialized] = cost;
+                }
+            }
+        }
+    }
+
+    fflush (stdout);
+    dup2 (saved_stdout, STDOUT_FILENO);
+    close (saved_stdout);
+
+    printf ("UNIT %s\n", TIMESOURCE_HAS_TSC ? "cycles" : "ns");
+    for (int kind = 0; kind < PP_DRIVER_TIMESOURCES; ++kind)
+    {
+        if (!available[kind])
+        {
+            printf ("%s UNAVAILABLE\n", timesource_name (kind));
+            continue;
+        }
+        for (size_t i = 0; i < num_cases; ++i)
+        {
+            const double generic = best[kind][i][0], specialized = best[kind][i][1];
+            printf ("%s %s GENERIC %.1f SPECIALIZED %.1f SAVED %.1f (%.1f%%)\n", timesource_name (kind), cases[i].name,
+                    generic, specialized, generic - specialized, 100.0 * (generic - specialized) / generic);
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,249 @@
+#!/usr/bin/env bash
+#
+# Loopback latency regression harness.
+#
+# Runs each datapath between the root network namespace (client) and a network namespace (server) linked by a veth
+# pair, with a short fixed workload, and compares the HDR histogram of the run against a stored baseline with
+# hdr_compare. Neither a NIC nor a second machine is needed:
+# - no-bypass sends UDP packets over the veth;
+# - pp_poll and pp_pure attach their XDP programs to the veth in native mode;
+# - pp_sock binds its AF_XDP socket in copy mode, since veth has no zero-copy support;
+# - ud_pingpong and rc_pingpong run over soft-RoCE (rdma_rxe) devices on top of the veth.
+#
+# The datapaths that were not built (e.g. without libbpf or ibverbs) or that lack kernel support are skipped.
+# Must run as root. Exit status: 0 if every datapath that ran matched its baseline (or, with -u, recorded a new one), 1
+# otherwise, including when a baseline is missing.
+
+set -u
+
+BUILD_DIR=build
+BASELINE_DIR="$(dirname "$(readlink -f "$0")")/baselines"
+OUT_DIR=loopback-results
+PACKETS=20000
+INTERVAL=100000
+GID_IDX=1
+UPDATE=0
+COMPARE_ARGS=()
+DATAPATHS="no-bypass pp_poll pp_sock pp_pure ud_pingpong rc_pingpong"
+
+NS=pp-loop
+CLIENT_IF=pp-loop-cli
+SERVER_IF=pp-loop-srv
+CLIENT_IP=10.66.0.1
+SERVER_IP=10.66.0.2
+CLIENT_RXE=rxe-pp-cli
+SERVER_RXE=rxe-pp-srv
+# Seconds given to a client to complete its run, and to a server to exit after its client
+CLIENT_TIMEOUT=120
+SERVER_GRACE=5
+
+usage ()
+{
+    echo "Usage: $0 [-b <build dir>] [-B <baseline dir>] [-o <output dir>] [-p <packets>] [-i <interval>] [-g <gidx>] [-d <datapaths>] [-t <tolerance>] [-s <slack>] [-k <distance>] [-u]"
+    echo -e "\t-b <build dir>\tCMake build directory holding the programs (default $BUILD_DIR)."
+    echo -e "\t-B <baseline dir>\tDirectory of the baselines, one <datapath>.dat each (default $BASELINE_DIR)."
+    echo -e "\t-o <output dir>\tDirectory of the results and logs of the runs (default $OUT_DIR)."
+    echo -e "\t-p <packets>\tNumber of pings of each run (default $PACKETS)."
+    echo -e "\t-i <interval>\tInterval between two pings in nanoseconds (default $INTERVAL)."
+    echo -e "\t-g <gidx>\tGID index of the soft-RoCE devices, 1 being the IPv4 RoCE v2 GID (default $GID_IDX)."
+    echo -e "\t-d <datapaths>\tSpace-separated datapaths to run (default: $DATAPATHS)."
+    echo -e "\t-t, -s, -k\tTolerance, slack and Kolmogorov-Smirnov bound of the comparison, see hdr_compare."
+    echo -e "\t-u\tRecord the results as the new baselines instead of comparing them."
+}
+
+while getopts "b:B:o:p:i:g:d:t:s:k:uh" opt; do
+    case $opt in
+    b) BUILD_DIR=$OPTARG ;;
+    B) BASELINE_DIR=$OPTARG ;;
+    o) OUT_DIR=$OPTARG ;;
+    p) PACKETS=$OPTARG ;;
+    i) INTERVAL=$OPTARG ;;
+    g) GID_IDX=$OPTARG ;;
+    d) DATAPATHS=$OPTARG ;;
+    t | s | k) COMPARE_ARGS+=("-$opt" "$OPTARG") ;;
+    u) UPDATE=1 ;;
+    *)
+        usage
+        exit 1
+        ;;
+    esac
+done
+
+if [ "$(id -u)" -ne 0 ]; then
+    echo "ERR: the harness creates network namespaces and attaches XDP programs, run it as root" >&2
+    exit 1
+fi
+
+BUILD_DIR=$(readlink -f "$BUILD_DIR")
+mkdir -p "$OUT_DIR" || exit 1
+if [ $UPDATE -eq 1 ]; then
+    mkdir -p "$BASELINE_DIR" || exit 1
+fi
+OUT_DIR=$(readlink -f "$OUT_DIR")
+HDR_COMPARE=$BUILD_DIR/tools/hdr_compare
+if [ $UPDATE -eq 0 ] && [ ! -x "$HDR_COMPARE" ]; then
+    echo "ERR: $HDR_COMPARE not found, build the tools first" >&2
+    exit 1
+fi
+
+RXE=0
+
+cleanup ()
+{
+    rdma link delete $CLIENT_RXE 2>/dev/null
+    rdma link delete $SERVER_RXE 2>/dev/null
+    # The veth pair goes away with the namespace
+    ip netns del $NS 2>/dev/null
+}
+
+setup_net ()
+{
+    ip netns add $NS &&
+        ip link add $CLIENT_IF type veth peer name $SERVER_IF netns $NS &&
+        ip addr add $CLIENT_IP/24 dev $CLIENT_IF &&
+        ip -n $NS addr add $SERVER_IP/24 dev $SERVER_IF &&
+        ip link set $CLIENT_IF up &&
+        ip -n $NS link set $SERVER_IF up &&
+        ip -n $NS link set lo up || return 1
+
+    # XDP_TX on a veth needs NAPI on the peer, which GRO enables even without an XDP program on it
+    ethtool -K $CLIENT_IF gro on >/dev/null 2>&1
+    ip netns exec $NS ethtool -K $SERVER_IF gro on >/dev/null 2>&1
+    return 0
+}
+
+setup_rxe ()
+{
+    modprobe rdma_rxe 2>/dev/null &&
+        rdma link add $CLIENT_RXE type rxe netdev $CLIENT_IF 2>/dev/null &&
+        ip netns exec $NS rdma link add $SERVER_RXE type rxe netdev $SERVER_IF 2>/dev/null
+}
+
+# Wait until the server in the namespace listens for the address exchange (1234) or the readiness handshake (1235)
+wait_server ()
+{
+    local pid=$1
+    for _ in $(seq 100); do
+        kill -0 "$pid" 2>/dev/null || return 1
+        ip netns exec $NS ss -Hlun 2>/dev/null | grep -qE ':123[45]\b' && return 0
+        sleep 0.1
+    done
+    return 1
+}
+
+# Run a command with a private bpffs, so that the pins of the client and of the server do not collide and do not
+# outlive the run
+with_bpffs ()
+{
+    unshare -m sh -c 'mount -t bpf bpf /sys/fs/bpf 2>/dev/null; exec "$@"' sh "$@"
+}
+
+# run_datapath <name>: run the datapath and compare its histogram, printing its status
+run_datapath ()
+{
+    local name=$1 bin out
+    local client_args=() server_args=()
+    case $name in
+    no-bypass)
+        bin=$BUILD_DIR/no-bypass/no-bypass
+        out=no-bypass.dat
+        ;;
+    pp_poll | pp_sock | pp_pure)
+        bin=$BUILD_DIR/xdp/$name
+        out=$(case $name in pp_poll) echo pingpong.dat ;; pp_sock) echo pingpong_xsk.dat ;; pp_pure) echo pingpong_pure.dat ;; esac)
+        client_args=(-d $CLIENT_IF)
+        server_args=(-d $SERVER_IF)
+        ;;
+    ud_pingpong | rc_pingpong)
+        bin=$BUILD_DIR/rdma/$name
+        out=$(case $name in ud_pingpong) echo ud.dat ;; rc_pingpong) echo rc.dat ;; esac)
+        client_args=(-d $CLIENT_RXE -g "$GID_IDX")
+        server_args=(-d $SERVER_RXE -g "$GID_IDX")
+        if [ $RXE -eq 0 ]; then
+            echo "SKIPPED (no soft-RoCE)"
+            return 0
+        fi
+        ;;
+    *)
+        echo "ERR: unknown datapath"
+        return 1
+        ;;
+    esac
+
+    if [ ! -x "$bin" ]; then
+        echo "SKIPPED (not built)"
+        return 0
+    fi
+
+    local dir=$OUT_DIR/$name
+    rm -rf "$dir" && mkdir -p "$dir" || return 1
+    # The XDP objects are loaded from the working directory
+    cp "$(dirname "$bin")"/*.o "$dir" 2>/dev/null
+
+    (cd "$dir" && exec ip netns exec $NS sh -c 'mount -t bpf bpf /sys/fs/bpf 2>/dev/null; exec "$@"' sh \
+        "$bin" --role server -p "$PACKETS" "${server_args[@]}") >"$dir/server.log" 2>&1 &
+    local server_pid=$!
+
+    local ret=0
+    if ! wait_server $server_pid; then
+        echo "FAILED (server did not start, see $dir/server.log)"
+        ret=1
+    elif ! (cd "$dir" && with_bpffs timeout -s INT $CLIENT_TIMEOUT "$bin" -p "$PACKETS" -i "$INTERVAL" -s $SERVER_IP -m 6 \
+        "${client_args[@]}") >"$dir/client.log" 2>&1; then
+        echo "FAILED (client, see $dir/client.log)"
+        ret=1
+    fi
+
+    # A server missing some pings never ends on its own
+    for _ in $(seq $((SERVER_GRACE * 10))); do
+        kill -0 $server_pid 2>/dev/null || break
+        sleep 0.1
+    done
+    pkill -INT -f "^$bin --role server" 2>/dev/null
+    wait $server_pid 2>/dev/null
+
+    ip link set dev $CLIENT_IF xdp off 2>/dev/null
+    ip -n $NS link set dev $SERVER_IF xdp off 2>/dev/null
+
+    [ $ret -eq 0 ] || return 1
+
+    if [ $UPDATE -eq 1 ]; then
+        cp "$dir/$out" "$BASELINE_DIR/$name.dat" && echo "UPDATED"
+        return
+    fi
+
+    if [ ! -f "$BASELINE_DIR/$name.dat" ]; then
+        echo "NO BASELINE (record one with -u)"
+        return 1
+    fi
+
+    "$HDR_COMPARE" "${COMPARE_ARGS[@]}" "$BASELINE_DIR/$name.dat" "$dir/$out" >"$dir/compare.log" 2>&1
+    case $? in
+    0) echo "OK" ;;
+    1)
+        echo "REGRESSION"
+        sed 's/^/    /' "$dir/compare.log"
+        return 1
+        ;;
+    *)
+        echo "FAILED (comparison, see $dir/compare.log)"
+        return 1
+        ;;
+    esac
+}
+
+trap cleanup EXIT
+cleanup
+if ! setup_net; then
+    echo "ERR: could not create the namespace and the veth pair" >&2
+    exit 1
+fi
+setup_rxe && RXE=1
+
+failed=0
+for name in $DATAPATHS; do
+    printf "%-12s " "$name"
+    run_datapath "$name" || failed=1
+done
+
+exit $failed
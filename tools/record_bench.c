@@ -0,0 +1,233 @@
+/**
+ * Microbenchmark of the cost of recording a round in each statistics persistence mode, isolated from the loop and
+ * the network: the same rounds, built in memory before the runs, are written to the agent of each mode.
+ *
+ * The latencies are a few microseconds of jitter around 8 us, with one round in a thousand between 50 us and 500 us,
+ * so that the tails of the modes are exercised; the rounds are sent every millisecond, so that their timestamps
+ * always increase. For each mode it reports the mean cost of a write, measured over the whole run, and the
+ * distribution of the cost of single writes, each timed on its own (the timing adds the cost of reading the TSC, the
+ * same for all the modes), in cycles of the TSC (ns where there is none), the best of several runs.
+ */
+#include "../common/histogram.h"
+#include "../common/persistence.h"
+#include "../common/timesource.h"
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DEFAULT_ROUNDS 2000000UL
+#define DEFAULT_REPEAT 5
+#define BENCH_INTERVAL 1000000UL
+
+struct bench_case {
+    const char *name;
+    uint32_t flags;
+};
+
+static const struct bench_case cases[] = {
+    {"min_max", PERSISTENCE_M_MIN_MAX_LATENCY},
+    {"buckets", PERSISTENCE_M_BUCKETS},
+    {"hdr", PERSISTENCE_M_HDR},
+    {"quantiles", PERSISTENCE_M_QUANTILES},
+};
+
+static inline uint64_t bench_now (void)
+{
+#if TIMESOURCE_HAS_TSC
+    return tsc_read ();
+#else
+    struct timespec t;
+    clock_gettime (CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000ULL + t.tv_nsec;
+#endif
+}
+
+/**
+ * splitmix64, for rounds that are the same in every run.
+ */
+static inline uint64_t bench_random (uint64_t *state)
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static struct pingpong_payload *bench_rounds (uint64_t rounds)
+{
+    struct pingpong_payload *payloads = malloc (rounds * sizeof (struct pingpong_payload));
+    if (payloads == NULL)
+        return NULL;
+
+    uint64_t state = 42;
+    uint64_t send = 1000000000;
+    for (uint64_t i = 0; i < rounds; ++i)
+    {
+        const uint64_t r = bench_random (&state);
+        const uint64_t latency = r % 1000 == 0 ? 50000 + (r >> 10) % 450000 : 7000 + (r >> 10) % 2000;
+        const uint64_t wait = (r >> 32) % 300;
+        payloads[i] = new_pingpong_payload (i + 1, 0, send);
+        payloads[i].ts[0] = send + wait;
+        payloads[i].ts[1] = send + wait + latency / 2 - 100;
+        payloads[i].ts[2] = send + wait + latency / 2 + 100;
+        payloads[i].ts[3] = send + wait + latency;
+        send += BENCH_INTERVAL;
+    }
+    return payloads;
+}
+
+/**
+ * Write all the rounds to a new agent of `bench`, timing each write on its own in `costs` if not NULL.
+ *
+ * @return the mean cost of a write, negative on failure
+ */
+static double bench_run (const struct bench_case *bench, const struct pingpong_payload *payloads, uint64_t rounds,
+                         const char *filename, struct hdr_histogram *costs)
+{
+    struct pers_config config = {.iters = rounds, .interval = BENCH_INTERVAL, .datapath = "record_bench"};
+    persistence_agent_t *agent = persistence_init (filename, bench->flags, &config);
+    if (agent == NULL)
+        return -1;
+
+    int ret = 0;
+    const uint64_t start = bench_now ();
+    if (costs)
+    {
+        for (uint64_t i = 0; i < rounds; ++i)
+        {
+            const uint64_t before = bench_now ();
+            ret |= agent->write (agent, &payloads[i]);
+            hdr_record (costs, bench_now () - before);
+        }
+    }
+    else
+    {
+        for (uint64_t i = 0; i < rounds; ++i)
+            ret |= agent->write (agent, &payloads[i]);
+    }
+    const uint64_t end = bench_now ();
+
+    ret |= agent->close (agent);
+    return ret == 0 ? (double) (end - start) / rounds : -1;
+}
+
+void record_bench_print_usage (char *prog)
+{
+    printf ("Usage: %s [-n <rounds>] [-r <repeat>] [-o <dir>]\n", prog);
+    printf ("\t-n, --rounds <rounds>\tRounds of each run (default %lu).\n", DEFAULT_ROUNDS);
+    printf ("\t-r, --repeat <repeat>\tRuns of each mode, the best one being reported (default %d).\n", DEFAULT_REPEAT);
+    printf ("\t-o, --output <dir>\tDirectory of the files written by the persistence (default: the current one).\n");
+}
+
+int main (int argc, char **argv)
+{
+    static struct option long_options[] = {
+        {"rounds", required_argument, 0, 'n'},
+        {"repeat", required_argument, 0, 'r'},
+        {"output", required_argument, 0, 'o'},
+        {"help", no_argument, 0, 'h'},
+        {0, 0, 0, 0}};
+
+    uint64_t rounds = DEFAULT_ROUNDS;
+    uint32_t repeat = DEFAULT_REPEAT;
+    const char *dir = ".";
+    int opt;
+    while ((opt = getopt_long (argc, argv, "n:r:o:h", long_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            rounds = atoll (optarg);
+            break;
+        case 'r':
+            repeat = atoi (optarg);
+            break;
+        case 'o':
+            dir = optarg;
+            break;
+        default:
+            record_bench_print_usage (argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (rounds == 0 || repeat == 0)
+    {
+        record_bench_print_usage (argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    struct pingpong_payload *payloads = bench_rounds (rounds);
+    if (payloads == NULL || timesource_init (TIMESOURCE_CLOCK) != 0)
+    {
+        fprintf (stderr, "ERR: could not prepare the rounds\n");
+        return EXIT_FAILURE;
+    }
+
+    // The summaries the agents print when they are closed go to /dev/null, the results are printed at the end
+    fflush (stdout);
+    const int saved_stdout = dup (STDOUT_FILENO);
+    const int null_fd = open ("/dev/null", O_WRONLY);
+    if (saved_stdout < 0 || null_fd < 0 || dup2 (null_fd, STDOUT_FILENO) < 0)
+    {
+        fprintf (stderr, "ERR: could not redirect the output of the persistence to /dev/null\n");
+        return EXIT_FAILURE;
+    }
+    close (null_fd);
+
+    const size_t num_cases = sizeof (cases) / sizeof (cases[0]);
+    double best[sizeof (cases) / sizeof (cases[0])];
+    struct hdr_histogram best_costs[sizeof (cases) / sizeof (cases[0])];
+    struct hdr_histogram costs;
+    if (hdr_init (&costs, 3, 1000000000UL) != 0)
+        return EXIT_FAILURE;
+    for (size_t i = 0; i < num_cases; ++i)
+    {
+        char filename[PATH_MAX];
+        snprintf (filename, sizeof (filename), "%s/record_bench-%s.dat", dir, cases[i].name);
+
+        best[i] = -1;
+        if (hdr_init (&best_costs[i], 3, 1000000000UL) != 0)
+            return EXIT_FAILURE;
+        for (uint32_t r = 0; r < repeat; ++r)
+        {
+            const double cost = bench_run (&cases[i], payloads, rounds, filename, NULL);
+            hdr_reset (&costs);
+            if (cost < 0 || bench_run (&cases[i], payloads, rounds, filename, &costs) < 0)
+            {
+                fprintf (stderr, "ERR: could not run %s\n", cases[i].name);
+                return EXIT_FAILURE;
+            }
+            if (best[i] < 0 || cost < best[i])
+                best[i] = cost;
+            // The run with the lowest tail
+            if (r == 0 || hdr_value_at_percentile (&costs, 99.99) < hdr_value_at_percentile (&best_costs[i], 99.99))
+            {
+                hdr_reset (&best_costs[i]);
+                hdr_merge (&best_costs[i], &costs);
+            }
+        }
+    }
+
+    fflush (stdout);
+    dup2 (saved_stdout, STDOUT_FILENO);
+    close (saved_stdout);
+
+    printf ("UNIT %s\n", TIMESOURCE_HAS_TSC ? "cycles" : "ns");
+    for (size_t i = 0; i < num_cases; ++i)
+    {
+        const struct hdr_histogram *h = &best_costs[i];
+        printf ("%s MEAN %.1f SINGLE P50 %lu P99 %lu P99.9 %lu P99.99 %lu MAX %lu\n", cases[i].name, best[i],
+                hdr_value_at_percentile (h, 50.0), hdr_value_at_percentile (h, 99.0), hdr_value_at_percentile (h, 99.9),
+                hdr_value_at_percentile (h, 99.99), h->max);
+        hdr_destroy (&best_costs[i]);
+    }
+
+    hdr_destroy (&costs);
+    free (payloads);
+    return EXIT_SUCCESS;
+}
@@ -9,6 +9,13 @@
 #include <linux/udp.h>
 #include <stdint.h>
 
+/**
+ * SERVER selects the side of the pingpong handled by the program: the object is built once per role by CMake.
+ */
+#ifndef SERVER
+#define SERVER 0
+#endif
+
 #if SERVER
 __attribute__((__always_inline__)) static inline __u16 csum_fold_helper(__u64 csum)
 {
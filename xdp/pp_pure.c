@@ -1,5 +1,5 @@
+#include "../common/driver.h"
 #include "../common/net.h"
-#include "src/args.h"
 #include "src/xdp-loading.h"
 #include <stdint.h>
 #include <stdio.h>
@@ -7,73 +7,80 @@
 #include <stdbool.h>
 #include <stdlib.h>
 
-persistence_agent_t *persistence = NULL;
-
-// Information about the XDP program
-static const char *filename = "pingpong_pure.o";
+// Information about the XDP program: the object is compiled once per role
+static const char *client_filename = "pingpong_pure_client.o";
+static const char *server_filename = "pingpong_pure_server.o";
 static const char *prog_name = "xdp_main";
 static const char *pinpath = "/sys/fs/bpf/xdp_pingpong_pure";
 
-__attribute_maybe_unused__ static const char *outfile = "pingpong_pure.dat";
-
-#if !SERVER
+/**
+ * Context of the datapath: the server pongs are sent by its XDP program, the client sends and receives UDP packets
+ * whose receive timestamp is taken by its own XDP program.
+ */
+struct pure_ctx {
+    int sock;
+    struct sockaddr_in server_addr;
+    char recv_buf[PACKET_SIZE];
+    char send_bufs[PINGPONG_MAX_FLOWS][PACKET_SIZE];// one per flow, since each flow has its own sender thread
+};
 
-int send_packet (char *buf, uint64_t id, struct sockaddr_ll *server_addr, void *aux)
+static int pure_attach (const struct pp_driver_config *config, bool attach)
 {
-    int sock = *(int *) aux;
-    struct pingpong_payload *payload = (struct pingpong_payload *) buf;
-    *payload = new_pingpong_payload (id);
-    payload->ts[0] = get_time_ns ();
-    if (sendto (sock, buf, PACKET_SIZE, 0, (struct sockaddr *) server_addr, sizeof (*server_addr)) < 0)
+    int ifindex = if_nametoindex (config->device);
+    if (!ifindex)
     {
-        perror ("sendto");
+        fprintf (stderr, "ERR: if_nametoindex failed\n");
         return -1;
     }
-    return 0;
-}
 
-int send_packets (int send_sock, const struct sockaddr_in *server_addr, uint64_t iters, uint64_t interval)
-{
-    char *packet = malloc (PACKET_SIZE);
-    if (!packet)
+    const char *filename = config->role == PP_ROLE_SERVER ? server_filename : client_filename;
+    struct bpf_object *obj = read_xdp_file (filename);
+    if (!obj)
     {
-        perror ("malloc");
+        fprintf (stderr, "ERR: loading file: %s\n", filename);
         return -1;
     }
-    memset (packet, 0, PACKET_SIZE);
 
-    start_sending_packets (iters, interval, packet, (struct sockaddr_ll *) server_addr, send_packet, &send_sock);
+    int ret = detach_xdp (obj, prog_name, ifindex, pinpath);
+    if (!attach)
+    {
+        return ret;
+    }
 
-    return send_sock;
+    obj = read_xdp_file (filename);
+    ret = attach_xdp (obj, prog_name, ifindex, pinpath);
+    if (ret)
+    {
+        fprintf (stderr, "ERR: attach_xdp failed\n");
+        return -1;
+    }
+    return 0;
 }
 
-void receive_packets (int recv_sock, uint64_t iters)
+static int pure_setup (const struct pp_driver_config *config, void **out)
 {
-    char packet[PACKET_SIZE];
-    memset (packet, 0, PACKET_SIZE);
+    if (pure_attach (config, true) != 0)
+        return -1;
 
-    uint64_t curr_iter = 0;
-    while (curr_iter < iters)
+    struct pure_ctx *ctx = calloc (1, sizeof (struct pure_ctx));
+    if (!ctx)
     {
-        if (recvfrom (recv_sock, packet, PACKET_SIZE, 0, NULL, NULL) < 0)
-        {
-            perror ("recvfrom");
-            return;
-        }
-
-        struct pingpong_payload *payload = (struct pingpong_payload *) packet;
-        persistence->write (persistence, payload);
-        curr_iter = max (curr_iter, payload->id);
+        perror ("calloc");
+        return -1;
     }
-}
+    ctx->sock = -1;
+    *out = ctx;
 
-void start_client (const char *server_ip, uint64_t iters, uint64_t interval)
-{
-    int send_sock = socket (AF_INET, SOCK_DGRAM, 0);
-    if (send_sock < 0)
+    // The pongs are sent by the XDP program itself: the server is ready as soon as it is attached
+    if (config->role == PP_ROLE_SERVER)
+        return 0;
+
+    ctx->sock = socket (AF_INET, SOCK_DGRAM, 0);
+    if (ctx->sock < 0)
     {
         perror ("socket");
-        return;
+        free (ctx);
+        return -1;
     }
 
     struct sockaddr_in client_addr;
@@ -81,93 +88,80 @@ void start_client (const char *server_ip, uint64_t iters, uint64_t interval)
     client_addr.sin_port = htons (XDP_UDP_PORT);
     client_addr.sin_addr.s_addr = htonl (INADDR_ANY);
 
-    if (bind (send_sock, (struct sockaddr *) &client_addr, sizeof (client_addr)) < 0)
+    if (bind (ctx->sock, (struct sockaddr *) &client_addr, sizeof (client_addr)) < 0)
     {
         perror ("bind");
-        return;
+        close (ctx->sock);
+        free (ctx);
+        return -1;
     }
 
-    struct sockaddr_in server_addr;
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons (XDP_UDP_PORT);
-    server_addr.sin_addr.s_addr = inet_addr (server_ip);
-
-    send_packets (send_sock, &server_addr, iters, interval);
-    receive_packets (send_sock, iters);
+    ctx->server_addr.sin_family = AF_INET;
+    ctx->server_addr.sin_port = htons (XDP_UDP_PORT);
+    ctx->server_addr.sin_addr.s_addr = inet_addr (config->server_ip);
 
-    pthread_cancel (get_sender_thread ());
-    pthread_join (get_sender_thread (), NULL);
-    close (send_sock);
-
-    persistence->close (persistence);
+    return 0;
 }
-#endif
 
-int main (int argc, char **argv)
+static int pure_send (void *aux, const struct pingpong_payload *payload)
 {
-    char *ifname = NULL;
-    bool remove;
-    uint64_t iters = 0;
-
-#if SERVER
-    if (!xdp_parse_args (argc, argv, &ifname, &remove, &iters))
+    struct pure_ctx *ctx = aux;
+    char *buf = ctx->send_bufs[payload->flow];
+    memcpy (buf, payload, sizeof (struct pingpong_payload));
+    if (sendto (ctx->sock, buf, PACKET_SIZE, 0, (struct sockaddr *) &ctx->server_addr, sizeof (ctx->server_addr)) < 0)
     {
-        xdp_print_usage (argv[0]);
-        return EXIT_FAILURE;
-    }
-#else
-    uint64_t interval = 0;
-    char *server_ip = NULL;
-    uint32_t persistence_flags = PERSISTENCE_M_ALL_TIMESTAMPS;
-
-    if (!xdp_parse_args (argc, argv, &ifname, &remove, &iters, &interval, &server_ip, &persistence_flags))
-    {
-        xdp_print_usage (argv[0]);
-        return EXIT_FAILURE;
+        perror ("sendto");
+        return -1;
     }
+    return 0;
+}
 
-    //persistence_flags |= PERSISTENCE_F_STDOUT;
-    persistence = persistence_init (outfile, persistence_flags, &interval);
-    if (!persistence)
+static int pure_poll (void *aux, struct pp_packet *packets, uint32_t max __unused)
+{
+    struct pure_ctx *ctx = aux;
+    if (recvfrom (ctx->sock, ctx->recv_buf, PACKET_SIZE, 0, NULL, NULL) < 0)
     {
-        fprintf (stderr, "ERR: persistence_init failed\n");
-        return EXIT_FAILURE;
+        if (errno == EINTR)
+            return 0;
+        perror ("recvfrom");
+        return -1;
     }
-#endif
 
-    int ifindex = if_nametoindex (ifname);
-    if (!ifindex)
-    {
-        fprintf (stderr, "ERR: if_nametoindex failed\n");
-        return EXIT_FAILURE;
-    }
+    packets[0].payload = (struct pingpong_payload *) ctx->recv_buf;
+    // The receive timestamp is taken by the client XDP program
+    packets[0].ts = packets[0].payload->ts[3];
+    return 1;
+}
 
-    struct bpf_object *obj = read_xdp_file (filename);
-    if (!obj)
-    {
-        fprintf (stderr, "ERR: loading file: %s\n", filename);
-        return EXIT_FAILURE;
-    }
+static void pure_teardown (void *aux)
+{
+    struct pure_ctx *ctx = aux;
+    // The server XDP program stays attached to keep answering, until --remove
+    if (ctx->sock >= 0)
+        close (ctx->sock);
+    free (ctx);
+}
 
-    int ret = detach_xdp (obj, prog_name, ifindex, pinpath);
-    if (remove)
-    {
-        return ret;
-    }
+static int pure_remove (const struct pp_driver_config *config)
+{
+    return pure_attach (config, false);
+}
 
-    obj = read_xdp_file (filename);
-//#if SERVER
-    ret = attach_xdp (obj, prog_name, ifindex, pinpath);
-    if (ret)
-    {
-        fprintf (stderr, "ERR: attach_xdp failed\n");
-        return EXIT_FAILURE;
-    }
-//#endif
+PP_DRIVER_DEFINE_LOOPS (pure_loops, pure_poll, NULL)
 
-#if !SERVER
-    start_client (server_ip, iters, interval);
-#endif
+static const struct pp_datapath pure_datapath = {
+    .name = "pp_pure",
+    .outfile = "pingpong_pure.dat",
+    .flags = PP_DATAPATH_F_DEVICE | PP_DATAPATH_F_KERNEL_SERVER,
+    .setup = pure_setup,
+    .send = pure_send,
+    .poll = pure_poll,
+    .teardown = pure_teardown,
+    .remove = pure_remove,
+    .loops = &pure_loops,
+};
 
-    return EXIT_SUCCESS;
-}
\ No newline at end of file
+int main (int argc, char **argv)
+{
+    return pp_driver_main (argc, argv, &pure_datapath);
+}
@@ -11,7 +11,6 @@
 #include <errno.h>
 #include <poll.h>
 #include <pthread.h>
-#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -28,10 +27,9 @@
 #include <net/if.h>
 
 #include "../common/common.h"
+#include "../common/driver.h"
 #include "../common/net.h"
-#include "../common/persistence.h"
 #include "../common/utils.h"
-#include "src/args.h"
 #include "src/xdp-loading.h"
 
 #define STATS_THREAD 0
@@ -50,15 +48,10 @@ static const char *sec_name = "xdp";
 static const char *pinpath = "/sys/fs/bpf/xdp_pingpong_xsk";
 static const char *mapname = "xsk_map";
 
-static const char *outfile = "pingpong_xsk.dat";
-static persistence_agent_t *persistence_agent;
-
 struct config {
     uint32_t xdp_flags;
     int ifindex;
-    char *ifname;
-    uint64_t iters;   // number of pingpong packet exchanges
-    uint64_t interval;// interval between two pingpong packet exchanges
+    const char *ifname;
     uint16_t xsk_bind_flags;
     int xsk_if_queue;
     bool xsk_poll_mode;
@@ -77,6 +70,12 @@ struct xsk_socket_info {
     struct xsk_socket *xsk;
 
     pthread_spinlock_t xsk_client_lock;// client needs synchronization beacuse it sends and receives at the same time.
+    bool server;
+
+    // Client only: frames of the last poll, released by the next one, and base packet of each flow
+    uint64_t rx_frames[RX_BATCH_SIZE];
+    uint32_t rx_count;
+    char packets[PINGPONG_MAX_FLOWS][PACKET_SIZE];
 
     uint64_t umem_frame_addr[NUM_FRAMES];
     uint32_t umem_frame_free;
@@ -87,17 +86,11 @@ struct xsk_socket_info {
 // File descriptor of the BPF_MAP_TYPE_XSKMAP used to receive packets from the XDP program.
 int xsk_map_fd;
 
-// Whether the program should exit.
-static volatile bool global_exit;
-
 // Initial configuration of the program. Some of the fields are overridden by the command line arguments.
 struct config cfg = {
     .ifindex = 0,
     .ifname = "",
 
-    .iters = 0,
-    .interval = 0,
-
     .xsk_if_queue = QUEUE_ID,
     .xdp_flags = XDP_FLAGS_UPDATE_IF_NOEXIST | XDP_FLAGS_DRV_MODE,
     .xsk_bind_flags = XDP_ZEROCOPY,
@@ -217,6 +210,16 @@ static struct xsk_socket_info *xsk_configure_socket (struct config *cfg,
     ret = xsk_socket__create (&xsk_info->xsk, cfg->ifname,
                               cfg->xsk_if_queue, umem->umem, &xsk_info->rx,
                               &xsk_info->tx, &xsk_cfg);
+    if (ret && (cfg->xsk_bind_flags & XDP_ZEROCOPY))
+    {
+        // e.g. a veth or a driver without zero-copy support: fall back to copying the packets into the UMEM
+        fprintf (stderr, "WARN: zero-copy not supported by %s, using copy mode\n", cfg->ifname);
+        cfg->xsk_bind_flags = (cfg->xsk_bind_flags & ~XDP_ZEROCOPY) | XDP_COPY;
+        xsk_cfg.bind_flags = cfg->xsk_bind_flags;
+        ret = xsk_socket__create (&xsk_info->xsk, cfg->ifname,
+                                  cfg->xsk_if_queue, umem->umem, &xsk_info->rx,
+                                  &xsk_info->tx, &xsk_cfg);
+    }
     if (ret)
         goto error_exit;
 
@@ -307,13 +310,13 @@ static void complete_tx (struct xsk_socket_info *xsk)
  * @param len the length of the packet.
  * @param is_umem_frame whether the packet is already in the UMEM or not.
  * @param complete whether the packet should be immediately sent.
+ * @param lock whether the socket lock must be taken, i.e. the caller is the client send thread.
  * @return 0 if the packet was successfully submitted, -1 otherwise.
  */
-static int xsk_send_packet (struct xsk_socket_info *socket, uint64_t addr, uint32_t len, bool is_umem_frame, bool complete)
+static int xsk_send_packet (struct xsk_socket_info *socket, uint64_t addr, uint32_t len, bool is_umem_frame, bool complete, bool lock)
 {
-#if !SERVER
-    pthread_spin_lock (&socket->xsk_client_lock);
-#endif
+    if (lock)
+        pthread_spin_lock (&socket->xsk_client_lock);
     int ret;
     uint32_t tx_idx = 0;
 
@@ -321,9 +324,8 @@ static int xsk_send_packet (struct xsk_socket_info *socket, uint64_t addr, uint3
     if (UNLIKELY (ret != 1))
     {
         /* No more transmit slots, drop the packet */
-#if !SERVER
-        pthread_spin_unlock (&socket->xsk_client_lock);
-#endif
+        if (lock)
+            pthread_spin_unlock (&socket->xsk_client_lock);
         return -1;
     }
 
@@ -344,102 +346,62 @@ static int xsk_send_packet (struct xsk_socket_info *socket, uint64_t addr, uint3
     {
         complete_tx (socket);
     }
-#if !SERVER
-    pthread_spin_unlock (&socket->xsk_client_lock);
-#endif
+    if (lock)
+        pthread_spin_unlock (&socket->xsk_client_lock);
 
     return 0;
 }
 
 /**
- * Process the packet located at the given address.
+ * Retrieve the packets available in the receive ring.
  *
- * @param xsk the socket information structure.
- * @param addr the UMEM address of the packet.
- * @param len the length of the packet.
- * @return true if the packet will be sent back, i.e. the UMEM frame must be kept; false otherwise.
+ * The frames of the pongs received by the client are released by the next poll, once the driver has recorded them.
+ * The frames of the pings received by the server are sent back as they are, and released when their transmission
+ * completes.
+ *
+ * @param aux the socket information structure.
+ * @param packets the output array of received packets.
+ * @param max the size of the `packets` array.
+ * @return the number of received packets.
  */
-static bool process_packet (struct xsk_socket_info *xsk,
-                            uint64_t addr, uint32_t len)
+static int sock_poll (void *aux, struct pp_packet *packets, uint32_t max)
 {
-    uint64_t receive_timestamp = get_time_ns ();
-    uint8_t *pkt = xsk_umem__get_data (xsk->umem->buffer, addr);
+    struct xsk_socket_info *xsk = aux;
+    unsigned int rcvd, stock_frames, i;
+    uint32_t idx_rx = 0, idx_fq = 0;
 
-    if (len < sizeof (struct ethhdr) + sizeof (struct iphdr) + sizeof (struct pingpong_payload))
+    if (!xsk->server)
     {
-        LOG (stderr, "Received packet is too small\n");
-        return false;
+        pthread_spin_lock (&xsk->xsk_client_lock);
+        for (i = 0; i < xsk->rx_count; i++)
+            xsk_free_umem_frame (xsk, xsk->rx_frames[i]);
+        xsk->rx_count = 0;
     }
 
-    struct ethhdr *eth = (struct ethhdr *) pkt;
-    struct pingpong_payload *payload = packet_payload ((char *) pkt);
+    /* Do we need to wake up the kernel for transmission, e.g. for the replies of the previous poll */
+    complete_tx (xsk);
 
-    if (eth->h_proto != htons (ETH_P_PINGPONG))
+    if (cfg.xsk_poll_mode)
     {
-        LOG (stderr, "Received non-pingpong packet\n");
-        return false;
-    }
+        if (!xsk->server)
+            pthread_spin_unlock (&xsk->xsk_client_lock);
 
-    if (payload->id >= cfg.iters)
-        global_exit = true;
-
-#if SERVER
-    struct iphdr *ip = (struct iphdr *) (eth + 1);
-    uint8_t tmp_mac[ETH_ALEN];
-    uint32_t tmp_ip;
-
-    //LOG (stdout, "Received ping with id %d, sending pong\n", payload->id);
-    // set ts[1] with arrival timestamp and ts[2] with send timestamp
-    payload->ts[1] = receive_timestamp;
-
-    // swap mac and ip addresses
-    memcpy (tmp_mac, eth->h_dest, ETH_ALEN);
-    memcpy (eth->h_dest, eth->h_source, ETH_ALEN);
-    memcpy (eth->h_source, tmp_mac, ETH_ALEN);
-
-    tmp_ip = ip->daddr;
-    ip->daddr = ip->saddr;
-    ip->saddr = tmp_ip;
-
-    payload->ts[2] = get_time_ns ();
-
-    /* Here we sent the packet out of the receive port. Note that
-         * we allocate one entry and schedule it. Your design would be
-         * faster if you do batch processing/transmission */
-    xsk_send_packet (xsk, addr, len, true, false);
-    return true;// the packet is queued for transmission, so we must keep the frame
-#else
-    payload->ts[3] = receive_timestamp;
-    persistence_agent->write (persistence_agent, payload);
-    return false;// the packet has no reason to be kept
-#endif
-}
+        struct pollfd fds = {.fd = xsk_socket__fd (xsk->xsk), .events = POLLIN};
+        if (poll (&fds, 1, -1) != 1)
+            return 0;
 
-/**
- * Handle the reception of packets.
- *
- * Check if there is any available packet to be processed by checking the receive ring.
- * If there are packets available, process them.
- *
- * @param xsk the socket information structure.
- */
-static void handle_receive_packets (struct xsk_socket_info *xsk)
-{
-    //START_TIMER ();
-    unsigned int rcvd, stock_frames, i;
-    uint32_t idx_rx = 0, idx_fq = 0;
-
-    rcvd = xsk_ring_cons__peek (&xsk->rx, RX_BATCH_SIZE, &idx_rx);
+        if (!xsk->server)
+            pthread_spin_lock (&xsk->xsk_client_lock);
+    }
 
+    rcvd = xsk_ring_cons__peek (&xsk->rx, max < RX_BATCH_SIZE ? max : RX_BATCH_SIZE, &idx_rx);
     if (!rcvd)
     {
-        return;
+        if (!xsk->server)
+            pthread_spin_unlock (&xsk->xsk_client_lock);
+        return 0;
     }
 
-#if !SERVER
-    pthread_spin_lock (&xsk->xsk_client_lock);
-#endif
-
     /*
      * Not sure about this instruction and the if block.
      * Without it, the send stops after 2048 packets, i.e. it must be related about the available
@@ -467,79 +429,98 @@ static void handle_receive_packets (struct xsk_socket_info *xsk)
         xsk_ring_prod__submit (&xsk->umem->fq, stock_frames);
     }
 
-    /* Process received packets */
+    /* Collect the received packets */
+    int received = 0;
     for (i = 0; i < rcvd; i++)
     {
         uint64_t addr = xsk_ring_cons__rx_desc (&xsk->rx, idx_rx)->addr;
         uint32_t len = xsk_ring_cons__rx_desc (&xsk->rx, idx_rx++)->len;
+        uint8_t *pkt = xsk_umem__get_data (xsk->umem->buffer, addr);
+        struct ethhdr *eth = (struct ethhdr *) pkt;
+
+        if (len < sizeof (struct ethhdr) + sizeof (struct iphdr) + sizeof (struct pingpong_payload))
+        {
+            LOG (stderr, "Received packet is too small\n");
+            xsk_free_umem_frame (xsk, addr);
+            continue;
+        }
 
-        if (!process_packet (xsk, addr, len))
+        if (eth->h_proto != htons (ETH_P_PINGPONG))
+        {
+            LOG (stderr, "Received non-pingpong packet\n");
             xsk_free_umem_frame (xsk, addr);
+            continue;
+        }
+
+        packets[received].payload = packet_payload ((char *) pkt);
+        packets[received].ts = 0;
+        packets[received].handle = addr;
+        received++;
+
+        if (!xsk->server)
+            xsk->rx_frames[xsk->rx_count++] = addr;
     }
 
     xsk_ring_cons__release (&xsk->rx, rcvd);
 
-    /* Do we need to wake up the kernel for transmission */
-    complete_tx (xsk);
-
-#if !SERVER
-    pthread_spin_unlock (&xsk->xsk_client_lock);
-#endif
+    if (!xsk->server)
+        pthread_spin_unlock (&xsk->xsk_client_lock);
 
-    //STOP_TIMER ();
+    return received;
 }
 
 /**
- * Keeps polling for new packets and, if available, process them.
- * This function can either use a busy-wait or a blocking poll.
- * The busy-wait is the default behavior.
+ * Send back the given ping, from the UMEM frame where it was received.
+ * The transmission is completed by the next poll, so that the replies of a batch are sent together.
  *
- * @param cfg the configuration of the program.
- * @param xsk_socket the socket information structure.
+ * @param aux the socket information structure.
+ * @param packet the received packet.
+ * @return 0 if the packet was successfully submitted, -1 otherwise.
  */
-static void rx_and_process (struct config *cfg,
-                            struct xsk_socket_info *xsk_socket)
+static int sock_reply (void *aux, struct pp_packet *packet)
 {
-    struct pollfd fds[2];
-    int ret, nfds = 1;
+    struct xsk_socket_info *xsk = aux;
+    uint8_t *pkt = xsk_umem__get_data (xsk->umem->buffer, packet->handle);
+    struct ethhdr *eth = (struct ethhdr *) pkt;
+    struct iphdr *ip = (struct iphdr *) (eth + 1);
+    uint8_t tmp_mac[ETH_ALEN];
+    uint32_t tmp_ip;
+
+    // swap mac and ip addresses
+    memcpy (tmp_mac, eth->h_dest, ETH_ALEN);
+    memcpy (eth->h_dest, eth->h_source, ETH_ALEN);
+    memcpy (eth->h_source, tmp_mac, ETH_ALEN);
 
-    memset (fds, 0, sizeof (fds));
-    fds[0].fd = xsk_socket__fd (xsk_socket->xsk);
-    fds[0].events = POLLIN;
+    tmp_ip = ip->daddr;
+    ip->daddr = ip->saddr;
+    ip->saddr = tmp_ip;
 
-    while (!global_exit)
+    if (xsk_send_packet (xsk, packet->handle, PACKET_SIZE, true, false, false))
     {
-        if (cfg->xsk_poll_mode)
-        {
-            ret = poll (fds, nfds, -1);
-            if (ret <= 0 || ret > 1)
-                continue;
-        }
-        handle_receive_packets (xsk_socket);
+        // the packet is dropped, so is its frame
+        xsk_free_umem_frame (xsk, packet->handle);
+        LOG (stderr, "Failed to send back packet\n");
     }
+    return 0;
 }
 
 /**
  * Send a pingpong packet to the server.
- * This function is called by the send thread every cfg.interval nanoseconds.
+ * This function is called by the send thread of the flow of the packet.
  *
- * @param buf the buffer containing the packet to send.
- * @param buf_len the length of the packet.
- * @param addr the socket address of the server.
  * @param aux the socket information structure.
+ * @param payload the payload of the packet.
  * @return 0 if the packet was successfully sent, -1 otherwise.
  */
-int client_send_pp_packet (char *buf, const uint64_t packet_id, struct sockaddr_ll *addr __unused, void *aux)
+static int sock_send (void *aux, const struct pingpong_payload *payload)
 {
+    struct xsk_socket_info *socket = aux;
+    char *buf = socket->packets[payload->flow];
     struct iphdr *ip = (struct iphdr *) (buf + sizeof (struct ethhdr));
-    ip->id = htons (packet_id);
-    struct pingpong_payload *payload = packet_payload (buf);
-    *payload = new_pingpong_payload (packet_id);
-    payload->ts[0] = get_time_ns ();
-
-    struct xsk_socket_info *socket = (struct xsk_socket_info *) aux;
+    ip->id = htons (payload->id);
+    memcpy (packet_payload (buf), payload, sizeof (struct pingpong_payload));
 
-    int ret = xsk_send_packet (socket, (uint64_t) buf, PACKET_SIZE, false, true);
+    int ret = xsk_send_packet (socket, (uint64_t) buf, PACKET_SIZE, false, true, true);
     if (ret)
     {
         LOG (stderr, "Failed to send packet\n");
@@ -549,50 +530,25 @@ int client_send_pp_packet (char *buf, const uint64_t packet_id, struct sockaddr_
     return 0;
 }
 
-/**
- * Initialize the client functionality, i.e. start sending pingpong packets to the server.
- *
- * @param cfg the configuration of the program.
- * @param socket the socket information structure.
- * @param src_mac the MAC address of the client.
- * @param dest_mac the MAC address of the server.
- * @param src_ip the IP address of the client.
- * @param dest_ip the IP address of the server.
- */
-void initialize_client (const struct config *cfg, struct xsk_socket_info *socket, uint8_t *src_mac, uint8_t *dest_mac, uint32_t *src_ip, uint32_t *dest_ip)
-{
-    const int ifindex = cfg->ifindex;
-    char *base_packet = malloc (PACKET_SIZE);
-    build_base_packet (base_packet, src_mac, dest_mac, *src_ip, *dest_ip);
-
-    struct sockaddr_ll sock_addr = build_sockaddr (ifindex, dest_mac);
-
-    start_sending_packets (cfg->iters, cfg->interval, base_packet, &sock_addr, client_send_pp_packet, (void *) socket);
-}
-
-int xsk_cleanup (struct xsk_socket_info *xsk)
+static int xsk_cleanup (struct xsk_socket_info *xsk)
 {
     xsk_socket__delete (xsk->xsk);
     xsk_umem__delete (xsk->umem->umem);
-#if !SERVER
     pthread_spin_destroy (&xsk->xsk_client_lock);
-#endif
     free (xsk->umem);
     free (xsk);
     return 0;
 }
 
+
 /**
- * Handle the SIGINT signal, which is sent when the user presses Ctrl+C.
+ * Attach the pingpong XDP program to the interface and open the AF_XDP socket it redirects the packets to.
  *
- * @param sig the signal number.
+ * @param config the configuration of the run.
+ * @param out the socket information structure.
+ * @return 0 on success, -1 otherwise.
  */
-void interrupt_handler (int sig __unused)
-{
-    global_exit = true;
-}
-
-int main (int argc __unused, char **argv __unused)
+static int sock_setup (const struct pp_driver_config *config, void **out)
 {
     int ret;
     void *packet_buffer;
@@ -600,49 +556,19 @@ int main (int argc __unused, char **argv __unused)
     struct xsk_umem_info *umem;
     struct xsk_socket_info *xsk_socket;
 
-    bool remove = false;
-
-    cfg.ifname = NULL;
-    cfg.iters = 0;
-    char *server_ip = NULL;
-    cfg.interval = 0;
-
-#if SERVER
-    if (!xdp_parse_args (argc, argv, &cfg.ifname, &remove, &cfg.iters))
-    {
-        xdp_print_usage (argv[0]);
-        return EXIT_FAILURE;
-    }
-#else
-    uint32_t persistence_flags = PERSISTENCE_M_ALL_TIMESTAMPS;
-
-    if (!xdp_parse_args (argc, argv, &cfg.ifname, &remove, &cfg.iters, &cfg.interval, &server_ip, &persistence_flags))
-    {
-        xdp_print_usage (argv[0]);
-        return EXIT_FAILURE;
-    }
-#endif
-
+    cfg.ifname = config->device;
     cfg.ifindex = if_nametoindex (cfg.ifname);
-
-    if (remove)
+    if (!cfg.ifindex)
     {
-        struct bpf_object *obj = read_xdp_file (filename);
-        if (obj == NULL)
-        {
-            fprintf (stderr, "ERR: loading file: %s\n", filename);
-            return EXIT_FAILURE;
-        }
-
-        detach_xdp (obj, prog_name, cfg.ifindex, pinpath);
-        return EXIT_SUCCESS;
+        fprintf (stderr, "ERR: if_nametoindex failed\n");
+        return -1;
     }
 
     struct bpf_object *obj = read_xdp_file (filename);
     if (obj == NULL)
     {
         fprintf (stderr, "ERR: loading file: %s\n", filename);
-        return EXIT_FAILURE;
+        return -1;
     }
 
     detach_xdp (obj, prog_name, cfg.ifindex, pinpath);
@@ -651,15 +577,13 @@ int main (int argc __unused, char **argv __unused)
     uint32_t src_ip;
     uint8_t dest_mac[ETH_ALEN];
     uint32_t dest_ip;
-    exchange_eth_ip_addresses (cfg.ifindex, server_ip, SERVER, src_mac, dest_mac, &src_ip, &dest_ip);
-
-    signal (SIGINT, interrupt_handler);
+    exchange_eth_ip_addresses (cfg.ifindex, config->server_ip, config->role == PP_ROLE_SERVER, src_mac, dest_mac, &src_ip, &dest_ip);
 
     obj = read_xdp_file (filename);
     if (obj == NULL)
     {
         fprintf (stderr, "ERR: loading file: %s\n", filename);
-        return EXIT_FAILURE;
+        return -1;
     }
 
     prog = xdp_program__from_bpf_obj (obj, sec_name);
@@ -669,7 +593,7 @@ int main (int argc __unused, char **argv __unused)
     if (ret)
     {
         fprintf (stderr, "ERR: attaching program failed\n");
-        return EXIT_FAILURE;
+        return -1;
     }
 
     xsk_map_fd = bpf_object__find_map_fd_by_name (obj, mapname);
@@ -682,7 +606,7 @@ int main (int argc __unused, char **argv __unused)
     {
         fprintf (stderr, "ERROR: setrlimit(RLIMIT_MEMLOCK) \"%s\"\n",
                  strerror (errno));
-        exit (EXIT_FAILURE);
+        return -1;
     }
 
     /* Allocate memory for NUM_FRAMES of the default XDP frame size */
@@ -693,7 +617,7 @@ int main (int argc __unused, char **argv __unused)
     {
         fprintf (stderr, "ERROR: Can't allocate buffer memory \"%s\"\n",
                  strerror (errno));
-        exit (EXIT_FAILURE);
+        return -1;
     }
 
     /* Initialize shared packet_buffer for umem usage */
@@ -702,7 +626,7 @@ int main (int argc __unused, char **argv __unused)
     {
         fprintf (stderr, "ERROR: Can't create umem \"%s\"\n",
                  strerror (errno));
-        exit (EXIT_FAILURE);
+        return -1;
     }
 
     /* Open and configure the AF_XDP (xsk) socket */
@@ -711,36 +635,58 @@ int main (int argc __unused, char **argv __unused)
     {
         fprintf (stderr, "ERROR: Can't setup AF_XDP socket \"%s\"\n",
                  strerror (errno));
-        exit (EXIT_FAILURE);
+        return -1;
     }
+    xsk_socket->server = config->role == PP_ROLE_SERVER;
 
-    START_TIMER ();
-    fprintf (stdout, "Starting experiment\n");
-    fflush (stdout);
-
-#if !SERVER
-    persistence_agent = persistence_init (outfile, persistence_flags, &cfg.interval);
-    initialize_client (&cfg, xsk_socket, src_mac, dest_mac, &src_ip, &dest_ip);
-#endif
+    if (!xsk_socket->server)
+    {
+        // each flow has its own sender thread, hence its own copy of the base packet
+        build_base_packet (xsk_socket->packets[0], src_mac, dest_mac, src_ip, dest_ip);
+        for (uint32_t i = 1; i < config->flows; i++)
+            memcpy (xsk_socket->packets[i], xsk_socket->packets[0], PACKET_SIZE);
+    }
 
-    /* Receive and count packets than drop them */
-    rx_and_process (&cfg, xsk_socket);
+    *out = xsk_socket;
+    return 0;
+}
 
-    STOP_TIMER ();
-    uint64_t time_taken = (__end - __start) / 1000000LL;
-    fprintf (stdout, "Experiment finished in %lu milliseconds.\n", time_taken);
+static void sock_teardown (void *aux)
+{
+    struct xsk_socket_info *xsk = aux;
+    xsk_cleanup (xsk);
+    bpf_xdp_detach (cfg.ifindex, XDP_FLAGS_DRV_MODE, 0);
+}
 
-    /* Cleanup */
-#if !SERVER
-    pthread_cancel (get_sender_thread ());
-    pthread_join (get_sender_thread (), NULL);
-#endif
-    xsk_cleanup (xsk_socket);
+static int sock_remove (const struct pp_driver_config *config)
+{
+    struct bpf_object *obj = read_xdp_file (filename);
+    if (obj == NULL)
+    {
+        fprintf (stderr, "ERR: loading file: %s\n", filename);
+        return -1;
+    }
 
-    if (persistence_agent)
-        persistence_agent->close (persistence_agent);
+    detach_xdp (obj, prog_name, if_nametoindex (config->device), pinpath);
+    return 0;
+}
 
-    bpf_xdp_detach (cfg.ifindex, XDP_FLAGS_DRV_MODE, 0);
+PP_DRIVER_DEFINE_LOOPS (sock_loops, sock_poll, sock_reply)
+
+static const struct pp_datapath sock_datapath = {
+    .name = "pp_sock",
+    .outfile = "pingpong_xsk.dat",
+    .flags = PP_DATAPATH_F_DEVICE,
+    .setup = sock_setup,
+    .send = sock_send,
+    .poll = sock_poll,
+    .reply = sock_reply,
+    .teardown = sock_teardown,
+    .remove = sock_remove,
+    .loops = &sock_loops,
+};
 
-    return EXIT_SUCCESS;
-}
\ No newline at end of file
+int main (int argc, char **argv)
+{
+    return pp_driver_main (argc, argv, &sock_datapath);
+}